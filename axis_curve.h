@@ -0,0 +1,204 @@
+#pragma once
+// Stick response curves and deadzones, precomputed into 256-entry tables.
+//
+// Stick axes are 8 bits, so every curve and axial deadzone can be evaluated ahead of time for
+// all 256 raw values. The default tables are built at compile time (constexpr); profiles given
+// on the command line are built once at load time by the same code. Per report, each axis is
+// then one table lookup, plus one compare for square or radial deadzones, which depend on both
+// axes:
+//   Axial  - each axis is zeroed on its own inside the deadzone (baked into the table)
+//   Square - both axes are zeroed while both are inside the deadzone
+//   Radial - both axes are zeroed while the stick is inside the deadzone circle
+// Curves map stick deflection (0..1) to output (0..1) and are mirrored for negative values:
+// linear, cubic, exponential ((e^(k*m) - 1) / (e^k - 1)) or piecewise-linear custom points.
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+enum class CurveShape : uint8_t {
+    Linear,
+    Cubic,
+    Exponential,
+    Points
+};
+
+enum class DeadzoneShape : uint8_t {
+    Axial,
+    Square,
+    Radial
+};
+
+struct CurvePoint {
+    float in = 0.0f;
+    float out = 0.0f;
+};
+
+// constexpr e^x: halve x until it is small, sum the series, square back up.
+constexpr double constexprExp(double x) {
+    int halvings = 0;
+    while (x > 0.5 || x < -0.5) { x *= 0.5; ++halvings; }
+    double sum = 1.0, term = 1.0;
+    for (int n = 1; n < 16; ++n) {
+        term *= x / n;
+        sum += term;
+    }
+    while (halvings-- > 0) sum *= sum;
+    return sum;
+}
+
+struct AxisCurve {
+    static constexpr int MAX_POINTS = 8;
+
+    CurveShape shape = CurveShape::Linear;
+    float exponent = 3.0f;                       // Exponential steepness k
+    std::array<CurvePoint, MAX_POINTS> points{}; // Points: ascending `in`, implicit (0, 0) first
+    int pointCount = 0;
+
+    // Output magnitude for a deflection magnitude m >= 0. Linear and cubic are the plain float
+    // expressions the mapper always used, so the default tables reproduce it bit for bit.
+    constexpr float eval(float m) const {
+        switch (shape) {
+            case CurveShape::Linear: return m;
+            case CurveShape::Cubic: return m * m * m;
+            case CurveShape::Exponential: {
+                if (exponent == 0.0f) return clampUnit(m);
+                const double k = exponent;
+                return static_cast<float>((constexprExp(k * clampUnit(m)) - 1.0) / (constexprExp(k) - 1.0));
+            }
+            case CurveShape::Points: {
+                const float c = clampUnit(m);
+                CurvePoint from;
+                for (int i = 0; i < pointCount; ++i) {
+                    const CurvePoint to = points[i];
+                    if (c <= to.in) {
+                        const float span = to.in - from.in;
+                        return span > 0.0f ? from.out + (to.out - from.out) * (c - from.in) / span : to.out;
+                    }
+                    from = to;
+                }
+                return from.out; // past the last point: hold its output
+            }
+        }
+        return m;
+    }
+
+    static constexpr AxisCurve linear() { return AxisCurve(); }
+    static constexpr AxisCurve cubic() { AxisCurve c; c.shape = CurveShape::Cubic; return c; }
+    static constexpr AxisCurve exponential(float k) {
+        AxisCurve c;
+        c.shape = CurveShape::Exponential;
+        c.exponent = k;
+        return c;
+    }
+
+private:
+    static constexpr float clampUnit(float m) { return m > 1.0f ? 1.0f : m; }
+};
+
+// One axis: curve output (axial deadzone applied) and squared deflection per raw value.
+struct AxisTable {
+    std::array<float, 256> value{};
+    std::array<float, 256> magnitude2{};
+};
+
+constexpr AxisTable makeAxisTable(const AxisCurve &curve, float axialDeadzone) {
+    AxisTable t;
+    for (int raw = 0; raw < 256; ++raw) {
+        const float v = (raw - 128) / 127.0f; // PS4Mapper::normalizeAxis
+        const float m = v < 0.0f ? -v : v;
+        const float out = m > axialDeadzone ? curve.eval(m) : 0.0f;
+        t.value[raw] = v < 0.0f ? -out : out;
+        t.magnitude2[raw] = v * v;
+    }
+    return t;
+}
+
+struct StickConfig {
+    AxisCurve curveX;
+    AxisCurve curveY;
+    DeadzoneShape deadzoneShape = DeadzoneShape::Axial;
+    float deadzone = 0.0f;
+};
+
+class StickMapping {
+public:
+    constexpr StickMapping() : StickMapping(StickConfig()) {}
+    constexpr explicit StickMapping(const StickConfig &c)
+        : x(makeAxisTable(c.curveX, c.deadzoneShape == DeadzoneShape::Axial ? c.deadzone : 0.0f)),
+          y(makeAxisTable(c.curveY, c.deadzoneShape == DeadzoneShape::Axial ? c.deadzone : 0.0f)),
+          shape(c.deadzoneShape), deadzone2(c.deadzone * c.deadzone) {}
+
+    // Curve output for both axes, in -1..1 (up is negative Y, as reported).
+    void apply(uint8_t rawX, uint8_t rawY, float &outX, float &outY) const {
+        bool inside = false;
+        switch (shape) {
+            case DeadzoneShape::Axial: break;
+            case DeadzoneShape::Square: inside = x.magnitude2[rawX] <= deadzone2 && y.magnitude2[rawY] <= deadzone2; break;
+            case DeadzoneShape::Radial: inside = x.magnitude2[rawX] + y.magnitude2[rawY] <= deadzone2; break;
+        }
+        outX = inside ? 0.0f : x.value[rawX];
+        outY = inside ? 0.0f : y.value[rawY];
+    }
+
+private:
+    AxisTable x;
+    AxisTable y;
+    DeadzoneShape shape;
+    float deadzone2;
+};
+
+// Load-time profile syntax:
+//   curve:    linear | cubic | expo:K | points:IN=OUT,IN=OUT,...   (deflections 0..1)
+//   deadzone: R | axial:R | square:R | radial:R                   (bare R keeps the current shape)
+inline bool parseAxisCurve(const std::string &text, AxisCurve &curve) {
+    AxisCurve c;
+    if (text == "linear") {
+        c = AxisCurve::linear();
+    } else if (text == "cubic") {
+        c = AxisCurve::cubic();
+    } else if (text.rfind("expo:", 0) == 0) {
+        char *end = nullptr;
+        const float k = std::strtof(text.c_str() + 5, &end);
+        if (end == text.c_str() + 5 || *end != '\0' || k < 0.0f) return false;
+        c = AxisCurve::exponential(k);
+    } else if (text.rfind("points:", 0) == 0) {
+        c.shape = CurveShape::Points;
+        const char *p = text.c_str() + 7;
+        float lastIn = 0.0f;
+        while (*p) {
+            if (c.pointCount == AxisCurve::MAX_POINTS) return false;
+            char *end = nullptr;
+            CurvePoint pt;
+            pt.in = std::strtof(p, &end);
+            if (end == p || *end != '=') return false;
+            p = end + 1;
+            pt.out = std::strtof(p, &end);
+            if (end == p || (*end != ',' && *end != '\0')) return false;
+            p = *end == ',' ? end + 1 : end;
+            if (pt.in <= lastIn || pt.in > 1.0f || pt.out < 0.0f) return false;
+            lastIn = pt.in;
+            c.points[c.pointCount++] = pt;
+        }
+        if (c.pointCount == 0) return false;
+    } else {
+        return false;
+    }
+    curve = c;
+    return true;
+}
+
+inline bool parseDeadzone(const std::string &text, StickConfig &config) {
+    DeadzoneShape shape = config.deadzoneShape;
+    size_t start = 0;
+    if (text.rfind("axial:", 0) == 0) { shape = DeadzoneShape::Axial; start = 6; }
+    else if (text.rfind("square:", 0) == 0) { shape = DeadzoneShape::Square; start = 7; }
+    else if (text.rfind("radial:", 0) == 0) { shape = DeadzoneShape::Radial; start = 7; }
+    char *end = nullptr;
+    const float r = std::strtof(text.c_str() + start, &end);
+    if (end == text.c_str() + start || *end != '\0' || r < 0.0f || r >= 1.0f) return false;
+    config.deadzoneShape = shape;
+    config.deadzone = r;
+    return true;
+}
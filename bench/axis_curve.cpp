@@ -0,0 +1,131 @@
+// Stick axis processing: precomputed curve/deadzone tables against the per-report float path
+// (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/axis_curve.cpp -o axis_curve && ./axis_curve
+//
+// First checks that the default tables give exactly what the float code they replaced gave,
+// for all 65536 (x, y) stick positions of each stick. Then times both over a synthetic
+// stream of stick positions, and times building a table at load time.
+// Exits non-zero if any position differs.
+
+#include "bench_common.h"
+#include "ps4_mapper.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// ---------- the float path the tables replaced ----------
+
+// right stick: square deadzone, cubic curve
+static void floatMouse(uint8_t rawX, uint8_t rawY, float &x, float &y) {
+    float rx = PS4Mapper::normalizeAxis(rawX);
+    float ry = PS4Mapper::normalizeAxis(rawY);
+    const float stickDead = 0.08f;
+    x = y = 0.0f;
+    if (std::fabs(rx) > stickDead || std::fabs(ry) > stickDead) {
+        x = std::copysign(rx * rx * rx, rx);
+        y = std::copysign(ry * ry * ry, ry);
+    }
+}
+
+// left stick -> WASD bits (W, S, A, D)
+static unsigned floatMove(uint8_t rawX, uint8_t rawY) {
+    const float deadzone = 0.25f;
+    float lx = PS4Mapper::normalizeAxis(rawX);
+    float ly = -PS4Mapper::normalizeAxis(rawY);
+    return (ly > deadzone) | (ly < -deadzone) << 1 | (lx < -deadzone) << 2 | (lx > deadzone) << 3;
+}
+
+static unsigned tableMove(const StickMapping &m, uint8_t rawX, uint8_t rawY) {
+    float lx, ly;
+    m.apply(rawX, rawY, lx, ly);
+    return (ly < 0.0f) | (ly > 0.0f) << 1 | (lx < 0.0f) << 2 | (lx > 0.0f) << 3;
+}
+
+// left stick -> on-screen keyboard step: 0 none, 1 right, 2 left, 3 up, 4 down
+static int floatKeyboard(uint8_t rawX, uint8_t rawY) {
+    float lx = PS4Mapper::normalizeAxis(rawX);
+    float ly = -PS4Mapper::normalizeAxis(rawY);
+    const float vkDead = 0.35f;
+    if (std::fabs(lx) > std::fabs(ly)) return lx > vkDead ? 1 : lx < -vkDead ? 2 : 0;
+    return ly > vkDead ? 3 : ly < -vkDead ? 4 : 0;
+}
+
+static int tableKeyboard(const StickMapping &m, uint8_t rawX, uint8_t rawY) {
+    float lx, ly;
+    m.apply(rawX, rawY, lx, ly);
+    if (std::fabs(lx) > std::fabs(ly)) return lx > 0.0f ? 1 : lx < 0.0f ? 2 : 0;
+    return ly < 0.0f ? 3 : ly > 0.0f ? 4 : 0;
+}
+
+static bool verifyDefaults() {
+    size_t mouseDiff = 0, moveDiff = 0, keyboardDiff = 0;
+    for (int x = 0; x < 256; ++x) {
+        for (int y = 0; y < 256; ++y) {
+            const uint8_t rx = static_cast<uint8_t>(x), ry = static_cast<uint8_t>(y);
+            float fx, fy, tx, ty;
+            floatMouse(rx, ry, fx, fy);
+            PS4Mapper::DEFAULT_MOUSE_STICK.apply(rx, ry, tx, ty);
+            if (fx != tx || fy != ty) ++mouseDiff;
+            if (floatMove(rx, ry) != tableMove(PS4Mapper::DEFAULT_MOVE_STICK, rx, ry)) ++moveDiff;
+            if (floatKeyboard(rx, ry) != tableKeyboard(PS4Mapper::DEFAULT_KEYBOARD_STICK, rx, ry)) ++keyboardDiff;
+        }
+    }
+    std::printf("defaults vs float path: mouse %zu, move %zu, keyboard %zu positions differ\n",
+                mouseDiff, moveDiff, keyboardDiff);
+    return mouseDiff == 0 && moveDiff == 0 && keyboardDiff == 0;
+}
+
+template <typename F>
+static void time(const char *name, const std::vector<uint8_t> &axes, F &&body) {
+    const int passes = 200;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int p = 0; p < passes; ++p) {
+        for (size_t i = 0; i + 1 < axes.size(); i += 2) body(axes[i], axes[i + 1]);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    const double sticks = passes * (axes.size() / 2.0);
+    std::printf("  %-28s %6.2f ns/stick\n", name, std::chrono::duration<double, std::nano>(t1 - t0).count() / sticks);
+}
+
+int main() {
+    const bool ok = verifyDefaults();
+
+    // a stick wandering over its whole range, with time spent near center
+    std::vector<uint8_t> axes(2 * 50000);
+    for (size_t i = 0; i < axes.size() / 2; ++i) {
+        const double t = i * 0.013, r = 127.0 * std::fabs(std::sin(t * 0.31));
+        axes[2 * i] = static_cast<uint8_t>(128 + r * std::cos(t));
+        axes[2 * i + 1] = static_cast<uint8_t>(128 + r * std::sin(t * 1.7));
+    }
+
+    std::printf("right stick (cubic, square deadzone)\n");
+    time("float path", axes, [](uint8_t x, uint8_t y) { float a, b; floatMouse(x, y, a, b); doNotOptimize(a); doNotOptimize(b); });
+    time("table", axes, [](uint8_t x, uint8_t y) {
+        float a, b; PS4Mapper::DEFAULT_MOUSE_STICK.apply(x, y, a, b); doNotOptimize(a); doNotOptimize(b);
+    });
+    std::printf("left stick (WASD, axial deadzone)\n");
+    time("float path", axes, [](uint8_t x, uint8_t y) { doNotOptimize(floatMove(x, y)); });
+    time("table", axes, [](uint8_t x, uint8_t y) { doNotOptimize(tableMove(PS4Mapper::DEFAULT_MOVE_STICK, x, y)); });
+
+    StickConfig expo = { AxisCurve::exponential(4.0f), AxisCurve::exponential(4.0f), DeadzoneShape::Radial, 0.1f };
+    StickMapping expoStick(expo);
+    std::printf("right stick (expo:4, radial deadzone, built at load time)\n");
+    time("table", axes, [&](uint8_t x, uint8_t y) { float a, b; expoStick.apply(x, y, a, b); doNotOptimize(a); doNotOptimize(b); });
+
+    const int builds = 2000;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < builds; ++i) {
+        expo.deadzone = 0.1f + i * 1e-6f;
+        StickMapping m(expo);
+        doNotOptimize(m);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    std::printf("building an expo stick profile: %.1f us\n",
+                std::chrono::duration<double, std::micro>(t1 - t0).count() / builds);
+
+    std::printf("%s\n", ok ? "OK: default tables match the float path" : "FAIL");
+    return ok ? 0 : 1;
+}
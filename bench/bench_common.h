@@ -0,0 +1,136 @@
+#pragma once
+// Helpers shared by the benchmarks in bench/: each is a single translation unit built on its
+// own, so this header may define things a library header couldn't.
+//
+//   doNotOptimize(v)   keeps a computed value alive without costing a store per iteration
+//   threadCpuSeconds() CPU time of the calling thread, for costs that sleep between reports
+//   NullSink           an OutputSink that drops everything
+//   CountingSink       an OutputSink that only counts events and submissions
+//   DigestSink         an OutputSink that folds every event into an FNV-1a digest, for
+//                      comparing two runs' output
+//   TimedSink          an OutputSink that logs every event with the time a ClockSource gave it
+//   g_allocs           heap allocations so far, for checking a path never allocates; only with
+//                      BENCH_COUNT_ALLOCATIONS defined before the include, since it replaces the
+//                      global operator new (which can't be done inline)
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(BENCH_COUNT_ALLOCATIONS)
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+#include "clock_source.h"
+#include "output_sink.h"
+
+#if defined(BENCH_COUNT_ALLOCATIONS)
+static std::atomic<size_t> g_allocs{0};
+void *operator new(size_t n) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+#endif
+
+template <typename T>
+inline void doNotOptimize(const T &value) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &value;
+#endif
+}
+
+inline double threadCpuSeconds() {
+#if defined(_WIN32)
+    FILETIME created, exited, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+    const auto ticks = [](const FILETIME &f) { return (static_cast<uint64_t>(f.dwHighDateTime) << 32) | f.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) / 1e7;     // 100 ns units
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+class NullSink : public OutputSink {
+public:
+    void submit(const OutputEvent *, size_t) override {}
+};
+
+class CountingSink : public OutputSink {
+public:
+    void submit(const OutputEvent *, size_t count) override { events += count; ++submissions; }
+    uint64_t events = 0;
+    uint64_t submissions = 0;
+};
+
+class DigestSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            const uint64_t fields[] = { e.type, e.down, e.left, e.vk, static_cast<uint32_t>(e.dx), static_cast<uint32_t>(e.dy) };
+            for (uint64_t v : fields) {
+                digest ^= v;
+                digest *= 1099511628211ull;
+            }
+        }
+        submitted += count;
+    }
+    uint64_t digest = 14695981039346656037ull;
+    uint64_t submitted = 0;
+};
+
+class TimedSink : public OutputSink {
+public:
+    explicit TimedSink(const ClockSource &c) : clock(c) {}
+    void submit(const OutputEvent *events, size_t count) override {
+        const ClockSource::time_point at = clock.now();
+        for (size_t i = 0; i < count; ++i) log.push_back({ at, events[i] });
+    }
+
+    // "key 0x41 down", "mouse_left up", "wheel 120", "move 3,-2"
+    static std::string describe(const OutputEvent &e) {
+        char buf[48];
+        switch (e.type) {
+            case OutputEvent::Key: std::snprintf(buf, sizeof(buf), "key 0x%02X %s", e.vk, e.down ? "down" : "up"); break;
+            case OutputEvent::MouseButton: std::snprintf(buf, sizeof(buf), "mouse_%s %s", e.left ? "left" : "right", e.down ? "down" : "up"); break;
+            case OutputEvent::MouseWheel: std::snprintf(buf, sizeof(buf), "wheel %d", e.dy); break;
+            case OutputEvent::MouseMove: std::snprintf(buf, sizeof(buf), "move %d,%d", e.dx, e.dy); break;
+        }
+        return buf;
+    }
+
+    // Every event so far as "<us since base> <event>".
+    std::vector<std::string> lines(ClockSource::time_point base) const {
+        std::vector<std::string> out;
+        for (const Entry &en : log) {
+            const long long us = std::chrono::duration_cast<std::chrono::microseconds>(en.at - base).count();
+            out.push_back(std::to_string(us) + ' ' + describe(en.e));
+        }
+        return out;
+    }
+
+    struct Entry { ClockSource::time_point at; OutputEvent e; };
+    std::vector<Entry> log;
+
+private:
+    const ClockSource &clock;
+};
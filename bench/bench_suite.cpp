@@ -0,0 +1,426 @@
+// Benchmark suite for the portable core (runs on Linux and Windows).
+//
+// Covers report parsing (USB and Bluetooth) and decode, mapping per mode, visualizer drawing and presenting, the output path
+// (including shared-memory publication), latency recording and metrics collection, against a synthetic report stream or a capture recorded with
+// `main.exe --capture=`.
+// Console and input injection are replaced by AnsiConsoleBackend without a stream and a
+// counting OutputSink, so only our own code is measured.
+//
+//   g++ -std=c++17 -O2 -I. bench/bench_suite.cpp -o bench_suite
+//   ./bench_suite [--json] [--filter=substr] [--capture=session.ds4cap] [--min-ms=N]
+//
+// --json prints one JSON document (name, ns_per_op, ops per benchmark) for regression tracking.
+
+#include "bench_common.h"
+#include "console_frame.h"
+#include "controller_state.h"
+#include "latency_histogram.h"
+#include "mapper_metrics.h"
+#include "output_sink.h"
+#include "ps4_mapper.h"
+#include "raw_input_decode.h"
+#include "report_capture.h"
+#include "report_parser.h"
+#include "shared_state.h"
+#include "visualizer_view.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp;
+    uint64_t ops;
+};
+
+class Suite {
+public:
+    Suite(std::string nameFilter, int minMs) : filter(std::move(nameFilter)), minTime(std::chrono::milliseconds(minMs)) {}
+
+    // `body` runs one batch and returns how many operations it did.
+    void run(const std::string &name, const std::function<uint64_t()> &body) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+        body(); // warm-up
+        uint64_t ops = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        auto t1 = t0;
+        do {
+            ops += body();
+            t1 = std::chrono::steady_clock::now();
+        } while (t1 - t0 < minTime);
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        results.push_back({ name, ns / static_cast<double>(ops), ops });
+    }
+
+    void print(bool json, const std::string &source) const {
+        if (json) {
+            std::printf("{\"suite\":\"ps4-mapper\",\"stream\":\"%s\",\"results\":[", source.c_str());
+            for (size_t i = 0; i < results.size(); ++i) {
+                std::printf("%s{\"name\":\"%s\",\"ns_per_op\":%.3f,\"ops\":%llu}", i ? "," : "",
+                            results[i].name.c_str(), results[i].nsPerOp, static_cast<unsigned long long>(results[i].ops));
+            }
+            std::printf("]}\n");
+            return;
+        }
+        std::printf("stream: %s\n", source.c_str());
+        for (const BenchResult &r : results) {
+            std::printf("%-34s %12.2f ns/op %14llu ops\n", r.name.c_str(), r.nsPerOp, static_cast<unsigned long long>(r.ops));
+        }
+    }
+
+private:
+    std::string filter;
+    std::chrono::steady_clock::duration minTime;
+    std::vector<BenchResult> results;
+};
+
+static std::vector<PS4ControllerReport> syntheticStream(size_t n) {
+    std::vector<PS4ControllerReport> reports(n);
+    for (size_t i = 0; i < n; ++i) {
+        PS4ControllerReport &r = reports[i];
+        r = PS4ControllerReport{};
+        r.reportId = 0x01;
+        double t = i * 0.01;
+        r.leftStickX = static_cast<uint8_t>(128 + 120 * std::cos(t));
+        r.leftStickY = static_cast<uint8_t>(128 + 120 * std::sin(t));
+        r.rightStickX = static_cast<uint8_t>(128 + 60 * std::sin(t * 1.7));
+        r.rightStickY = static_cast<uint8_t>(128 + 60 * std::cos(t * 1.3));
+        uint8_t hat = static_cast<uint8_t>((i / 25) % 9);             // 0..7 directions, 8 neutral
+        uint8_t face = static_cast<uint8_t>(((i / 40) % 16) << 4);
+        r.buttons1 = static_cast<uint8_t>(face | hat);
+        r.buttons2 = 0;                                               // keep OPTIONS/R1 released
+        r.leftTrigger = static_cast<uint8_t>((i * 3) & 0xFF);
+        r.rightTrigger = static_cast<uint8_t>((i * 5) & 0xFF);
+        r.battery = 0x0B;
+        const uint16_t ts = static_cast<uint16_t>(i * 750);              // 4 ms apart
+        const int16_t yaw = static_cast<int16_t>(400 * std::sin(t * 3.0)); // about +-25 deg/s
+        const int16_t up = 8192;                                          // 1 g, lying flat
+        std::memcpy(r.timestamp, &ts, 2);
+        std::memcpy(r.gyroY, &yaw, 2);
+        std::memcpy(r.accelY, &up, 2);
+    }
+    return reports;
+}
+
+// RAWINPUT buffer (x64 layout) holding one HID record per report.
+static std::vector<uint8_t> rawInputBlob(const std::vector<PS4ControllerReport> &reports, size_t maxRecords) {
+    const RawInputLayout layout = RawInputLayout::x64();
+    const uint32_t reportSize = sizeof(PS4ControllerReport);
+    const size_t blockSize = layout.headerSize + 8 + reportSize;
+    const size_t stride = (blockSize + layout.blockAlign - 1) & ~(layout.blockAlign - 1);
+    const size_t n = std::min(reports.size(), maxRecords);
+    std::vector<uint8_t> buf(stride * n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t *b = buf.data() + i * stride;
+        uint32_t type = RawInputDecode::TYPE_HID, size = static_cast<uint32_t>(blockSize), count = 1;
+        std::memcpy(b, &type, 4);
+        std::memcpy(b + 4, &size, 4);
+        std::memcpy(b + layout.headerSize, &reportSize, 4);
+        std::memcpy(b + layout.headerSize + 4, &count, 4);
+        std::memcpy(b + layout.headerSize + 8, &reports[i], reportSize);
+    }
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    std::string filter, capturePath;
+    int minMs = 200;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") json = true;
+        else if (arg.rfind("--filter=", 0) == 0) filter = arg.substr(9);
+        else if (arg.rfind("--capture=", 0) == 0) capturePath = arg.substr(10);
+        else if (arg.rfind("--min-ms=", 0) == 0) minMs = std::max(1, std::atoi(arg.c_str() + 9));
+    }
+
+    std::vector<PS4ControllerReport> stream;
+    std::string source = "synthetic";
+    if (!capturePath.empty()) {
+        ReportCaptureFile file;
+        if (!file.open(capturePath)) {
+            std::fprintf(stderr, "%s: %s\n", capturePath.c_str(), file.lastError().c_str());
+            return 1;
+        }
+        for (size_t i = 0; i < file.recordCount(); ++i) stream.push_back(file.record(i).report);
+        source = capturePath;
+    } else {
+        stream = syntheticStream(20000);
+    }
+    if (stream.empty()) {
+        std::fprintf(stderr, "empty report stream\n");
+        return 1;
+    }
+
+    Suite suite(filter, minMs);
+
+    // ---------- decode ----------
+    suite.run("decode/normalizeAxis", [&] {
+        float acc = 0;
+        for (int v = 0; v < 256; ++v) acc += PS4Mapper::normalizeAxis(static_cast<uint8_t>(v));
+        doNotOptimize(acc);
+        return uint64_t(256);
+    });
+    suite.run("decode/decodeReport", [&] {
+        uint32_t acc = 0;
+        for (const PS4ControllerReport &r : stream) acc ^= decodeReport(r).buttons;
+        doNotOptimize(acc);
+        return uint64_t(stream.size());
+    });
+    // the same reports as raw USB and Bluetooth input, through a ReportParser each
+    std::vector<uint8_t> usbBytes(stream.size() * UsbReportLayout::SIZE), btBytes(stream.size() * BluetoothReportLayout::SIZE, 0);
+    for (size_t i = 0; i < stream.size(); ++i) {
+        std::memcpy(&usbBytes[i * UsbReportLayout::SIZE], &stream[i], sizeof(PS4ControllerReport));
+        uint8_t *bt = &btBytes[i * BluetoothReportLayout::SIZE];
+        bt[0] = BluetoothReportLayout::ID;
+        bt[1] = 0xC0;
+        std::memcpy(bt + BluetoothReportLayout::PAYLOAD, reinterpret_cast<const uint8_t *>(&stream[i]) + 1, BluetoothReportLayout::COPY);
+        const uint32_t crc = Ds4Crc::bluetoothInput(bt, BluetoothReportLayout::CRC_OFFSET);
+        for (int k = 0; k < 4; ++k) bt[BluetoothReportLayout::CRC_OFFSET + k] = static_cast<uint8_t>(crc >> (8 * k));
+    }
+    auto parseBench = [&](const char *name, const std::vector<uint8_t> &bytes, uint32_t size) {
+        ReportParser parser;
+        suite.run(name, [&] {
+            PS4ControllerReport out;
+            uint32_t acc = 0;
+            for (size_t off = 0; off < bytes.size(); off += size) acc += parser.parse(&bytes[off], size, out) ? out.leftStickX : 0;
+            doNotOptimize(acc);
+            return uint64_t(bytes.size() / size);
+        });
+    };
+    parseBench("decode/parseReport/usb", usbBytes, UsbReportLayout::SIZE);
+    parseBench("decode/parseReport/bluetooth", btBytes, BluetoothReportLayout::SIZE);
+    const std::vector<uint8_t> blob = rawInputBlob(stream, 200);
+    suite.run("decode/rawInputBlocks", [&] {
+        size_t bytes = 0;
+        auto st = RawInputDecode::decodeBlocks(blob.data(), blob.size(), SIZE_MAX, RawInputLayout::x64(),
+                                               [&](uint64_t, const uint8_t *, uint32_t len) { bytes += len; });
+        doNotOptimize(bytes);
+        return uint64_t(st.hidReports);
+    });
+
+    // ---------- mapping ----------
+    auto mappingBench = [&](const char *name, PS4Mapper::Mode mode, bool gyro) {
+        CountingSink sink;
+        OutputBatch out(sink);
+        ManualClockSource clock;
+        PS4Mapper mapper(out, clock);
+        mapper.setMode(mode);
+        mapper.setGyroAim(gyro);
+        out.flush();
+        suite.run(name, [&] {
+            for (const PS4ControllerReport &r : stream) {
+                clock.advance(std::chrono::milliseconds(4));
+                mapper.processMapping(r);
+                out.flush();
+            }
+            return uint64_t(stream.size());
+        });
+    };
+    mappingBench("mapping/processMapping/visualizer", PS4Mapper::MODE_VISUALIZER, false);
+    mappingBench("mapping/processMapping/gyroAim", PS4Mapper::MODE_VISUALIZER, true);
+    mappingBench("mapping/processMapping/vkeyboard", PS4Mapper::MODE_VKEYBOARD, false);
+    {
+        // the built-in bindings plus chords, taps, holds and sequences on the buttons the stream presses
+        ActionTable parsed;
+        std::string error;
+        parseProfile("[combos]\nl1+r1 = \"mouse_left, 2ms, mouse_left\"\nsquare+cross = \"Q\"\ntap:l1 = \"F\"\n"
+                     "hold:r1 = \"R down, 20ms, R up\"\ndpad_down>dpad_right>circle = \"H, 1ms, J\"\n", parsed, error);
+        auto table = std::make_unique<ActionTable>(ActionTable::defaults());
+        table->combos = parsed.combos;
+        table->compile();
+        CountingSink sink;
+        OutputBatch out(sink);
+        ManualClockSource clock;
+        PS4Mapper mapper(out, clock);
+        mapper.setActionTable(std::move(table));
+        out.flush();
+        suite.run("mapping/processMapping/combos", [&] {
+            for (const PS4ControllerReport &r : stream) {
+                clock.advance(std::chrono::milliseconds(4));
+                mapper.runTimers();
+                mapper.processMapping(r);
+                out.flush();
+            }
+            return uint64_t(stream.size());
+        });
+    }
+    {
+        // the same stream through the change check; a stream that never rests pays for the compare
+        CountingSink sink;
+        OutputBatch out(sink);
+        ManualClockSource clock;
+        PS4Mapper mapper(out, clock);
+        suite.run("mapping/processReport/visualizer", [&] {
+            for (const PS4ControllerReport &r : stream) {
+                clock.advance(std::chrono::milliseconds(4));
+                if (mapper.processReport(r)) out.flush();
+            }
+            return uint64_t(stream.size());
+        });
+    }
+
+    suite.run("mapping/motionUpdate", [&] {
+        static MotionProcessor motion;
+        for (const PS4ControllerReport &r : stream) motion.update(decodeReport(r), 0.001f);
+        doNotOptimize(motion.worldYawRate());
+        return uint64_t(stream.size());
+    });
+
+    // what pressing a virtual key costs now that layouts are compiled (was a label string chain)
+    suite.run("mapping/layoutKeyLookup", [&] {
+        static const int cells[8][3] = { {0, 0, 0}, {0, 1, 9}, {0, 2, 7}, {0, 2, 9}, {0, 3, 0}, {0, 3, 1}, {1, 0, 6}, {1, 2, 2} };
+        const KeyboardLayout &layout = KeyboardLayout::builtIn();
+        uint32_t acc = 0;
+        for (const auto &c : cells) acc += layout.page(c[0]).key(c[1], c[2]).vk;
+        doNotOptimize(acc);
+        return uint64_t(8);
+    });
+    suite.run("mapping/parseKeyboardLayout", [&] {
+        static KeyboardLayout layout;
+        std::string error;
+        KeyboardLayout::parse(KeyboardLayout::BUILT_IN_TEXT, layout, error);
+        doNotOptimize(layout.pageCount());
+        return uint64_t(1);
+    });
+
+    // ---------- rendering ----------
+    CountingSink viewSink;
+    OutputBatch viewOut(viewSink);
+    PS4Mapper viewMapper(viewOut);
+    VisualizerView view(viewMapper.keyboardLayout());
+    FrameBuffer fb(120, 40);
+    DisplaySnapshot snap;
+    snap.hasReport = true;
+
+    auto drawBench = [&](const char *name, int mode) {
+        suite.run(name, [&] {
+            snap.mode = mode;
+            for (size_t i = 0; i < 256; ++i) {
+                snap.report = stream[i % stream.size()];
+                snap.selCol = static_cast<int>(i % 10);
+                view.draw(snap, fb);
+            }
+            doNotOptimize(fb.at(0, 0));
+            return uint64_t(256);
+        });
+    };
+    drawBench("render/updateDisplay/visualizer", PS4Mapper::MODE_VISUALIZER);
+    drawBench("render/updateDisplay/vkeyboard", PS4Mapper::MODE_VKEYBOARD);
+
+    suite.run("render/drawStick", [&] {
+        for (size_t i = 0; i < 256; ++i) {
+            const PS4ControllerReport &r = stream[i % stream.size()];
+            view.drawStick(fb, 0, 10, r.leftStickX, r.leftStickY, "Left");
+        }
+        doNotOptimize(fb.at(0, 10));
+        return uint64_t(256);
+    });
+    suite.run("render/drawButtons", [&] {
+        for (size_t i = 0; i < 256; ++i) view.drawButtons(fb, 0, 18, stream[i % stream.size()]);
+        doNotOptimize(fb.at(0, 18));
+        return uint64_t(256);
+    });
+    suite.run("render/drawVirtualKeyboard", [&] {
+        const int pages = viewMapper.keyboardLayout().pageCount();
+        for (int i = 0; i < 256; ++i) view.drawVirtualKeyboard(fb, 0, 10, (i / 16) % pages, i % 4, i % 10);
+        doNotOptimize(fb.at(0, 10));
+        return uint64_t(256);
+    });
+    suite.run("render/bytesToHex", [&] {
+        size_t len = 0;
+        for (size_t i = 0; i < 64; ++i) {
+            len += VisualizerView::bytesToHex(reinterpret_cast<const uint8_t*>(&stream[i % stream.size()]), 24).size();
+        }
+        doNotOptimize(len);
+        return uint64_t(64);
+    });
+    {
+        ConsoleFrame frame(120, 40);
+        AnsiConsoleBackend backend(nullptr);
+        size_t i = 0;
+        suite.run("render/drawAndPresent", [&] {
+            for (int n = 0; n < 64; ++n, ++i) {
+                snap.mode = PS4Mapper::MODE_VISUALIZER;
+                snap.report = stream[i % stream.size()];
+                view.draw(snap, frame.buffer());
+                frame.present(backend);
+            }
+            return uint64_t(64);
+        });
+    }
+
+    // ---------- output ----------
+    {
+        CountingSink sink;
+        OutputBatch out(sink);
+        suite.run("output/batch10Events", [&] {
+            for (int n = 0; n < 64; ++n) {
+                for (uint16_t vk = 0x41; vk < 0x45; ++vk) { out.key(vk, true); out.key(vk, false); }
+                out.mouseButton(true, true);
+                out.mouseMove(3, -2);
+                out.flush();
+            }
+            return uint64_t(64);
+        });
+    }
+    {
+        // --shm: decoded state and raw report into shared memory, per report
+        auto region = std::make_unique<ds4_shm_region>();
+        SharedStatePublisher shared;
+        shared.attach(region.get());
+        const auto received = std::chrono::steady_clock::now();
+        suite.run("output/sharedStatePublish", [&] {
+            for (const PS4ControllerReport &r : stream) shared.publish(0, received, r, PS4Mapper::MODE_VISUALIZER);
+            return uint64_t(stream.size());
+        });
+    }
+
+    // ---------- latency instrumentation ----------
+    {
+        PipelineLatency latency;
+        std::chrono::steady_clock::time_point t0{};
+        uint64_t n = 0;
+        suite.run("latency/recordReport", [&] {
+            for (int i = 0; i < 256; ++i, ++n) {
+                auto t1 = t0 + std::chrono::nanoseconds(20000 + (n * 7919) % 500000);
+                auto t2 = t1 + std::chrono::nanoseconds(300 + n % 700);
+                latency.record(t0, t1, t2, t2 + std::chrono::nanoseconds(15000 + n % 9000));
+            }
+            return uint64_t(256);
+        });
+        suite.run("latency/summarize", [&] {
+            PipelineLatency::Table t = latency.summarize();
+            doNotOptimize(t);
+            return uint64_t(1);
+        });
+
+        // --metrics: the mapping thread's copy per loop, and one scrape
+        MapperMetrics metrics(latency);
+        ControllerCounters counters;
+        suite.run("latency/metricsUpdate", [&] {
+            for (int i = 0; i < 256; ++i) {
+                ++counters.reports;
+                counters.outputEvents += 2;
+                ++counters.outputSubmissions;
+                metrics.update(0, counters);
+            }
+            return uint64_t(256);
+        });
+        suite.run("latency/metricsRender", [&] {
+            std::string text = metrics.render();
+            doNotOptimize(text);
+            return uint64_t(1);
+        });
+    }
+
+    suite.print(json, source);
+    return 0;
+}
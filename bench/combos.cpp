@@ -0,0 +1,303 @@
+// Combo and macro check through capture replay (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/combos.cpp -o combos && ./combos
+//
+// Writes combos.profile, with chords, a tap and a hold on one button, sequences and macros, and
+// combos.ds4cap, a capture of scripted button presses at the DS4's 250 Hz USB rate. It then
+// replays the capture through PS4Mapper on a ManualClockSource exactly as tools/replay.cpp
+// does, and checks every output event and its time to the microsecond:
+//   chord         L1 then R1 20 ms later plays a macro with 1.5 ms and 250 us pauses; pressing
+//                 the chord again while it plays doesn't restart it; 100 ms apart is no chord
+//   tap / hold    the same button released after 100 ms, and held for 500 ms
+//   sequence      down, down-right, right on the D-pad hat, then Square; too slow is no match
+//   fallback      Square, Square, Square, Circle completes Square>Square>Circle
+//   mode switch   a macro holding a key is stopped and the key released
+// The replay runs twice, mapping every report and skipping unchanged ones; both must match.
+// Then: profile errors, the cost per report with 32 combos against none, and how closely a
+// macro's steps follow their schedule on the real clock (informational: that is the host's
+// wake-up latency, see timer_jitter). Exits non-zero if anything is wrong.
+// `./replay combos.ds4cap --profile=combos.profile` replays the same file.
+
+#include "bench_common.h"
+#include "report_capture.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const char *PROFILE =
+    "[bind]\n"
+    "cross = \"SPACE\"\n"
+    "options = \"toggle_mode\"\n"
+    "\n"
+    "[macros]\n"
+    "burst = \"mouse_left, 1.5ms, mouse_left, 250us, wheel_up, 30ms, wheel_down\"\n"
+    "charge = \"R down, 20ms, R up\"\n"
+    "hadouken = \"H down, 0.5ms, H up, 10ms, J\"\n"
+    "\n"
+    "[combos]\n"
+    "chord_ms = 50\n"
+    "hold_ms = 300\n"
+    "sequence_ms = 200\n"
+    "l1+r1 = \"burst\"\n"
+    "tap:triangle = \"Q\"                       # steps in place of a macro name\n"
+    "hold:triangle = \"charge\"\n"
+    "dpad_down>dpad_right>square = \"hadouken\"\n"
+    "square>square>circle = \"F\"\n";
+
+// Button state over time; one report every 4 ms.
+class ButtonScript {
+public:
+    void press(int ms, uint32_t buttons) { changes.push_back({ ms, buttons, true }); }
+    void release(int ms, uint32_t buttons) { changes.push_back({ ms, buttons, false }); }
+
+    std::vector<PS4ControllerReport> reports(int endMs) const {
+        std::vector<PS4ControllerReport> out;
+        uint32_t held = 0;
+        size_t next = 0;
+        for (int t = 0; t < endMs; t += 4) {
+            for (; next < changes.size() && changes[next].ms <= t; ++next) {
+                held = changes[next].down ? held | changes[next].buttons : held & ~changes[next].buttons;
+            }
+            out.push_back(reportFor(held));
+        }
+        return out;
+    }
+
+    static PS4ControllerReport reportFor(uint32_t buttons) {
+        PS4ControllerReport r{};
+        r.reportId = 0x01;
+        r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+        // hat: 0..7 clockwise from Up, 8 = neutral
+        const bool up = buttons & buttonBit(BTN_DPAD_UP), right = buttons & buttonBit(BTN_DPAD_RIGHT);
+        const bool down = buttons & buttonBit(BTN_DPAD_DOWN), left = buttons & buttonBit(BTN_DPAD_LEFT);
+        uint8_t hat = 8;
+        if (up) hat = right ? 1 : left ? 7 : 0;
+        else if (down) hat = right ? 3 : left ? 5 : 4;
+        else if (right) hat = 2;
+        else if (left) hat = 6;
+        r.buttons1 = static_cast<uint8_t>(((buttons & 0x0F) << 4) | hat);
+        r.buttons2 = static_cast<uint8_t>(buttons >> 4);
+        r.buttons3 = static_cast<uint8_t>((buttons >> 12) & 0x03);
+        return r;
+    }
+
+private:
+    struct Change { int ms; uint32_t buttons; bool down; };
+    std::vector<Change> changes;
+};
+
+static bool writeFile(const std::string &path, const std::string &text) {
+    std::ofstream f(path, std::ios::binary);
+    f << text;
+    return static_cast<bool>(f);
+}
+
+static bool replayCheck(const std::string &capture, const ActionTable &table, bool skipUnchanged,
+                        const std::vector<std::string> &expect) {
+    ReportCaptureFile file;
+    if (!file.open(capture)) { std::fprintf(stderr, "%s: %s\n", capture.c_str(), file.lastError().c_str()); return false; }
+    ManualClockSource clock;
+    const ClockSource::time_point start = clock.now();
+    TimedSink sink(clock);
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    mapper.setActionTable(std::make_unique<ActionTable>(table));
+    output.flush();
+    const ReplayStats st = replayCapture(file, mapper, output, clock, false, skipUnchanged);
+    const std::vector<std::string> log = sink.lines(start);
+
+    bool ok = log == expect;
+    std::printf("replay (%s): %zu reports, %zu skipped, %zu events, %llu combos matched, %llu macros started  %s\n",
+                skipUnchanged ? "skip unchanged" : "map all", st.reports, st.skipped, log.size(),
+                static_cast<unsigned long long>(mapper.combosMatched()), static_cast<unsigned long long>(mapper.macrosStarted()),
+                ok ? "ok" : "FAIL");
+    if (!ok) {
+        const size_t n = (std::max)(expect.size(), log.size());
+        for (size_t i = 0; i < n; ++i) {
+            const std::string want = i < expect.size() ? expect[i] : "-", got = i < log.size() ? log[i] : "-";
+            std::printf("  %-32s %-32s%s\n", want.c_str(), got.c_str(), want == got ? "" : "  <--");
+        }
+    }
+    return ok;
+}
+
+static bool checkErrors() {
+    const struct { const char *text; const char *error; } cases[] = {
+        { "[combos]\nl1 = \"Q\"\n", "line 2: combo 'l1' needs two or more inputs" },
+        { "[combos]\nl1+foo = \"Q\"\n", "line 2: unknown input 'foo'" },
+        { "[combos]\nl1+l1 = \"Q\"\n", "line 2: input 'l1' twice" },
+        { "[combos]\nhold_ms = 0\n", "line 2: hold_ms must be 1..10000" },
+        { "[macros]\nm = \"Q, 20 parsecs\"\n", "line 2: unknown macro step '20 parsecs'" },
+        { "[macros]\nm = \"Q, 0ms\"\n", "line 2: pause '0ms' must be 1us..10000ms" },
+        { "[macros]\nm = \"Q sideways\"\n", "line 2: expected down or up after 'Q'" },
+        { "[macros]\nm = \"Q\"\nm = \"W\"\n", "line 3: macro 'm' defined twice" },
+        { "[macros]\nM = \"Q\"\n", "line 2: macro names are" },
+        { "[combos]\nl1+r1 = \"nosuch\"\n[macros]\nother = \"Q\"\n", "line 2: unknown macro step 'nosuch'" },
+    };
+    bool ok = true;
+    for (const auto &c : cases) {
+        ActionTable t;
+        std::string error;
+        const bool parsed = parseProfile(c.text, t, error);
+        const bool match = !parsed && error.rfind(c.error, 0) == 0;
+        ok = ok && match;
+        if (!match) std::printf("  expected \"%s\", got %s\"%s\"\n", c.error, parsed ? "success " : "", error.c_str());
+    }
+    // a macro named later in the file than the combo that plays it is fine
+    ActionTable t;
+    std::string error;
+    const bool forward = parseProfile("[combos]\nl1+r1 = \"later\"\n[macros]\nlater = \"Q\"\n", t, error) &&
+                         t.combos.macroCount == 1 && t.combos.combos[0].macro == 0;
+    ok = ok && forward;
+    if (!forward) std::printf("  forward macro reference failed: %s\n", error.c_str());
+    std::printf("profile errors: %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// ns per report over `reports`, mapped with `table`.
+static double mappingCost(const ActionTable &table, const std::vector<PS4ControllerReport> &reports) {
+    NullSink sink;
+    OutputBatch output(sink);
+    ManualClockSource clock;
+    PS4Mapper mapper(output, clock);
+    mapper.setActionTable(std::make_unique<ActionTable>(table));
+    double best = 1e30;
+    for (int round = 0; round < 5; ++round) {
+        const auto t0 = std::chrono::steady_clock::now();
+        for (const PS4ControllerReport &r : reports) {
+            clock.advance(std::chrono::milliseconds(4));
+            mapper.processMapping(r);
+            mapper.runTimers();
+            output.flush();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        best = (std::min)(best, ns / static_cast<double>(reports.size()));
+    }
+    return best;
+}
+
+static void printCost() {
+    std::string text = "[combos]\n";
+    const char *pairs[] = { "square", "cross", "circle", "triangle", "l1", "r1", "l2_button", "r2_button" };
+    for (int i = 0; i < 8; ++i) text += std::string(pairs[i]) + "+" + pairs[(i + 1) % 8] + " = \"Q\"\n";
+    for (const char *p : pairs) text += std::string("tap:") + p + " = \"W\"\nhold:" + p + " = \"E\"\n";
+    for (int i = 0; i < 8; ++i) text += std::string(pairs[i]) + ">" + pairs[(i + 1) % 8] + ">" + pairs[(i + 3) % 8] + " = \"R\"\n";
+    ActionTable none, many;
+    std::string error;
+    parseProfile("", none, error);
+    if (!parseProfile(text, many, error)) { std::printf("cost profile: %s\n", error.c_str()); return; }
+
+    std::mt19937 rng(7);
+    std::vector<PS4ControllerReport> idle(20000, ButtonScript::reportFor(0)), busy;
+    uint32_t held = 0;
+    for (int i = 0; i < 20000; ++i) {
+        held ^= 1u << (rng() % 8);   // one face or shoulder button changes every report
+        busy.push_back(ButtonScript::reportFor(held));
+    }
+    std::printf("cost per report (%d combos vs none): unchanged %.0f vs %.0f ns, one edge %.0f vs %.0f ns\n",
+                many.combos.comboCount, mappingCost(many, idle), mappingCost(none, idle),
+                mappingCost(many, busy), mappingCost(none, busy));
+}
+
+// A macro of 1 ms steps on the real clock, driven like the live loop: sleep to the next
+// deadline, run timers, flush.
+static void printLiveTiming() {
+    ActionTable table;
+    std::string error;
+    std::string steps;
+    for (int i = 0; i < 50; ++i) steps += std::string(i ? ", " : "") + "F, 1ms";
+    if (!parseProfile("[combos]\nl1+r1 = \"" + steps + "\"\n", table, error)) { std::printf("live: %s\n", error.c_str()); return; }
+
+    struct StampSink : OutputSink {
+        void submit(const OutputEvent *events, size_t count) override {
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; ++i) if (events[i].down) at.push_back(now);
+        }
+        std::vector<std::chrono::steady_clock::time_point> at;
+    } sink;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    mapper.setActionTable(std::make_unique<ActionTable>(table));
+    mapper.processMapping(ButtonScript::reportFor(buttonBit(BTN_L1) | buttonBit(BTN_R1)));
+    output.flush();
+    const auto start = sink.at.empty() ? std::chrono::steady_clock::now() : sink.at[0];
+    while (auto deadline = mapper.nextTimerDeadline()) {
+        std::this_thread::sleep_until(*deadline);
+        mapper.runTimers();
+        output.flush();
+    }
+    std::vector<double> lateUs;
+    for (size_t i = 1; i < sink.at.size(); ++i) {
+        lateUs.push_back(std::chrono::duration<double, std::micro>(sink.at[i] - (start + std::chrono::milliseconds(i))).count());
+    }
+    if (lateUs.empty()) return;
+    std::sort(lateUs.begin(), lateUs.end());
+    std::printf("live macro, %zu steps 1 ms apart: lateness p50 %.0f us, p99 %.0f us, max %.0f us (informational)\n",
+                lateUs.size(), lateUs[lateUs.size() / 2], lateUs[lateUs.size() * 99 / 100], lateUs.back());
+}
+
+int main(int argc, char **argv) {
+    const std::string capture = argc > 1 ? argv[1] : "combos.ds4cap";
+    const std::string profilePath = capture.substr(0, capture.rfind('.')) + ".profile";
+
+    const uint32_t L1 = buttonBit(BTN_L1), R1 = buttonBit(BTN_R1), TRI = buttonBit(BTN_TRIANGLE);
+    const uint32_t SQ = buttonBit(BTN_SQUARE), CIR = buttonBit(BTN_CIRCLE), X = buttonBit(BTN_CROSS);
+    const uint32_t DOWN = buttonBit(BTN_DPAD_DOWN), RIGHT = buttonBit(BTN_DPAD_RIGHT), OPT = buttonBit(BTN_OPTIONS);
+    ButtonScript s;
+    std::vector<std::string> expect;
+    auto at = [&](long long us, const char *what) { expect.push_back(std::to_string(us) + ' ' + what); };
+
+    // chord, pressed again mid-macro: one burst, timed from the second press
+    s.press(100, L1); s.press(120, R1); s.release(128, L1 | R1); s.press(136, L1 | R1); s.release(200, L1 | R1);
+    at(120000, "mouse_left down"); at(120000, "mouse_left up");
+    at(121500, "mouse_left down"); at(121500, "mouse_left up");
+    at(121750, "wheel 120"); at(151750, "wheel -120");
+    // too far apart for a chord
+    s.press(500, L1); s.press(600, R1); s.release(700, L1 | R1);
+    // tap, then hold: the hold plays at 300 ms and the release is no tap
+    s.press(1000, TRI); s.release(1100, TRI);
+    at(1100000, "key 0x51 down"); at(1100000, "key 0x51 up");
+    s.press(1500, TRI); s.release(2000, TRI);
+    at(1800000, "key 0x52 down"); at(1820000, "key 0x52 up");
+    // down, down-right, right, Square
+    s.press(2500, DOWN); s.press(2540, RIGHT); s.release(2560, DOWN); s.release(2600, RIGHT);
+    s.press(2620, SQ); s.release(2660, SQ);
+    at(2620000, "key 0x48 down"); at(2620500, "key 0x48 up"); at(2630500, "key 0x4A down"); at(2630500, "key 0x4A up");
+    // Square x3, Circle: the third Square falls back to one matched step
+    s.press(3000, SQ); s.release(3020, SQ); s.press(3040, SQ); s.release(3060, SQ); s.press(3080, SQ); s.release(3100, SQ);
+    s.press(3120, CIR); s.release(3160, CIR);
+    at(3120000, "key 0x46 down"); at(3120000, "key 0x46 up");
+    // the same sequence with a 300 ms gap
+    s.press(3500, DOWN); s.release(3520, DOWN); s.press(3820, RIGHT); s.release(3840, RIGHT); s.press(3860, SQ); s.release(3880, SQ);
+    // a mode switch while the hold macro holds R releases it; back to the visualizer after
+    s.press(4500, TRI); s.press(4808, OPT); s.release(4840, OPT); s.release(4900, TRI); s.press(5000, OPT); s.release(5040, OPT);
+    at(4800000, "key 0x52 down"); at(4808000, "key 0x52 up");
+    // bindings work alongside
+    s.press(5500, X); s.release(5540, X);
+    at(5500000, "key 0x20 down"); at(5540000, "key 0x20 up");
+
+    if (!writeFile(profilePath, PROFILE)) { std::fprintf(stderr, "cannot write %s\n", profilePath.c_str()); return 1; }
+    {
+        ReportCaptureWriter writer;
+        if (!writer.open(capture)) { std::fprintf(stderr, "cannot write %s\n", capture.c_str()); return 1; }
+        const std::vector<PS4ControllerReport> reports = s.reports(6000);
+        const ClockSource::time_point t0;
+        for (size_t i = 0; i < reports.size(); ++i) writer.write(t0 + std::chrono::milliseconds(4 * i), reports[i]);
+    }
+    ActionTable table;
+    std::string error;
+    if (!loadProfile(profilePath, table, error)) { std::fprintf(stderr, "%s\n", error.c_str()); return 1; }
+
+    bool ok = replayCheck(capture, table, false, expect);
+    ok = replayCheck(capture, table, true, expect) && ok;
+    ok = checkErrors() && ok;
+    printCost();
+    printLiveTiming();
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+// Console rendering benchmark (portable, runs on Linux).
+//
+// Draws a visualizer-like frame (static header, two moving stick grids, trigger bars, hex dump)
+// and compares the old full redraw (clear screen, rewrite every row) with ConsoleFrame's
+// differential present through the ANSI backend. Reports bytes written and time per frame.
+// Pass --tty to actually render to the terminal instead of only counting bytes.
+//
+//   g++ -std=c++17 -O2 -I. bench/console_render.cpp -o console_render
+//   ./console_render [--tty]
+
+#include "console_frame.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+static void drawFrame(FrameBuffer &fb, int i) {
+    fb.fill(' ');
+    fb.put(0, 0, "=== PS4 Controller -> Mouse/Keyboard Mapper ===");
+    fb.put(0, 1, "Mappings (Visualizer mode):");
+    fb.put(0, 2, "  Left stick -> WASD (analog -> digital)");
+    fb.put(0, 3, "  D-Pad -> Arrow keys");
+    fb.put(0, 4, "  Right stick -> Mouse movement (relative)");
+    fb.put(0, 5, "  R2 -> Left mouse button, L2 -> Right mouse button");
+    fb.put(0, 7, "Mode: Visualizer");
+
+    // sticks circle slowly, like a thumb resting on the stick
+    int lx = static_cast<int>(std::lround(std::cos(i * 0.05) * 5));
+    int ly = static_cast<int>(std::lround(std::sin(i * 0.05) * 2));
+    for (int s = 0; s < 2; ++s) {
+        int x0 = s * 30;
+        fb.put(x0, 10, s ? "Right Stick:" : "Left Stick:");
+        for (int row = -2; row <= 2; ++row) {
+            char line[12];
+            for (int col = -5; col <= 5; ++col) {
+                line[col + 5] = (col == lx && row == ly) ? '@' : (col == 0 && row == 0) ? '+' : '.';
+            }
+            fb.put(x0, 13 + row, line, 11);
+        }
+    }
+    char buf[64];
+    int trig = (i * 3) % 256;
+    std::snprintf(buf, sizeof(buf), "L2: [%-10.*s] %3d", trig * 10 / 255, "##########", trig);
+    fb.put(60, 10, buf);
+    std::snprintf(buf, sizeof(buf), "Raw Data: 01 %02x %02x 80 80 08 00 %02x 00 00", 128 + lx, 128 + ly, i & 0xff);
+    fb.put(0, 29, buf);
+}
+
+int main(int argc, char **argv) {
+    const bool tty = argc > 1 && std::strcmp(argv[1], "--tty") == 0;
+    const int frames = tty ? 300 : 20000;
+    const int W = 120, H = 30;
+
+    // old path: clear the whole screen and rewrite every row each frame
+    FrameBuffer full(W, H);
+    std::string out;
+    uint64_t fullBytes = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        drawFrame(full, i);
+        out.assign("\x1b[2J\x1b[H");
+        for (int y = 0; y < H; ++y) {
+            out.append(full.row(y), W);
+            out.push_back('\n');
+        }
+        fullBytes += out.size();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    ConsoleFrame frame(W, H);
+    AnsiConsoleBackend backend(tty ? stdout : nullptr);
+    if (tty) std::fputs("\x1b[2J\x1b[?25l", stdout);
+    auto t2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        drawFrame(frame.buffer(), i);
+        frame.present(backend);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    if (tty) std::fputs("\x1b[?25h\x1b[31;1H", stdout);
+
+    auto perFrameUs = [&](std::chrono::steady_clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count() / frames;
+    };
+    // without --tty neither path does terminal I/O; the times are CPU cost of producing the bytes
+    std::printf("full redraw : %8.1f bytes/frame  %7.2f us/frame\n",
+                static_cast<double>(fullBytes) / frames, perFrameUs(t1 - t0));
+    std::printf("differential: %8.1f bytes/frame  %7.2f us/frame  (%llu writes for %d frames)\n",
+                static_cast<double>(backend.bytesWritten()) / frames, perFrameUs(t3 - t2),
+                static_cast<unsigned long long>(backend.writeCount()), frames);
+    return 0;
+}
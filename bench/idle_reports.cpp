@@ -0,0 +1,356 @@
+// Idle reports: skipping reports that change nothing must not change the output, and should
+// make a resting controller nearly free (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/idle_reports.cpp -o idle_reports && ./idle_reports [seconds]
+//
+// A resting DS4 still changes most of its bytes on every report: the report counter, the
+// sensor timestamp, gyro/accelerometer noise, and sticks jittering by a count around center.
+// Three parts:
+//   equivalence  a scripted 250 Hz session (walking, aiming, clicking, D-pad, typing on the
+//                virtual keyboard with completions, touchpad swipes and taps, gyro turns), with
+//                noisy idle stretches between, is written as a capture and replayed twice per
+//                configuration: every report through processMapping(), then through
+//                processReport(). The output digests must be identical.
+//   idle cost    a resting controller at 250 and 1000 Hz through the host's per-report work:
+//                map, flush, publish a snapshot and draw a frame (at most 60 per second) when
+//                something was published. CPU time per second of stream, mapping every report
+//                vs skipping unchanged ones.
+//   compare      the masked compare alone, SSE2 (when built with it) vs a byte loop
+// Exits non-zero if any configuration's digests differ.
+
+#include "bench_common.h"
+#include "console_frame.h"
+#include "report_capture.h"
+#include "visualizer_view.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// ---------- scripted session ----------
+
+class Session {
+public:
+    explicit Session(uint32_t seed) : rng(seed) {}
+
+    // A resting controller: counter, timestamp and sensor noise, sticks within a count of center.
+    void idle(int ms) {
+        for (int t = 0; t < ms; t += 4) emit();
+    }
+    void hold(int ms) { idle(ms); }
+
+    PS4ControllerReport state{};
+    std::vector<PS4ControllerReport> reports;
+
+    void press(uint8_t &byte, uint8_t bits, int ms = 60) {
+        byte |= bits;
+        hold(ms);
+        byte &= static_cast<uint8_t>(~bits);
+        hold(40);
+    }
+    void touch(int x0, int y0, int x1, int y1, int ms, bool twoFingers = false) {
+        const int steps = ms / 4;
+        for (int i = 0; i <= steps; ++i) {
+            fingerX = x0 + (x1 - x0) * i / (std::max)(steps, 1);
+            fingerY = y0 + (y1 - y0) * i / (std::max)(steps, 1);
+            fingers = twoFingers ? 2 : 1;
+            emit();
+        }
+        fingers = 0;
+        emit();
+    }
+
+private:
+    void emit() {
+        PS4ControllerReport r = state;
+        r.reportId = 0x01;
+        r.buttons3 = static_cast<uint8_t>((r.buttons3 & 0x03) | (counter++ << 2));
+        timestamp = static_cast<uint16_t>(timestamp + 750);   // 4 ms in 16/3 us units
+        r.timestamp[0] = static_cast<uint8_t>(timestamp);
+        r.timestamp[1] = static_cast<uint8_t>(timestamp >> 8);
+        r.temperature = static_cast<uint8_t>(20 + rng() % 2);
+        std::uniform_int_distribution<int> noise(-3, 3);
+        const int16_t gyro[3] = { static_cast<int16_t>(gyroBase[0] + noise(rng)), static_cast<int16_t>(gyroBase[1] + noise(rng)),
+                                  static_cast<int16_t>(gyroBase[2] + noise(rng)) };
+        const int16_t accel[3] = { static_cast<int16_t>(noise(rng)), static_cast<int16_t>(8192 + noise(rng)), static_cast<int16_t>(noise(rng)) };
+        put16(r.gyroX, gyro[0]); put16(r.gyroY, gyro[1]); put16(r.gyroZ, gyro[2]);
+        put16(r.accelX, accel[0]); put16(r.accelY, accel[1]); put16(r.accelZ, accel[2]);
+        r.battery = 0x0B;
+        // sticks at rest wander by a count; a deflected stick keeps its position
+        auto jitter = [&](uint8_t &axis) { if (axis >= 126 && axis <= 130) axis = static_cast<uint8_t>(127 + rng() % 3); };
+        jitter(r.leftStickX); jitter(r.leftStickY); jitter(r.rightStickX); jitter(r.rightStickY);
+        // one touch frame per report; the frame counter only advances while a finger is down
+        r.touchPacketCount = 1;
+        if (fingers > 0) ++touchCounter;
+        r.touchPackets[0][0] = touchCounter;
+        for (int f = 0; f < 2; ++f) {
+            uint8_t *p = r.touchPackets[0] + 1 + 4 * f;
+            const int x = fingerX + f * 200, y = fingerY;
+            p[0] = static_cast<uint8_t>((f < fingers ? 0 : 0x80) | (5 + f));
+            p[1] = static_cast<uint8_t>(x & 0xFF);
+            p[2] = static_cast<uint8_t>(((x >> 8) & 0x0F) | ((y & 0x0F) << 4));
+            p[3] = static_cast<uint8_t>(y >> 4);
+        }
+        reports.push_back(r);
+    }
+    static void put16(uint8_t *p, int16_t v) {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(static_cast<uint16_t>(v) >> 8);
+    }
+
+    std::mt19937 rng;
+    uint8_t counter = 0;
+    uint16_t timestamp = 0;
+    uint8_t touchCounter = 0;
+    int fingers = 0, fingerX = 900, fingerY = 400;
+
+public:
+    int16_t gyroBase[3] = { 0, 0, 0 };
+};
+
+static std::vector<PS4ControllerReport> scriptedSession() {
+    Session s(11);
+    PS4ControllerReport &st = s.state;
+    st.leftStickX = st.leftStickY = st.rightStickX = st.rightStickY = 128;
+    st.buttons1 = 0x08;
+    s.idle(500);
+    st.leftStickY = 0; s.hold(700); st.leftStickY = 128;                  // walk forward, W repeats
+    s.idle(300);
+    st.leftStickX = 255; st.leftStickY = 20; s.hold(400);                 // diagonal
+    st.leftStickX = st.leftStickY = 128;
+    for (int i = 0; i < 60; ++i) {                                        // aim in a circle
+        st.rightStickX = static_cast<uint8_t>(128 + 100 * std::cos(i * 0.2));
+        st.rightStickY = static_cast<uint8_t>(128 + 100 * std::sin(i * 0.2));
+        s.hold(8);
+    }
+    st.rightStickX = st.rightStickY = 128;
+    s.idle(400);
+    for (int v = 0; v <= 255; v += 15) { st.rightTrigger = static_cast<uint8_t>(v); s.hold(4); }   // fire
+    s.hold(200);
+    st.rightTrigger = 0;
+    s.idle(200);
+    s.press(st.buttons1, 0x20);                                           // Cross
+    s.press(st.buttons1, 0x10);                                           // Square
+    st.buttons1 = 0x02; s.hold(500); st.buttons1 = 0x08;                  // D-pad right, repeats
+    s.idle(300);
+    s.press(st.buttons2, 0x20);                                           // Options: keyboard
+    s.idle(200);
+    for (int step : { 1, 1, 2, 0, 3, 3, 1 }) {                            // move and type
+        if (step == 1) { st.leftStickX = 255; s.hold(40); st.leftStickX = 128; s.idle(200); }
+        if (step == 2) { st.leftStickY = 255; s.hold(40); st.leftStickY = 128; s.idle(200); }
+        if (step == 3) { st.leftStickY = 255; s.hold(600); st.leftStickY = 128; s.idle(200); }   // held: auto-move
+        s.press(st.buttons1, 0x20);
+    }
+    s.press(st.buttons2, 0x01);                                           // L1: next completion
+    s.press(st.buttons2, 0x02);                                           // R1: accept
+    s.press(st.buttons1, 0x80);                                           // Triangle: space
+    s.idle(400);
+    s.press(st.buttons2, 0x20);                                           // back to the visualizer
+    s.idle(300);
+    s.touch(600, 400, 1200, 500, 200);                                    // swipe
+    s.idle(300);
+    s.touch(900, 400, 905, 402, 60);                                      // tap
+    s.idle(300);
+    s.touch(900, 600, 900, 300, 160, true);                               // two-finger scroll
+    s.idle(300);
+    s.gyroBase[1] = 800; s.hold(300); s.gyroBase[1] = 0;                  // turn
+    s.idle(1500);                                                         // long rest: counters wrap
+    s.touch(900, 400, 902, 401, 40);                                      // tap after the rest
+    s.idle(500);
+    return s.reports;
+}
+
+struct Config {
+    const char *name;
+    bool vkeyboard, gyro, trackpad, dictionary, leftStickUnbound;
+};
+
+static bool checkEquivalence(const std::string &path) {
+    static const Config configs[] = {
+        { "default", false, false, false, false, false },
+        { "keyboard+dictionary", true, false, false, true, false },
+        { "gyro aim", false, true, false, false, false },
+        { "trackpad", false, false, true, false, false },
+        { "left stick unbound", false, false, false, false, true },
+    };
+    const std::vector<uint8_t> image = WordDictionary::build({ { "we", 50 }, { "were", 40 }, { "wet", 30 }, { "west", 20 } });
+    WordDictionary dictionary;
+    dictionary.openImage(image.data(), image.size());
+    ReportCaptureFile file;
+    if (!file.open(path)) {
+        std::printf("cannot read %s\n", path.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (const Config &c : configs) {
+        uint64_t digest[2], events[2];
+        size_t skipped = 0;
+        for (int skip = 0; skip < 2; ++skip) {
+            DigestSink sink;
+            ManualClockSource clock;
+            OutputBatch output(sink);
+            PS4Mapper mapper(output, clock);
+            if (c.vkeyboard) mapper.setMode(PS4Mapper::MODE_VKEYBOARD);
+            if (c.gyro) mapper.setGyroAim(true);
+            if (c.trackpad) mapper.setTrackpad(true);
+            if (c.dictionary) mapper.setDictionary(&dictionary);
+            if (c.leftStickUnbound) {
+                auto table = std::make_unique<ActionTable>(ActionTable::defaults());
+                for (int in = IN_LSTICK_UP; in <= IN_LSTICK_RIGHT; ++in) table->bind(in, Action::None);
+                table->compile();
+                mapper.setActionTable(std::move(table));
+            }
+            output.flush();
+            const ReplayStats st = replayCapture(file, mapper, output, clock, false, skip != 0);
+            digest[skip] = sink.digest;
+            events[skip] = sink.submitted;
+            if (skip) skipped = st.skipped;
+        }
+        const bool same = digest[0] == digest[1];
+        std::printf("  %-20s %s  %5llu events  digest %016llx / %016llx  %zu of %zu reports skipped\n", c.name,
+                    same ? "ok  " : "FAIL", static_cast<unsigned long long>(events[0]),
+                    static_cast<unsigned long long>(digest[0]), static_cast<unsigned long long>(digest[1]),
+                    skipped, file.recordCount());
+        ok = ok && same;
+    }
+    return ok;
+}
+
+// ---------- idle cost ----------
+
+// What main.cpp does per report and per frame, on a simulated clock, timed on the real one.
+static void idleCost(int hz, int seconds, bool skipUnchanged) {
+    Session s(static_cast<uint32_t>(hz));
+    s.state.leftStickX = s.state.leftStickY = s.state.rightStickX = s.state.rightStickY = 128;
+    s.state.buttons1 = 0x08;
+    s.idle(1000);                                   // one second of distinct noisy reports, looped
+    const std::vector<PS4ControllerReport> &stream = s.reports;
+
+    NullSink sink;
+    ManualClockSource clock;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    VisualizerView view(mapper.keyboardLayout());
+    ConsoleFrame frame(120, 40);
+    AnsiConsoleBackend backend(nullptr);
+    DisplaySnapshot published, drawn;
+    bool pending = false;
+    const auto period = std::chrono::nanoseconds(1000000000 / hz);
+    const auto frameInterval = std::chrono::microseconds(1000000 / 60);
+    auto nextFrame = clock.now();
+    uint64_t frames = 0;
+
+    const int total = hz * seconds;
+    const double cpu0 = threadCpuSeconds();
+    for (int i = 0; i < total; ++i) {
+        clock.advance(period);
+        const PS4ControllerReport &r = stream[static_cast<size_t>(i) % stream.size()];
+        bool mapped = true;
+        if (skipUnchanged) mapped = mapper.processReport(r);
+        else mapper.processMapping(r);
+        if (mapped) {
+            output.flush();
+            published.report = r;
+            published.hasReport = true;
+            published.mode = mapper.currentMode();
+            published.lastMouseMoveX = mapper.lastMouseMoveX();
+            published.lastMouseMoveY = mapper.lastMouseMoveY();
+            published.gyroRate[0] = mapper.motionState().pitchRate();
+            published.outputEvents = output.eventCount();
+            pending = true;
+        }
+        if (mapper.runTimers() > 0) pending = true;
+        if (pending && clock.now() >= nextFrame) {
+            drawn = published;
+            view.draw(drawn, frame.buffer());
+            frame.present(backend);
+            ++frames;
+            pending = false;
+            nextFrame = clock.now() + frameInterval;
+        }
+    }
+    const double cpu = threadCpuSeconds() - cpu0;
+    std::printf("  %4d Hz  %-16s %8.1f us CPU per second (%.3f%% of a core)  %6.1f ns/report  %5.1f frames/s  %llu of %d mapped\n",
+                hz, skipUnchanged ? "skip unchanged" : "map every report", cpu * 1e6 / seconds, cpu * 100.0 / seconds,
+                cpu * 1e9 / total, static_cast<double>(frames) / seconds,
+                static_cast<unsigned long long>(skipUnchanged ? mapper.reportsMapped() : static_cast<uint64_t>(total)), total);
+}
+
+// ---------- the compare alone ----------
+
+static bool byteLoopEqual(const PS4ControllerReport &a, const PS4ControllerReport &b, const ReportMask &m) {
+    const uint8_t *pa = reinterpret_cast<const uint8_t *>(&a), *pb = reinterpret_cast<const uint8_t *>(&b);
+    for (size_t i = 0; i < ReportMask::SIZE; ++i) {
+        if ((pa[i] ^ pb[i]) & m.bytes[i]) return false;
+    }
+    return true;
+}
+
+static void compareCost() {
+    Session s(3);
+    s.state.leftStickX = s.state.leftStickY = s.state.rightStickX = s.state.rightStickY = 128;
+    s.idle(400);
+    NullSink sink;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    const ReportMask &mask = mapper.reportMask();
+    const std::vector<PS4ControllerReport> &v = s.reports;
+    const int rounds = 20000000;
+    volatile int sameCount = 0;
+    bool agree = true;
+    auto t0 = Clock::now();
+    for (int i = 0; i < rounds; ++i) sameCount = sameCount + sameUnderMask(v[i % v.size()], v[(i + 1) % v.size()], mask);
+    const double vecNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    t0 = Clock::now();
+    for (int i = 0; i < rounds; ++i) sameCount = sameCount + byteLoopEqual(v[i % v.size()], v[(i + 1) % v.size()], mask);
+    const double loopNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    for (size_t i = 0; i + 1 < v.size(); ++i) agree = agree && sameUnderMask(v[i], v[i + 1], mask) == byteLoopEqual(v[i], v[i + 1], mask);
+#if defined(DS4_REPORT_COMPARE_SSE2)
+    const char *how = "SSE2";
+#else
+    const char *how = "64-bit words";
+#endif
+    std::printf("  masked compare (%s) %.2f ns, byte loop %.2f ns%s\n", how, vecNs, loopNs, agree ? "" : "  (DISAGREE)");
+}
+
+int main(int argc, char **argv) {
+    const int seconds = argc > 1 ? (std::max)(1, std::atoi(argv[1])) : 10;
+
+    const std::vector<PS4ControllerReport> session = scriptedSession();
+    char path[] = "/tmp/ds4idleXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        std::printf("cannot create temporary file\n");
+        return 1;
+    }
+    close(fd);
+    {
+        ReportCaptureWriter writer;
+        writer.open(path);
+        ClockSource::time_point t{};
+        for (const PS4ControllerReport &r : session) {
+            writer.write(t, r);
+            t += std::chrono::milliseconds(4);
+        }
+    }
+    std::printf("equivalence: %zu-report session, every report mapped vs unchanged ones skipped\n", session.size());
+    const bool ok = checkEquivalence(path);
+    std::remove(path);
+
+    std::printf("idle cost: resting controller, %d s simulated, host loop per report plus frames (<= 60/s)\n", seconds);
+    for (int hz : { 250, 1000 }) {
+        idleCost(hz, seconds, false);
+        idleCost(hz, seconds, true);
+    }
+    compareCost();
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,309 @@
+// Virtual keyboard layouts: parsing the shipped layout files, drawing against the old
+// string-building renderer, and the cost of a key press, a frame and a page switch (portable,
+// runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/keyboard_layout.cpp -o keyboard_layout
+//   ./keyboard_layout [layouts-directory | file.layout...]
+//
+// Without arguments, the shipped layouts are read from layouts/ in the current directory or
+// next to the binary (or one or two directories up from it), so the bench runs from anywhere
+// in or under the repository root; a directory argument names it instead. Parts:
+//   parse      each file parses; layouts/qwerty.layout compiles to exactly the built-in layout
+//   render     every page, every selection, drawn with drawVirtualKeyboard() and with the
+//              renderer it replaced (a " LABEL " / "[LABEL]" string per cell) must match
+//   dirty      moving the selection one key and presenting the frame: changed cells per move
+//   timing     key lookup (the old label-to-VK string chain vs the compiled key), one keyboard
+//              draw, and pressing through a page switch; heap allocations in the timed loops
+//              must be zero
+// Exits non-zero if any check fails.
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "bench_common.h"
+#include "console_frame.h"
+#include "keyboard_layout.h"
+#include "ps4_mapper.h"
+#include "visualizer_view.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static bool samePages(const KeyboardLayout &a, const KeyboardLayout &b) {
+    if (a.pageCount() != b.pageCount()) return false;
+    for (int i = 0; i < a.pageCount(); ++i) {
+        const LayoutPage &p = a.page(i), &q = b.page(i);
+        if (std::strcmp(p.name, q.name) != 0 || p.rows != q.rows || p.rowLength != q.rowLength || p.rowTextLen != q.rowTextLen)
+            return false;
+        for (int r = 0; r < p.rows; ++r) {
+            if (std::memcmp(p.rowText[r], q.rowText[r], p.rowTextLen[r]) != 0) return false;
+            for (int c = 0; c < p.rowLength[r]; ++c) {
+                const LayoutKey &k = p.key(r, c), &m = q.key(r, c);
+                if (k.kind != m.kind || k.modifiers != m.modifiers || k.vk != m.vk || k.page != m.page || k.x != m.x ||
+                    std::strcmp(k.label, m.label) != 0)
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The renderer drawVirtualKeyboard() replaced: one string per cell, built every frame.
+static void drawOld(FrameBuffer &out, int x, int y, const LayoutPage &p, int selectedRow, int selectedCol) {
+    for (int r = 0; r < p.rows; ++r) {
+        int colX = x;
+        for (int c = 0; c < p.rowLength[r]; ++c) {
+            const std::string label = p.key(r, c).label;
+            std::string disp = (r == selectedRow && c == selectedCol) ? "[" + label + "]" : " " + label + " ";
+            if (static_cast<int>(disp.size()) < KeyboardLayout::KEY_WIDTH) disp += std::string(KeyboardLayout::KEY_WIDTH - disp.size(), ' ');
+            out.put(colX, y + r, disp);
+            colX += static_cast<int>(disp.size()) + 1;
+        }
+    }
+}
+
+// The lookup pressing a key used to do (PS4Mapper::getVkForLabel): the label through a chain of
+// string compares.
+static uint16_t vkForLabelOld(const std::string &label) {
+    if (label.empty()) return 0;
+    if (label.size() == 1) {
+        const char c = label[0];
+        if (std::isalpha(static_cast<unsigned char>(c))) return static_cast<uint16_t>(std::toupper(static_cast<unsigned char>(c)));
+        if (std::isdigit(static_cast<unsigned char>(c))) return static_cast<uint16_t>(c);
+    }
+    if (label == "SPACE") return Vk::SPACE;
+    if (label == "ENTER") return Vk::RETURN;
+    if (label == "BACKSPACE") return Vk::BACK;
+    if (label == "TAB") return Vk::TAB;
+    if (label == "CAPS") return Vk::CAPITAL;
+    if (label == "LSHFT" || label == "RSHIFT") return Vk::LSHIFT;
+    if (label == "LCTRL" || label == "RCTRL") return Vk::LCONTROL;
+    if (label == "LALT" || label == "RALT") return Vk::MENU;
+    if (label == ",") return Vk::OEM_COMMA;
+    if (label == ".") return Vk::OEM_PERIOD;
+    if (label == "/") return Vk::OEM_2;
+    if (label == ";") return Vk::OEM_1;
+    if (label == "'") return Vk::OEM_7;
+    if (label == "[") return Vk::OEM_4;
+    if (label == "]") return Vk::OEM_6;
+    if (label == "\\") return Vk::OEM_5;
+    if (label == "-") return Vk::OEM_MINUS;
+    if (label == "=") return Vk::OEM_PLUS;
+    return 0;
+}
+
+static bool checkRender(const KeyboardLayout &layout, const char *name) {
+    VisualizerView view(layout);
+    FrameBuffer a(120, 8), b(120, 8);
+    int mismatches = 0, frames = 0;
+    for (int pi = 0; pi < layout.pageCount(); ++pi) {
+        const LayoutPage &p = layout.page(pi);
+        for (int r = 0; r < (std::min)(p.rows, LayoutPage::MAX_ROWS); ++r) {   // min() only for GCC -Warray-bounds
+            for (int c = 0; c < p.rowLength[r]; ++c) {
+                a.fill(' ');
+                b.fill(' ');
+                view.drawVirtualKeyboard(a, 0, 0, pi, r, c);
+                drawOld(b, 0, 0, p, r, c);
+                for (int y = 0; y < a.height(); ++y) mismatches += std::memcmp(a.row(y), b.row(y), static_cast<size_t>(a.width())) != 0;
+                ++frames;
+            }
+        }
+    }
+    std::printf("render    %-8s %s (%d frames, %d mismatched rows)\n", name, mismatches ? "FAIL" : "ok", frames, mismatches);
+    return mismatches == 0;
+}
+
+class CountingBackend : public ConsoleBackend {
+public:
+    void present(const FrameBuffer &, const DirtyRun *runs, size_t count) override {
+        for (size_t i = 0; i < count; ++i) cells += static_cast<uint64_t>(runs[i].len);
+    }
+    uint64_t cells = 0;
+};
+
+// Walk the selection across the first page; every frame after the first may change at most
+// the old and the new selected cell's brackets (within ConsoleFrame's run merging).
+static void dirtyCells(const KeyboardLayout &layout) {
+    VisualizerView view(layout);
+    ConsoleFrame frame(120, 8);
+    CountingBackend backend;
+    const LayoutPage &p = layout.page(0);
+    view.drawVirtualKeyboard(frame.buffer(), 0, 0, 0, 0, 0);
+    frame.present(backend);
+    const uint64_t full = backend.cells;
+    backend.cells = 0;
+    int moves = 0;
+    for (int r = 0; r < p.rows; ++r) {
+        for (int c = 0; c < p.rowLength[r]; ++c) {
+            view.drawVirtualKeyboard(frame.buffer(), 0, 0, 0, r, c);
+            frame.present(backend);
+            ++moves;
+        }
+    }
+    std::printf("dirty     first frame %llu cells, then %.1f cells per selection move\n",
+                static_cast<unsigned long long>(full), static_cast<double>(backend.cells) / moves);
+}
+
+static bool timing() {
+    const KeyboardLayout &layout = KeyboardLayout::builtIn();
+    const LayoutPage &qwerty = layout.page(0);
+    const int rounds = 2000000;
+    bool ok = true;
+
+    std::vector<std::string> labels;
+    for (int r = 0; r < qwerty.rows; ++r)
+        for (int c = 0; c < qwerty.rowLength[r]; ++c) labels.push_back(qwerty.key(r, c).label);
+    uint32_t acc = 0;
+    auto t0 = Clock::now();
+    for (int i = 0; i < rounds; ++i) acc += vkForLabelOld(labels[static_cast<size_t>(i) % labels.size()]);
+    const double oldNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    size_t allocs = g_allocs.load();
+    t0 = Clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        const int r = i % qwerty.rows;
+        acc += qwerty.key(r, (i / 7) % qwerty.rowLength[r]).vk;
+    }
+    const double newNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    doNotOptimize(acc);
+    std::printf("timing    key lookup: label compare %.1f ns, compiled key %.1f ns\n", oldNs, newNs);
+    ok = g_allocs.load() == allocs && ok;
+
+    VisualizerView view(layout);
+    FrameBuffer fb(120, 8);
+    const int frames = 200000;
+    t0 = Clock::now();
+    for (int i = 0; i < frames; ++i) drawOld(fb, 0, 0, qwerty, i % 4, i % 10);
+    const double oldDraw = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / frames;
+    allocs = g_allocs.load();
+    t0 = Clock::now();
+    for (int i = 0; i < frames; ++i) view.drawVirtualKeyboard(fb, 0, 0, (i / 16) % layout.pageCount(), i % 4, i % 10);
+    const double newDraw = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / frames;
+    const size_t drawAllocs = g_allocs.load() - allocs;
+    std::printf("          keyboard draw: per-cell strings %.0f ns, prerendered rows %.0f ns (%zu allocations)\n",
+                oldDraw, newDraw, drawAllocs);
+    ok = drawAllocs == 0 && ok;
+
+    // Cross on "?123" then on "ABC" and back, through the mapper: two page switches per round
+    CountingSink sink;
+    ManualClockSource clock;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    mapper.setMode(PS4Mapper::MODE_VKEYBOARD);
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+    auto send = [&](uint8_t buttons1) {
+        r.buttons1 = buttons1;
+        clock.advance(std::chrono::milliseconds(4));
+        mapper.processMapping(r);
+        output.flush();
+    };
+    auto stick = [&](int dx) {
+        r.leftStickX = static_cast<uint8_t>(128 + dx * 127);
+        send(0x08);
+        r.leftStickX = 128;
+        send(0x08);
+        clock.advance(std::chrono::milliseconds(200));
+        mapper.runTimers();
+    };
+    send(0x08);
+    r.leftStickY = 255;                     // down to the bottom row
+    for (int i = 0; i < 3; ++i) {
+        send(0x08);
+        r.leftStickY = 128;
+        send(0x08);
+        clock.advance(std::chrono::milliseconds(200));
+        mapper.runTimers();
+        r.leftStickY = 255;
+    }
+    r.leftStickY = 128;
+    send(0x08);
+    stick(1);
+    stick(1);                               // "?123" on qwerty, "ABC" on symbols
+    const int switches = 20000;
+    bool switched = true;
+    allocs = g_allocs.load();
+    t0 = Clock::now();
+    for (int i = 0; i < switches; ++i) {
+        send(0x28);                         // Cross down: switch page
+        send(0x08);
+        switched = switched && mapper.keyboardPage() == (i % 2 == 0 ? 1 : 0);
+    }
+    const double switchNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / (switches * 2);
+    const size_t switchAllocs = g_allocs.load() - allocs;
+    std::printf("          page switch through the mapper: %.0f ns per report, %s, %zu allocations, %llu key events\n",
+                switchNs, switched ? "ok" : "FAIL", switchAllocs, static_cast<unsigned long long>(sink.events));
+    return ok && switched && switchAllocs == 0 && sink.events == 0;
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+    const size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// layouts/ in the current directory, else next to the binary or up to two levels above it.
+static std::string findLayouts(const char *argv0) {
+    std::vector<std::string> candidates{ "layouts" };
+    std::string dir(argv0 ? argv0 : "");
+    const size_t slash = dir.find_last_of("/\\");
+    dir = slash == std::string::npos ? "." : dir.substr(0, slash);
+    for (const char *up : { "", "/..", "/../.." }) candidates.push_back(dir + up + "/layouts");
+    for (const std::string &c : candidates) {
+        if (FILE *f = std::fopen((c + "/qwerty.layout").c_str(), "rb")) {
+            std::fclose(f);
+            return c;
+        }
+    }
+    std::printf("layouts/ is not in the current directory or near %s; pass its path\n", argv0 ? argv0 : "the binary");
+    return "layouts";
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> paths;
+    std::string dir;
+    for (int i = 1; i < argc; ++i) {
+        if (endsWith(argv[i], ".layout")) paths.push_back(argv[i]);
+        else dir = argv[i];
+    }
+    if (paths.empty()) {
+        if (dir.empty()) dir = findLayouts(argv[0]);
+        for (const char *name : { "qwerty", "azerty", "jis" }) paths.push_back(dir + "/" + name + ".layout");
+    }
+
+    bool ok = true;
+    std::vector<std::pair<std::string, KeyboardLayout>> loaded;
+    for (const std::string &path : paths) {
+        KeyboardLayout layout;
+        std::string error;
+        auto t0 = Clock::now();
+        const bool parsed = KeyboardLayout::load(path, layout, error);
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        if (!parsed) {
+            std::printf("parse     FAIL %s\n", error.c_str());
+            ok = false;
+            continue;
+        }
+        std::string pages;
+        for (int i = 0; i < layout.pageCount(); ++i) pages += std::string(i ? ", " : "") + layout.page(i).name;
+        std::printf("parse     ok   %s: %d pages (%s) in %.0f us\n", path.c_str(), layout.pageCount(), pages.c_str(), us);
+        if (endsWith(path, "qwerty.layout")) {
+            const bool same = samePages(layout, KeyboardLayout::builtIn());
+            std::printf("          %s: %s the built-in layout\n", same ? "ok" : "FAIL", same ? "same as" : "differs from");
+            ok = same && ok;
+        }
+        const size_t slash = path.find_last_of("/\\");
+        loaded.emplace_back(path.substr(slash == std::string::npos ? 0 : slash + 1), layout);
+    }
+    ok = checkRender(KeyboardLayout::builtIn(), "built-in") && ok;
+    for (const auto &l : loaded) ok = checkRender(l.second, l.first.substr(0, l.first.find('.')).c_str()) && ok;
+    dirtyCells(KeyboardLayout::builtIn());
+    ok = timing() && ok;
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,64 @@
+// PS4Mapper::processMapping() microbenchmark (portable, runs on Linux).
+//
+// Feeds a synthetic report stream (sticks circling, face buttons and D-pad cycling, triggers
+// ramping) through the mapper in each mode and reports ns per report. Output goes to a sink
+// that only counts, so the numbers are mapping cost alone.
+//
+//   g++ -std=c++17 -O2 -I. bench/mapping.cpp -o mapping && ./mapping
+
+#include "bench_common.h"
+#include "ps4_mapper.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+static std::vector<PS4ControllerReport> makeStream(size_t n) {
+    std::vector<PS4ControllerReport> reports(n);
+    for (size_t i = 0; i < n; ++i) {
+        PS4ControllerReport &r = reports[i];
+        r = PS4ControllerReport{};
+        r.reportId = 0x01;
+        double t = i * 0.01;
+        r.leftStickX = static_cast<uint8_t>(128 + 120 * std::cos(t));
+        r.leftStickY = static_cast<uint8_t>(128 + 120 * std::sin(t));
+        r.rightStickX = static_cast<uint8_t>(128 + 60 * std::sin(t * 1.7));
+        r.rightStickY = static_cast<uint8_t>(128 + 60 * std::cos(t * 1.3));
+        uint8_t hat = static_cast<uint8_t>((i / 25) % 9);             // 0..7 directions, 8 neutral
+        uint8_t face = static_cast<uint8_t>(((i / 40) % 16) << 4);
+        r.buttons1 = static_cast<uint8_t>(face | hat);
+        r.buttons2 = 0;                                               // keep OPTIONS/R1 released
+        r.leftTrigger = static_cast<uint8_t>((i * 3) & 0xFF);
+        r.rightTrigger = static_cast<uint8_t>((i * 5) & 0xFF);
+    }
+    return reports;
+}
+
+static void bench(const char *name, PS4Mapper::Mode mode, const std::vector<PS4ControllerReport> &stream) {
+    CountingSink sink;
+    OutputBatch out(sink);
+    PS4Mapper mapper(out);
+    mapper.setMode(mode);
+    out.flush();
+
+    const int passes = 20;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int p = 0; p < passes; ++p) {
+        for (const PS4ControllerReport &r : stream) {
+            mapper.processMapping(r);
+            out.flush();
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    double reports = static_cast<double>(passes) * stream.size();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    std::printf("%-16s %7.1f ns/report  %.2f events/report\n", name, ns / reports, sink.events / reports);
+}
+
+int main() {
+    auto stream = makeStream(50000);
+    bench("visualizer", PS4Mapper::MODE_VISUALIZER, stream);
+    bench("virtual keyboard", PS4Mapper::MODE_VKEYBOARD, stream);
+    return 0;
+}
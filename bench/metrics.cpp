@@ -0,0 +1,342 @@
+// Metrics endpoint: collection cost on the mapping thread, exposition format, loopback scrapes
+// (Linux; the server is the same code on Windows).
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/metrics.cpp -o metrics && ./metrics [seconds]
+//
+// Five parts:
+//   update    ns per MapperMetrics::update() over 1, 4 and 8 controllers
+//   mapping   the host's per-report work through ControllerShards (map, flush, record latency,
+//             update the metrics once per drain) for a while at a time: mapping-thread CPU ns
+//             per report without metrics, with metrics and no scraper, and with a thread
+//             rendering the exposition flat out
+//   format    renders after a scripted session and checks the text: every sample is
+//             `name{labels} value` under a HELP and TYPE line, histogram buckets never
+//             decrease and +Inf equals _count, and the counters match what was sent (reports,
+//             skips, a key released by a mode switch as a stuck-key reset, a dropped report)
+//   rate      ds4_report_rate_hz on a manual clock: 250 reports in a second read 250
+//   http      a MetricsServer on a free loopback port: GET /metrics round trips (p50/p99),
+//             a 404 for any other path, and the scrape count
+// Exits non-zero if any check fails.
+
+#include "bench_common.h"
+#include "controller_shards.h"
+#include "latency_histogram.h"
+#include "mapper_metrics.h"
+#include "metrics_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static TimedReport makeReport(size_t i) {
+    TimedReport item;
+    item.received = Clock::now();
+    PS4ControllerReport &r = item.report;
+    r = PS4ControllerReport{};
+    r.reportId = 0x01;
+    const double t = i * 0.01;
+    r.leftStickX = static_cast<uint8_t>(128 + 120 * std::cos(t));
+    r.leftStickY = static_cast<uint8_t>(128 + 120 * std::sin(t));
+    r.rightStickX = r.rightStickY = 128;
+    r.buttons1 = static_cast<uint8_t>((((i / 40) % 16) << 4) | ((i / 25) % 9));
+    return item;
+}
+
+// The host's drain callback, as in main.cpp: map, flush if mapped, record the stages.
+static size_t drainLikeHost(ControllerShards &shards, PipelineLatency &latency) {
+    return shards.drain([&](ControllerShard &c, const TimedReport &item) {
+        const auto dequeued = Clock::now();
+        const bool mapped = c.mapper->processReport(item.report);
+        const auto mappedAt = Clock::now();
+        if (mapped) c.output->flush();
+        latency.record(item.received, dequeued, mappedAt, Clock::now());
+    });
+}
+
+// ---------- parts ----------
+
+static void updateCost() {
+    for (int n : { 1, 4, 8 }) {
+        CountingSink sink;
+        ControllerShards shards(sink);
+        PipelineLatency latency;
+        MapperMetrics metrics(latency);
+        for (int d = 0; d < n; ++d) shards.push(d + 1, makeReport(d));
+        drainLikeHost(shards, latency);
+        const int iterations = 1000000;
+        const auto start = Clock::now();
+        for (int i = 0; i < iterations; ++i) metrics.update(shards);
+        const double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+        std::printf("update    %d controller%s  %6.1f ns per update\n", n, n == 1 ? " " : "s", ns);
+    }
+}
+
+// Mapping-thread CPU per report: batches of 4 reports for 4 controllers per drain, the metrics
+// updated after each drain as the hosts do.
+static void mappingCost(double seconds) {
+    const char *names[] = { "no metrics", "metrics, no scraper", "metrics, scraper flat out" };
+    for (int mode = 0; mode < 3; ++mode) {
+        CountingSink sink;
+        ControllerShards shards(sink);
+        PipelineLatency latency;
+        MapperMetrics metrics(latency);
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> renders{0};
+        std::thread scraper;
+        if (mode == 2) {
+            scraper = std::thread([&] {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    volatile size_t size = metrics.render().size();
+                    (void)size;
+                    renders.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+        uint64_t reports = 0;
+        size_t i = 0;
+        const double cpuStart = threadCpuSeconds();
+        const auto end = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        while (Clock::now() < end) {
+            for (int k = 0; k < 256; ++k, ++i) {
+                for (int d = 0; d < 4; ++d) shards.push(d + 1, makeReport(i));
+                reports += drainLikeHost(shards, latency);
+                if (mode > 0) metrics.update(shards);
+            }
+        }
+        const double cpu = threadCpuSeconds() - cpuStart;
+        stop = true;
+        if (scraper.joinable()) scraper.join();
+        std::printf("mapping   %-26s %6.1f ns CPU per report (%llu reports", names[mode], cpu * 1e9 / reports,
+                    static_cast<unsigned long long>(reports));
+        if (mode == 2) std::printf(", %llu renders", static_cast<unsigned long long>(renders.load()));
+        std::printf(")\n");
+    }
+}
+
+// Parses an exposition; on success `samples` maps "name{labels}" to the value.
+static bool checkExposition(const std::string &text, std::map<std::string, double> &samples, std::string &why) {
+    std::map<std::string, std::string> types;
+    std::map<std::string, bool> helped;
+    std::map<std::string, double> lastBucket;   // histogram series without le -> last cumulative count
+    std::istringstream in(text);
+    std::string line;
+    auto bad = [&](const std::string &what) { why = what + ": " + line; return false; };
+    while (std::getline(in, line)) {
+        if (line.rfind("# HELP ", 0) == 0) {
+            helped[line.substr(7, line.find(' ', 7) - 7)] = true;
+            continue;
+        }
+        if (line.rfind("# TYPE ", 0) == 0) {
+            const size_t sp = line.find(' ', 7);
+            types[line.substr(7, sp - 7)] = line.substr(sp + 1);
+            continue;
+        }
+        const size_t space = line.rfind(' ');
+        if (space == std::string::npos) return bad("no value");
+        const std::string series = line.substr(0, space);
+        char *endp = nullptr;
+        const double value = std::strtod(line.c_str() + space + 1, &endp);
+        if (*endp != '\0') return bad("value");
+        const size_t brace = series.find('{');
+        const std::string name = series.substr(0, brace);
+        if (name.empty() || name.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789_") != std::string::npos) return bad("name");
+        if (brace != std::string::npos && series.back() != '}') return bad("labels");
+        std::string family = name;
+        for (const char *suffix : { "_bucket", "_sum", "_count" }) {
+            const size_t len = std::strlen(suffix);
+            if (family.size() > len && family.compare(family.size() - len, len, suffix) == 0 &&
+                types.count(family.substr(0, family.size() - len)) && types[family.substr(0, family.size() - len)] == "histogram") {
+                family = family.substr(0, family.size() - len);
+            }
+        }
+        if (!types.count(family) || !helped.count(family)) return bad("no HELP/TYPE before");
+        if (types[family] == "histogram") {
+            // series key without le: buckets and _count of one label set meet under it
+            std::string labels = series.substr(name.size());
+            const size_t le = labels.find("le=\"");
+            if (le != std::string::npos) {
+                labels.erase(le, labels.find('"', le + 4) + 1 - le);
+                if (labels == "{}") labels.clear();
+                else if (labels.size() > 1 && labels[labels.size() - 2] == ',') labels.erase(labels.size() - 2, 1);
+            }
+            const std::string key = family + labels;
+            if (name == family + "_bucket") {
+                if (lastBucket.count(key) && value < lastBucket[key]) return bad("bucket decreases");
+                lastBucket[key] = value;
+            } else if (name == family + "_count" && (!lastBucket.count(key) || lastBucket[key] != value)) {
+                return bad("+Inf differs from _count");
+            }
+        }
+        samples[series] = value;
+    }
+    return true;
+}
+
+static bool formatCheck() {
+    CountingSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    PipelineLatency latency;
+    MapperMetrics metrics(latency, clock);
+
+    // controller 1: 300 moving reports, then 100 identical; controller 2: W held by the left
+    // stick, then a mode switch releases it
+    for (int i = 0; i < 300; ++i) {
+        shards.push(0x10, makeReport(i));
+        drainLikeHost(shards, latency);
+    }
+    TimedReport rest = makeReport(0);
+    rest.report.leftStickX = rest.report.leftStickY = 128;
+    rest.report.buttons1 = 0x08;
+    for (int i = 0; i < 100; ++i) {
+        shards.push(0x10, rest);
+        drainLikeHost(shards, latency);
+    }
+    TimedReport up = rest;
+    up.report.leftStickY = 0;
+    shards.push(0x20, up);
+    drainLikeHost(shards, latency);
+    shards.shard(1).mapper->toggleMode();
+    shards.shard(1).output->flush();
+    // a full ring: 256 fit, the rest are dropped
+    for (int i = 0; i < 260; ++i) shards.push(0x20, up);
+    metrics.update(shards);
+
+    const std::string text = metrics.render();
+    std::map<std::string, double> samples;
+    std::string why;
+    bool ok = checkExposition(text, samples, why);
+    const uint64_t skipped = shards.shard(0).mapper->reportsSkipped();
+    auto expect = [&](const std::string &series, double want) {
+        auto it = samples.find(series);
+        if (it != samples.end() && it->second == want) return true;
+        why = series + (it == samples.end() ? " missing" : " = " + std::to_string(it->second)) + ", want " + std::to_string(want);
+        return false;
+    };
+    ok = ok && expect("ds4_controllers", 2) &&
+         expect("ds4_reports_total{controller=\"0\",device=\"0x10\"}", 400) &&
+         expect("ds4_reports_skipped_total{controller=\"0\",device=\"0x10\"}", static_cast<double>(skipped)) &&
+         expect("ds4_stuck_key_resets_total{controller=\"1\",device=\"0x20\"}", 1) &&
+         expect("ds4_reports_dropped_total{controller=\"1\",device=\"0x20\"}", 260 - 256) &&
+         expect("ds4_report_latency_seconds_count{stage=\"total\"}", 401) &&
+         expect("ds4_timer_lateness_seconds_count", 0) && skipped >= 99;
+
+    const int iterations = 2000;
+    const auto start = Clock::now();
+    size_t bytes = 0;
+    for (int i = 0; i < iterations; ++i) bytes = metrics.render().size();
+    const double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+    std::printf("format    %s (%zu samples, %zu bytes, render %.1f us)%s%s\n", ok ? "ok" : "FAIL", samples.size(), bytes, us,
+                ok ? "" : "  ", ok ? "" : why.c_str());
+    return ok;
+}
+
+static bool rateCheck() {
+    CountingSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    PipelineLatency latency;
+    MapperMetrics metrics(latency, clock);
+    auto rateOf = [&] {
+        const std::string text = metrics.render();
+        const size_t at = text.find("ds4_report_rate_hz{");
+        return at == std::string::npos ? -1.0 : std::atof(text.c_str() + text.find(' ', at) + 1);
+    };
+    for (int i = 0; i < 250; ++i) {
+        shards.push(1, makeReport(i));
+        drainLikeHost(shards, latency);
+        metrics.update(shards);
+        clock.advance(std::chrono::milliseconds(4));
+    }
+    const double first = rateOf();
+    clock.advance(std::chrono::milliseconds(500));   // too soon for a new sample
+    const double soon = rateOf();
+    clock.advance(std::chrono::milliseconds(500));   // a second with no reports
+    const double idle = rateOf();
+    const bool ok = std::fabs(first - 250.0) < 0.01 && soon == first && idle == 0.0;
+    std::printf("rate      %s (250 reports in 1 s: %.1f Hz, 0.5 s later %.1f Hz, after an idle second %.1f Hz)\n",
+                ok ? "ok" : "FAIL", first, soon, idle);
+    return ok;
+}
+
+// One request over a fresh loopback connection; returns the whole response.
+static std::string httpGet(uint16_t port, const char *path) {
+    const int s = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    std::string response;
+    if (::connect(s, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0) {
+        const std::string request = std::string("GET ") + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        (void)!::send(s, request.data(), request.size(), MSG_NOSIGNAL);
+        char buf[4096];
+        for (ssize_t n; (n = ::recv(s, buf, sizeof(buf), 0)) > 0;) response.append(buf, static_cast<size_t>(n));
+    }
+    ::close(s);
+    return response;
+}
+
+static bool httpCheck() {
+    CountingSink sink;
+    ControllerShards shards(sink);
+    PipelineLatency latency;
+    MapperMetrics metrics(latency);
+    for (int i = 0; i < 100; ++i) {
+        shards.push(1, makeReport(i));
+        drainLikeHost(shards, latency);
+    }
+    metrics.update(shards);
+
+    MetricsServer server;
+    if (!server.start(0, [&metrics] { return metrics.render(); })) {
+        std::printf("http      FAIL (%s)\n", server.lastError().c_str());
+        return false;
+    }
+    LatencyHistogram roundTrip;
+    bool ok = true;
+    std::string why;
+    const int scrapes = 200;
+    for (int i = 0; i < scrapes; ++i) {
+        const auto start = Clock::now();
+        const std::string r = httpGet(server.port(), "/metrics");
+        roundTrip.record(Clock::now() - start);
+        const size_t body = r.find("\r\n\r\n");
+        std::map<std::string, double> samples;
+        if (r.rfind("HTTP/1.1 200 OK\r\n", 0) != 0 || r.find("version=0.0.4") == std::string::npos || body == std::string::npos ||
+            !checkExposition(r.substr(body + 4), samples, why) || samples["ds4_reports_total{controller=\"0\",device=\"0x1\"}"] != 100) {
+            ok = false;
+            if (why.empty()) why = r.substr(0, r.find("\r\n"));
+            break;
+        }
+    }
+    const std::string notFound = httpGet(server.port(), "/");
+    ok = ok && notFound.rfind("HTTP/1.1 404", 0) == 0 && server.scrapeCount() == static_cast<uint64_t>(scrapes);
+    server.stop();
+    std::printf("http      %s (127.0.0.1:%u, %d scrapes: round trip p50 %.1f us p99 %.1f us, other paths 404)%s%s\n",
+                ok ? "ok" : "FAIL", server.port(), scrapes, roundTrip.percentile(0.50) / 1000.0,
+                roundTrip.percentile(0.99) / 1000.0, ok ? "" : "  ", why.c_str());
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const double seconds = argc > 1 ? (std::max)(0.1, std::atof(argv[1])) : 1.0;
+    updateCost();
+    std::printf("mapping   %.1f s per row, 4 controllers, %u cores%s\n", seconds, std::thread::hardware_concurrency(),
+                std::thread::hardware_concurrency() < 2 ? " (the scraper takes turns with the mapping thread)" : "");
+    mappingCost(seconds);
+    bool ok = formatCheck();
+    ok = rateCheck() && ok;
+    ok = httpCheck() && ok;
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
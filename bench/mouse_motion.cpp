@@ -0,0 +1,135 @@
+// Report-rate independence check for the mouse motion engine (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/mouse_motion.cpp -o mouse_motion && ./mouse_motion
+//
+// Replays the same right-stick trajectory at several report rates (250 Hz USB, 800 Hz and
+// 1000 Hz) and mouse tick rates on a manual clock, and compares total cursor displacement.
+// The stepped trajectory changes every 20 ms, on a report boundary at every rate, so totals
+// must agree to within one count; the smooth one is sampled differently per rate and must
+// agree within 1% of the distance travelled. The old per-report round(cubic * 36) result is
+// printed for contrast.
+// Exits non-zero if the engine's totals disagree.
+
+#include "report_capture.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+class DisplacementSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        for (size_t i = 0; i < count; ++i) {
+            if (events[i].type != OutputEvent::MouseMove) continue;
+            dx += events[i].dx;
+            dy += events[i].dy;
+            path += std::llabs(events[i].dx) + std::llabs(events[i].dy);
+            ++moves;
+        }
+    }
+    long long dx = 0, dy = 0;
+    long long path = 0;   // total distance travelled, |dx| + |dy|
+    uint64_t moves = 0;
+};
+
+struct StickSample { uint8_t x, y; };
+using Trajectory = std::function<StickSample(double seconds)>;
+
+static PS4ControllerReport stickReport(StickSample s) {
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = r.leftStickY = 128;
+    r.rightStickX = s.x;
+    r.rightStickY = s.y;
+    r.buttons1 = 0x08; // D-pad neutral
+    return r;
+}
+
+struct RunResult {
+    long long dx = 0, dy = 0, path = 0;
+    uint64_t moves = 0;
+    long long legacyDx = 0, legacyDy = 0;
+};
+
+// The per-report mapping this engine replaced, for comparison only.
+static int legacyCounts(uint8_t raw) {
+    const float v = PS4Mapper::normalizeAxis(raw);
+    if (std::fabs(v) <= 0.08f) return 0;
+    int m = static_cast<int>(std::round(std::copysign(v * v * v, v) * 36.0f));
+    return m == 0 ? (v > 0 ? 1 : -1) : m;
+}
+
+static RunResult run(const Trajectory &traj, double seconds, int reportHz, int tickHz) {
+    DisplacementSink sink;
+    OutputBatch output(sink);
+    ManualClockSource clock;
+    PS4Mapper mapper(output, clock);
+    mapper.setMouseTickRate(tickHz);
+    const auto start = clock.now();
+    RunResult res;
+
+    const long long reports = static_cast<long long>(std::llround(seconds * reportHz));
+    for (long long i = 0; i <= reports; ++i) {
+        const auto at = start + std::chrono::nanoseconds(i * 1000000000LL / reportHz);
+        runTimersUntil(at, mapper, output, clock);
+        clock.set(at);
+        // the last report centers the stick so the run has a definite end
+        const StickSample s = i == reports ? StickSample{ 128, 128 } : traj(static_cast<double>(i) / reportHz);
+        mapper.processMapping(stickReport(s));
+        output.flush();
+        if (i != reports) {
+            res.legacyDx += legacyCounts(s.x);
+            res.legacyDy += legacyCounts(s.y);
+        }
+    }
+    // let the engine emit whatever is still pending
+    runTimersUntil(clock.now() + std::chrono::milliseconds(20), mapper, output, clock);
+    res.dx = sink.dx;
+    res.dy = sink.dy;
+    res.path = sink.path;
+    res.moves = sink.moves;
+    return res;
+}
+
+static bool check(const char *name, const Trajectory &traj, double seconds, double tolerance) {
+    struct Rate { int report, tick; };
+    const Rate rates[] = { { 250, 1000 }, { 800, 1000 }, { 1000, 1000 }, { 250, 500 }, { 1000, 500 } };
+    std::printf("%s (%.1f s)\n", name, seconds);
+    std::printf("  %-8s %-8s %10s %10s %8s %14s\n", "reports", "tick", "dx", "dy", "moves", "legacy dx/dy");
+    RunResult ref;
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+        RunResult r = run(traj, seconds, rates[i].report, rates[i].tick);
+        if (i == 0) ref = r;
+        // sub-pixel remainders allow one count; sampling differences scale with distance travelled
+        const double allow = (std::max)(1.0, static_cast<double>(ref.path) * tolerance);
+        const bool match = std::fabs(static_cast<double>(r.dx - ref.dx)) <= allow &&
+                           std::fabs(static_cast<double>(r.dy - ref.dy)) <= allow;
+        ok = ok && match;
+        std::printf("  %-8d %-8d %10lld %10lld %8llu %7lld/%-7lld%s\n", rates[i].report, rates[i].tick, r.dx, r.dy,
+                    static_cast<unsigned long long>(r.moves), r.legacyDx, r.legacyDy, match ? "" : "  MISMATCH");
+    }
+    return ok;
+}
+
+int main() {
+    // held steps: each value lasts 20 ms, a multiple of every report period
+    const Trajectory stepped = [](double t) {
+        static const StickSample steps[] = {
+            { 128, 128 }, { 200, 128 }, { 255, 60 }, { 150, 140 }, { 40, 220 }, { 0, 0 }, { 120, 135 }, { 180, 90 }
+        };
+        const size_t i = static_cast<size_t>(t / 0.020 + 1e-9) % (sizeof(steps) / sizeof(steps[0]));
+        return steps[i];
+    };
+    // a slow circle, sampled wherever each rate's reports fall
+    const Trajectory circle = [](double t) {
+        const double a = t * 2.0 * 3.14159265358979;
+        return StickSample{ static_cast<uint8_t>(128 + 110 * std::cos(a)), static_cast<uint8_t>(128 + 110 * std::sin(a * 0.5)) };
+    };
+
+    bool ok = check("stepped trajectory", stepped, 2.0, 0.0);
+    ok = check("smooth trajectory", circle, 3.0, 0.01) && ok;
+    std::printf("%s\n", ok ? "OK: displacement is independent of report and tick rate" : "FAIL");
+    return ok ? 0 : 1;
+}
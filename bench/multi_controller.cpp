@@ -0,0 +1,333 @@
+// Several controllers through ControllerShards (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/multi_controller.cpp -o multi_controller && ./multi_controller
+//
+// Four checks on N synthetic report streams:
+//   keys     two controllers holding the same key: it is released only when both let go
+//   repeats  while two controllers hold W, each one's auto-repeat still reaches the system
+//            (twice the repeats of one pad alone) and W stays down; a tap or repeat pair
+//            sent while another controller holds the key comes out as up, down
+//   fairness one controller has 200 reports queued, the others one each; the others must be
+//            mapped within the first round, not behind the backlog
+//   removal  a controller unplugged while holding W and the left mouse button: W stays down
+//            while another pad holds it and goes up when that pad lets go, the button is
+//            released at once, and 40 plug/unplug cycles after 8 controllers fill every shard
+//            each find a free shard (no unassigned reports)
+//   profiles three controllers told apart by vendor:product id and by device path run their
+//            own profiles (Cross types a different key on each); reloading one profile changes
+//            only its controller, and a new controller in a freed shard runs its own profile
+//   scaling  mapping cost per report for 1, 2, 4 and 8 controllers (should stay flat), and
+//            queue latency p50/p99 of quiet controllers at 1 kHz each, with and without one
+//            controller dumping 200-report bursts every 10 ms
+// Exits non-zero if the key, repeat, fairness, removal or profile checks fail.
+
+#include "bench_common.h"
+#include "controller_shards.h"
+#include "latency_histogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+static TimedReport makeReport(size_t i, uint8_t leftY = 128) {
+    TimedReport item;
+    item.received = std::chrono::steady_clock::now();
+    PS4ControllerReport &r = item.report;
+    r = PS4ControllerReport{};
+    r.reportId = 0x01;
+    const double t = i * 0.01;
+    r.leftStickX = static_cast<uint8_t>(128 + 120 * std::cos(t));
+    r.leftStickY = leftY == 128 ? static_cast<uint8_t>(128 + 120 * std::sin(t)) : leftY;
+    r.rightStickX = static_cast<uint8_t>(128 + 60 * std::sin(t * 1.7));
+    r.rightStickY = static_cast<uint8_t>(128 + 60 * std::cos(t * 1.3));
+    r.buttons1 = static_cast<uint8_t>((((i / 40) % 16) << 4) | ((i / 25) % 9));
+    return item;
+}
+
+static bool checkSharedKeys() {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    auto step = [&](uint64_t device, uint8_t leftY) {
+        TimedReport item = makeReport(0, leftY);
+        item.report.leftStickX = 128;
+        item.report.rightStickX = item.report.rightStickY = 128;
+        item.report.buttons1 = 0x08;
+        shards.push(device, item);
+        shards.drain([](ControllerShard &c, const TimedReport &r) { c.mapper->processMapping(r.report); c.output->flush(); });
+    };
+    auto countW = [&](bool down) {
+        size_t n = 0;
+        for (const auto &batch : sink.batches)
+            for (const OutputEvent &e : batch) n += e.type == OutputEvent::Key && e.vk == Vk::W && e.down == down;
+        return n;
+    };
+    step(0x100, 0);   // pad 1 pushes up: W down
+    step(0x200, 0);   // pad 2 too: already down, nothing sent
+    step(0x100, 128); // pad 1 lets go: pad 2 still holds W
+    const bool heldByOther = countW(true) == 1 && countW(false) == 0;
+    step(0x200, 128); // pad 2 lets go: W up
+    const bool ok = heldByOther && countW(false) == 1;
+    std::printf("keys      %s (W down %zu, up %zu)\n", ok ? "ok" : "FAIL", countW(true), countW(false));
+    return ok;
+}
+
+// Hold W on `pads` controllers for a second with timers running; returns the W events the
+// system saw while they were held.
+static std::vector<OutputEvent> holdW(int pads) {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    auto step = [&](uint64_t device, uint8_t leftY) {
+        TimedReport item = makeReport(0, leftY);
+        item.report.leftStickX = 128;
+        item.report.rightStickX = item.report.rightStickY = 128;
+        item.report.buttons1 = 0x08;
+        shards.push(device, item);
+        shards.drain([](ControllerShard &c, const TimedReport &r) { c.mapper->processMapping(r.report); c.output->flush(); });
+    };
+    for (int p = 0; p < pads; ++p) step(0x100 * (p + 1), 0);
+    for (int t = 0; t < 1000; t += 5) {
+        clock.advance(std::chrono::milliseconds(5));
+        shards.runTimers();
+    }
+    std::vector<OutputEvent> w;
+    for (const auto &batch : sink.batches)
+        for (const OutputEvent &e : batch)
+            if (e.type == OutputEvent::Key && e.vk == Vk::W) w.push_back(e);
+    return w;
+}
+
+static bool checkRepeats() {
+    auto ups = [](const std::vector<OutputEvent> &w) {
+        size_t n = 0;
+        for (const OutputEvent &e : w) n += !e.down;
+        return n;
+    };
+    const std::vector<OutputEvent> one = holdW(1), two = holdW(2);
+    const bool repeats = ups(one) > 0 && ups(two) == 2 * ups(one) && !two.empty() && two.back().down;
+
+    // the sink alone: pad 1 holds W, pad 2 presses it, repeats it, taps it, lets go; pad 1 lets go
+    RecordingOutputSink rec;
+    SharedInputSink shared(rec);
+    const OutputEvent down = OutputEvent::key(Vk::W, true), up = OutputEvent::key(Vk::W, false);
+    const OutputEvent batches[][2] = { { down, down }, { down, down }, { up, down }, { down, up }, { up, up }, { up, up } };
+    const size_t sizes[] = { 1, 1, 2, 2, 1, 1 };
+    std::string seen;
+    for (int b = 0; b < 6; ++b) {
+        rec.clear();
+        shared.submit(batches[b], sizes[b]);
+        for (const auto &batch : rec.batches)
+            for (const OutputEvent &e : batch) seen += e.down ? 'd' : 'u';
+        seen += ' ';
+    }
+    const bool pairs = seen == "d  ud ud  u ";
+    const bool ok = repeats && pairs;
+    std::printf("repeats   %s (W repeats: one pad %zu, two pads %zu; sink sequence \"%s\")\n", ok ? "ok" : "FAIL",
+                ups(one), ups(two), seen.c_str());
+    return ok;
+}
+
+static bool checkRemoval() {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    auto step = [&](uint64_t device, uint8_t leftY, bool r2) {
+        TimedReport item = makeReport(0, leftY);
+        item.report.leftStickX = 128;
+        item.report.rightStickX = item.report.rightStickY = 128;
+        item.report.buttons1 = 0x08;
+        item.report.rightTrigger = r2 ? 255 : 0;
+        shards.push(device, item);
+    };
+    auto map = [&] {
+        shards.drain([](ControllerShard &c, const TimedReport &r) { c.mapper->processMapping(r.report); c.output->flush(); });
+    };
+    auto count = [&](OutputEvent::Type type, bool down) {
+        size_t n = 0;
+        for (const auto &batch : sink.batches)
+            for (const OutputEvent &e : batch)
+                n += e.type == type && e.down == down && (type != OutputEvent::Key || e.vk == Vk::W);
+        return n;
+    };
+
+    step(0x100, 0, true);      // pad 1: W and the left button
+    step(0x200, 0, false);     // pad 2: W
+    map();
+    shards.remove(0x100);      // pad 1 unplugged mid-press
+    map();
+    const bool released = count(OutputEvent::Key, false) == 0 && count(OutputEvent::MouseButton, false) == 1 &&
+                          shards.count() == 1;
+    step(0x200, 128, false);   // pad 2 lets go: W goes up, nothing holds it any more
+    map();
+    const bool upAfter = count(OutputEvent::Key, false) == 1;
+    shards.remove(0x200);
+    map();
+
+    // fill every shard, then keep replacing one controller with a new handle
+    for (int d = 0; d < ControllerShards::MAX_CONTROLLERS; ++d) step(0x1000 + d, 0, false);
+    map();
+    bool cycled = shards.count() == ControllerShards::MAX_CONTROLLERS;
+    for (int i = 0; i < 40; ++i) {
+        const uint64_t gone = 0x1000 + i, next = 0x1000 + ControllerShards::MAX_CONTROLLERS + i;
+        shards.remove(gone);
+        map();                 // the removal wakes the mapping thread, which frees the shard
+        step(next, 0, true);
+        map();
+        cycled = cycled && shards.count() == ControllerShards::MAX_CONTROLLERS;
+    }
+    for (int d = 0; d < ControllerShards::MAX_CONTROLLERS; ++d) shards.remove(0x1000 + 40 + d);
+    map();
+    cycled = cycled && shards.count() == 0 && shards.unassignedReports() == 0;
+    // everything pressed was released: W by the last of its holders, the button by each removal
+    const bool balanced = count(OutputEvent::Key, true) == count(OutputEvent::Key, false) &&
+                          count(OutputEvent::MouseButton, true) == count(OutputEvent::MouseButton, false);
+
+    const bool ok = released && upAfter && cycled && balanced;
+    std::printf("removal   %s (held by another pad %s, released after %s, 40 reconnects %s, %zu presses %zu releases)\n",
+                ok ? "ok" : "FAIL", released ? "ok" : "FAIL", upAfter ? "ok" : "FAIL", cycled ? "ok" : "FAIL",
+                count(OutputEvent::Key, true) + count(OutputEvent::MouseButton, true),
+                count(OutputEvent::Key, false) + count(OutputEvent::MouseButton, false));
+    return ok;
+}
+
+static bool checkProfiles() {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    ControllerShards shards(sink, ControllerShards::Configure(), clock);
+    const int wired = shards.addDeviceProfile(DeviceMatch::parse("054c:09cc"));
+    const int named = shards.addDeviceProfile(DeviceMatch::parse("BT-PAD"));
+    shards.setIdentify([](uint64_t device) {
+        DeviceInfo d;
+        d.vendorId = 0x054C;
+        d.productId = device == 0x100 ? 0x09CC : 0x05C4;
+        d.path = device == 0x300 ? "/dev/bt-pad0" : "\\\\?\\HID#VID_054C&PID_" + std::string(device == 0x100 ? "09CC" : "05C4");
+        return d;
+    });
+    auto publish = [&](const char *text, int id) {
+        ActionTable t;
+        std::string error;
+        if (parseProfile(text, t, error)) shards.publishProfile(t, id);
+    };
+    publish("[bind]\ncross = \"Q\"\n", wired);
+    publish("[bind]\ncross = \"Z\"\n", named);
+
+    // Cross down and up on `device`; returns the key it typed
+    auto cross = [&](uint64_t device) {
+        sink.clear();
+        for (uint8_t buttons : { 0x28, 0x08 }) {
+            TimedReport item = makeReport(0, 128);
+            item.report.leftStickX = item.report.rightStickX = item.report.rightStickY = 128;
+            item.report.buttons1 = buttons;
+            shards.push(device, item);
+            shards.drain([](ControllerShard &c, const TimedReport &r) { c.mapper->processMapping(r.report); c.output->flush(); });
+        }
+        for (const auto &batch : sink.batches)
+            for (const OutputEvent &e : batch)
+                if (e.type == OutputEvent::Key && e.down) return static_cast<int>(e.vk);
+        return 0;
+    };
+    const bool own = cross(0x100) == 'Q' && cross(0x200) == Vk::SPACE && cross(0x300) == 'Z';
+    publish("[bind]\ncross = \"R\"\n", wired);
+    const bool reloaded = cross(0x100) == 'R' && cross(0x200) == Vk::SPACE && cross(0x300) == 'Z';
+    shards.remove(0x100);
+    shards.drain([](ControllerShard &, const TimedReport &) {});
+    const int next = cross(0x400);   // takes shard 0, which ran the wired profile
+    const bool reused = next == Vk::SPACE && shards.shard(0).device == 0x400;
+
+    const bool ok = own && reloaded && reused;
+    std::printf("profiles  %s (by id, by path and default %s; reload %s; new controller in a freed shard %s)\n",
+                ok ? "ok" : "FAIL", own ? "ok" : "FAIL", reloaded ? "ok" : "FAIL", reused ? "ok" : "FAIL");
+    return ok;
+}
+
+static bool checkFairness() {
+    CountingSink sink;
+    ControllerShards shards(sink);
+    const int quiet = 7, backlog = 200;
+    for (int i = 0; i < backlog; ++i) shards.push(1, makeReport(i));
+    for (int d = 0; d < quiet; ++d) shards.push(100 + d, makeReport(d));
+    size_t position = 0, worst = 0;
+    shards.drain([&](ControllerShard &c, const TimedReport &r) {
+        c.mapper->processMapping(r.report);
+        c.output->flush();
+        ++position;
+        if (c.device != 1) worst = position;
+    });
+    const bool ok = worst <= static_cast<size_t>(quiet + 1);
+    std::printf("fairness  %s (last quiet controller mapped at position %zu of %zu; one shared FIFO: %d)\n",
+                ok ? "ok" : "FAIL", worst, position, backlog + quiet);
+    return ok;
+}
+
+static void mappingCost() {
+    std::printf("scaling   mapping cost with all rings full\n");
+    for (int n : { 1, 2, 4, 8 }) {
+        CountingSink sink;
+        ControllerShards shards(sink);
+        const int perDevice = 200, passes = 100;
+        double ns = 0;
+        size_t reports = 0;
+        for (int p = 0; p < passes; ++p) {
+            for (int i = 0; i < perDevice; ++i)
+                for (int d = 0; d < n; ++d) shards.push(d + 1, makeReport(p * perDevice + i));
+            auto t0 = std::chrono::steady_clock::now();
+            reports += shards.drain([](ControllerShard &c, const TimedReport &r) { c.mapper->processMapping(r.report); c.output->flush(); });
+            ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        }
+        std::printf("  %d controller%s %7.1f ns/report\n", n, n == 1 ? " " : "s", ns / reports);
+    }
+}
+
+// Producer thread plays `quiet` controllers at 1 kHz (plus the bursty one), consumer maps.
+static void queueLatency(int quiet, bool burst) {
+    CountingSink sink;
+    ControllerShards shards(sink);
+    LatencyHistogram quietLatency;
+    std::atomic<bool> running{true};
+
+    std::thread consumer([&] {
+        while (running.load(std::memory_order_relaxed)) {
+            shards.drain([&](ControllerShard &c, const TimedReport &r) {
+                const auto dequeued = std::chrono::steady_clock::now();
+                c.mapper->processMapping(r.report);
+                c.output->flush();
+                if (c.device != 1) quietLatency.record(dequeued - r.received);
+            });
+            std::this_thread::yield();
+        }
+    });
+
+    auto next = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < 1000; ++tick) {
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);
+        if (burst && tick % 10 == 0)
+            for (int i = 0; i < 200; ++i) shards.push(1, makeReport(tick * 200 + i));
+        for (int d = 0; d < quiet; ++d) shards.push(100 + d, makeReport(tick));
+    }
+    running.store(false);
+    consumer.join();
+    std::printf("  %d quiet%s  queue latency p50 %6.1f us  p99 %6.1f us\n", quiet, burst ? " + bursty" : "         ",
+                quietLatency.percentile(0.50) / 1000.0, quietLatency.percentile(0.99) / 1000.0);
+}
+
+int main() {
+    bool ok = checkSharedKeys();
+    ok = checkRepeats() && ok;
+    ok = checkFairness() && ok;
+    ok = checkRemoval() && ok;
+    ok = checkProfiles() && ok;
+    mappingCost();
+    std::printf("latency   quiet controllers at 1 kHz\n");
+    queueLatency(3, false);
+    queueLatency(3, true);
+    queueLatency(7, false);
+    queueLatency(7, true);
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
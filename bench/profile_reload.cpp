@@ -0,0 +1,274 @@
+// Mapping profile reloads: held-key reconciliation, swaps under load, file watching
+// (portable apart from the inotify part, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/profile_reload.cpp -o profile_reload && ./profile_reload
+//
+// Four parts:
+//   reconcile  Cross and stick-up held, then a profile that rebinds Cross and drops W is
+//              swapped in: SPACE and W go up, E goes down, the still-bound arrow stays down
+//              with no release/press in between
+//   stress     a loader thread publishes a new table every 50 us while the mapping thread maps
+//              a random report stream flat out; every key must see strictly alternating
+//              down/up events and nothing may stay down at the end. Mapping cost per report
+//              (p50/p99/max) is printed with and without the reloads; on a single core the
+//              max mostly shows the loader thread preempting the mapping one
+//   watch      ProfileWatcher on a temporary file: rewriting it is picked up, a broken edit is
+//              rejected and the previous table keeps running
+//   cost       ns/report for the built-in table and for one binding every input
+// Exits non-zero if any check fails.
+
+#include "latency_histogram.h"
+#include "profile_watcher.h"
+#include "ps4_mapper.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Checks that every key and mouse button strictly alternates down/up.
+class ValidatingSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            bool *state = e.type == OutputEvent::Key ? &keyDown[e.vk]
+                        : e.type == OutputEvent::MouseButton ? &buttonDown[e.left ? 0 : 1]
+                        : nullptr;
+            if (!state) continue;
+            if (*state == e.down) ++violations;
+            *state = e.down;
+            ++transitions;
+        }
+    }
+    int held() const {
+        int n = buttonDown[0] + buttonDown[1];
+        for (bool d : keyDown) n += d;
+        return n;
+    }
+    std::array<bool, Vk::COUNT> keyDown{};
+    bool buttonDown[2] = { false, false };
+    uint64_t violations = 0;
+    uint64_t transitions = 0;
+};
+
+static ActionTable parsed(const char *text) {
+    ActionTable t;
+    std::string error;
+    if (!parseProfile(text, t, error)) std::fprintf(stderr, "bench profile: %s\n", error.c_str());
+    return t;
+}
+
+static const char *ALT_PROFILE = R"(
+[bind]
+cross = "E"
+square = "SPACE"
+dpad_up = "UP"
+lstick_up = "UP"
+l2 = "mouse_left"
+r2 = "mouse_right"
+options = "toggle_mode"
+[repeat]
+keys = ["UP"]
+delay_ms = 200
+[triggers]
+threshold = 100
+)";
+
+static PS4ControllerReport neutral() {
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+    r.buttons1 = 0x08;
+    return r;
+}
+
+static bool checkReconcile() {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    PS4ControllerReport r = neutral();
+    r.buttons1 = 0x20 | 0x00;   // Cross, D-pad up
+    r.leftStickY = 0;           // stick up: W
+    mapper.processMapping(r);
+    output.flush();
+    sink.clear();
+
+    mapper.setActionTable(std::make_unique<ActionTable>(parsed(ALT_PROFILE)));
+    output.flush();
+    auto has = [&](uint16_t vk, bool down) {
+        for (const auto &batch : sink.batches)
+            for (const OutputEvent &e : batch)
+                if (e.type == OutputEvent::Key && e.vk == vk && e.down == down) return true;
+        return false;
+    };
+    const bool ok = has(Vk::SPACE, false) && has(Vk::W, false) && has(Vk::E, true) &&
+                    !has(Vk::UP, false) && !has(Vk::UP, true);
+    std::printf("reconcile %s (SPACE up %d, W up %d, E down %d, UP untouched %d)\n", ok ? "ok" : "FAIL",
+                has(Vk::SPACE, false), has(Vk::W, false), has(Vk::E, true), !has(Vk::UP, false) && !has(Vk::UP, true));
+    return ok;
+}
+
+static std::vector<PS4ControllerReport> randomStream(size_t n) {
+    std::mt19937 rng(11);
+    std::vector<PS4ControllerReport> reports(n);
+    PS4ControllerReport r = neutral();
+    for (size_t i = 0; i < n; ++i) {
+        switch (rng() % 8) {
+            case 0: r.buttons1 = static_cast<uint8_t>((r.buttons1 & 0xF0) | (rng() % 9)); break;
+            case 1: r.buttons1 ^= static_cast<uint8_t>(0x10 << (rng() % 4)); break;
+            case 2: r.buttons2 ^= static_cast<uint8_t>(1 << (rng() % 8)); break;
+            case 3: r.leftStickX = static_cast<uint8_t>(rng()); break;
+            case 4: r.leftStickY = static_cast<uint8_t>(rng()); break;
+            case 5: r.leftTrigger = static_cast<uint8_t>(rng()); break;
+            case 6: r.rightTrigger = static_cast<uint8_t>(rng()); break;
+            default: break;
+        }
+        r.buttons3 = 0;   // no options presses: stay in one mode so every binding is exercised
+        reports[i] = r;
+    }
+    return reports;
+}
+
+struct StressResult { bool ok; uint64_t swaps; };
+
+static StressResult stress(bool reload) {
+    const std::vector<PS4ControllerReport> stream = randomStream(400000);
+    const ActionTable tables[2] = { ActionTable::defaults(), parsed(ALT_PROFILE) };
+    ValidatingSink sink;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    ProfileExchange exchange;
+    LatencyHistogram cost;
+    std::atomic<bool> running{true};
+
+    std::thread loader([&] {
+        for (int i = 0; reload && running.load(std::memory_order_relaxed); ++i) {
+            exchange.publish(std::make_unique<ActionTable>(tables[i & 1]));
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    });
+    uint64_t swaps = 0;
+    for (const PS4ControllerReport &r : stream) {
+        const auto t0 = std::chrono::steady_clock::now();
+        swaps += mapper.adoptActionTable(exchange);
+        mapper.processMapping(r);
+        output.flush();
+        cost.record(std::chrono::steady_clock::now() - t0);
+    }
+    running.store(false);
+    loader.join();
+    mapper.releaseAllInputs();
+    output.flush();
+
+    const bool ok = sink.violations == 0 && sink.held() == 0;
+    std::printf("  %-14s %6llu swaps  %8llu transitions  violations %llu  held at end %d  "
+                "p50 %5.0f ns  p99 %6.0f ns  max %7.1f us  %s\n",
+                reload ? "with reloads" : "no reloads", static_cast<unsigned long long>(swaps),
+                static_cast<unsigned long long>(sink.transitions), static_cast<unsigned long long>(sink.violations),
+                sink.held(), static_cast<double>(cost.percentile(0.50)), static_cast<double>(cost.percentile(0.99)),
+                cost.maxValue() / 1000.0, ok ? "ok" : "FAIL");
+    return { ok, swaps };
+}
+
+static bool writeFile(const std::string &path, const std::string &text) {
+    // write elsewhere and rename over, the way editors save
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        if (!f) return false;
+        f << text;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static bool checkWatch() {
+    char dirTemplate[] = "/tmp/ds4profileXXXXXX";
+    if (!mkdtemp(dirTemplate)) { std::printf("watch     FAIL (no temp dir)\n"); return false; }
+    const std::string dir = dirTemplate, path = dir + "/test.profile";
+    writeFile(path, "[bind]\ncross = \"SPACE\"\n");
+
+    ProfileExchange exchange;
+    ProfileWatcher watcher;
+    if (!watcher.start(path, [&](const ActionTable &t) { exchange.publish(std::make_unique<ActionTable>(t)); })) {
+        std::printf("watch     FAIL (%s)\n", watcher.lastError().c_str());
+        return false;
+    }
+    RecordingOutputSink sink;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    mapper.adoptActionTable(exchange);
+    const bool initial = mapper.actionTable().bindings[BTN_CROSS].vk == Vk::SPACE;
+
+    // wait on the mapping side, the way the host loop would notice the new table
+    auto waitForTable = [&](std::chrono::milliseconds limit) {
+        const auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < limit) {
+            if (mapper.adoptActionTable(exchange)) return std::chrono::steady_clock::now() - start;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        return std::chrono::steady_clock::duration::max();
+    };
+
+    writeFile(path, "[bind]\ncross = \"E\"\n");
+    const auto latency = waitForTable(std::chrono::milliseconds(2000));
+    const bool reloaded = mapper.actionTable().bindings[BTN_CROSS].vk == Vk::E;
+
+    writeFile(path, "[bind]\ncross = \"NOT_A_KEY\"\n");
+    const auto start = std::chrono::steady_clock::now();
+    while (watcher.rejectedCount() == 0 && std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const bool rejected = watcher.rejectedCount() == 1 && !mapper.adoptActionTable(exchange) &&
+                          mapper.actionTable().bindings[BTN_CROSS].vk == Vk::E;
+    watcher.stop();
+    std::remove(path.c_str());
+    std::remove(dir.c_str());
+
+    const bool ok = initial && reloaded && rejected;
+    std::printf("watch     %s (save -> adopted in %.1f ms incl. %lld ms settle; broken edit rejected: %s)\n",
+                ok ? "ok" : "FAIL", std::chrono::duration<double, std::milli>(latency).count(),
+                static_cast<long long>(std::chrono::milliseconds(50).count()), watcher.lastError().c_str());
+    return ok;
+}
+
+static void mappingCost() {
+    const std::vector<PS4ControllerReport> stream = randomStream(200000);
+    ActionTable everything;
+    for (int i = 0; i < INPUT_COUNT; ++i) everything.bind(i, Action::Key, static_cast<uint16_t>('A' + i));
+    everything.compile();
+    const ActionTable *tables[] = { nullptr, &everything };
+    for (const ActionTable *t : tables) {
+        ValidatingSink sink;
+        OutputBatch output(sink);
+        PS4Mapper mapper(output);
+        if (t) mapper.setActionTable(std::make_unique<ActionTable>(*t));
+        const auto t0 = std::chrono::steady_clock::now();
+        for (const PS4ControllerReport &r : stream) {
+            mapper.processMapping(r);
+            output.flush();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+        std::printf("  %-22s %2d keys  %6.1f ns/report\n", t ? "every input bound" : "built-in profile",
+                    mapper.actionTable().keyCount, ns / stream.size());
+    }
+}
+
+int main() {
+    bool ok = checkReconcile();
+    std::printf("stress    400000 reports\n");
+    ok = stress(false).ok && ok;
+    const StressResult s = stress(true);
+    ok = s.ok && s.swaps > 0 && ok;
+    ok = checkWatch() && ok;
+    std::printf("cost\n");
+    mappingCost();
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
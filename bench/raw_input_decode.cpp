@@ -0,0 +1,78 @@
+// RAWINPUT block decode benchmark (portable, runs on Linux).
+//
+// Decodes a buffer of RAWINPUT records the way the message thread does after GetRawInputBuffer.
+// With no argument a synthetic buffer of DS4 USB records (x64 layout) is generated; with a path
+// the file is taken as a captured GetRawInputBuffer blob. Also counts heap allocations during
+// the timed loop, which must stay at zero.
+//
+//   g++ -std=c++17 -O2 -I. bench/raw_input_decode.cpp -o raw_input_decode
+//   ./raw_input_decode [captured.bin [x86|x64]]
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "bench_common.h"
+#include "raw_input_decode.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+static void put32(std::vector<uint8_t> &b, size_t off, uint32_t v) { std::memcpy(&b[off], &v, 4); }
+
+static std::vector<uint8_t> synthesize(size_t blocks, RawInputLayout layout) {
+    const uint32_t reportSize = 64;
+    const size_t blockSize = layout.headerSize + 8 + reportSize;
+    const size_t stride = (blockSize + layout.blockAlign - 1) & ~(layout.blockAlign - 1);
+    std::vector<uint8_t> buf(stride * blocks, 0);
+    for (size_t i = 0; i < blocks; ++i) {
+        size_t off = i * stride;
+        put32(buf, off, RawInputDecode::TYPE_HID);
+        put32(buf, off + 4, static_cast<uint32_t>(blockSize));
+        put32(buf, off + 8, 0x1234);                          // hDevice (low bits)
+        put32(buf, off + layout.headerSize, reportSize);      // dwSizeHid
+        put32(buf, off + layout.headerSize + 4, 1);           // dwCount
+        uint8_t *rep = &buf[off + layout.headerSize + 8];
+        rep[0] = 0x01; rep[1] = static_cast<uint8_t>(i); rep[2] = 128; rep[3] = 128; rep[4] = 128; rep[5] = 0x08;
+    }
+    return buf;
+}
+
+int main(int argc, char **argv) {
+    RawInputLayout layout = RawInputLayout::x64();
+    std::vector<uint8_t> buf;
+    if (argc > 1) {
+        std::ifstream f(argv[1], std::ios::binary);
+        if (!f) { std::fprintf(stderr, "cannot open %s\n", argv[1]); return 1; }
+        buf.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        if (argc > 2 && std::string(argv[2]) == "x86") layout = RawInputLayout::x86();
+    } else {
+        buf = synthesize(200, layout);
+    }
+
+    uint64_t checksum = 0;
+    auto onReport = [&](uint64_t device, const uint8_t *data, uint32_t len) {
+        checksum += device + data[1] + len;
+    };
+    RawInputDecodeStats st = RawInputDecode::decodeBlocks(buf.data(), buf.size(), SIZE_MAX, layout, onReport);
+    std::printf("buffer %zu bytes: %zu blocks, %zu HID reports, %zu skipped, %zu malformed\n",
+                buf.size(), st.blocks, st.hidReports, st.skipped, st.malformed);
+    if (st.blocks == 0) return 1;
+
+    const int iterations = 20000;
+    size_t allocsBefore = g_allocs.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        RawInputDecode::decodeBlocks(buf.data(), buf.size(), SIZE_MAX, layout, onReport);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    size_t allocs = g_allocs.load() - allocsBefore;
+
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    std::printf("decode: %.1f ns/buffer, %.2f ns/report, heap allocations in loop: %zu (checksum %llu)\n",
+                ns / iterations, ns / (static_cast<double>(iterations) * st.hidReports), allocs,
+                static_cast<unsigned long long>(checksum));
+    return allocs == 0 ? 0 : 1;
+}
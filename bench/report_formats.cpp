@@ -0,0 +1,403 @@
+// Report formats: USB, Bluetooth and basic Bluetooth reports through ReportParser (portable,
+// runs on Linux).
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/report_formats.cpp -o report_formats && ./report_formats [fuzz iterations]
+//
+// For the fuzz part, build it with -fsanitize=address,undefined as well: every fuzzed report
+// sits in a buffer of exactly its length, so a read past the end is reported.
+// Parts:
+//   crc        the slicing-by-8 CRC against a bitwise one on random buffers of every length up
+//              to 200, the standard check value, and the 0xA1 header folded in ahead of time
+//   round trip random USB-layout reports encoded as USB, Bluetooth (78 bytes, and padded to
+//              547 as Windows delivers them) and basic reports parse back to the same bytes;
+//              a fourth Bluetooth touch packet is dropped
+//   corruption every single-bit flip of a Bluetooth report is rejected, or (a flipped id)
+//              never parsed as Bluetooth
+//   fuzz       random lengths and bytes, valid reports mixed in, through one parser: no crash,
+//              accepted reports are well formed, valid ones are never rejected
+//   switching  basic reports then 0x11 on one parser, and ControllerShards taking a USB and a
+//              Bluetooth controller while ignoring a device that sends neither
+//   replay     one scripted session as a USB stream and as a Bluetooth stream, parsed record
+//              by record into captures: both replays through PS4Mapper give the same digest
+//   cost       ns per parse for each format, next to a plain 64-byte copy
+// Exits non-zero if any check fails.
+
+#include "bench_common.h"
+#include "controller_shards.h"
+#include "report_capture.h"
+#include "report_parser.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// ---------- encoders ----------
+
+static std::vector<uint8_t> encodeUsb(const PS4ControllerReport &r) {
+    std::vector<uint8_t> out(sizeof(r));
+    std::memcpy(out.data(), &r, sizeof(r));
+    return out;
+}
+
+// 0x11, two bytes of Bluetooth flags, the USB report's bytes 1..63, padding, CRC at 74..77.
+// `fourthPacket` fills the room a Bluetooth report has after the three USB touch packets.
+static std::vector<uint8_t> encodeBluetooth(const PS4ControllerReport &r, size_t size = 78, const uint8_t *fourthPacket = nullptr) {
+    std::vector<uint8_t> out(size, 0);
+    out[0] = 0x11;
+    out[1] = 0xC0;
+    out[2] = 0x00;
+    std::memcpy(out.data() + 3, reinterpret_cast<const uint8_t *>(&r) + 1, sizeof(r) - 1);
+    if (fourthPacket) std::memcpy(out.data() + 3 + offsetof(PS4ControllerReport, touchPackets) - 1 + 27, fourthPacket, 9);
+    const uint32_t crc = Ds4Crc::bluetoothInput(out.data(), 74);
+    for (int i = 0; i < 4; ++i) out[74 + i] = static_cast<uint8_t>(crc >> (8 * i));
+    return out;
+}
+
+static std::vector<uint8_t> encodeBasic(const PS4ControllerReport &r) {
+    std::vector<uint8_t> out(10);
+    std::memcpy(out.data(), &r, 10);
+    return out;
+}
+
+static PS4ControllerReport randomReport(std::mt19937 &rng) {
+    PS4ControllerReport r;
+    uint8_t *p = reinterpret_cast<uint8_t *>(&r);
+    for (size_t i = 0; i < sizeof(r); ++i) p[i] = static_cast<uint8_t>(rng());
+    r.reportId = 0x01;
+    r.touchPacketCount = static_cast<uint8_t>(rng() % 4);
+    return r;
+}
+
+static bool sameBytes(const PS4ControllerReport &a, const PS4ControllerReport &b) { return std::memcmp(&a, &b, sizeof(a)) == 0; }
+
+// ---------- crc ----------
+
+static uint32_t crcBitwise(const uint8_t *p, size_t len) {
+    uint32_t c = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i) {
+        c ^= p[i];
+        for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+    }
+    return ~c;
+}
+
+static bool checkCrc() {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> buf(201);
+    int bad = 0;
+    for (size_t len = 0; len <= 200; ++len) {
+        for (int round = 0; round < 8; ++round) {
+            for (auto &b : buf) b = static_cast<uint8_t>(rng());
+            if (Ds4Crc::crc32(buf.data() + 1, len) != crcBitwise(buf.data() + 1, len)) ++bad;
+            buf[0] = 0xA1;
+            if (Ds4Crc::bluetoothInput(buf.data() + 1, len) != crcBitwise(buf.data(), len + 1)) ++bad;
+        }
+    }
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    const bool known = Ds4Crc::crc32(check, sizeof(check)) == 0xCBF43926u;
+    std::printf("crc: %s, %d mismatches against the bitwise CRC over lengths 0..200\n",
+                known ? "check value ok" : "check value WRONG", bad);
+    return known && bad == 0;
+}
+
+// ---------- round trip ----------
+
+static bool checkRoundTrip() {
+    std::mt19937 rng(2);
+    int bad = 0;
+    const int n = 20000;
+    for (int i = 0; i < n; ++i) {
+        const PS4ControllerReport r = randomReport(rng);
+        PS4ControllerReport out;
+        ReportParser usb, bt, padded, basic;
+        const auto u = encodeUsb(r), b = encodeBluetooth(r), w = encodeBluetooth(r, 547), s = encodeBasic(r);
+        if (!usb.parse(u.data(), static_cast<uint32_t>(u.size()), out) || !sameBytes(out, r) || usb.format() != ReportFormat::Usb) ++bad;
+        if (!bt.parse(b.data(), static_cast<uint32_t>(b.size()), out) || !sameBytes(out, r) || bt.format() != ReportFormat::Bluetooth) ++bad;
+        if (!padded.parse(w.data(), static_cast<uint32_t>(w.size()), out) || !sameBytes(out, r)) ++bad;
+        PS4ControllerReport expect{};
+        std::memcpy(&expect, &r, 10);
+        if (!basic.parse(s.data(), static_cast<uint32_t>(s.size()), out) || !sameBytes(out, expect) ||
+            basic.format() != ReportFormat::BluetoothBasic) ++bad;
+    }
+
+    // four touch packets: the USB layout keeps the three it has room for
+    PS4ControllerReport r = randomReport(rng);
+    r.touchPacketCount = 3;
+    const uint8_t oldest[9] = { 0x40, 0x80, 0, 0, 0, 0x80, 0, 0, 0 };
+    std::memcpy(r.unknown4, oldest, sizeof(r.unknown4));   // where the fourth packet starts
+    auto four = encodeBluetooth(r, 78, oldest);
+    four[3 + offsetof(PS4ControllerReport, touchPacketCount) - 1] = 4;
+    const uint32_t crc = Ds4Crc::bluetoothInput(four.data(), 74);
+    for (int i = 0; i < 4; ++i) four[74 + i] = static_cast<uint8_t>(crc >> (8 * i));
+    ReportParser p;
+    PS4ControllerReport out;
+    const bool fourOk = p.parse(four.data(), 78, out) && sameBytes(out, r) &&
+                        decodeReport(out).touchFrames == decodeReport(r).touchFrames;
+
+    std::printf("round trip: %d reports x 4 encodings, %d mismatches; four touch packets %s\n", n, bad, fourOk ? "clamped" : "WRONG");
+    return bad == 0 && fourOk;
+}
+
+// ---------- corruption ----------
+
+static bool checkCorruption() {
+    std::mt19937 rng(3);
+    int accepted = 0, asBluetooth = 0, flips = 0;
+    for (int round = 0; round < 16; ++round) {
+        const auto good = encodeBluetooth(randomReport(rng));
+        for (size_t byte = 0; byte < good.size(); ++byte) {
+            for (int bit = 0; bit < 8; ++bit) {
+                auto bad = good;
+                bad[byte] ^= static_cast<uint8_t>(1u << bit);
+                ReportParser p;
+                PS4ControllerReport out;
+                const bool ok = p.parse(bad.data(), static_cast<uint32_t>(bad.size()), out);
+                ++flips;
+                if (byte == 0) {
+                    // 0x11 ^ 0x10 is the USB id, and a 78-byte report of it is a USB report
+                    asBluetooth += ok && p.format() == ReportFormat::Bluetooth;
+                } else {
+                    accepted += ok;
+                }
+            }
+        }
+    }
+    std::printf("corruption: %d single-bit flips, %d accepted, %d flipped ids parsed as Bluetooth\n", flips, accepted, asBluetooth);
+    return accepted == 0 && asBluetooth == 0;
+}
+
+// ---------- fuzz ----------
+
+static bool checkFuzz(int iterations) {
+    std::mt19937 rng(4);
+    ReportParser parser;
+    int accepted = 0, validRejected = 0, malformed = 0;
+    for (int i = 0; i < iterations; ++i) {
+        const uint32_t kind = rng() % 8;
+        std::vector<uint8_t> bytes;
+        bool valid = false;
+        if (kind == 0) { bytes = encodeBluetooth(randomReport(rng)); valid = true; }
+        else if (kind == 1) { bytes = encodeUsb(randomReport(rng)); valid = true; }
+        else if (kind == 2) { bytes = encodeBasic(randomReport(rng)); valid = true; }
+        else {
+            bytes.resize(rng() % 100);
+            for (auto &b : bytes) b = static_cast<uint8_t>(rng());
+            const uint8_t ids[] = { 0x01, 0x11, 0x05, 0x00 };
+            if (!bytes.empty() && kind < 6) bytes[0] = ids[rng() % 4];
+        }
+        // exactly the report's length on the heap, so a sanitizer sees any overread
+        std::unique_ptr<uint8_t[]> data(new uint8_t[bytes.size() + (bytes.empty() ? 1 : 0)]);
+        if (!bytes.empty()) std::memcpy(data.get(), bytes.data(), bytes.size());
+        PS4ControllerReport out;
+        const bool ok = parser.parse(data.get(), static_cast<uint32_t>(bytes.size()), out);
+        if (valid && !ok) ++validRejected;
+        if (ok) {
+            ++accepted;
+            if (out.reportId != 0x01 || out.touchPacketCount > MAX_TOUCH_FRAMES ||
+                parser.format() != ReportParser::formatOf(data.get(), static_cast<uint32_t>(bytes.size()))) ++malformed;
+        }
+    }
+    std::printf("fuzz: %d reports, %d accepted, %llu rejected, %llu format changes; %d valid rejected, %d malformed\n",
+                iterations, accepted, static_cast<unsigned long long>(parser.rejected()),
+                static_cast<unsigned long long>(parser.formatChanges()), validRejected, malformed);
+    return validRejected == 0 && malformed == 0 && parser.rejected() == static_cast<uint64_t>(iterations - accepted);
+}
+
+// ---------- switching ----------
+
+static bool checkSwitching() {
+    std::mt19937 rng(5);
+    ReportParser p;
+    PS4ControllerReport out;
+    bool ok = true;
+    for (int i = 0; i < 5; ++i) {
+        const auto b = encodeBasic(randomReport(rng));
+        ok = ok && p.parse(b.data(), 10, out);
+    }
+    ok = ok && p.format() == ReportFormat::BluetoothBasic;
+    for (int i = 0; i < 5; ++i) {
+        const PS4ControllerReport r = randomReport(rng);
+        const auto b = encodeBluetooth(r);
+        ok = ok && p.parse(b.data(), 78, out) && sameBytes(out, r);
+    }
+    ok = ok && p.format() == ReportFormat::Bluetooth && p.formatChanges() == 1 && p.rejected() == 0;
+
+    // a USB pad, a Bluetooth pad and a device that is neither
+    DigestSink sink;
+    ControllerShards shards(sink);
+    std::vector<PS4ControllerReport> sent;
+    const uint8_t other[20] = { 0x05 };
+    const auto t = Clock::now();
+    for (int i = 0; i < 10; ++i) {
+        const PS4ControllerReport r = randomReport(rng);
+        sent.push_back(r);
+        const auto u = encodeUsb(r), b = encodeBluetooth(r);
+        ok = ok && shards.push(1, t, u.data(), 64) && shards.push(2, t, b.data(), 78) && !shards.push(3, t, other, sizeof(other));
+    }
+    auto bad = encodeBluetooth(sent[0]);
+    bad[20] ^= 1;
+    ok = ok && !shards.push(2, t, bad.data(), 78);
+    std::vector<PS4ControllerReport> got[2];
+    shards.drain([&](ControllerShard &s, const TimedReport &item) { got[s.index].push_back(item.report); });
+    bool same = got[0].size() == sent.size() && got[1].size() == sent.size();
+    for (size_t i = 0; same && i < sent.size(); ++i) same = sameBytes(got[0][i], sent[i]) && sameBytes(got[1][i], sent[i]);
+    ok = ok && same && shards.count() == 2 && shards.unrecognizedReports() == 10 && shards.rejectedReports() == 1 &&
+         shards.shard(0).parser.format() == ReportFormat::Usb && shards.shard(1).parser.format() == ReportFormat::Bluetooth;
+    std::printf("switching: basic -> Bluetooth %s; shards: %d controllers, %llu unrecognized, %llu rejected, reports %s\n",
+                p.format() == ReportFormat::Bluetooth ? "ok" : "WRONG", shards.count(),
+                static_cast<unsigned long long>(shards.unrecognizedReports()),
+                static_cast<unsigned long long>(shards.rejectedReports()), same ? "identical" : "DIFFER");
+    return ok;
+}
+
+// ---------- replay ----------
+
+// 30 s at 250 Hz: sticks, buttons, triggers, gyro turns and touchpad strokes of 1-3 frames per report.
+static std::vector<PS4ControllerReport> scriptedSession() {
+    std::mt19937 rng(6);
+    std::vector<PS4ControllerReport> out;
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+    r.buttons1 = 0x08;
+    r.battery = 0x0B;
+    uint8_t touchCounter = 0;
+    for (int i = 0; i < 7500; ++i) {
+        const int phase = (i / 250) % 6;
+        const double t = i * 0.004;
+        r.leftStickY = static_cast<uint8_t>(phase == 0 ? 20 : 128);
+        r.leftStickX = static_cast<uint8_t>(phase == 1 ? 128 + 120 * std::sin(t * 3) : 128);
+        r.rightStickX = static_cast<uint8_t>(phase == 2 ? 128 + 100 * std::cos(t * 4) : 128);
+        r.rightStickY = static_cast<uint8_t>(phase == 2 ? 128 + 100 * std::sin(t * 4) : 128);
+        r.buttons1 = static_cast<uint8_t>((phase == 3 && i % 60 < 20 ? 0x20 : 0) | (phase == 3 && i % 90 < 30 ? 0x02 : 0x08));
+        r.buttons2 = static_cast<uint8_t>(phase == 4 && i % 500 == 0 ? 0x20 : 0);
+        r.rightTrigger = static_cast<uint8_t>(phase == 3 ? (i * 7) & 0xFF : 0);
+        const int16_t yaw = static_cast<int16_t>(phase == 4 ? 900 : static_cast<int>(rng() % 7) - 3);
+        r.gyroY[0] = static_cast<uint8_t>(yaw);
+        r.gyroY[1] = static_cast<uint8_t>(static_cast<uint16_t>(yaw) >> 8);
+        r.accelY[0] = 0x00; r.accelY[1] = 0x20;
+        r.timestamp[0] = static_cast<uint8_t>(i * 750);
+        r.timestamp[1] = static_cast<uint8_t>((i * 750) >> 8);
+        const bool touching = phase == 5 && i % 250 < 120;
+        r.touchPacketCount = static_cast<uint8_t>(1 + i % 3);
+        for (int k = 0; k < r.touchPacketCount; ++k) {
+            uint8_t *p = r.touchPackets[k];
+            if (touching) ++touchCounter;
+            p[0] = touchCounter;
+            const int x = 600 + (i % 250) * 5 + k, y = 450;
+            p[1] = static_cast<uint8_t>((touching ? 0 : 0x80) | 3);
+            p[2] = static_cast<uint8_t>(x & 0xFF);
+            p[3] = static_cast<uint8_t>(((x >> 8) & 0x0F) | ((y & 0x0F) << 4));
+            p[4] = static_cast<uint8_t>(y >> 4);
+            p[5] = 0x84;
+        }
+        out.push_back(r);
+    }
+    return out;
+}
+
+// Parse a byte stream of fixed-size records, as hidraw_source.h cuts a FIFO, into a capture.
+static bool streamToCapture(const std::vector<uint8_t> &stream, uint32_t recordBytes, const std::string &path, ReportParser &parser) {
+    ReportCaptureWriter capture;
+    if (!capture.open(path)) return false;
+    const auto base = ClockSource::time_point{};
+    for (size_t off = 0, i = 0; off + recordBytes <= stream.size(); off += recordBytes, ++i) {
+        PS4ControllerReport r;
+        if (parser.parse(stream.data() + off, recordBytes, r)) capture.write(base + std::chrono::milliseconds(4 * i), r);
+    }
+    capture.close();
+    return true;
+}
+
+static uint64_t replayDigest(const std::string &path, uint64_t &events) {
+    ReportCaptureFile file;
+    if (!file.open(path)) return 0;
+    DigestSink sink;
+    ManualClockSource clock;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    mapper.setGyroAim(true);
+    mapper.setTrackpad(true);
+    output.flush();
+    replayCapture(file, mapper, output, clock, false, true);
+    events = sink.submitted;
+    return sink.digest;
+}
+
+static bool checkReplay() {
+    const std::vector<PS4ControllerReport> session = scriptedSession();
+    std::vector<uint8_t> usb, bt;
+    for (const PS4ControllerReport &r : session) {
+        const auto u = encodeUsb(r), b = encodeBluetooth(r);
+        usb.insert(usb.end(), u.begin(), u.end());
+        bt.insert(bt.end(), b.begin(), b.end());
+    }
+    const std::string usbPath = "/tmp/report_formats_usb.ds4cap", btPath = "/tmp/report_formats_bt.ds4cap";
+    ReportParser usbParser, btParser;
+    if (!streamToCapture(usb, 64, usbPath, usbParser) || !streamToCapture(bt, 78, btPath, btParser)) {
+        std::printf("replay: cannot write captures in /tmp\n");
+        return false;
+    }
+    uint64_t usbEvents = 0, btEvents = 0;
+    const uint64_t usbDigest = replayDigest(usbPath, usbEvents), btDigest = replayDigest(btPath, btEvents);
+    std::remove(usbPath.c_str());
+    std::remove(btPath.c_str());
+    const bool same = usbDigest == btDigest && usbEvents == btEvents && usbEvents > 0 &&
+                      usbParser.rejected() == 0 && btParser.rejected() == 0;
+    std::printf("replay: %zu reports, USB %llu events digest %016llx, Bluetooth %llu events digest %016llx: %s\n",
+                session.size(), static_cast<unsigned long long>(usbEvents), static_cast<unsigned long long>(usbDigest),
+                static_cast<unsigned long long>(btEvents), static_cast<unsigned long long>(btDigest), same ? "same" : "DIFFER");
+    return same;
+}
+
+// ---------- cost ----------
+
+template <typename F>
+static double nsPer(int n, F &&f) {
+    const auto t0 = Clock::now();
+    for (int i = 0; i < n; ++i) f(i);
+    return std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / n;
+}
+
+static void printCost() {
+    std::mt19937 rng(7);
+    const int kinds = 64, n = 2000000;
+    std::vector<std::vector<uint8_t>> usb, bt, basic;
+    for (int i = 0; i < kinds; ++i) {
+        const PS4ControllerReport r = randomReport(rng);
+        usb.push_back(encodeUsb(r));
+        bt.push_back(encodeBluetooth(r));
+        basic.push_back(encodeBasic(r));
+    }
+    volatile uint8_t sinkByte = 0;
+    PS4ControllerReport out;
+    ReportParser pu, pb, ps;
+    const double copy = nsPer(n, [&](int i) { std::memcpy(&out, usb[i & (kinds - 1)].data(), 64); sinkByte = out.leftStickX; });
+    const double u = nsPer(n, [&](int i) { pu.parse(usb[i & (kinds - 1)].data(), 64, out); sinkByte = out.leftStickX; });
+    const double b = nsPer(n, [&](int i) { pb.parse(bt[i & (kinds - 1)].data(), 78, out); sinkByte = out.leftStickX; });
+    const double s = nsPer(n, [&](int i) { ps.parse(basic[i & (kinds - 1)].data(), 10, out); sinkByte = out.leftStickX; });
+    const double bitwise = nsPer(n / 20, [&](int i) { sinkByte = static_cast<uint8_t>(crcBitwise(bt[i & (kinds - 1)].data(), 74)); });
+    std::printf("cost per report: copy %.1f ns, USB %.1f ns, Bluetooth %.1f ns (bitwise CRC alone %.1f ns), basic %.1f ns\n",
+                copy, u, b, bitwise, s);
+}
+
+int main(int argc, char **argv) {
+    const int fuzzIterations = argc > 1 ? std::atoi(argv[1]) : 200000;
+    bool ok = checkCrc();
+    ok = checkRoundTrip() && ok;
+    ok = checkCorruption() && ok;
+    ok = checkFuzz(fuzzIterations > 0 ? fuzzIterations : 200000) && ok;
+    ok = checkSwitching() && ok;
+    ok = checkReplay() && ok;
+    printCost();
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+// Shared-memory state publication: writer cost, reader throughput and seqlock consistency
+// (Linux: POSIX shared memory).
+//
+//   g++ -std=c++17 -O2 -pthread -I. bench/shared_state.cpp -o shared_state && ./shared_state [seconds]
+//
+// The writer is SharedStatePublisher on a temporary named region; readers map it read-only
+// with shm_open/mmap and read it through ds4_shared_state.h, the way another process would.
+// Every published report encodes its sequence number in the sticks, triggers, timestamp and
+// motion bytes, so each copy a reader accepts can be checked for a mix of two reports.
+// Three parts:
+//   publish      ns per publish() with no readers (p50/p99/max), and heap allocations (must be 0)
+//   contention   the writer publishing flat out for a while with 0, 1 and 3 state readers
+//                spinning on the same slot plus one reader following the ring: writer CPU ns
+//                per publish, reads per second, retries per read, torn copies accepted (must be 0),
+//                ring reports followed in order (gaps only where counted as lost)
+//   latency      publishing at 1 kHz with a reader polling the slot: publish-to-read p50/p99
+// Exits non-zero if any check fails.
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "bench_common.h"
+#include "latency_histogram.h"
+#include "shared_state.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// ---------- reports that carry their own sequence number ----------
+
+// Report k carries the low 16 bits of k; received_ns carries all of it.
+static PS4ControllerReport encodedReport(uint32_t k) {
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = static_cast<uint8_t>(k);
+    r.leftStickY = static_cast<uint8_t>(k >> 8);
+    r.rightStickX = r.rightStickY = 128;
+    r.buttons1 = 0x08;
+    r.leftTrigger = static_cast<uint8_t>(k * 3);
+    r.rightTrigger = static_cast<uint8_t>(k * 5);
+    r.timestamp[0] = static_cast<uint8_t>(k);
+    r.timestamp[1] = static_cast<uint8_t>(k >> 8);
+    r.gyroX[0] = static_cast<uint8_t>(k >> 8);
+    r.gyroX[1] = static_cast<uint8_t>(k);
+    r.accelZ[0] = static_cast<uint8_t>(~k);
+    r.accelZ[1] = static_cast<uint8_t>(~k >> 8);
+    r.touchPacketCount = 1;
+    r.touchPackets[0][0] = static_cast<uint8_t>(k * 7);
+    r.touchPackets[0][1] = 0x80;
+    r.touchPackets[0][5] = 0x80;
+    return r;
+}
+
+// The sequence number a state was published from, or -1 if its fields disagree.
+static int64_t decodedSequence(const ds4_shm_state &s) {
+    const uint64_t k = s.received_ns;
+    const bool consistent = s.reports == k + 1 && s.left_x == static_cast<uint8_t>(k) && s.left_y == static_cast<uint8_t>(k >> 8) &&
+                            s.right_x == 128 && s.left_trigger == static_cast<uint8_t>(k * 3) &&
+                            s.right_trigger == static_cast<uint8_t>(k * 5) && s.timestamp == static_cast<uint16_t>(k) &&
+                            s.gyro[0] == static_cast<int16_t>(((k & 0xFF) << 8) | ((k >> 8) & 0xFF)) &&
+                            s.accel[2] == static_cast<int16_t>(static_cast<uint16_t>(~k)) &&
+                            s.touch[0].counter == static_cast<uint8_t>(k * 7);
+    return consistent ? int64_t(k) : -1;
+}
+
+static std::vector<PS4ControllerReport> encodedReports() {
+    std::vector<PS4ControllerReport> reports;
+    for (uint32_t k = 0; k < 65536; ++k) reports.push_back(encodedReport(k));
+    return reports;
+}
+
+static bool sameReport(const ds4_shm_report &e, const std::vector<PS4ControllerReport> &reports, uint32_t k) {
+    return std::memcmp(e.data, &reports[k & 0xFFFF], sizeof(e.data)) == 0 && e.received_ns == k;
+}
+
+static const ds4_shm_region *mapReadOnly(const std::string &name) {
+    const int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0) return nullptr;
+    void *p = mmap(nullptr, sizeof(ds4_shm_region), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return p == MAP_FAILED ? nullptr : static_cast<const ds4_shm_region *>(p);
+}
+
+static Clock::time_point fakeTime(uint32_t k) { return Clock::time_point(std::chrono::nanoseconds(k)); }
+
+// ---------- parts ----------
+
+static bool publishCost(SharedStatePublisher &pub) {
+    LatencyHistogram h;
+    const std::vector<PS4ControllerReport> reports = encodedReports();
+    const size_t allocsBefore = g_allocs.load();
+    const int rounds = 2000000;
+    auto t0 = Clock::now();
+    for (int i = 0; i < rounds; ++i) pub.publish(0, fakeTime(i), reports[i & 0xFFFF], 0);
+    const double flatNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+    for (int i = 0; i < 200000; ++i) {
+        const auto a = Clock::now();
+        pub.publish(1, fakeTime(i), reports[i & 0xFFFF], 0);
+        h.record(Clock::now() - a);
+    }
+    const size_t allocs = g_allocs.load() - allocsBefore;
+    std::printf("publish     %.1f ns per report back to back; timed one by one p50 %llu ns  p99 %llu ns  max %.1f us; %zu allocations\n",
+                flatNs, static_cast<unsigned long long>(h.percentile(0.50)), static_cast<unsigned long long>(h.percentile(0.99)),
+                h.maxValue() / 1000.0, allocs);
+    return allocs == 0;
+}
+
+struct ReaderStats {
+    uint64_t reads = 0, tries = 0, torn = 0, backwards = 0;
+    char pad[32];   // keeps the readers' counters from sharing a cache line
+};
+
+static bool contention(SharedStatePublisher &pub, const std::string &name, int stateReaders, double seconds) {
+    pub.open(name);
+    const ds4_shm_region *view = mapReadOnly(name);
+    if (!view || !ds4_shm_valid(view, sizeof(ds4_shm_region))) {
+        std::printf("cannot map %s read-only\n", name.c_str());
+        return false;
+    }
+    std::atomic<bool> stop{false}, started{false};
+    std::vector<ReaderStats> stats(static_cast<size_t>(stateReaders));
+    const std::vector<PS4ControllerReport> reports = encodedReports();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < stateReaders; ++t) {
+        threads.emplace_back([&, t] {
+            ReaderStats &st = stats[static_cast<size_t>(t)];
+            int64_t last = -1;
+            while (!stop.load(std::memory_order_relaxed)) {
+                ds4_shm_state s;
+                // count the attempts ds4_shm_read_state makes by doing its loop here
+                const ds4_shm_controller &c = view->controllers[0];
+                const uint32_t before = ds4_shm_load_acquire(&c.seq);
+                ++st.tries;
+                if (before == 0 || (before & 1u)) continue;
+                std::memcpy(&s, &c.state, sizeof(s));
+                ds4_shm_fence_acquire();
+                if (ds4_shm_load_relaxed(&c.seq) != before) continue;
+                ++st.reads;
+                const int64_t k = decodedSequence(s);
+                if (k < 0) ++st.torn;
+                else if (k < last) ++st.backwards;
+                else last = k;
+            }
+        });
+    }
+    // ring follower
+    uint64_t followed = 0, lost = 0, outOfOrder = 0;
+    threads.emplace_back([&] {
+        while (!started.load()) {}
+        uint32_t cursor = ds4_shm_ring_head(view);
+        ds4_shm_report e;
+        while (!stop.load(std::memory_order_relaxed)) {
+            const uint32_t expect = cursor;
+            const uint64_t lostBefore = lost;
+            if (!ds4_shm_next_report(view, &cursor, &e, &lost)) continue;
+            // the report copied is the one just before the advanced cursor
+            const uint32_t k = cursor - 1;
+            if (!sameReport(e, reports, k) || (lost == lostBefore && k != expect)) ++outOfOrder;
+            ++followed;
+        }
+    });
+
+    started = true;
+    uint32_t k = 0;
+    const double cpu0 = threadCpuSeconds();
+    const auto end = Clock::now() + std::chrono::duration<double>(seconds);
+    while (Clock::now() < end) {
+        for (int i = 0; i < 4096; ++i, ++k) pub.publish(0, fakeTime(k), reports[k & 0xFFFF], 0);
+    }
+    // CPU time, so that on a machine with fewer cores than threads the readers' time slices
+    // don't count as the writer's
+    const double writerNs = (threadCpuSeconds() - cpu0) * 1e9 / k;
+    stop = true;
+    for (std::thread &t : threads) t.join();
+    munmap(const_cast<ds4_shm_region *>(view), sizeof(ds4_shm_region));
+
+    ReaderStats sum;
+    for (const ReaderStats &st : stats) {
+        sum.reads += st.reads;
+        sum.tries += st.tries;
+        sum.torn += st.torn;
+        sum.backwards += st.backwards;
+    }
+    const double elapsed = seconds;
+    std::printf("  %d state reader%s  writer %6.1f ns CPU/publish", stateReaders, stateReaders == 1 ? " " : "s", writerNs);
+    if (stateReaders) {
+        std::printf("  reads %6.1f M/s  %.2f tries/read  torn %llu", sum.reads / elapsed / 1e6,
+                    sum.reads ? double(sum.tries) / sum.reads : 0.0, static_cast<unsigned long long>(sum.torn));
+    }
+    std::printf("  ring followed %llu, lost %llu, bad %llu\n", static_cast<unsigned long long>(followed),
+                static_cast<unsigned long long>(lost), static_cast<unsigned long long>(outOfOrder));
+    return sum.torn == 0 && sum.backwards == 0 && outOfOrder == 0;
+}
+
+static void publishLatency(SharedStatePublisher &pub, const std::string &name, int reports) {
+    pub.open(name);
+    const ds4_shm_region *view = mapReadOnly(name);
+    std::atomic<bool> stop{false};
+    LatencyHistogram h;
+    std::thread reader([&] {
+        uint64_t seen = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            ds4_shm_state s;
+            if (ds4_shm_read_state(view, 0, &s) != 1 || s.reports == seen) continue;
+            const uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now().time_since_epoch()).count());
+            seen = s.reports;
+            h.record(now - s.received_ns);
+        }
+    });
+    auto next = Clock::now();
+    for (int i = 0; i < reports; ++i) {
+        next += std::chrono::milliseconds(1);
+        std::this_thread::sleep_until(next);   // like the mapper, which waits for the next report
+        pub.publish(0, Clock::now(), encodedReport(static_cast<uint32_t>(i)), 0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    stop = true;
+    reader.join();
+    munmap(const_cast<ds4_shm_region *>(view), sizeof(ds4_shm_region));
+    std::printf("latency     1 kHz, reader polling: publish to read p50 %llu ns  p99 %llu ns  max %.1f us (%llu of %d seen)\n",
+                static_cast<unsigned long long>(h.percentile(0.50)), static_cast<unsigned long long>(h.percentile(0.99)),
+                h.maxValue() / 1000.0, static_cast<unsigned long long>(h.count()), reports);
+}
+
+int main(int argc, char **argv) {
+    const double seconds = argc > 1 ? (std::max)(0.1, std::atof(argv[1])) : 1.0;
+    const std::string name = "ds4bench-" + std::to_string(getpid());
+    SharedStatePublisher pub;
+    if (!pub.open(name)) {
+        std::printf("%s\n", pub.lastError().c_str());
+        return 1;
+    }
+    std::printf("region      %zu bytes: %d controller slots, %u-report ring\n", sizeof(ds4_shm_region),
+                DS4_SHM_MAX_CONTROLLERS, DS4_SHM_RING_SIZE);
+    bool ok = publishCost(pub);
+    std::printf("contention  writer flat out for %.1f s per row, %u cores%s\n", seconds, std::thread::hardware_concurrency(),
+                std::thread::hardware_concurrency() < 2 ? " (readers and writer take turns)" : "");
+    for (int readers : { 0, 1, 3 }) ok = contention(pub, name, readers, seconds) && ok;
+    publishLatency(pub, name, 2000);
+    pub.close();
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+// Key-repeat timing: how the host loop waits for the mapper's next deadline (Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/timer_jitter.cpp -o timer_jitter && ./timer_jitter [seconds]
+//
+// The left stick and the D-pad are held, so W and UP auto-repeat through the real PS4Mapper
+// on the real clock, with a 20 ms repeat interval to collect more samples per second. The
+// mapping thread waits for the next deadline three ways:
+//   poll 8 ms       sleep 8 ms, then run whatever is due (the original PS4VisualizerMapper loop)
+//   epoll ms        epoll_wait with the deadline rounded up to whole milliseconds as the
+//                   timeout (the event-driven loop before the timer queue)
+//   timerfd         a timerfd armed at the absolute deadline, as linux_main does now
+// For each: timer lateness (deadline -> fired, p50/p99/max) and repeat-interval jitter
+// (|interval between consecutive presses of one key - 20 ms|). The last part compares the cost
+// of finding the next deadline with the heap against a scan of every key slot.
+
+#include "latency_histogram.h"
+#include "ps4_mapper.h"
+#include "timer_queue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Interval between consecutive presses of each repeating key, against the nominal interval.
+class RepeatSink : public OutputSink {
+public:
+    explicit RepeatSink(Clock::duration interval) : nominal(interval) {}
+    void submit(const OutputEvent *events, size_t count) override {
+        const auto now = Clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            if (e.type != OutputEvent::Key || !e.down) continue;
+            if (pressed[e.vk] && repeating[e.vk]) {
+                const auto d = (now - lastPress[e.vk]) - nominal;
+                jitter.record(d < Clock::duration::zero() ? -d : d);
+            }
+            repeating[e.vk] = pressed[e.vk];   // the first interval includes the repeat delay
+            pressed[e.vk] = true;
+            lastPress[e.vk] = now;
+        }
+    }
+    LatencyHistogram jitter;
+
+private:
+    Clock::duration nominal;
+    bool pressed[Vk::COUNT] = {};
+    bool repeating[Vk::COUNT] = {};
+    Clock::time_point lastPress[Vk::COUNT];
+};
+
+enum WaitMode { POLL_8MS, EPOLL_MS, TIMERFD };
+
+static void run(WaitMode how, std::chrono::seconds duration) {
+    const auto interval = std::chrono::milliseconds(20);
+    RepeatSink sink(interval);
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    auto table = std::make_unique<ActionTable>(ActionTable::defaults());
+    table->repeatDelayMs = 100;
+    table->repeatIntervalMs = static_cast<int>(interval.count());
+    mapper.setActionTable(std::move(table));
+
+    PS4ControllerReport r{};
+    r.reportId = 0x01;
+    r.leftStickX = r.rightStickX = r.rightStickY = 128;
+    r.leftStickY = 0;     // stick up: W
+    r.buttons1 = 0x00;    // D-pad up: UP
+    mapper.processMapping(r);
+    output.flush();
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    const int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+    LatencyHistogram lateness;
+    const auto end = Clock::now() + duration;
+    while (Clock::now() < end) {
+        const auto deadline = mapper.nextTimerDeadline().value_or(end);
+        if (how == POLL_8MS) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(8));
+        } else if (how == EPOLL_MS) {
+            const auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - Clock::now());
+            epoll_event out;
+            epoll_wait(epfd, &out, 1, static_cast<int>((std::max)(wait.count(), static_cast<decltype(wait.count())>(0))));
+        } else {
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+            itimerspec spec{};
+            spec.it_value.tv_sec = ns / 1000000000;
+            spec.it_value.tv_nsec = ns % 1000000000;
+            timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, nullptr);
+            epoll_event out;
+            if (epoll_wait(epfd, &out, 1, -1) == 1) {
+                uint64_t expirations;
+                (void)!read(tfd, &expirations, sizeof(expirations));
+            }
+        }
+        mapper.runTimers(&lateness);
+        output.flush();
+    }
+    mapper.releaseAllInputs();
+    output.flush();
+    close(tfd);
+    close(epfd);
+
+    static const char *names[] = { "poll 8 ms", "epoll ms", "timerfd" };
+    auto us = [](uint64_t ns) { return ns / 1000.0; };
+    std::printf("  %-10s %5llu repeats  lateness p50 %7.1f us  p99 %7.1f us  max %7.1f us  |  "
+                "jitter p50 %7.1f us  p99 %7.1f us  max %7.1f us\n",
+                names[how], static_cast<unsigned long long>(lateness.count()),
+                us(lateness.percentile(0.50)), us(lateness.percentile(0.99)), us(lateness.maxValue()),
+                us(sink.jitter.percentile(0.50)), us(sink.jitter.percentile(0.99)), us(sink.jitter.maxValue()));
+}
+
+// Re-arm the earliest timer and find the next deadline: heap vs a scan of every key slot.
+static void lookupCost() {
+    using time_point = ClockSource::time_point;
+    std::mt19937 rng(5);
+    TimerQueue<Vk::COUNT> queue;
+    time_point slots[Vk::COUNT];
+    bool armed[Vk::COUNT] = {};
+    const time_point base = Clock::now();
+    for (int pending : { 2, 8, 64 }) {
+        queue.clear();
+        for (bool &a : armed) a = false;
+        for (int i = 0; i < pending; ++i) {
+            const int id = static_cast<int>(rng() % Vk::COUNT);
+            slots[id] = base + std::chrono::microseconds(rng() % 100000);
+            armed[id] = true;
+            queue.schedule(id, slots[id]);
+        }
+        const int rounds = 2000000;
+        volatile int64_t sink = 0;
+        auto t0 = Clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            // re-arm the earliest one, like a repeat firing, then look up the next deadline
+            const int id = queue.popDue(time_point::max());
+            queue.schedule(id, queue.deadlineOf(id) + std::chrono::microseconds(100000 + (i & 63)));
+            sink = sink + queue.nextDeadline()->time_since_epoch().count();
+        }
+        const double heapNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+        t0 = Clock::now();
+        for (int i = 0; i < rounds; ++i) {
+            int first = -1;
+            for (int vk = 0; vk < Vk::COUNT; ++vk)
+                if (armed[vk] && (first < 0 || slots[vk] < slots[first])) first = vk;
+            slots[first] += std::chrono::microseconds(100000 + (i & 63));
+            sink = sink + slots[first].time_since_epoch().count();
+        }
+        const double scanNs = std::chrono::duration<double, std::nano>(Clock::now() - t0).count() / rounds;
+        std::printf("  %2d pending  heap %6.1f ns  scan %6.1f ns\n", pending, heapNs, scanNs);
+    }
+}
+
+int main(int argc, char **argv) {
+    const std::chrono::seconds duration(argc > 1 ? std::atoi(argv[1]) : 3);
+    std::printf("repeat every 20 ms, W and UP held, %lld s each\n", static_cast<long long>(duration.count()));
+    run(POLL_8MS, duration);
+    run(EPOLL_MS, duration);
+    run(TIMERFD, duration);
+    std::printf("next-deadline lookup (schedule + peek)\n");
+    lookupCost();
+    return 0;
+}
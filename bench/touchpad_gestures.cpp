@@ -0,0 +1,162 @@
+// Trackpad gesture check through capture replay (portable, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/touchpad_gestures.cpp -o touchpad_gestures && ./touchpad_gestures
+//
+// Writes a capture of scripted touch gestures at the DS4's 250 Hz USB rate, three touch frames
+// per report, to touchpad_gestures.ds4cap, then replays it through PS4Mapper in trackpad mode
+// exactly as tools/replay.cpp does and checks what each gesture produced:
+//   flick         a swipe that starts and ends within two reports: motion from every frame
+//                 (taking only each report's last frame would see no motion at all)
+//   swipe         a long one-finger drag: the full distance, no click
+//   scroll        two fingers moving up: two wheel notches up, no pointer motion
+//   tap / 2-tap   left click / right click
+//   long press    held past the tap time: no click
+// Exits non-zero if any gesture is wrong. `./replay touchpad_gestures.ds4cap --trackpad`
+// replays the same file.
+
+#include "bench_common.h"
+#include "report_capture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+struct Finger { bool down; uint8_t id; int x, y; };
+
+class GestureScript {
+public:
+    // One touch frame. Three frames make a report; time advances 4 ms per report.
+    void frame(Finger a, Finger b = { false, 0, 0, 0 }) {
+        pending.push_back({ a, b });
+        if (pending.size() == MAX_TOUCH_FRAMES) emit();
+    }
+    void idle(int ms) {
+        while (!pending.empty()) frame({ false, 0, 0, 0 });
+        for (int t = 0; t < ms; t += 4) emit();
+    }
+    // Capture time (ms) of the next report, for marking gesture boundaries.
+    int nowMs() const { return static_cast<int>(reports.size()) * 4; }
+    const std::vector<PS4ControllerReport> &all() const { return reports; }
+
+private:
+    static void putFinger(uint8_t *p, const Finger &f) {
+        p[0] = static_cast<uint8_t>((f.down ? 0 : 0x80) | (f.id & 0x7F));
+        p[1] = static_cast<uint8_t>(f.x & 0xFF);
+        p[2] = static_cast<uint8_t>(((f.x >> 8) & 0x0F) | ((f.y & 0x0F) << 4));
+        p[3] = static_cast<uint8_t>(f.y >> 4);
+    }
+    void emit() {
+        PS4ControllerReport r{};
+        r.reportId = 0x01;
+        r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+        r.buttons1 = 0x08;
+        if (pending.empty()) pending.push_back({ { false, 0, 0, 0 }, { false, 0, 0, 0 } });
+        r.touchPacketCount = static_cast<uint8_t>(pending.size());
+        // packets are stored newest first; the decoder must order them by counter
+        for (size_t i = 0; i < pending.size(); ++i) {
+            uint8_t *p = r.touchPackets[pending.size() - 1 - i];
+            p[0] = counter++;
+            putFinger(p + 1, pending[i].first);
+            putFinger(p + 5, pending[i].second);
+        }
+        pending.clear();
+        reports.push_back(r);
+    }
+
+    std::vector<std::pair<Finger, Finger>> pending;
+    std::vector<PS4ControllerReport> reports;
+    uint8_t counter = 0;
+};
+
+struct Totals { int moveX = 0, moveY = 0, wheelX = 0, wheelY = 0, left = 0, right = 0; };
+
+struct Gesture { const char *name; int fromMs, toMs; Totals expect; int tolerance; };
+
+int main(int argc, char **argv) {
+    const std::string path = argc > 1 ? argv[1] : "touchpad_gestures.ds4cap";
+    GestureScript g;
+    std::vector<Gesture> gestures;
+    auto mark = [&](const char *name, int from, Totals expect, int tolerance) {
+        gestures.push_back({ name, from, g.nowMs(), expect, tolerance });
+    };
+    const Finger up = { false, 0, 0, 0 };
+
+    g.idle(20);
+    int from = g.nowMs();
+    for (int x = 100; x <= 900; x += 200) g.frame({ true, 1, x, 400 });   // 5 frames down, 1 lift
+    g.frame(up);
+    g.idle(100);
+    mark("flick", from, { 480, 0, 0, 0, 0, 0 }, 1);
+
+    from = g.nowMs();
+    for (int i = 0; i <= 90; ++i) g.frame({ true, 2, 200 + i * 15, 600 - i * 3 });
+    g.frame(up);
+    g.idle(100);
+    mark("swipe", from, { 810, -162, 0, 0, 0, 0 }, 1);
+
+    from = g.nowMs();
+    for (int i = 0; i <= 48; ++i) g.frame({ true, 3, 800, 700 - i * 5 }, { true, 4, 1100, 720 - i * 5 });
+    g.frame(up);
+    g.idle(100);
+    mark("scroll", from, { 0, 0, 0, 240, 0, 0 }, 0);
+
+    from = g.nowMs();
+    for (int i = 0; i < 9; ++i) g.frame({ true, 5, 960, 470 + (i & 1) });
+    g.frame(up);
+    g.idle(100);
+    mark("tap", from, { 0, 0, 0, 0, 1, 0 }, 0);
+
+    from = g.nowMs();
+    for (int i = 0; i < 9; ++i) g.frame({ true, 6, 700, 470 }, { true, 7, 1200, 470 });
+    g.frame(up);
+    g.idle(100);
+    mark("2-finger tap", from, { 0, 0, 0, 0, 0, 1 }, 0);
+
+    from = g.nowMs();
+    for (int i = 0; i < 225; ++i) g.frame({ true, 8, 960, 470 });         // 75 reports, 300 ms
+    g.frame(up);
+    g.idle(100);
+    mark("long press", from, { 0, 0, 0, 0, 0, 0 }, 0);
+
+    // write the capture: one record per scripted report, 4 ms apart
+    {
+        ReportCaptureWriter writer;
+        if (!writer.open(path)) { std::fprintf(stderr, "cannot write %s\n", path.c_str()); return 1; }
+        const ClockSource::time_point t0;
+        for (size_t i = 0; i < g.all().size(); ++i) writer.write(t0 + std::chrono::milliseconds(4 * i), g.all()[i]);
+    }
+
+    ReportCaptureFile file;
+    if (!file.open(path)) { std::fprintf(stderr, "%s: %s\n", path.c_str(), file.lastError().c_str()); return 1; }
+    ManualClockSource clock;
+    TimedSink sink(clock);
+    OutputBatch output(sink);
+    PS4Mapper mapper(output, clock);
+    mapper.setTrackpad(true);
+    const ClockSource::time_point base = clock.now();
+    ReplayStats st = replayCapture(file, mapper, output, clock, false);
+    std::printf("%zu reports replayed from %s\n", st.reports, path.c_str());
+
+    bool ok = true;
+    for (const Gesture &ge : gestures) {
+        Totals t;
+        for (const TimedSink::Entry &en : sink.log) {
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(en.at - base).count();
+            if (ms < ge.fromMs || ms >= ge.toMs) continue;
+            const OutputEvent &e = en.e;
+            if (e.type == OutputEvent::MouseMove) { t.moveX += e.dx; t.moveY += e.dy; }
+            else if (e.type == OutputEvent::MouseWheel) { t.wheelX += e.dx; t.wheelY += e.dy; }
+            else if (e.type == OutputEvent::MouseButton && e.down) ++(e.left ? t.left : t.right);
+        }
+        auto near = [&](int got, int want) { return std::abs(got - want) <= ge.tolerance; };
+        const bool match = near(t.moveX, ge.expect.moveX) && near(t.moveY, ge.expect.moveY) &&
+                           near(t.wheelX, ge.expect.wheelX) && near(t.wheelY, ge.expect.wheelY) &&
+                           t.left == ge.expect.left && t.right == ge.expect.right;
+        ok = ok && match;
+        std::printf("  %-13s move %4d,%4d  wheel %4d,%4d  clicks L%d R%d  %s\n", ge.name, t.moveX, t.moveY,
+                    t.wheelX, t.wheelY, t.left, t.right, match ? "ok" : "FAIL");
+    }
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
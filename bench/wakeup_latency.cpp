@@ -0,0 +1,83 @@
+// Synthetic-producer wakeup latency benchmark (portable, runs on Linux).
+//
+// A producer thread emits a "report" every 4 ms (DS4 over USB) and stamps it. The consumer
+// either polls a flag and sleeps 8 ms (the old PS4VisualizerMapper::run() loop) or blocks on
+// a wakeup the producer signals (the event-driven loop). We record produce -> observe latency.
+//
+//   g++ -std=c++17 -O2 -pthread bench/wakeup_latency.cpp -o wakeup_latency
+//   ./wakeup_latency [reports]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Mailbox {
+    std::mutex m;
+    std::condition_variable cv;
+    bool signaled = false;           // auto-reset event stand-in
+    std::atomic<bool> newReport{false};
+    std::atomic<int64_t> stampNs{0};
+    std::atomic<bool> done{false};
+};
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static void producer(Mailbox &mb, int reports, bool signal) {
+    auto next = Clock::now();
+    for (int i = 0; i < reports; ++i) {
+        next += std::chrono::milliseconds(4);
+        std::this_thread::sleep_until(next);
+        mb.stampNs.store(nowNs());
+        mb.newReport.store(true);
+        if (signal) {
+            { std::lock_guard<std::mutex> lk(mb.m); mb.signaled = true; }
+            mb.cv.notify_one();
+        }
+    }
+    mb.done.store(true);
+    { std::lock_guard<std::mutex> lk(mb.m); mb.signaled = true; }
+    mb.cv.notify_one();
+}
+
+static std::vector<int64_t> runMode(int reports, bool eventDriven) {
+    Mailbox mb;
+    std::vector<int64_t> lat;
+    lat.reserve(reports);
+    std::thread prod(producer, std::ref(mb), reports, eventDriven);
+    while (!mb.done.load()) {
+        if (eventDriven) {
+            std::unique_lock<std::mutex> lk(mb.m);
+            mb.cv.wait(lk, [&] { return mb.signaled; });
+            mb.signaled = false;
+        }
+        if (mb.newReport.exchange(false)) lat.push_back(nowNs() - mb.stampNs.load());
+        if (!eventDriven) std::this_thread::sleep_for(std::chrono::milliseconds(8));
+    }
+    prod.join();
+    return lat;
+}
+
+static void report(const char *name, std::vector<int64_t> lat, int produced) {
+    if (lat.empty()) { std::printf("%-14s no samples\n", name); return; }
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat[static_cast<size_t>(p * (lat.size() - 1))] / 1000.0; };
+    std::printf("%-14s seen %5zu/%d  p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+                name, lat.size(), produced, pct(0.50), pct(0.99), lat.back() / 1000.0);
+}
+
+int main(int argc, char **argv) {
+    int reports = argc > 1 ? std::atoi(argv[1]) : 1000;
+    report("sleep 8 ms", runMode(reports, false), reports);
+    report("event-driven", runMode(reports, true), reports);
+    return 0;
+}
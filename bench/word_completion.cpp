@@ -0,0 +1,278 @@
+// Word completion: dictionary load time, lookup latency and correctness, and typing through
+// the virtual keyboard (portable apart from the temporary file, runs on Linux).
+//
+//   g++ -std=c++17 -O2 -I. bench/word_completion.cpp -o word_completion && ./word_completion [words.txt]
+//
+// Without a word list, 120k synthetic words are generated from syllables, with Zipf-distributed
+// counts. Six parts:
+//   build      WordDictionary::build() time and file size (offline, for reference)
+//   load       open() on the written file: mmap, header checks and the a-z scan of the text
+//              section, then the first lookup, which faults in the pages it touches
+//   check      complete() against a brute-force scan (every word with the prefix, best k by
+//              rank) for 5000 prefixes
+//   lookup     complete() latency (p50/p99/max) for random prefixes of 1-6 letters, k = 4 and 16
+//   typing     drives a PS4Mapper in Virtual Keyboard mode: types "he" with the stick and
+//              Cross, checks the completions, highlights the second with L1 and accepts it with
+//              R1, which must type the rest of the word and a space
+//   corrupt    a dictionary whose text holds a byte outside a-z (Escape, Enter, '&' as the up
+//              arrow's VK, an upper-case letter) must not open, since accepting a completion
+//              types its bytes as virtual keys
+// Exits non-zero if any check fails.
+
+#include "latency_histogram.h"
+#include "ps4_mapper.h"
+#include "word_dictionary.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+using WordList = std::vector<std::pair<std::string, uint32_t>>;
+
+static WordList syntheticWords(size_t n) {
+    static const char *syllables[] = {
+        "a", "an", "ar", "be", "ca", "co", "de", "di", "el", "en", "er", "fa", "go", "ha", "he",
+        "in", "is", "ka", "la", "le", "li", "ma", "me", "mo", "na", "ne", "no", "on", "or", "pa",
+        "pe", "pro", "ra", "re", "ri", "ro", "sa", "se", "si", "st", "ta", "te", "th", "ti", "to",
+        "tr", "un", "us", "ve", "wa", "we", "wi", "ya", "zo"
+    };
+    constexpr size_t SYLLABLES = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 rng(19);
+    std::set<std::string> seen;
+    WordList list;
+    while (list.size() < n) {
+        std::string w;
+        const int parts = 1 + static_cast<int>(rng() % 4);
+        for (int i = 0; i < parts; ++i) w += syllables[rng() % SYLLABLES];
+        if (!seen.insert(w).second) continue;
+        // Zipf: the i-th word generated is about 1/i as common as the first
+        list.emplace_back(w, static_cast<uint32_t>(1e9 / (list.size() + 1)));
+    }
+    std::shuffle(list.begin(), list.end(), rng);
+    return list;
+}
+
+static WordList readWords(const char *path) {
+    WordList list;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string w;
+        unsigned long long count = 1;
+        if (!(fields >> w)) continue;
+        if (!(fields >> count)) count = 1;
+        list.emplace_back(w, static_cast<uint32_t>((std::min)(count, 0xFFFFFFFFull)));
+    }
+    return list;
+}
+
+static double msSince(Clock::time_point t0) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+}
+
+// Every id whose word starts with `prefix`, best `k` by rank.
+static std::vector<uint32_t> bruteForce(const WordDictionary &d, const std::string &prefix, int k) {
+    std::vector<uint32_t> ids;
+    for (uint32_t id = 0; id < d.wordCount() && static_cast<int>(ids.size()) < k; ++id) {
+        if (d.word(id).substr(0, prefix.size()) == prefix) ids.push_back(id);
+    }
+    return ids;
+}
+
+static std::string randomPrefix(const WordDictionary &d, std::mt19937 &rng) {
+    const std::string_view w = d.word(static_cast<uint32_t>(rng() % d.wordCount()));
+    return std::string(w.substr(0, 1 + rng() % (std::min)(w.size(), size_t(6))));
+}
+
+static bool checkLookups(const WordDictionary &d) {
+    std::mt19937 rng(3);
+    int mismatches = 0;
+    for (int i = 0; i < 5000; ++i) {
+        // mostly real prefixes, some random letters that may match nothing
+        std::string prefix = randomPrefix(d, rng);
+        if (i % 5 == 0) prefix += static_cast<char>('a' + rng() % 26);
+        const int k = 1 + static_cast<int>(rng() % WordDictionary::MAX_COMPLETIONS);
+        uint32_t got[WordDictionary::MAX_COMPLETIONS];
+        const int n = d.complete(prefix, got, k);
+        if (std::vector<uint32_t>(got, got + n) != bruteForce(d, prefix, k)) ++mismatches;
+    }
+    std::printf("check     %s (5000 prefixes against a full scan, %d mismatches)\n", mismatches ? "FAIL" : "ok", mismatches);
+    return mismatches == 0;
+}
+
+static void lookupLatency(const WordDictionary &d) {
+    std::mt19937 rng(7);
+    std::vector<std::string> prefixes;
+    for (int i = 0; i < 200000; ++i) prefixes.push_back(randomPrefix(d, rng));
+    for (int k : { 4, 16 }) {
+        LatencyHistogram h;
+        uint32_t out[WordDictionary::MAX_COMPLETIONS];
+        uint64_t total = 0;
+        for (const std::string &p : prefixes) {
+            const auto t0 = Clock::now();
+            total += d.complete(p, out, k);
+            h.record(Clock::now() - t0);
+        }
+        std::printf("  k=%-2d  p50 %6.0f ns  p99 %6.0f ns  max %6.1f us  (%.1f completions per prefix)\n", k,
+                    static_cast<double>(h.percentile(0.50)), static_cast<double>(h.percentile(0.99)),
+                    h.maxValue() / 1000.0, static_cast<double>(total) / prefixes.size());
+    }
+}
+
+// ---------- typing through the mapper ----------
+
+struct KeyboardDriver {
+    RecordingOutputSink sink;
+    ManualClockSource clock;
+    OutputBatch output{sink};
+    PS4Mapper mapper{output, clock};
+    PS4ControllerReport r{};
+
+    KeyboardDriver() {
+        r.reportId = 0x01;
+        r.leftStickX = r.leftStickY = r.rightStickX = r.rightStickY = 128;
+        r.buttons1 = 0x08;
+        mapper.setMode(PS4Mapper::MODE_VKEYBOARD);
+    }
+    void send() {
+        clock.advance(std::chrono::milliseconds(4));
+        mapper.processMapping(r);
+        output.flush();
+    }
+    // one deflection, released before the auto-move timer fires
+    void step(int dx, int dy) {
+        r.leftStickX = static_cast<uint8_t>(128 + dx * 127);
+        r.leftStickY = static_cast<uint8_t>(128 + dy * 127);
+        send();
+        r.leftStickX = r.leftStickY = 128;
+        send();
+        clock.advance(std::chrono::milliseconds(200));
+        mapper.runTimers();
+    }
+    void press(uint8_t &byte, uint8_t bit) {
+        byte |= bit;
+        send();
+        byte &= static_cast<uint8_t>(~bit);
+        send();
+    }
+    void type(char c) {
+        const LayoutPage &page = mapper.keyboardLayout().page(mapper.keyboardPage());
+        const char label[2] = { static_cast<char>(std::toupper(static_cast<unsigned char>(c))), '\0' };
+        for (int row = 0; row < page.rows; ++row) {
+            for (int col = 0; col < page.rowLength[row]; ++col) {
+                if (std::strcmp(page.key(row, col).label, label) != 0) continue;
+                while (mapper.selectedRow() != row) step(0, row > mapper.selectedRow() ? 1 : -1);
+                while (mapper.selectedCol() != col) step(col > mapper.selectedCol() ? 1 : -1, 0);
+                press(r.buttons1, 0x20); // Cross
+                return;
+            }
+        }
+    }
+    std::string typedKeys() const {
+        std::string keys;
+        for (const auto &batch : sink.batches)
+            for (const OutputEvent &e : batch)
+                if (e.type == OutputEvent::Key && e.down) keys += e.vk == Vk::SPACE ? '_' : static_cast<char>(e.vk);
+        return keys;
+    }
+};
+
+static bool checkTyping() {
+    const std::vector<uint8_t> image = WordDictionary::build({
+        { "hello", 500 }, { "help", 300 }, { "he", 200 }, { "her", 100 }, { "hold", 900 }, { "the", 1000 }
+    });
+    WordDictionary d;
+    d.openImage(image.data(), image.size());
+    KeyboardDriver kb;
+    kb.mapper.setDictionary(&d);
+    kb.type('h');
+    kb.type('e');
+    std::string offered;
+    for (int i = 0; i < kb.mapper.suggestionCount(); ++i) offered += std::string(i ? " " : "") + std::string(kb.mapper.suggestion(i));
+    kb.sink.clear();
+    kb.press(kb.r.buttons2, 0x01);   // L1: highlight "help"
+    const int highlighted = kb.mapper.selectedSuggestion();
+    kb.press(kb.r.buttons2, 0x02);   // R1: accept
+    const std::string accepted = kb.typedKeys();
+    const bool ok = offered == "hello help he her" && highlighted == 1 && accepted == "LP_" &&
+                    kb.mapper.currentWord().empty() && kb.mapper.suggestionCount() == 0;
+    std::printf("typing    %s (\"he\" offers: %s; L1 -> #%d; R1 typed %s)\n", ok ? "ok" : "FAIL", offered.c_str(),
+                highlighted, accepted.c_str());
+    return ok;
+}
+
+// The text section is the end of the file: overwrite a byte of the last word.
+static bool checkCorruptText() {
+    const std::vector<uint8_t> image = WordDictionary::build({ { "hello", 500 }, { "help", 300 } });
+    WordDictionary good;
+    bool ok = good.openImage(image.data(), image.size());
+    int rejected = 0;
+    std::string why;
+    for (uint8_t bad : { uint8_t(0x1B), uint8_t(0x0D), uint8_t('&'), uint8_t('L'), uint8_t(0xE1) }) {
+        std::vector<uint8_t> corrupt = image;
+        corrupt.back() = bad;
+        WordDictionary d;
+        if (!d.openImage(corrupt.data(), corrupt.size()) && d.wordCount() == 0) {
+            ++rejected;
+            why = d.lastError();
+        }
+    }
+    ok = ok && rejected == 5;
+    std::printf("corrupt   %s (%d of 5 dictionaries with a stray byte rejected: %s)\n", ok ? "ok" : "FAIL", rejected, why.c_str());
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    WordList list = argc > 1 ? readWords(argv[1]) : syntheticWords(120000);
+    const size_t entries = list.size();
+
+    auto t0 = Clock::now();
+    const std::vector<uint8_t> image = WordDictionary::build(std::move(list));
+    const double buildMs = msSince(t0);
+    char path[] = "/tmp/ds4dictXXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0 || write(fd, image.data(), image.size()) != static_cast<ssize_t>(image.size())) {
+        std::printf("cannot write temporary file\n");
+        return 1;
+    }
+    close(fd);
+
+    // page cache warm from the write, as after the first run; the mapping itself is fresh
+    LatencyHistogram openTime, firstLookup;
+    bool ok = true;
+    for (int i = 0; i < 200; ++i) {
+        WordDictionary d;
+        t0 = Clock::now();
+        ok = d.open(path) && ok;
+        openTime.record(Clock::now() - t0);
+        uint32_t out[4];
+        t0 = Clock::now();
+        d.complete("th", out, 4);
+        firstLookup.record(Clock::now() - t0);
+    }
+    WordDictionary d;
+    ok = d.open(path) && ok;
+    std::printf("build     %zu entries -> %u words, %u nodes, %.1f MB in %.0f ms\n", entries, d.wordCount(),
+                d.nodeCount(), image.size() / 1e6, buildMs);
+    std::printf("load      open p50 %.1f us  max %.1f us;  first lookup p50 %.1f us  max %.1f us\n",
+                openTime.percentile(0.50) / 1000.0, openTime.maxValue() / 1000.0,
+                firstLookup.percentile(0.50) / 1000.0, firstLookup.maxValue() / 1000.0);
+    ok = checkLookups(d) && ok;
+    std::printf("lookup    200000 random prefixes of 1-6 letters\n");
+    lookupLatency(d);
+    ok = checkTyping() && ok;
+    ok = checkCorruptText() && ok;
+    std::remove(path);
+    std::printf("%s\n", ok ? "OK" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+// Injectable time source for the mapping core.
+//
+// Everything time-based in PS4Mapper (key repeat, virtual keyboard move delay) asks a
+// ClockSource instead of calling steady_clock directly. The live program uses SteadyClockSource;
+// replay and benchmarks drive a ManualClockSource so runs are deterministic.
+
+#include <chrono>
+
+class ClockSource {
+public:
+    using Clock = std::chrono::steady_clock;
+    using time_point = Clock::time_point;
+
+    virtual ~ClockSource() = default;
+    virtual time_point now() const = 0;
+};
+
+class SteadyClockSource : public ClockSource {
+public:
+    time_point now() const override { return Clock::now(); }
+
+    static const SteadyClockSource &instance() {
+        static const SteadyClockSource clock;
+        return clock;
+    }
+};
+
+class ManualClockSource : public ClockSource {
+public:
+    explicit ManualClockSource(time_point start = time_point()) : current(start) {}
+
+    time_point now() const override { return current; }
+    void set(time_point t) { current = t; }
+    void advance(Clock::duration d) { current += d; }
+
+private:
+    time_point current;
+};
@@ -0,0 +1,192 @@
+#pragma once
+// Combo matching and macro playback for a profile's [combos] and [macros] (ComboSet in
+// mapping_profile.h).
+//
+// ComboMatcher is the per-mapper state machine. It is fed the press and release edges of a
+// report and the mapper's hold timers, and returns the combos that completed as a mask of
+// combo ids. Each edge only visits the combos that read its input (ComboSet::byInput), so a
+// report costs O(changed inputs x combos on them), nothing for an unchanged one, and nothing
+// allocates:
+//   chord     complete when its last input goes down and every input went down within
+//             chordMs; its inputs are then used up, so none of them also counts as a tap
+//   tap       released before holdMs, unless the press was used up
+//   hold      held for holdMs (the mapper's hold timer), unless the press was used up
+//   sequence  a KMP automaton over the sequence: a press of one of its inputs advances it or
+//             falls back to the longest partial match; inputs it doesn't use don't interrupt
+//             it, a pause longer than sequenceMs restarts it
+//
+// MacroPlayer plays macros in up to MAX_PLAYING slots. play() emits a slot's steps until one
+// has a pause after it and returns that pause; the mapper arms a timer for it from the
+// deadline the step was due at, not from when it ran, so one late wakeup delays a step without
+// shifting the rest of the macro.
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include "clock_source.h"
+#include "mapping_profile.h"
+#include "output_sink.h"
+#include "vk_codes.h"
+
+class ComboMatcher {
+public:
+    using time_point = ClockSource::time_point;
+
+    // Combos completed by this report's edges (inputs masked by mode), lowest id first.
+    uint32_t update(const ComboSet &s, uint32_t pressed, uint32_t released, time_point now) {
+        uint32_t fired = 0;
+        for (uint32_t m = released & held; m; m &= m - 1) {
+            const int i = lowestBitIndex(m);
+            const uint32_t bit = inputBit(i);
+            if (!(usedUp & bit) && now - pressedAt[i] < std::chrono::milliseconds(s.holdMs)) fired |= s.byInput[i] & s.tapCombos;
+            held &= ~bit;
+            usedUp &= ~bit;
+        }
+        for (uint32_t m = pressed & s.inputs; m; m &= m - 1) {
+            const int i = lowestBitIndex(m);
+            held |= inputBit(i);
+            usedUp &= ~inputBit(i);
+            pressedAt[i] = now;
+            for (uint32_t c = s.byInput[i] & s.chordCombos; c; c &= c - 1) {
+                const int id = lowestBitIndex(c);
+                if (chordComplete(s, s.combos[id], now)) {
+                    fired |= 1u << id;
+                    usedUp |= s.combos[id].inputs;
+                }
+            }
+            for (uint32_t c = s.byInput[i] & s.sequenceCombos; c; c &= c - 1) {
+                const int id = lowestBitIndex(c);
+                if (advanceSequence(s, id, i, now)) {
+                    fired |= 1u << id;
+                    usedUp |= inputBit(i);
+                }
+            }
+        }
+        return fired;
+    }
+
+    // The hold timer of `input` ran out: its Hold combos, if the press is still unused.
+    uint32_t holdElapsed(const ComboSet &s, int input) {
+        const uint32_t bit = inputBit(input);
+        if (!(held & bit) || (usedUp & bit)) return 0;
+        usedUp |= bit;
+        return s.byInput[input] & s.holdCombos;
+    }
+
+    // Forget every partial match (mode switch, new profile). Inputs held now are ignored until
+    // they are pressed again.
+    void reset() {
+        held = usedUp = 0;
+        progress.fill(0);
+    }
+
+private:
+    bool chordComplete(const ComboSet &s, const ComboSet::Combo &c, time_point now) const {
+        if ((held & c.inputs) != c.inputs || (usedUp & c.inputs)) return false;
+        for (uint32_t m = c.inputs; m; m &= m - 1) {
+            if (now - pressedAt[lowestBitIndex(m)] > std::chrono::milliseconds(s.chordMs)) return false;
+        }
+        return true;
+    }
+
+    bool advanceSequence(const ComboSet &s, int id, int input, time_point now) {
+        const ComboSet::Combo &c = s.combos[id];
+        int p = progress[id];
+        if (p > 0 && now - stepAt[id] > std::chrono::milliseconds(s.sequenceMs)) p = 0;
+        while (p > 0 && c.sequence[p] != input) p = c.fallback[p - 1];
+        if (c.sequence[p] == input) ++p;
+        stepAt[id] = now;
+        const bool complete = p == c.length;
+        progress[id] = static_cast<uint8_t>(complete ? 0 : p);
+        return complete;
+    }
+
+    uint32_t held = 0;      // combo inputs down, as seen through update()
+    uint32_t usedUp = 0;    // held inputs whose press already completed a chord, hold or sequence
+    std::array<time_point, INPUT_COUNT> pressedAt{};
+    std::array<uint8_t, ComboSet::MAX_COMBOS> progress{};     // sequence steps matched so far
+    std::array<time_point, ComboSet::MAX_COMBOS> stepAt{};    // time of the last one
+};
+
+class MacroPlayer {
+public:
+    static constexpr int MAX_PLAYING = 8;
+
+    // Take a free slot for macro `macro` and return it; -1 if that macro is already playing
+    // (a trigger doesn't restart or stack it) or every slot is busy (counted in dropped()).
+    int start(int macro) {
+        int free = -1;
+        for (int i = 0; i < MAX_PLAYING; ++i) {
+            if (slots[i].macro == macro) return -1;
+            if (slots[i].macro < 0 && free < 0) free = i;
+        }
+        if (free < 0) {
+            ++droppedStarts;
+            return -1;
+        }
+        slots[free] = { static_cast<int16_t>(macro), 0 };
+        ++started;
+        return free;
+    }
+
+    // Emit the steps of `slot` from where it stopped, up to and including the first with a
+    // pause after it, and return that pause. Zero when the macro has ended; the slot is free.
+    std::chrono::microseconds play(int slot, const ComboSet &s, OutputBatch &out) {
+        Slot &p = slots[slot];
+        const ComboSet::Macro &m = s.macros[p.macro];
+        while (p.next < m.count) {
+            const ComboSet::Step &step = s.steps[m.first + p.next++];
+            switch (step.kind) {
+                case ComboSet::Step::Wait: break;
+                case ComboSet::Step::KeyDown: out.key(step.vk, true); keyDown[step.vk] = true; break;
+                case ComboSet::Step::KeyUp: out.key(step.vk, false); keyDown[step.vk] = false; break;
+                case ComboSet::Step::MouseDown: out.mouseButton(step.left, true); buttonDown[step.left] = true; break;
+                case ComboSet::Step::MouseUp: out.mouseButton(step.left, false); buttonDown[step.left] = false; break;
+                case ComboSet::Step::Wheel: out.mouseWheel(0, step.wheel); break;
+            }
+            if (step.waitUs > 0 && p.next < m.count) return std::chrono::microseconds(step.waitUs);
+        }
+        p.macro = -1;
+        return std::chrono::microseconds(0);
+    }
+
+    // Stop every macro and release the keys and mouse buttons they left down. Returns how
+    // many were released.
+    int stopAll(OutputBatch &out) {
+        int released = 0;
+        for (Slot &p : slots) p.macro = -1;
+        for (int vk = 0; vk < Vk::COUNT; ++vk) {
+            if (!keyDown[vk]) continue;
+            out.key(static_cast<uint16_t>(vk), false);
+            keyDown[vk] = false;
+            ++released;
+        }
+        for (int left = 0; left < 2; ++left) {
+            if (!buttonDown[left]) continue;
+            out.mouseButton(left != 0, false);
+            buttonDown[left] = false;
+            ++released;
+        }
+        return released;
+    }
+
+    int playing() const {
+        int n = 0;
+        for (const Slot &p : slots) n += p.macro >= 0;
+        return n;
+    }
+    uint64_t startCount() const { return started; }
+    uint64_t dropped() const { return droppedStarts; }
+
+private:
+    struct Slot {
+        int16_t macro = -1;   // -1: free
+        uint16_t next = 0;    // step to play next
+    };
+    std::array<Slot, MAX_PLAYING> slots{};
+    std::array<bool, Vk::COUNT> keyDown{};    // left down by a macro
+    std::array<bool, 2> buttonDown{};         // [0] right, [1] left
+    uint64_t started = 0;
+    uint64_t droppedStarts = 0;
+};
@@ -0,0 +1,142 @@
+#pragma once
+// Double-buffered, differential console rendering.
+//
+// Drawing code writes text into a FrameBuffer (the back buffer). ConsoleFrame::present()
+// compares it with what was last shown (the front buffer), collects the changed runs per row
+// and hands them to a ConsoleBackend in one call. The backend turns them into one
+// WriteConsoleOutput per run (Win32, main.cpp) or one ANSI/VT write (AnsiConsoleBackend below).
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class FrameBuffer {
+public:
+    FrameBuffer(int width, int height, char fill = ' ')
+        : w(width), h(height), cells(static_cast<size_t>(width) * height, fill) {}
+
+    int width() const { return w; }
+    int height() const { return h; }
+
+    void fill(char c) { std::fill(cells.begin(), cells.end(), c); }
+
+    // Write text at (x, y), clipped to the frame. Newlines are not interpreted.
+    void put(int x, int y, const char *text, size_t len) {
+        if (y < 0 || y >= h || x >= w) return;
+        size_t skip = x < 0 ? static_cast<size_t>(-x) : 0;
+        if (skip >= len) return;
+        x += static_cast<int>(skip);
+        size_t n = (std::min)(len - skip, static_cast<size_t>(w - x));
+        std::copy(text + skip, text + skip + n, cells.begin() + (static_cast<size_t>(y) * w + x));
+    }
+    void put(int x, int y, const std::string &s) { put(x, y, s.data(), s.size()); }
+
+    char at(int x, int y) const { return cells[static_cast<size_t>(y) * w + x]; }
+    const char *row(int y) const { return cells.data() + static_cast<size_t>(y) * w; }
+    char *row(int y) { return cells.data() + static_cast<size_t>(y) * w; }
+
+private:
+    int w, h;
+    std::vector<char> cells;
+};
+
+// A horizontal span [x, x + len) of row y that differs from the previous frame.
+struct DirtyRun {
+    int y;
+    int x;
+    int len;
+};
+
+class ConsoleBackend {
+public:
+    virtual ~ConsoleBackend() = default;
+    // Show the given runs of `frame`. Called once per presented frame, count may be zero.
+    virtual void present(const FrameBuffer &frame, const DirtyRun *runs, size_t count) = 0;
+};
+
+class ConsoleFrame {
+public:
+    // Unchanged gaps shorter than this are folded into the surrounding run; repositioning the
+    // cursor costs more than rewriting a few identical cells.
+    static constexpr int MERGE_GAP = 6;
+
+    ConsoleFrame(int width, int height)
+        : back(width, height), front(width, height, '\0') { runs.reserve(static_cast<size_t>(height) * 4); }
+
+    FrameBuffer &buffer() { return back; }
+    const FrameBuffer &shown() const { return front; }
+
+    // Diff back against front, send the changed runs to the backend and make back the new front.
+    // Returns the number of changed runs (0 = nothing written).
+    size_t present(ConsoleBackend &backend) {
+        runs.clear();
+        const int w = back.width();
+        for (int y = 0; y < back.height(); ++y) {
+            const char *b = back.row(y);
+            char *f = front.row(y);
+            int x = 0;
+            while (x < w) {
+                if (b[x] == f[x]) { ++x; continue; }
+                int start = x, end = x + 1, gap = 0;
+                for (int i = x + 1; i < w && gap < MERGE_GAP; ++i) {
+                    if (b[i] != f[i]) { end = i + 1; gap = 0; } else { ++gap; }
+                }
+                runs.push_back({ y, start, end - start });
+                std::copy(b + start, b + end, f + start);
+                x = end;
+            }
+        }
+        backend.present(back, runs.data(), runs.size());
+        ++frames;
+        return runs.size();
+    }
+
+    // Forget what is on screen so the next present() redraws every cell.
+    void invalidate() { front.fill('\0'); }
+
+    uint64_t frameCount() const { return frames; }
+
+private:
+    FrameBuffer back;
+    FrameBuffer front;
+    std::vector<DirtyRun> runs;
+    uint64_t frames = 0;
+};
+
+// ANSI/VT backend: builds one escape-sequence string per frame and writes it in one call.
+// Works in any VT-capable terminal (Linux, Windows 10+ with virtual terminal processing).
+// With a null stream it only counts bytes, which is what the benchmark uses.
+class AnsiConsoleBackend : public ConsoleBackend {
+public:
+    explicit AnsiConsoleBackend(std::FILE *stream = stdout) : out(stream) { buf.reserve(4096); }
+
+    void present(const FrameBuffer &frame, const DirtyRun *runs, size_t count) override {
+        buf.clear();
+        char pos[24];
+        for (size_t i = 0; i < count; ++i) {
+            const DirtyRun &r = runs[i];
+            int n = std::snprintf(pos, sizeof(pos), "\x1b[%d;%dH", r.y + 1, r.x + 1);
+            buf.append(pos, static_cast<size_t>(n));
+            buf.append(frame.row(r.y) + r.x, static_cast<size_t>(r.len));
+        }
+        if (buf.empty()) return;
+        bytes += buf.size();
+        ++writes;
+        if (out) {
+            std::fwrite(buf.data(), 1, buf.size(), out);
+            std::fflush(out);
+        }
+    }
+
+    uint64_t bytesWritten() const { return bytes; }
+    uint64_t writeCount() const { return writes; }
+
+private:
+    std::FILE *out;
+    std::string buf;
+    uint64_t bytes = 0;
+    uint64_t writes = 0;
+};
@@ -0,0 +1,496 @@
+#pragma once
+// Several controllers at once, with per-device state sharded by device handle.
+//
+// Every controller gets its own shard: a report ring, a PS4Mapper (mode, held keys, mouse
+// motion, stick profiles) and an OutputBatch. Nothing on the hot path is shared between
+// shards, so cost grows linearly with the number of controllers. The producer (raw input
+// message thread, or a Linux reader) looks the device up in a small array and pushes into that
+// device's ring; a controller flooding its own ring can't crowd out another's reports. Raw
+// reports go through the shard's ReportParser on the way in, so a USB and a Bluetooth
+// controller queue the same USB-layout reports, and a device whose reports aren't DS4 input
+// reports never takes a shard. The
+// consumer drains the rings round-robin, one report per controller per round, so a deep queue
+// on one controller delays the others by at most one report each.
+//
+// Output from all shards meets in SharedInputSink, which keeps a key or mouse button down
+// while any controller still holds it, so two pads holding W don't release each other's W.
+// A repeat (up, down) or tap (down, up) from one pad while another holds the same key still
+// reaches the system, as a fresh press that leaves the key down.
+//
+// A controller that goes away (unplugged, or a Bluetooth link dropped) is handed to remove()
+// by the producer: on Windows for WM_INPUT_DEVICE_CHANGE / GIDC_REMOVAL, on Linux for a hidraw
+// read error or hang-up (HidrawReportSource's PollResult::removed). The mapping thread maps
+// whatever it had queued, releases every key and button it still held, and frees its shard for
+// the next controller; a reconnect gets a new device handle, so it takes a shard like any new
+// controller.
+//
+// Profiles are per device. Profile 0 is for every controller no DeviceMatch claims; each
+// addDeviceProfile() adds one for the controllers it matches, by vendor:product id or by a
+// piece of the device path. A controller's profile is picked once, when its device registers,
+// from the DeviceInfo the producer's Identify callback returns. A published table reaches the
+// controllers running that profile through their own ProfileExchange, and each mapper adopts
+// it at the start of the next drain(), between reports; a controller plugged in later starts
+// with the newest table of its profile.
+
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "clock_source.h"
+#include "latency_histogram.h"
+#include "mapping_profile.h"
+#include "output_sink.h"
+#include "ps4_mapper.h"
+#include "report_parser.h"
+#include "spsc_ring.h"
+#include "vk_codes.h"
+
+// What the producer knows about a device, for picking its profile.
+struct DeviceInfo {
+    uint16_t vendorId = 0;
+    uint16_t productId = 0;
+    std::string path;                    // RIDI_DEVICENAME, or the hidraw node
+};
+
+// Which devices a per-device profile is for: "054C:09CC" (vendor:product, hex) or any other
+// text, found anywhere in the device path regardless of case.
+struct DeviceMatch {
+    bool byId = false;
+    uint16_t vendorId = 0;
+    uint16_t productId = 0;
+    std::string pathPart;                // lower case
+
+    static DeviceMatch parse(const std::string &text) {
+        DeviceMatch m;
+        const size_t colon = text.find(':');
+        auto hex = [](const std::string &digits, uint16_t &out) {
+            if (digits.empty() || digits.size() > 4) return false;
+            unsigned v = 0;
+            for (char c : digits) {
+                if (!std::isxdigit(static_cast<unsigned char>(c))) return false;
+                v = v * 16 + static_cast<unsigned>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(c) - 'a' + 10);
+            }
+            out = static_cast<uint16_t>(v);
+            return true;
+        };
+        if (colon != std::string::npos && hex(text.substr(0, colon), m.vendorId) && hex(text.substr(colon + 1), m.productId)) {
+            m.byId = true;
+        } else {
+            m.pathPart = lower(text);
+        }
+        return m;
+    }
+
+    bool matches(const DeviceInfo &d) const {
+        if (byId) return d.vendorId == vendorId && d.productId == productId;
+        return !pathPart.empty() && lower(d.path).find(pathPart) != std::string::npos;
+    }
+
+private:
+    static std::string lower(std::string s) {
+        for (char &c : s) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return s;
+    }
+};
+
+// A report as handed from the producer thread to the mapping thread.
+struct TimedReport {
+    std::chrono::steady_clock::time_point received;
+    PS4ControllerReport report;
+};
+
+// Reference-counts key and mouse button state across controllers before the real sink.
+class SharedInputSink : public OutputSink {
+public:
+    explicit SharedInputSink(OutputSink &target) : out(target) {
+        merged.reserve(64);
+        held.reserve(16);
+    }
+
+    void submit(const OutputEvent *events, size_t count) override {
+        merged.clear();
+        held.clear();
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            uint8_t *holders = e.type == OutputEvent::Key ? &keyHolders[e.vk]
+                             : e.type == OutputEvent::MouseButton ? &buttonHolders[e.left ? 0 : 1]
+                             : nullptr;
+            if (holders) {
+                // only the first press and the last release reach the system
+                const bool first = e.down && (*holders)++ == 0;
+                const bool last = !e.down && *holders != 0 && --(*holders) == 0;
+                if (!first && !last) {
+                    if (*holders != 0) pairWithinBatch(e);
+                    continue;
+                }
+            }
+            merged.push_back(e);
+        }
+        if (!merged.empty()) out.submit(merged.data(), merged.size());
+    }
+
+private:
+    // `e` was held back because another controller holds its key. If this batch already held
+    // back the opposite edge of the same key, the two are a repeat or a tap: send up, down.
+    void pairWithinBatch(const OutputEvent &e) {
+        for (size_t j = 0; j < held.size(); ++j) {
+            const OutputEvent &h = held[j];
+            if (h.type != e.type || h.vk != e.vk || h.left != e.left || h.down == e.down) continue;
+            OutputEvent press = e;
+            press.down = false;
+            merged.push_back(press);
+            press.down = true;
+            merged.push_back(press);
+            held.erase(held.begin() + static_cast<std::ptrdiff_t>(j));
+            return;
+        }
+        held.push_back(e);
+    }
+
+    OutputSink &out;
+    std::vector<OutputEvent> merged;
+    std::vector<OutputEvent> held;      // edges held back in the current batch, not yet paired
+    std::array<uint8_t, Vk::COUNT> keyHolders{};
+    uint8_t buttonHolders[2] = { 0, 0 };
+};
+
+struct ControllerShard {
+    // Who owns the shard: the producer claims a free one for a new device and marks it leaving
+    // when the device goes away; the mapping thread frees it once the device's inputs are released.
+    enum State : uint8_t { FREE, CLAIMED, LEAVING };
+
+    int index = 0;
+    uint64_t device = 0;                 // RAWINPUT hDevice, or the hidraw descriptor
+    int profileId = 0;                   // picked by the producer when the device registers
+    std::atomic<uint8_t> state{FREE};
+    SpscRing<TimedReport, 256> ring;     // producer -> mapping thread
+    ProfileExchange profile;             // profile loader -> mapping thread
+    int liveProfile = -1;                // the profile its mapper runs, -1 without one; under the profile mutex
+    ReportParser parser;                 // producer thread; its counters are read anywhere
+
+    // mapping thread only; created when the first report of the device is drained, dropped
+    // when the device is gone. The ring's and parser's counters stay with the shard.
+    std::unique_ptr<OutputBatch> output;
+    std::unique_ptr<PS4Mapper> mapper;
+    std::optional<PS4ControllerReport> lastReport;
+    uint64_t reports = 0;
+};
+
+class ControllerShards {
+public:
+    static constexpr int MAX_CONTROLLERS = 8;
+    // Called on the mapping thread when a controller's mapper is created, to apply its options.
+    using Configure = std::function<void(ControllerShard &)>;
+    // Called on the producer thread when a device registers, if any device profile was added.
+    using Identify = std::function<DeviceInfo(uint64_t device)>;
+
+    ControllerShards(OutputSink &sink, Configure configure = Configure(),
+                     const ClockSource &clockSource = SteadyClockSource::instance())
+        : shared(sink), onCreate(std::move(configure)), clock(clockSource) {
+        for (int i = 0; i < MAX_CONTROLLERS; ++i) {
+            shards[i] = std::make_unique<ControllerShard>();
+            shards[i]->index = i;
+        }
+    }
+
+    // ---------- setup, before any producer or loader runs ----------
+    // Add a profile for the devices `match` picks; returns its id for publishProfile(). The
+    // first match in the order they were added wins.
+    int addDeviceProfile(const DeviceMatch &match) {
+        deviceMatches.push_back(match);
+        latestProfiles.emplace_back();
+        return static_cast<int>(deviceMatches.size());
+    }
+    void setIdentify(Identify identify) { identifyDevice = std::move(identify); }
+
+    // ---------- producer thread ----------
+    // Queue a report for `device`, registering the device on first sight. Returns false if
+    // the device's ring is full or every shard is in use; both are counted.
+    bool push(uint64_t device, const TimedReport &item) {
+        ControllerShard *s = shardFor(device);
+        if (!s) {
+            unassigned.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return s->ring.tryPush(item);
+    }
+
+    // Parse a raw report from `device` into its USB layout and queue it. A device is
+    // registered by its first report in a known format; reports in none, before that, are
+    // counted in unrecognizedReports() and take no shard. Returns false for those, for reports
+    // the device's parser rejects, and when push() above would.
+    bool push(uint64_t device, std::chrono::steady_clock::time_point received, const uint8_t *data, uint32_t len) {
+        ControllerShard *s = findShard(device);
+        if (!s) {
+            if (ReportParser::formatOf(data, len) == ReportFormat::Unknown) {
+                unrecognized.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            s = registerShard(device);
+            if (!s) {
+                unassigned.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        TimedReport item;
+        item.received = received;
+        if (!s->parser.parse(data, len, item.report)) return false;
+        return s->ring.tryPush(item);
+    }
+
+    // `device` is gone: no more reports will be pushed for it. Its queued reports are still
+    // mapped, then its held inputs released and its shard freed, in the next drain().
+    // Returns false for a device that has no shard.
+    bool remove(uint64_t device) {
+        ControllerShard *s = findShard(device);
+        if (!s) return false;
+        if (lastShard == s) lastShard = nullptr;
+        s->state.store(ControllerShard::LEAVING, std::memory_order_release);  // after its last push
+        return true;
+    }
+
+    // ---------- profile loader thread ----------
+    // Hand a compiled table of profile `profileId` (0: the default) to every controller that
+    // runs it, and keep it for controllers plugged in later, which start with it.
+    void publishProfile(const ActionTable &table, int profileId = 0) {
+        std::lock_guard<std::mutex> lock(profileMutex);
+        if (profileId < 0 || static_cast<size_t>(profileId) >= latestProfiles.size()) return;
+        latestProfiles[profileId] = std::make_shared<const ActionTable>(table);
+        for (const auto &s : shards) {
+            if (s->liveProfile == profileId) s->profile.publish(std::make_unique<ActionTable>(table));
+        }
+    }
+
+    // ---------- mapping thread ----------
+    // Pop queued reports one per controller per round until every ring is empty, calling
+    // onReport(ControllerShard &, const TimedReport &). Then retire controllers that went away.
+    // Returns the number of reports.
+    template <typename OnReport>
+    size_t drain(OnReport &&onReport) {
+        adoptNewDevices();
+        adoptProfiles();
+        size_t total = 0;
+        for (bool any = true; any;) {
+            any = false;
+            forEach([&](ControllerShard &s) {
+                TimedReport item;
+                if (!s.ring.tryPop(item)) return;
+                deliver(s, item, onReport);
+                any = true;
+                ++total;
+            });
+        }
+        if (leaving()) {
+            forEach([&](ControllerShard &s) {
+                if (s.state.load(std::memory_order_acquire) != ControllerShard::LEAVING) return;
+                // everything pushed before remove() is visible now
+                TimedReport item;
+                while (s.ring.tryPop(item)) {
+                    deliver(s, item, onReport);
+                    ++total;
+                }
+                retire(s);
+            });
+        }
+        return total;
+    }
+
+    // Call f(ControllerShard &) for every controller that has a mapper.
+    template <typename F>
+    void forEach(F &&f) {
+        for (const auto &s : shards)
+            if (s->mapper) f(*s);
+    }
+    template <typename F>
+    void forEach(F &&f) const {
+        for (const auto &s : shards)
+            if (s->mapper) f(static_cast<const ControllerShard &>(*s));
+    }
+
+    // Controllers with a mapper. Their shard indexes need not be 0..count()-1: a controller
+    // that went away leaves a gap until the next one takes its shard.
+    int count() const { return active; }
+    ControllerShard &shard(int i) { return *shards[i]; }
+    const ControllerShard &shard(int i) const { return *shards[i]; }
+
+    // Aggregates over all controllers, for the host's wait loop.
+    std::optional<PS4Mapper::Clock::time_point> nextTimerDeadline() const {
+        std::optional<PS4Mapper::Clock::time_point> next;
+        forEach([&](const ControllerShard &s) {
+            auto d = s.mapper->nextTimerDeadline();
+            if (d && (!next || *d < *next)) next = d;
+        });
+        return next;
+    }
+    bool isMouseMotionActive() const {
+        bool any = false;
+        forEach([&](const ControllerShard &s) { any = any || s.mapper->isMouseMotionActive(); });
+        return any;
+    }
+    void tickMouse() { forEach([](ControllerShard &s) { s.mapper->tickMouse(); s.output->flush(); }); }
+    int runTimers(LatencyHistogram *lateness = nullptr) {
+        int fired = 0;
+        forEach([&](ControllerShard &s) { fired += s.mapper->runTimers(lateness); s.output->flush(); });
+        return fired;
+    }
+    void releaseAllInputs() { forEach([](ControllerShard &s) { s.mapper->releaseAllInputs(); s.output->flush(); }); }
+
+    // Swap in any newly published profile; keys it releases go out right away.
+    void adoptProfiles() {
+        forEach([](ControllerShard &s) {
+            if (s.mapper->adoptActionTable(s.profile)) s.output->flush();
+        });
+    }
+
+    // Reports from a controller that found every shard held by another connected controller.
+    uint64_t unassignedReports() const { return unassigned.load(std::memory_order_relaxed); }
+    // Raw reports from unregistered devices in no DS4 format (another HID game pad, say).
+    uint64_t unrecognizedReports() const { return unrecognized.load(std::memory_order_relaxed); }
+    // Raw reports a controller's parser rejected: an unknown format or a bad Bluetooth checksum.
+    uint64_t rejectedReports() const {
+        uint64_t n = 0;
+        for (const auto &s : shards) n += s->parser.rejected();
+        return n;
+    }
+    uint64_t droppedReports() const {
+        uint64_t n = unassignedReports();
+        for (const auto &s : shards) n += s->ring.overflowCount();
+        return n;
+    }
+    uint64_t outputEvents() const {
+        uint64_t n = 0;
+        forEach([&](const ControllerShard &s) { n += s.output->eventCount(); });
+        return n;
+    }
+    uint64_t outputSubmissions() const {
+        uint64_t n = 0;
+        forEach([&](const ControllerShard &s) { n += s.output->submissionCount(); });
+        return n;
+    }
+    // Reports processReport() found unchanged and did not map.
+    uint64_t reportsSkipped() const {
+        uint64_t n = 0;
+        forEach([&](const ControllerShard &s) { n += s.mapper->reportsSkipped(); });
+        return n;
+    }
+
+private:
+    ControllerShard *shardFor(uint64_t device) {
+        ControllerShard *s = findShard(device);
+        return s ? s : registerShard(device);
+    }
+
+    // Only the producer moves a shard to CLAIMED or LEAVING, so a relaxed load finds its own.
+    ControllerShard *findShard(uint64_t device) {
+        if (lastShard && lastShard->device == device) return lastShard;
+        for (const auto &s : shards) {
+            if (s->state.load(std::memory_order_relaxed) == ControllerShard::CLAIMED && s->device == device)
+                return lastShard = s.get();
+        }
+        return nullptr;
+    }
+
+    ControllerShard *registerShard(uint64_t device) {
+        for (const auto &s : shards) {
+            // acquire: the mapping thread is done with a shard it freed
+            if (s->state.load(std::memory_order_acquire) != ControllerShard::FREE) continue;
+            s->device = device;
+            s->profileId = profileFor(device);
+            s->parser.reset();
+            s->state.store(ControllerShard::CLAIMED, std::memory_order_release); // publishes the device handle
+            return lastShard = s.get();
+        }
+        return nullptr;
+    }
+
+    template <typename OnReport>
+    void deliver(ControllerShard &s, const TimedReport &item, OnReport &onReport) {
+        ++s.reports;
+        s.lastReport = item.report;
+        onReport(s, item);
+    }
+
+    // Give newly registered devices a mapper before their first report is drained.
+    void adoptNewDevices() {
+        for (const auto &p : shards) {
+            ControllerShard &s = *p;
+            if (s.mapper || s.state.load(std::memory_order_acquire) == ControllerShard::FREE) continue;
+            s.output = std::make_unique<OutputBatch>(shared);
+            s.mapper = std::make_unique<PS4Mapper>(*s.output, clock);
+            {
+                // from here on publishProfile() reaches this shard; start from the newest table
+                std::lock_guard<std::mutex> lock(profileMutex);
+                s.liveProfile = s.profileId;
+                if (const auto &latest = latestProfiles[s.profileId]) s.mapper->setActionTable(std::make_unique<ActionTable>(*latest));
+            }
+            if (onCreate) onCreate(s);
+            s.output->flush();
+            ++active;
+        }
+    }
+
+    int profileFor(uint64_t device) const {
+        if (deviceMatches.empty() || !identifyDevice) return 0;
+        const DeviceInfo info = identifyDevice(device);
+        for (size_t i = 0; i < deviceMatches.size(); ++i) {
+            if (deviceMatches[i].matches(info)) return static_cast<int>(i + 1);
+        }
+        return 0;
+    }
+
+    bool leaving() const {
+        for (const auto &s : shards)
+            if (s->state.load(std::memory_order_relaxed) == ControllerShard::LEAVING) return true;
+        return false;
+    }
+
+    // The device is gone: let go of everything it held, so no key stays down for the rest of
+    // the session, and hand the shard back to the producer.
+    void retire(ControllerShard &s) {
+        s.mapper->releaseAllInputs();
+        s.output->flush();
+        {
+            // no more tables for this shard; one not yet adopted is for the device that left
+            std::lock_guard<std::mutex> lock(profileMutex);
+            s.liveProfile = -1;
+            s.profile.take();
+        }
+        s.mapper.reset();
+        s.output.reset();
+        s.lastReport.reset();
+        s.reports = 0;
+        --active;
+        s.state.store(ControllerShard::FREE, std::memory_order_release);
+    }
+
+    SharedInputSink shared;
+    Configure onCreate;
+    const ClockSource &clock;
+    std::array<std::unique_ptr<ControllerShard>, MAX_CONTROLLERS> shards;
+
+    // set up before anything runs, then read-only
+    std::vector<DeviceMatch> deviceMatches;   // profile i + 1
+    Identify identifyDevice;
+
+    // profile loaders write, the mapping thread reads when a controller is created or retired
+    std::mutex profileMutex;
+    using SharedTable = std::shared_ptr<const ActionTable>;
+    std::vector<SharedTable> latestProfiles = std::vector<SharedTable>(1);   // by profile id
+
+    // producer side
+    ControllerShard *lastShard = nullptr;
+    std::atomic<uint64_t> unassigned{0};
+    std::atomic<uint64_t> unrecognized{0};
+
+    // mapping thread side
+    int active = 0;
+};
@@ -0,0 +1,213 @@
+#pragma once
+// DS4 HID report layout and its decoded, compact form.
+//
+// Each PS4ControllerReport is decoded once into a ControllerState: every digital input,
+// including the four D-pad directions, becomes one bit of `buttons`. Press/release edges for a
+// report are then a single XOR against the previous state.
+//
+// The touchpad is sampled faster than reports are sent, so one report carries up to three
+// touch packets (the USB report has room for three), each a frame with two finger slots.
+// All of them are decoded, oldest first, so consumers see every frame of a fast swipe.
+
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#pragma pack(push, 1)
+struct PS4ControllerReport {
+    uint8_t reportId;
+    uint8_t leftStickX;
+    uint8_t leftStickY;
+    uint8_t rightStickX;
+    uint8_t rightStickY;
+    uint8_t buttons1;      // D-pad (lower nibble) and face buttons (upper nibble)
+    uint8_t buttons2;      // Shoulder buttons and stick clicks
+    uint8_t buttons3;      // PS, touchpad, share, options (approx.)
+    uint8_t leftTrigger;
+    uint8_t rightTrigger;
+    uint8_t timestamp[2];  // little endian, 16/3 us units, wraps
+    uint8_t temperature;
+    uint8_t gyroX[2];      // little endian int16: pitch
+    uint8_t gyroY[2];      // yaw
+    uint8_t gyroZ[2];      // roll
+    uint8_t accelX[2];     // little endian int16
+    uint8_t accelY[2];
+    uint8_t accelZ[2];
+    uint8_t unknown2[5];
+    uint8_t battery;
+    uint8_t unknown3[2];
+    uint8_t touchPacketCount;  // valid entries in touchPackets
+    // per packet: frame counter, then two fingers of 4 bytes each:
+    //   [0] bit 7 set = not touching, bits 0-6 tracking id
+    //   [1..3] 12-bit X (0..1919) then 12-bit Y (0..942), little endian nibbles
+    uint8_t touchPackets[3][9];
+    uint8_t unknown4[3];
+};
+#pragma pack(pop)
+static_assert(sizeof(PS4ControllerReport) == 64, "DS4 USB input report is 64 bytes");
+
+// Bit positions in ControllerState::buttons. The order follows the report so decode is
+// shifts and masks: buttons1 >> 4, then buttons2, then the low bits of buttons3, then D-pad.
+enum Button : uint8_t {
+    BTN_SQUARE = 0,
+    BTN_CROSS,
+    BTN_CIRCLE,
+    BTN_TRIANGLE,
+    BTN_L1,
+    BTN_R1,
+    BTN_L2,
+    BTN_R2,
+    BTN_SHARE,
+    BTN_OPTIONS,
+    BTN_L3,
+    BTN_R3,
+    BTN_PS,
+    BTN_PAD,
+    BTN_DPAD_UP,
+    BTN_DPAD_RIGHT,
+    BTN_DPAD_DOWN,
+    BTN_DPAD_LEFT,
+    BTN_COUNT
+};
+
+constexpr uint32_t buttonBit(Button b) { return 1u << b; }
+
+// Index of the lowest set bit; mask must be non-zero.
+inline int lowestBitIndex(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// Call f(Button) for every set bit of mask, lowest first.
+template <typename F>
+inline void forEachButton(uint32_t mask, F &&f) {
+    while (mask) {
+        f(static_cast<Button>(lowestBitIndex(mask)));
+        mask &= mask - 1;
+    }
+}
+
+constexpr uint32_t FACE_BUTTONS = buttonBit(BTN_SQUARE) | buttonBit(BTN_CROSS) |
+                                  buttonBit(BTN_CIRCLE) | buttonBit(BTN_TRIANGLE);
+constexpr uint32_t DPAD_BUTTONS = buttonBit(BTN_DPAD_UP) | buttonBit(BTN_DPAD_RIGHT) |
+                                  buttonBit(BTN_DPAD_DOWN) | buttonBit(BTN_DPAD_LEFT);
+
+constexpr int MAX_TOUCH_FRAMES = 3;
+constexpr uint16_t TOUCHPAD_WIDTH = 1920;
+constexpr uint16_t TOUCHPAD_HEIGHT = 943;
+
+struct TouchPoint {
+    bool active = false;
+    uint8_t id = 0;        // tracking id, stays the same while the finger is down
+    uint16_t x = 0, y = 0;
+};
+
+struct TouchFrame {
+    uint8_t counter = 0;   // increments per touchpad frame, wraps
+    TouchPoint finger[2];
+};
+
+struct ControllerState {
+    uint32_t buttons = 0;   // bitfield of Button
+    uint8_t dpad = 8;       // hat value 0..7 clockwise from Up, 8 = neutral
+    uint8_t leftX = 128, leftY = 128;
+    uint8_t rightX = 128, rightY = 128;
+    uint8_t leftTrigger = 0, rightTrigger = 0;
+    uint8_t battery = 0;
+    uint16_t timestamp = 0;              // sensor timestamp, 16/3 us units
+    int16_t gyro[3] = { 0, 0, 0 };      // raw pitch, yaw, roll
+    int16_t accel[3] = { 0, 0, 0 };     // raw X, Y, Z
+    uint8_t touchFrames = 0;             // valid entries in touch, oldest first
+    TouchFrame touch[MAX_TOUCH_FRAMES];
+
+    bool down(Button b) const { return (buttons & buttonBit(b)) != 0; }
+};
+
+struct ButtonEdges {
+    uint32_t pressed = 0;
+    uint32_t released = 0;
+
+    bool wasPressed(Button b) const { return (pressed & buttonBit(b)) != 0; }
+    bool wasReleased(Button b) const { return (released & buttonBit(b)) != 0; }
+};
+
+inline ButtonEdges diffButtons(const ControllerState &prev, const ControllerState &cur) {
+    uint32_t changed = prev.buttons ^ cur.buttons;
+    return { changed & cur.buttons, changed & prev.buttons };
+}
+
+// hat value -> D-pad direction bits (already shifted to BTN_DPAD_UP)
+constexpr uint32_t DPAD_HAT_BITS[16] = {
+    buttonBit(BTN_DPAD_UP),
+    buttonBit(BTN_DPAD_UP) | buttonBit(BTN_DPAD_RIGHT),
+    buttonBit(BTN_DPAD_RIGHT),
+    buttonBit(BTN_DPAD_RIGHT) | buttonBit(BTN_DPAD_DOWN),
+    buttonBit(BTN_DPAD_DOWN),
+    buttonBit(BTN_DPAD_DOWN) | buttonBit(BTN_DPAD_LEFT),
+    buttonBit(BTN_DPAD_LEFT),
+    buttonBit(BTN_DPAD_LEFT) | buttonBit(BTN_DPAD_UP),
+    0, 0, 0, 0, 0, 0, 0, 0
+};
+
+inline int16_t readLe16(const uint8_t *p) {
+    return static_cast<int16_t>(static_cast<uint16_t>(p[0] | (p[1] << 8)));
+}
+
+inline TouchPoint decodeTouchPoint(const uint8_t *p) {
+    TouchPoint t;
+    t.active = (p[0] & 0x80) == 0;
+    t.id = p[0] & 0x7F;
+    t.x = static_cast<uint16_t>(p[1] | ((p[2] & 0x0F) << 8));
+    t.y = static_cast<uint16_t>((p[2] >> 4) | (p[3] << 4));
+    return t;
+}
+
+// Decode the report's touch packets into s.touch, ordered by frame counter (oldest first).
+inline void decodeTouch(const PS4ControllerReport &r, ControllerState &s) {
+    const int n = r.touchPacketCount < MAX_TOUCH_FRAMES ? r.touchPacketCount : MAX_TOUCH_FRAMES;
+    for (int i = 0; i < n; ++i) {
+        const uint8_t *p = r.touchPackets[i];
+        TouchFrame f;
+        f.counter = p[0];
+        f.finger[0] = decodeTouchPoint(p + 1);
+        f.finger[1] = decodeTouchPoint(p + 5);
+        // insertion sort on the wrapping counter; at most three entries
+        int j = i;
+        for (; j > 0 && static_cast<int8_t>(f.counter - s.touch[j - 1].counter) < 0; --j) s.touch[j] = s.touch[j - 1];
+        s.touch[j] = f;
+    }
+    s.touchFrames = static_cast<uint8_t>(n);
+}
+
+inline ControllerState decodeReport(const PS4ControllerReport &r) {
+    ControllerState s;
+    const uint8_t hat = r.buttons1 & 0x0F;
+    s.buttons = (static_cast<uint32_t>(r.buttons1) >> 4)
+              | (static_cast<uint32_t>(r.buttons2) << 4)
+              | (static_cast<uint32_t>(r.buttons3 & 0x03) << 12)
+              | DPAD_HAT_BITS[hat];
+    s.dpad = hat > 8 ? 8 : hat;
+    s.leftX = r.leftStickX;
+    s.leftY = r.leftStickY;
+    s.rightX = r.rightStickX;
+    s.rightY = r.rightStickY;
+    s.leftTrigger = r.leftTrigger;
+    s.rightTrigger = r.rightTrigger;
+    s.battery = r.battery;
+    s.timestamp = static_cast<uint16_t>(readLe16(r.timestamp));
+    s.gyro[0] = readLe16(r.gyroX);
+    s.gyro[1] = readLe16(r.gyroY);
+    s.gyro[2] = readLe16(r.gyroZ);
+    s.accel[0] = readLe16(r.accelX);
+    s.accel[1] = readLe16(r.accelY);
+    s.accel[2] = readLe16(r.accelZ);
+    decodeTouch(r, s);
+    return s;
+}
@@ -0,0 +1,217 @@
+#pragma once
+// Shared-memory view of the mapper's controllers, for overlays, loggers and other tools.
+//
+// Plain C (C99 or later, or C++), no dependencies: include it, map the region read-only and
+// read it with the functions below. After the mapping is opened nothing here makes a system
+// call or takes a lock.
+//
+// The mapper (main.cpp, linux_main.cpp with --shm[=NAME]) creates the region:
+//   Linux    POSIX shared memory "/NAME" (/dev/shm/NAME): shm_open(O_RDONLY) + mmap(PROT_READ)
+//   Windows  named file mapping "Local\NAME": OpenFileMappingA(FILE_MAP_READ) + MapViewOfFile
+// NAME defaults to DS4_SHM_NAME. tools/shm_reader.c opens it on both.
+//
+// Layout: a 64-byte header, one 128-byte slot per controller holding its latest decoded
+// state, then a ring of the last DS4_SHM_RING_SIZE raw reports from all controllers.
+//
+// Every slot and every ring entry is a seqlock. The writer makes the sequence number odd,
+// writes the payload, then makes it even; a reader copies the payload between two reads of
+// the sequence number and keeps the copy only if both are the same even value. The writer
+// never waits for readers, however many there are or however slow; a reader that races a
+// write retries, which costs it a few hundred nanoseconds at most.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DS4_SHM_NAME            "ds4-mapper"
+#define DS4_SHM_MAGIC           0x4D485344u     // "DSHM" little endian
+#define DS4_SHM_VERSION         1u
+#define DS4_SHM_MAX_CONTROLLERS 8
+#define DS4_SHM_RING_SIZE       1024u           // power of two; about a second at 1 kHz
+#define DS4_SHM_READ_TRIES      1000            // a slot still odd after this: writer died mid-write
+
+// ds4_shm_state.buttons bits; the same order as Button in controller_state.h
+#define DS4_BTN_SQUARE      (1u << 0)
+#define DS4_BTN_CROSS       (1u << 1)
+#define DS4_BTN_CIRCLE      (1u << 2)
+#define DS4_BTN_TRIANGLE    (1u << 3)
+#define DS4_BTN_L1          (1u << 4)
+#define DS4_BTN_R1          (1u << 5)
+#define DS4_BTN_L2          (1u << 6)
+#define DS4_BTN_R2          (1u << 7)
+#define DS4_BTN_SHARE       (1u << 8)
+#define DS4_BTN_OPTIONS     (1u << 9)
+#define DS4_BTN_L3          (1u << 10)
+#define DS4_BTN_R3          (1u << 11)
+#define DS4_BTN_PS          (1u << 12)
+#define DS4_BTN_PAD         (1u << 13)
+#define DS4_BTN_DPAD_UP     (1u << 14)
+#define DS4_BTN_DPAD_RIGHT  (1u << 15)
+#define DS4_BTN_DPAD_DOWN   (1u << 16)
+#define DS4_BTN_DPAD_LEFT   (1u << 17)
+
+// ds4_shm_state.mode
+#define DS4_MODE_VISUALIZER 0
+#define DS4_MODE_VKEYBOARD  1
+
+typedef struct ds4_shm_touch {
+    uint8_t  counter;       // touchpad frame counter, wraps
+    uint8_t  down;          // bit 0: finger 0 touching, bit 1: finger 1
+    uint8_t  id[2];         // tracking ids
+    uint16_t x[2];          // 0..1919
+    uint16_t y[2];          // 0..942
+} ds4_shm_touch;
+
+typedef struct ds4_shm_state {
+    uint64_t received_ns;   // arrival on the host's monotonic clock (CLOCK_MONOTONIC on
+                            // Linux, QueryPerformanceCounter on Windows)
+    uint64_t reports;       // reports received from this controller so far
+    uint32_t buttons;       // DS4_BTN_*
+    uint8_t  dpad;          // hat 0..7 clockwise from up, 8 = neutral
+    uint8_t  left_x, left_y, right_x, right_y;      // 0..255, 128 = centre
+    uint8_t  left_trigger, right_trigger;
+    uint8_t  battery;
+    uint16_t timestamp;     // controller sensor clock, 16/3 us units, wraps
+    int16_t  gyro[3];       // raw pitch, yaw, roll
+    int16_t  accel[3];      // raw X, Y, Z
+    uint8_t  mode;          // DS4_MODE_* of this controller's mapper
+    uint8_t  touch_frames;  // valid entries in touch, oldest first
+    ds4_shm_touch touch[3];
+} ds4_shm_state;
+
+typedef struct ds4_shm_controller {
+    uint32_t seq;           // 0: never reported; odd: being written
+    uint32_t reserved;
+    ds4_shm_state state;
+    uint8_t  pad[40];       // one slot per two cache lines
+} ds4_shm_controller;
+
+typedef struct ds4_shm_report {
+    uint32_t seq;           // 2n+1 while report n is written, then 2n+2 (mod 2^32)
+    uint8_t  controller;    // slot index
+    uint8_t  reserved[3];
+    uint64_t received_ns;
+    uint8_t  data[64];      // the USB input report as received (PS4ControllerReport)
+    uint8_t  pad[16];
+} ds4_shm_report;
+
+typedef struct ds4_shm_header {
+    uint32_t magic;         // DS4_SHM_MAGIC, written last once the region is set up
+    uint32_t version;       // DS4_SHM_VERSION
+    uint32_t size;          // sizeof(ds4_shm_region)
+    uint32_t max_controllers;
+    uint32_t ring_size;
+    uint32_t writer_pid;    // 0 once the writer has exited
+    uint32_t ring_head;     // reports written to the ring so far (wraps)
+    uint32_t reserved[9];
+} ds4_shm_header;
+
+typedef struct ds4_shm_region {
+    ds4_shm_header header;
+    ds4_shm_controller controllers[DS4_SHM_MAX_CONTROLLERS];
+    ds4_shm_report ring[DS4_SHM_RING_SIZE];
+} ds4_shm_region;
+
+// ---------- memory ordering ----------
+// 32-bit loads and stores are atomic on every target; these only add the ordering. MSVC on
+// x86/x64 needs no fence instruction for it (loads are not reordered with loads, nor stores
+// with stores), only a compiler barrier.
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#if defined(_M_ARM64) || defined(_M_ARM)
+#define DS4_SHM_FENCE() __dmb(0xB)  // ISH
+#else
+#define DS4_SHM_FENCE() _ReadWriteBarrier()
+#endif
+#define DS4_SHM_INLINE static __inline
+DS4_SHM_INLINE uint32_t ds4_shm_load_acquire(const uint32_t *p) { uint32_t v = *(const volatile uint32_t *)p; DS4_SHM_FENCE(); return v; }
+DS4_SHM_INLINE uint32_t ds4_shm_load_relaxed(const uint32_t *p) { return *(const volatile uint32_t *)p; }
+DS4_SHM_INLINE void ds4_shm_store_release(uint32_t *p, uint32_t v) { DS4_SHM_FENCE(); *(volatile uint32_t *)p = v; }
+DS4_SHM_INLINE void ds4_shm_store_relaxed(uint32_t *p, uint32_t v) { *(volatile uint32_t *)p = v; }
+DS4_SHM_INLINE void ds4_shm_fence_acquire(void) { DS4_SHM_FENCE(); }
+DS4_SHM_INLINE void ds4_shm_fence_release(void) { DS4_SHM_FENCE(); }
+#else
+#define DS4_SHM_INLINE static inline
+DS4_SHM_INLINE uint32_t ds4_shm_load_acquire(const uint32_t *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+DS4_SHM_INLINE uint32_t ds4_shm_load_relaxed(const uint32_t *p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+DS4_SHM_INLINE void ds4_shm_store_release(uint32_t *p, uint32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+DS4_SHM_INLINE void ds4_shm_store_relaxed(uint32_t *p, uint32_t v) { __atomic_store_n(p, v, __ATOMIC_RELAXED); }
+DS4_SHM_INLINE void ds4_shm_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+DS4_SHM_INLINE void ds4_shm_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+#endif
+
+// ---------- reading ----------
+
+// 1 if `shm` (of `bytes` mapped bytes) is a region this header can read.
+DS4_SHM_INLINE int ds4_shm_valid(const ds4_shm_region *shm, size_t bytes) {
+    return bytes >= sizeof(ds4_shm_region) &&
+           ds4_shm_load_acquire(&shm->header.magic) == DS4_SHM_MAGIC &&
+           shm->header.version == DS4_SHM_VERSION &&
+           shm->header.size == sizeof(ds4_shm_region);
+}
+
+// 1 while the writer process is running.
+DS4_SHM_INLINE int ds4_shm_writer_alive(const ds4_shm_region *shm) {
+    return ds4_shm_load_relaxed(&shm->header.writer_pid) != 0;
+}
+
+// Copy controller `index`'s latest state into *out. Returns 1 on success, 0 if that
+// controller has not reported, -1 if the slot stayed mid-write (the writer died).
+DS4_SHM_INLINE int ds4_shm_read_state(const ds4_shm_region *shm, unsigned index, ds4_shm_state *out) {
+    const ds4_shm_controller *c;
+    int tries;
+    if (index >= DS4_SHM_MAX_CONTROLLERS) return 0;
+    c = &shm->controllers[index];
+    for (tries = 0; tries < DS4_SHM_READ_TRIES; ++tries) {
+        const uint32_t before = ds4_shm_load_acquire(&c->seq);
+        if (before == 0) return 0;
+        if (before & 1u) continue;
+        memcpy(out, &c->state, sizeof(*out));
+        ds4_shm_fence_acquire();
+        if (ds4_shm_load_relaxed(&c->seq) == before) return 1;
+    }
+    return -1;
+}
+
+// Reports written to the ring so far. Start a cursor here to follow only new reports.
+DS4_SHM_INLINE uint32_t ds4_shm_ring_head(const ds4_shm_region *shm) {
+    return ds4_shm_load_acquire(&shm->header.ring_head);
+}
+
+// Copy the report at *cursor into *out and advance the cursor. Returns 1 if a report was
+// copied, 0 if the cursor has caught up with the writer. A reader that fell more than a ring
+// behind skips to the oldest report still there and adds the reports it missed to *lost.
+DS4_SHM_INLINE int ds4_shm_next_report(const ds4_shm_region *shm, uint32_t *cursor, ds4_shm_report *out, uint64_t *lost) {
+    for (;;) {
+        const uint32_t head = ds4_shm_ring_head(shm);
+        const uint32_t n = *cursor;
+        const uint32_t behind = head - n;
+        const ds4_shm_report *e;
+        uint32_t seq;
+        if (behind == 0) return 0;
+        if (behind > 0x80000000u) {             // ahead of the writer: it restarted
+            *cursor = head;
+            return 0;
+        }
+        if (behind >= DS4_SHM_RING_SIZE) {
+            // leave a quarter of the ring as margin against the writer's next laps
+            const uint32_t skip = behind - DS4_SHM_RING_SIZE * 3u / 4u;
+            if (lost) *lost += skip;
+            *cursor = n + skip;
+            continue;
+        }
+        e = &shm->ring[n & (DS4_SHM_RING_SIZE - 1u)];
+        seq = ds4_shm_load_acquire(&e->seq);
+        if (seq == 2u * n + 2u) {
+            memcpy(out, e, sizeof(*out));
+            ds4_shm_fence_acquire();
+            if (ds4_shm_load_relaxed(&e->seq) == seq) {
+                *cursor = n + 1u;
+                return 1;
+            }
+        }
+        // overwritten under us; the next pass sees how far behind that left us
+        if (lost) *lost += 1;
+        *cursor = n + 1u;
+    }
+}
@@ -0,0 +1,177 @@
+#pragma once
+// Linux report source: a hidraw node, or a pipe/file standing in for one.
+//
+// The descriptor is opened non-blocking and waited on with epoll together with any extra
+// descriptors the caller watches (a signalfd for Ctrl+C, say). Reads go into one buffer
+// allocated at open and reused for every wakeup, and reports are handed to the caller in place
+// through the same onReport(device, data, len) callback RawInputDecode uses on Windows.
+//
+// A hidraw node (character device) returns exactly one report per read(). Anything else is
+// treated as a byte stream of fixed-size reports (64 bytes, a DS4 USB report, by default), so
+// `cat capture.bin > fifo` or a plain file can stand in for a controller. Regular files can't
+// be registered with epoll; they are read to EOF as if always readable.
+//
+// A hidraw node whose controller went away (unplugged, Bluetooth link lost) hangs up and fails
+// its reads; poll() reports that as `removed`, so the caller can release what the controller
+// held rather than leave it down.
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class HidrawReportSource {
+public:
+    static constexpr size_t BUFFER_BYTES = 16 * 1024;
+    static constexpr uint32_t DEFAULT_STREAM_REPORT_BYTES = 64;
+
+    struct PollResult {
+        size_t reports = 0;     // reports delivered to onReport
+        uint32_t watchReady = 0; // bit i: the descriptor of watch() slot i is readable
+        bool closed = false;    // EOF (writer went away / end of file) or a read error
+        bool removed = false;   // the hidraw device is gone: hang-up or a read error (implies closed)
+    };
+
+    HidrawReportSource() : buffer(BUFFER_BYTES) {}
+    HidrawReportSource(const HidrawReportSource &) = delete;
+    HidrawReportSource &operator=(const HidrawReportSource &) = delete;
+    ~HidrawReportSource() { close(); }
+
+    // streamReportBytes is the record size for non-hidraw inputs; ignored for hidraw.
+    bool open(const std::string &path, uint32_t streamReportBytes = DEFAULT_STREAM_REPORT_BYTES) {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) return fail("cannot open " + path + ": " + std::strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0) return fail(std::string("cannot stat: ") + std::strerror(errno));
+        packetMode = S_ISCHR(st.st_mode);
+        recordBytes = packetMode ? 0 : streamReportBytes;
+        if (!packetMode && (recordBytes == 0 || recordBytes > BUFFER_BYTES)) return fail("bad stream report size");
+        pending = 0;
+
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) return fail(std::string("epoll_create1: ") + std::strerror(errno));
+        epoll_event ev{};
+        ev.events = EPOLLIN;            // EPOLLHUP and EPOLLERR are always reported
+        ev.data.u64 = 0;
+        alwaysReady = false;
+        watchCount = 0;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            if (errno != EPERM) return fail(std::string("epoll_ctl: ") + std::strerror(errno));
+            alwaysReady = true; // regular file
+        }
+        return true;
+    }
+
+    // Also wake poll() when `watchFd` becomes readable. The caller owns and drains it.
+    // Returns the slot whose bit is set in PollResult::watchReady, or -1.
+    int watch(int watchFd) {
+        if (epfd < 0 || watchCount == MAX_WATCHES) return -1;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = WATCH_TAG | watchCount;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, watchFd, &ev) != 0) return -1;
+        return static_cast<int>(watchCount++);
+    }
+
+    // Wait up to timeoutMs (-1 = forever) for input, then read everything available without
+    // blocking and call onReport(uint64_t device, const uint8_t *data, uint32_t len) for each
+    // report. `data` points into the internal buffer and is only valid during the call.
+    template <typename OnReport>
+    PollResult poll(int timeoutMs, OnReport &&onReport) {
+        PollResult res;
+        bool readable = alwaysReady;
+        epoll_event events[MAX_WATCHES + 1];
+        int n = epoll_wait(epfd, events, MAX_WATCHES + 1, alwaysReady ? 0 : timeoutMs);
+        wokeAt = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag & WATCH_TAG) {
+                res.watchReady |= 1u << (tag & ~WATCH_TAG);
+            } else {
+                readable = true;
+                // a stream's writer hanging up is EOF once its data is read; a hidraw node's is removal
+                if (packetMode && (events[i].events & (EPOLLHUP | EPOLLERR))) res.removed = res.closed = true;
+            }
+        }
+        if (n < 0 && errno != EINTR) res.closed = true;
+        if (readable) drain(res, onReport);
+        return res;
+    }
+
+    void close() {
+        if (epfd >= 0) ::close(epfd);
+        if (fd >= 0) ::close(fd);
+        epfd = fd = -1;
+    }
+
+    // When the current poll() returned from epoll_wait: the "received" time of its reports.
+    std::chrono::steady_clock::time_point lastWake() const { return wokeAt; }
+    bool isHidraw() const { return packetMode; }
+    uint64_t readCalls() const { return reads; }
+    const std::string &lastError() const { return error; }
+
+private:
+    static constexpr uint32_t MAX_WATCHES = 8;
+    static constexpr uint64_t WATCH_TAG = 1ull << 32;
+
+    template <typename OnReport>
+    void drain(PollResult &res, OnReport &onReport) {
+        const uint64_t device = static_cast<uint64_t>(fd);
+        for (;;) {
+            uint8_t *dst = buffer.data() + pending;
+            ssize_t got = ::read(fd, dst, buffer.size() - pending);
+            ++reads;
+            if (got < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    res.closed = true;
+                    res.removed = packetMode;   // ENODEV or EIO: the controller is gone
+                }
+                return;
+            }
+            if (got == 0) { res.closed = true; res.removed = packetMode; return; }
+
+            if (packetMode) {
+                onReport(device, buffer.data(), static_cast<uint32_t>(got));
+                ++res.reports;
+                continue;
+            }
+
+            // stream: slice whole records in place, keep a partial tail for the next read
+            size_t avail = pending + static_cast<size_t>(got);
+            size_t off = 0;
+            for (; avail - off >= recordBytes; off += recordBytes) {
+                onReport(device, buffer.data() + off, recordBytes);
+                ++res.reports;
+            }
+            pending = avail - off;
+            if (pending) std::memmove(buffer.data(), buffer.data() + off, pending);
+        }
+    }
+
+    bool fail(const std::string &why) {
+        error = why;
+        close();
+        return false;
+    }
+
+    int fd = -1;
+    int epfd = -1;
+    bool packetMode = false;
+    bool alwaysReady = false;
+    uint32_t recordBytes = 0;
+    size_t pending = 0;
+    uint32_t watchCount = 0;
+    uint64_t reads = 0;
+    std::chrono::steady_clock::time_point wokeAt{};
+    std::vector<uint8_t> buffer;
+    std::string error;
+};
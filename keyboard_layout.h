@@ -0,0 +1,240 @@
+#pragma once
+// On-screen keyboard layouts: pages of keys loaded from text and compiled once into flat
+// arrays.
+//
+// A layout is up to MAX_PAGES pages (QWERTY, symbols, numeric pad, ...). Each key is compiled
+// to what pressing it does (a virtual-key code, optionally with Shift, or a switch to another
+// page) and to where its cell sits in its row. Each row is also rendered once, unselected, into
+// a fixed text buffer. So pressing a key is an index lookup, a frame copies the prerendered rows
+// and overlays the brackets of the selected cell, and switching pages is an index change. None
+// of it allocates after parsing. A layout is immutable once built and is shared by every
+// controller's mapper and the visualizer.
+//
+// Layout text:
+//
+//   # comment
+//   [page qwerty]
+//   Q W E R T Y U I O P
+//   A S D F G H J K L ENTER
+//   ?123>symbols SPACE BACKSPACE
+//   [page symbols]
+//   !=shift+1 @=shift+2 ...
+//
+// One line per row, keys separated by spaces. A key is a key name (vkForKeyName() in
+// mapping_profile.h) that is also its label, LABEL=KEY to show one thing and send another
+// (KEY may start with shift+), or LABEL>PAGE to switch to another page.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "mapping_profile.h"
+#include "vk_codes.h"
+
+struct LayoutKey {
+    enum Kind : uint8_t { Key, Page };
+    static constexpr uint8_t MOD_SHIFT = 1;
+    static constexpr int LABEL_CHARS = 11;
+
+    Kind kind = Key;
+    uint8_t modifiers = 0;      // MOD_SHIFT: held for this key only
+    uint16_t vk = 0;            // Key
+    uint8_t page = 0;           // Page: index of the target page
+    uint8_t x = 0;              // cell column in the row's prerendered text
+    uint8_t labelLen = 0;
+    char label[LABEL_CHARS + 1] = {};
+};
+
+struct LayoutPage {
+    static constexpr int MAX_ROWS = 6;
+    static constexpr int MAX_COLS = 14;
+    static constexpr int ROW_CHARS = 160;
+    static constexpr int NAME_CHARS = 15;
+
+    char name[NAME_CHARS + 1] = {};
+    int rows = 0;
+    std::array<uint8_t, MAX_ROWS> rowLength{};
+    LayoutKey keys[MAX_ROWS][MAX_COLS];
+    char rowText[MAX_ROWS][ROW_CHARS] = {};     // unselected rendering of each row
+    std::array<uint8_t, MAX_ROWS> rowTextLen{};
+
+    const LayoutKey &key(int row, int col) const { return keys[row][col]; }
+};
+
+class KeyboardLayout {
+public:
+    static constexpr int MAX_PAGES = 8;
+    // cell: " LABEL " padded to at least KEY_WIDTH, then a one-column gap; selected "[LABEL]"
+    static constexpr int KEY_WIDTH = 7;
+
+    int pageCount() const { return pages; }
+    const LayoutPage &page(int i) const { return pageData[i]; }
+    // Rows of the tallest page, so what is drawn under the keyboard doesn't move between pages.
+    int maxRows() const { return tallest; }
+
+    int findPage(const char *name) const {
+        for (int i = 0; i < pages; ++i) {
+            if (std::strcmp(pageData[i].name, name) == 0) return i;
+        }
+        return -1;
+    }
+
+    // Parse layout text. On failure returns false, leaves `layout` untouched and describes the
+    // first problem, with its line number, in `error`.
+    static bool parse(const std::string &text, KeyboardLayout &layout, std::string &error) {
+        auto l = std::make_unique<KeyboardLayout>();
+        // page targets can name pages further down; resolved after every page is known
+        std::string pageTargets[MAX_PAGES][LayoutPage::MAX_ROWS][LayoutPage::MAX_COLS];
+        int targetLine[MAX_PAGES][LayoutPage::MAX_ROWS][LayoutPage::MAX_COLS] = {};
+        std::istringstream in(text);
+        std::string line;
+        int lineNo = 0;
+        auto fail = [&](int at, const std::string &what) {
+            error = "line " + std::to_string(at) + ": " + what;
+            return false;
+        };
+        while (std::getline(in, line)) {
+            ++lineNo;
+            const size_t b = line.find_first_not_of(" \t\r");
+            if (b == std::string::npos || line[b] == '#') continue;
+            line = line.substr(b, line.find_last_not_of(" \t\r") - b + 1);
+            if (line.front() == '[') {
+                if (line.back() != ']' || line.compare(0, 6, "[page ") != 0) return fail(lineNo, "expected [page NAME]");
+                const std::string name = line.substr(6, line.size() - 7);
+                if (name.empty() || name.size() > LayoutPage::NAME_CHARS) return fail(lineNo, "page name must be 1-15 characters");
+                if (l->findPage(name.c_str()) >= 0) return fail(lineNo, "duplicate page '" + name + "'");
+                if (l->pages == MAX_PAGES) return fail(lineNo, "more than 8 pages");
+                std::memcpy(l->pageData[l->pages].name, name.c_str(), name.size() + 1);
+                ++l->pages;
+                continue;
+            }
+            if (l->pages == 0) return fail(lineNo, "keys outside of a [page]");
+            const int pageIndex = l->pages - 1;
+            LayoutPage &p = l->pageData[pageIndex];
+            if (p.rows == LayoutPage::MAX_ROWS) return fail(lineNo, "more than 6 rows on a page");
+            const int row = p.rows++;
+            std::istringstream tokens(line);
+            std::string token;
+            while (tokens >> token) {
+                if (p.rowLength[row] == LayoutPage::MAX_COLS) return fail(lineNo, "more than 14 keys in a row");
+                const int col = p.rowLength[row]++;
+                LayoutKey &k = p.keys[row][col];
+                std::string label = token;
+                const size_t eq = token.find('=', 1), gt = token.find('>', 1);
+                if (eq != std::string::npos) {
+                    label = token.substr(0, eq);
+                    std::string spec = token.substr(eq + 1);
+                    if (spec.compare(0, 6, "shift+") == 0) {
+                        k.modifiers |= LayoutKey::MOD_SHIFT;
+                        spec = spec.substr(6);
+                    }
+                    k.vk = vkForKeyName(spec);
+                    if (!k.vk) return fail(lineNo, "unknown key '" + spec + "'");
+                } else if (gt != std::string::npos) {
+                    label = token.substr(0, gt);
+                    k.kind = LayoutKey::Page;
+                    pageTargets[pageIndex][row][col] = token.substr(gt + 1);
+                    targetLine[pageIndex][row][col] = lineNo;
+                } else {
+                    k.vk = vkForKeyName(token);
+                    if (!k.vk) return fail(lineNo, "unknown key '" + token + "'");
+                }
+                if (label.size() > LayoutKey::LABEL_CHARS) return fail(lineNo, "label '" + label + "' longer than 11 characters");
+                std::memcpy(k.label, label.c_str(), label.size() + 1);
+                k.labelLen = static_cast<uint8_t>(label.size());
+            }
+            if (!prerender(p, row)) return fail(lineNo, "row too wide to draw");
+        }
+        if (l->pages == 0) return fail(lineNo, "no [page] in layout");
+        for (int pi = 0; pi < l->pages; ++pi) {
+            LayoutPage &p = l->pageData[pi];
+            if (p.rows == 0) return fail(lineNo, "page '" + std::string(p.name) + "' has no keys");
+            for (int r = 0; r < p.rows; ++r) {
+                for (int c = 0; c < p.rowLength[r]; ++c) {
+                    if (p.keys[r][c].kind != LayoutKey::Page) continue;
+                    const int target = l->findPage(pageTargets[pi][r][c].c_str());
+                    if (target < 0) return fail(targetLine[pi][r][c], "no page named '" + pageTargets[pi][r][c] + "'");
+                    p.keys[r][c].page = static_cast<uint8_t>(target);
+                }
+            }
+            l->tallest = (std::max)(l->tallest, p.rows);
+        }
+        layout = *l;
+        return true;
+    }
+
+    static bool load(const std::string &path, KeyboardLayout &layout, std::string &error) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) {
+            error = "cannot open " + path;
+            return false;
+        }
+        std::ostringstream text;
+        text << f.rdbuf();
+        if (!parse(text.str(), layout, error)) {
+            error = path + ": " + error;
+            return false;
+        }
+        return true;
+    }
+
+    // QWERTY, symbols and numeric pad pages; the same as layouts/qwerty.layout.
+    static const KeyboardLayout &builtIn() {
+        static const KeyboardLayout layout = [] {
+            KeyboardLayout l;
+            std::string error;
+            parse(BUILT_IN_TEXT, l, error);
+            return l;
+        }();
+        return layout;
+    }
+
+    static constexpr const char *BUILT_IN_TEXT =
+        "[page qwerty]\n"
+        "Q W E R T Y U I O P\n"
+        "A S D F G H J K L ENTER\n"
+        "Z X C V B N M , . /\n"
+        "SPACE BACKSPACE ?123>symbols NUM>numpad\n"
+        "[page symbols]\n"
+        "1 2 3 4 5 6 7 8 9 0\n"
+        "!=shift+1 @=shift+2 #=shift+3 $=shift+4 %=shift+5 ^=shift+6 &=shift+7 *=shift+8 (=shift+9 )=shift+0\n"
+        "- _=shift+- = +=shift+= [ ] ; :=shift+; ' \"=shift+'\n"
+        "SPACE BACKSPACE ABC>qwerty ` ~=shift+` \\ |=shift+\\ ?=shift+/\n"
+        "[page numpad]\n"
+        "7=NUM7 8=NUM8 9=NUM9 /=NUM/\n"
+        "4=NUM4 5=NUM5 6=NUM6 *=NUM*\n"
+        "1=NUM1 2=NUM2 3=NUM3 -=NUM-\n"
+        "0=NUM0 .=NUM. ENTER +=NUM+\n"
+        "BACKSPACE ABC>qwerty\n";
+
+private:
+    // Lay out one row's cells and render it unselected.
+    static bool prerender(LayoutPage &p, int row) {
+        char *text = p.rowText[row];
+        int x = 0;
+        for (int c = 0; c < p.rowLength[row]; ++c) {
+            LayoutKey &k = p.keys[row][c];
+            const int width = (std::max)(k.labelLen + 2, KEY_WIDTH);
+            if (x + width > LayoutPage::ROW_CHARS) return false;
+            std::memset(text + x, ' ', static_cast<size_t>(width));
+            std::memcpy(text + x + 1, k.label, k.labelLen);
+            k.x = static_cast<uint8_t>(x);
+            x += width;
+            if (c + 1 < p.rowLength[row]) {
+                if (x + 1 > LayoutPage::ROW_CHARS) return false;
+                text[x++] = ' ';
+            }
+        }
+        p.rowTextLen[row] = static_cast<uint8_t>(x);
+        return true;
+    }
+
+    std::array<LayoutPage, MAX_PAGES> pageData{};
+    int pages = 0;
+    int tallest = 0;
+};
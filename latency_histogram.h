@@ -0,0 +1,212 @@
+#pragma once
+// Per-stage latency histograms for the report pipeline.
+//
+// Each report carries four timestamps:
+//   received   WM_INPUT handled on the message thread
+//   dequeued   popped from the report ring by the mapping thread
+//   mapped     processMapping() returned
+//   submitted  OutputBatch::flush() (SendInput) returned
+// and PipelineLatency records the gaps between them into LatencyHistograms.
+//
+// LatencyHistogram is HDR-style: values up to 2^40 ns (~18 minutes) go into log-linear buckets,
+// 32 per power of two, so any percentile is within ~3% of the true value. There is one writer
+// (the mapping thread) and any number of readers; a record is a bucket-index computation and a
+// few relaxed atomic load/store pairs, no locks and no read-modify-write instructions, so it
+// stays on in release builds. Readers may see a count that is one record ahead of the buckets,
+// which only matters to the last digit of a live display.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 5;                        // 32 buckets per power of two
+    static constexpr uint64_t SUB_COUNT = 1ull << SUB_BITS;
+    static constexpr int MAX_BITS = 40;                       // values are clamped below 2^40 ns
+    static constexpr size_t BUCKET_COUNT = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+    static constexpr uint64_t MAX_VALUE = (1ull << MAX_BITS) - 1;
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram &) = delete;
+    LatencyHistogram &operator=(const LatencyHistogram &) = delete;
+
+    // Writer thread only.
+    void record(uint64_t ns) {
+        ns = (std::min)(ns, MAX_VALUE);
+        bump(buckets[bucketIndex(ns)], 1);
+        bump(total, 1);
+        bump(sumNs, ns);
+        if (ns > maxNs.load(std::memory_order_relaxed)) maxNs.store(ns, std::memory_order_relaxed);
+    }
+
+    void record(std::chrono::steady_clock::duration d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        record(static_cast<uint64_t>(ns < 0 ? 0 : ns));
+    }
+
+    // Any thread.
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t maxValue() const { return maxNs.load(std::memory_order_relaxed); }
+    double meanNs() const {
+        uint64_t n = count();
+        return n ? static_cast<double>(sumNs.load(std::memory_order_relaxed)) / n : 0.0;
+    }
+    uint64_t sumNanoseconds() const { return sumNs.load(std::memory_order_relaxed); }
+    uint64_t bucketCount(size_t i) const { return buckets[i].load(std::memory_order_relaxed); }
+
+    // Smallest bucket upper bound that covers fraction q (0..1) of the recorded values.
+    uint64_t percentile(double q) const {
+        uint64_t n = 0;
+        for (const auto &b : buckets) n += b.load(std::memory_order_relaxed);
+        if (n == 0) return 0;
+        const uint64_t rank = (std::max)(uint64_t(1), static_cast<uint64_t>(q * n + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) return (std::min)(bucketHigh(i), maxValue());
+        }
+        return maxValue();
+    }
+
+    // One "low_ns,high_ns,count" line per non-empty bucket.
+    void dumpBuckets(std::ostream &out, const char *prefix) const {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            uint64_t c = buckets[i].load(std::memory_order_relaxed);
+            if (c) out << prefix << bucketLow(i) << ',' << bucketHigh(i) << ',' << c << '\n';
+        }
+    }
+
+    // Values below 2 * SUB_COUNT get a bucket each; above that, each power of two
+    // [2^k, 2^(k+1)) is split into SUB_COUNT buckets of width 2^(k - SUB_BITS).
+    static size_t bucketIndex(uint64_t ns) {
+        if (ns < 2 * SUB_COUNT) return static_cast<size_t>(ns);
+        const int shift = highestBitIndex(ns) - SUB_BITS;
+        return static_cast<size_t>((shift + 1) * SUB_COUNT + ((ns >> shift) - SUB_COUNT));
+    }
+    static uint64_t bucketLow(size_t i) {
+        if (i < 2 * SUB_COUNT) return i;
+        const int shift = static_cast<int>(i / SUB_COUNT) - 1;
+        return (i % SUB_COUNT + SUB_COUNT) << shift;
+    }
+    static uint64_t bucketHigh(size_t i) {
+        if (i < 2 * SUB_COUNT) return i;
+        const int shift = static_cast<int>(i / SUB_COUNT) - 1;
+        return bucketLow(i) + (1ull << shift) - 1;
+    }
+
+private:
+    // Single writer: a relaxed load + store is enough and avoids a locked add.
+    static void bump(std::atomic<uint64_t> &a, uint64_t by) {
+        a.store(a.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    static int highestBitIndex(uint64_t v) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanReverse(&index, static_cast<unsigned long>(v >> 32))) return static_cast<int>(index) + 32;
+        _BitScanReverse(&index, static_cast<unsigned long>(v));
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(v);
+#endif
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> buckets{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sumNs{0};
+    std::atomic<uint64_t> maxNs{0};
+};
+
+// Percentiles of one stage, computed by a reader for display.
+struct LatencySummary {
+    uint64_t count = 0;
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;
+};
+
+class PipelineLatency {
+public:
+    enum Stage { QUEUE, MAP, SUBMIT, TOTAL, TIMER, STAGE_COUNT };
+    using Table = std::array<LatencySummary, STAGE_COUNT>;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    // Mapping thread, once per report after its output was submitted.
+    void record(time_point received, time_point dequeued, time_point mapped, time_point submitted) {
+        stages[QUEUE].record(dequeued - received);
+        stages[MAP].record(mapped - dequeued);
+        stages[SUBMIT].record(submitted - mapped);
+        stages[TOTAL].record(submitted - received);
+    }
+
+    const LatencyHistogram &stage(Stage s) const { return stages[s]; }
+
+    // Not a report stage: how late the mapper's timers (key repeat, keyboard move, combo hold,
+    // macro step) fire after their deadline. Pass it to PS4Mapper::runTimers().
+    LatencyHistogram &timerLateness() { return stages[TIMER]; }
+
+    LatencySummary summary(Stage s) const {
+        const LatencyHistogram &h = stages[s];
+        LatencySummary out;
+        out.count = h.count();
+        out.p50Ns = h.percentile(0.50);
+        out.p99Ns = h.percentile(0.99);
+        out.p999Ns = h.percentile(0.999);
+        out.maxNs = h.maxValue();
+        return out;
+    }
+
+    // Reader side; scans every bucket, so call it at display rate, not per report.
+    Table summarize() const {
+        Table t;
+        for (int s = 0; s < STAGE_COUNT; ++s) t[s] = summary(static_cast<Stage>(s));
+        return t;
+    }
+
+    static const char *stageName(Stage s) {
+        switch (s) {
+            case QUEUE: return "queue";     // received -> dequeued
+            case MAP: return "map";         // dequeued -> mapped
+            case SUBMIT: return "submit";   // mapped -> submitted
+            case TIMER: return "timer";     // timer deadline -> fired
+            default: return "total";        // received -> submitted
+        }
+    }
+
+    // Human-readable percentile table.
+    void printSummary(std::ostream &out) const {
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-8s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 us", "p99 us", "p99.9 us", "max us");
+        out << line;
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            LatencySummary sum = summary(static_cast<Stage>(s));
+            std::snprintf(line, sizeof(line), "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+                          stageName(static_cast<Stage>(s)), static_cast<unsigned long long>(sum.count),
+                          sum.p50Ns / 1000.0, sum.p99Ns / 1000.0, sum.p999Ns / 1000.0, sum.maxNs / 1000.0);
+            out << line;
+        }
+    }
+
+    // Full histograms as CSV: stage,low_ns,high_ns,count.
+    void dumpCsv(std::ostream &out) const {
+        out << "stage,low_ns,high_ns,count\n";
+        for (int s = 0; s < STAGE_COUNT; ++s) {
+            std::string prefix = std::string(stageName(static_cast<Stage>(s))) + ',';
+            stages[s].dumpBuckets(out, prefix.c_str());
+        }
+    }
+
+private:
+    LatencyHistogram stages[STAGE_COUNT];
+};
@@ -0,0 +1,364 @@
+// Linux front end: hidraw (or a stand-in pipe/file) -> PS4Mapper -> uinput.
+//
+//   g++ -std=c++17 -O2 -pthread -I. linux_main.cpp -o ps4-mapper-linux
+//   sudo ./ps4-mapper-linux /dev/hidraw3 [--vkeyboard] [--gyro] [--trackpad] [--mouse-hz=N] [--profile=FILE] [--dictionary=FILE] [--layout=FILE] [--capture=FILE] [--latency-dump=FILE] [--shm[=NAME]] [--metrics[=PORT]]
+//
+// Without a controller, feed it raw 64-byte reports through a FIFO or a file and print the
+// mapped events instead of injecting them (78-byte Bluetooth reports with --report-size=78):
+//
+//   mkfifo /tmp/ds4 && ./ps4-mapper-linux /tmp/ds4 --dry-run &
+//   cat reports.bin > /tmp/ds4
+//
+// Reports go through a ReportParser (report_parser.h), so a controller on USB or Bluetooth
+// maps the same way; reports in neither format, or failing their checksum, are counted.
+// A hidraw controller that goes away (unplugged, Bluetooth link lost) has everything it held
+// released at once, and the program ends.
+//
+// The mapping core is the same portable code main.cpp uses; only input and output differ.
+// One thread does the mapping: epoll wakes it for reports, the mouse motion timerfd and Ctrl+C,
+// and a second timerfd armed at the mapper's earliest deadline (key repeat, keyboard move,
+// combo hold, macro step), like the event-driven loop on Windows.
+// With --profile, a watcher thread recompiles the profile when the file changes and wakes the
+// loop through an eventfd to swap it in.
+// With --shm, every report's decoded state is published for other processes to read
+// (ds4_shared_state.h, tools/shm_reader.c).
+// With --metrics, a server thread answers Prometheus scrapes on 127.0.0.1:PORT (default 9470)
+// from counters this loop copies out once per wakeup (mapper_metrics.h).
+
+#include "hidraw_source.h"
+#include "latency_histogram.h"
+#include "mapper_metrics.h"
+#include "metrics_server.h"
+#include "output_sink.h"
+#include "profile_watcher.h"
+#include "ps4_mapper.h"
+#include "report_capture.h"
+#include "report_parser.h"
+#include "shared_state.h"
+#include "uinput_sink.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// --dry-run sink: one line per submission.
+class PrintSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        std::string line;
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            char buf[48];
+            switch (e.type) {
+                case OutputEvent::Key: std::snprintf(buf, sizeof(buf), " key %02X %s", e.vk, e.down ? "down" : "up"); break;
+                case OutputEvent::MouseMove: std::snprintf(buf, sizeof(buf), " move %d,%d", e.dx, e.dy); break;
+                case OutputEvent::MouseButton:
+                    std::snprintf(buf, sizeof(buf), " %s %s", e.left ? "lmb" : "rmb", e.down ? "down" : "up");
+                    break;
+                case OutputEvent::MouseWheel: std::snprintf(buf, sizeof(buf), " wheel %d,%d", e.dx, e.dy); break;
+            }
+            line += buf;
+        }
+        std::printf("out%s\n", line.c_str());
+    }
+};
+
+struct LinuxOptions {
+    std::string device;
+    bool dryRun = false;
+    bool vkeyboard = false;
+    uint32_t streamReportBytes = HidrawReportSource::DEFAULT_STREAM_REPORT_BYTES;
+    std::string capturePath;
+    std::string latencyDumpPath;
+    bool gyroAim = false;
+    bool trackpad = false;
+    float gyroSensitivity = 8.0f;
+    int mouseHz = 1000;
+    StickConfig mouseStick = PS4Mapper::MOUSE_STICK_CONFIG;
+    std::string profilePath;
+    std::string dictionaryPath;
+    std::string layoutPath;
+    std::string sharedStateName;
+    int metricsPort = 0;
+};
+
+static int run(const LinuxOptions &opts) {
+    // Ctrl+C / SIGTERM arrive as a readable signalfd in the same epoll set
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, nullptr);
+    int sigfd = signalfd(-1, &stopSignals, SFD_CLOEXEC | SFD_NONBLOCK);
+
+    HidrawReportSource source;
+    if (!source.open(opts.device, opts.streamReportBytes)) {
+        std::cerr << source.lastError() << std::endl;
+        return 1;
+    }
+    const int stopSlot = sigfd >= 0 ? source.watch(sigfd) : -1;
+
+    // cursor motion goes out on its own periodic timer, armed only while the cursor moves
+    int mouseTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    const int mouseSlot = mouseTimer >= 0 ? source.watch(mouseTimer) : -1;
+    if (mouseSlot < 0) {
+        std::cerr << "cannot create mouse timer" << std::endl;
+        return 1;
+    }
+    bool mouseTimerArmed = false;
+
+    // one-shot timer at the mapper's earliest deadline; steady_clock is CLOCK_MONOTONIC here,
+    // so the deadline goes in as an absolute time with nanosecond resolution instead of an
+    // epoll timeout rounded up to whole milliseconds
+    int deadlineTimer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    const int deadlineSlot = deadlineTimer >= 0 ? source.watch(deadlineTimer) : -1;
+    if (deadlineSlot < 0) {
+        std::cerr << "cannot create deadline timer" << std::endl;
+        return 1;
+    }
+    ClockSource::time_point deadlineArmed = ClockSource::time_point::max(); // max: disarmed
+
+    PrintSink printSink;
+    UinputSink uinputSink;
+    if (!opts.dryRun && !uinputSink.open()) {
+        std::cerr << uinputSink.lastError() << " (use --dry-run to only print events)" << std::endl;
+        return 1;
+    }
+    OutputSink &sink = opts.dryRun ? static_cast<OutputSink &>(printSink) : uinputSink;
+    OutputBatch output(sink);
+    PS4Mapper mapper(output);
+    if (opts.vkeyboard) mapper.setMode(PS4Mapper::MODE_VKEYBOARD);
+    mapper.setGyroAim(opts.gyroAim);
+    mapper.setTrackpad(opts.trackpad);
+    mapper.setGyroSensitivity(opts.gyroSensitivity);
+    mapper.setMouseTickRate(opts.mouseHz);
+    mapper.setMouseStick(opts.mouseStick);
+    WordDictionary dictionary;
+    if (!opts.dictionaryPath.empty()) {
+        if (!dictionary.open(opts.dictionaryPath)) {
+            std::cerr << opts.dictionaryPath << ": " << dictionary.lastError() << std::endl;
+            return 1;
+        }
+        mapper.setDictionary(&dictionary);
+    }
+    KeyboardLayout keyboardLayout = KeyboardLayout::builtIn();
+    if (!opts.layoutPath.empty()) {
+        std::string error;
+        if (!KeyboardLayout::load(opts.layoutPath, keyboardLayout, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        mapper.setKeyboardLayout(&keyboardLayout);
+    }
+    output.flush();
+
+    // profile reloads: compiled on the watcher thread, swapped in by this loop between reports
+    ProfileExchange profile;
+    ProfileWatcher profileWatcher;
+    int profileWake = -1, profileSlot = -1;
+    if (!opts.profilePath.empty()) {
+        profileWake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        profileSlot = profileWake >= 0 ? source.watch(profileWake) : -1;
+        auto onLoad = [&](const ActionTable &t) {
+            profile.publish(std::make_unique<ActionTable>(t));
+            const uint64_t one = 1;
+            (void)!write(profileWake, &one, sizeof(one));
+        };
+        auto onError = [](const std::string &why) { std::cerr << "profile not loaded: " << why << std::endl; };
+        if (profileSlot < 0 || !profileWatcher.start(opts.profilePath, onLoad, onError)) return 1;
+        mapper.adoptActionTable(profile);
+        output.flush();
+    }
+
+    ReportCaptureWriter capture;
+    if (!opts.capturePath.empty() && !capture.open(opts.capturePath)) {
+        std::cerr << "Failed to open capture file: " << opts.capturePath << std::endl;
+        return 1;
+    }
+    SharedStatePublisher sharedState;
+    if (!opts.sharedStateName.empty() && !sharedState.open(opts.sharedStateName)) {
+        std::cerr << sharedState.lastError() << std::endl;
+        return 1;
+    }
+
+    PipelineLatency latency;
+    MapperMetrics metrics(latency);
+    MetricsServer metricsServer;
+    if (opts.metricsPort != 0 &&
+        !metricsServer.start(static_cast<uint16_t>(opts.metricsPort), [&metrics] { return metrics.render(); })) {
+        std::cerr << metricsServer.lastError() << std::endl;
+        return 1;
+    }
+
+    ReportParser parser;
+    bool done = false;
+    while (!done) {
+        const auto deadline = mapper.nextTimerDeadline().value_or(ClockSource::time_point::max());
+        if (deadline != deadlineArmed) {
+            deadlineArmed = deadline;
+            itimerspec spec{};
+            if (deadline != ClockSource::time_point::max()) {
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+                spec.it_value.tv_sec = ns / 1000000000;
+                spec.it_value.tv_nsec = ns % 1000000000;
+                if (ns <= 0) spec.it_value.tv_nsec = 1; // all-zero would disarm
+            }
+            timerfd_settime(deadlineTimer, TFD_TIMER_ABSTIME, &spec, nullptr);
+        }
+
+        auto onReport = [&](uint64_t /*device*/, const uint8_t *data, uint32_t len) {
+            PS4ControllerReport report;
+            if (!parser.parse(data, len, report)) return; // counted in parser.rejected()
+            const auto received = source.lastWake();
+            const auto dequeued = std::chrono::steady_clock::now();
+            const bool mappedReport = mapper.processReport(report); // false: nothing the mapping reads changed
+            const auto mapped = std::chrono::steady_clock::now();
+            if (mappedReport) output.flush(); // one uinput write per processed report
+            latency.record(received, dequeued, mapped, std::chrono::steady_clock::now());
+            if (capture.isOpen()) capture.write(received, report);
+            if (sharedState.isOpen()) sharedState.publish(0, received, report, mapper.currentMode());
+        };
+        HidrawReportSource::PollResult res = source.poll(-1, onReport);
+
+        // stop on Ctrl+C, or once the stand-in's writer is gone / the file is exhausted
+        if ((stopSlot >= 0 && (res.watchReady & (1u << stopSlot))) || res.closed) done = true;
+        if (res.removed) {
+            // unplugged or out of Bluetooth range: nothing it held may stay down
+            std::cerr << "controller removed: " << opts.device << std::endl;
+            mapper.releaseAllInputs();
+            output.flush();
+            break;
+        }
+
+        if (profileSlot >= 0 && (res.watchReady & (1u << profileSlot))) {
+            uint64_t wakes;
+            (void)!read(profileWake, &wakes, sizeof(wakes));
+            if (mapper.adoptActionTable(profile)) std::cerr << "profile reloaded: " << opts.profilePath << std::endl;
+        }
+        if (res.watchReady & (1u << mouseSlot)) {
+            uint64_t expirations;
+            (void)!read(mouseTimer, &expirations, sizeof(expirations));
+            mapper.tickMouse();
+        }
+        if (res.watchReady & (1u << deadlineSlot)) {
+            uint64_t expirations;
+            (void)!read(deadlineTimer, &expirations, sizeof(expirations));
+            deadlineArmed = ClockSource::time_point::max(); // fired; re-arm for whatever is next
+        }
+        mapper.runTimers(&latency.timerLateness());
+        output.flush();
+
+        if (mapper.isMouseMotionActive() != mouseTimerArmed) {
+            mouseTimerArmed = !mouseTimerArmed;
+            itimerspec spec{};
+            if (mouseTimerArmed) {
+                const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mapper.mouseTickInterval()).count();
+                spec.it_interval.tv_sec = ns / 1000000000;
+                spec.it_interval.tv_nsec = ns % 1000000000;
+                spec.it_value = spec.it_interval;
+            }
+            timerfd_settime(mouseTimer, 0, &spec, nullptr); // all-zero disarms
+        }
+
+        if (metricsServer.isRunning()) {
+            ControllerCounters c;
+            c.reports = mapper.reportsMapped() + mapper.reportsSkipped();
+            c.skipped = mapper.reportsSkipped();
+            c.rejected = parser.rejected();
+            c.outputEvents = output.eventCount();
+            c.outputSubmissions = output.submissionCount();
+            c.stuckKeyResets = mapper.stuckKeyResets();
+            metrics.update(0, c);
+        }
+    }
+
+    mapper.releaseAllInputs();
+    output.flush();
+    metricsServer.stop();
+
+    std::cout << (source.isHidraw() ? "hidraw" : "stream") << " source: "
+              << latency.stage(PipelineLatency::TOTAL).count() << " reports in "
+              << source.readCalls() << " reads, " << reportFormatName(parser.format()) << " format, "
+              << parser.rejected() << " rejected\n";
+    std::cout << "Mapped " << mapper.reportsMapped() << " reports, " << mapper.reportsSkipped() << " unchanged skipped\n";
+    std::cout << "Output: " << output.eventCount() << " events in " << output.submissionCount() << " submissions";
+    if (!opts.dryRun) std::cout << ", " << uinputSink.unmappedKeyCount() << " keys without an evdev code";
+    std::cout << "\n";
+    latency.printSummary(std::cout);
+    if (!opts.latencyDumpPath.empty()) {
+        std::ofstream dump(opts.latencyDumpPath);
+        latency.dumpCsv(dump);
+    }
+    if (capture.isOpen()) {
+        capture.close();
+        std::cout << "Captured " << capture.recordCount() << " reports to " << opts.capturePath << std::endl;
+    }
+    if (sharedState.isOpen()) {
+        std::cout << "Published " << sharedState.published() << " reports to /dev/shm/" << opts.sharedStateName << std::endl;
+    }
+    if (opts.metricsPort != 0) {
+        std::cout << "Served " << metricsServer.scrapeCount() << " metrics scrapes on 127.0.0.1:" << metricsServer.port() << std::endl;
+    }
+    if (!opts.profilePath.empty()) {
+        profileWatcher.stop();
+        std::cout << "Profile: " << profileWatcher.reloadCount() << " reloads, "
+                  << profileWatcher.rejectedCount() << " rejected" << std::endl;
+        close(profileWake);
+    }
+    if (sigfd >= 0) close(sigfd);
+    close(mouseTimer);
+    close(deadlineTimer);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    LinuxOptions opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dry-run") opts.dryRun = true;
+        else if (arg == "--vkeyboard") opts.vkeyboard = true;
+        else if (arg.rfind("--report-size=", 0) == 0) opts.streamReportBytes = static_cast<uint32_t>(std::atoi(arg.c_str() + 14));
+        else if (arg.rfind("--capture=", 0) == 0) opts.capturePath = arg.substr(10);
+        else if (arg.rfind("--latency-dump=", 0) == 0) opts.latencyDumpPath = arg.substr(15);
+        else if (arg == "--gyro") opts.gyroAim = true;
+        else if (arg == "--trackpad") opts.trackpad = true;
+        else if (arg.rfind("--mouse-hz=", 0) == 0) opts.mouseHz = (std::max)(1, std::atoi(arg.c_str() + 11));
+        else if (arg.rfind("--gyro-sens=", 0) == 0) opts.gyroSensitivity = static_cast<float>(std::atof(arg.c_str() + 12));
+        else if (arg.rfind("--mouse-curve=", 0) == 0) {
+            AxisCurve curve;
+            if (!parseAxisCurve(arg.substr(14), curve)) { std::fprintf(stderr, "invalid curve: %s\n", arg.c_str()); return 2; }
+            opts.mouseStick.curveX = opts.mouseStick.curveY = curve;
+        }
+        else if (arg.rfind("--mouse-deadzone=", 0) == 0) {
+            if (!parseDeadzone(arg.substr(17), opts.mouseStick)) { std::fprintf(stderr, "invalid deadzone: %s\n", arg.c_str()); return 2; }
+        }
+        else if (arg.rfind("--profile=", 0) == 0) opts.profilePath = arg.substr(10);
+        else if (arg.rfind("--dictionary=", 0) == 0) opts.dictionaryPath = arg.substr(13);
+        else if (arg.rfind("--layout=", 0) == 0) opts.layoutPath = arg.substr(9);
+        else if (arg == "--shm") opts.sharedStateName = DS4_SHM_NAME;
+        else if (arg.rfind("--shm=", 0) == 0) opts.sharedStateName = arg.substr(6);
+        else if (arg == "--metrics") opts.metricsPort = MetricsServer::DEFAULT_PORT;
+        else if (arg.rfind("--metrics=", 0) == 0) {
+            opts.metricsPort = std::atoi(arg.c_str() + 10);
+            if (opts.metricsPort < 1 || opts.metricsPort > 65535) { std::fprintf(stderr, "invalid metrics port: %s\n", arg.c_str()); return 2; }
+        }
+        else if (opts.device.empty()) opts.device = arg;
+    }
+    if (opts.device.empty()) {
+        std::fprintf(stderr, "usage: %s <hidraw|fifo|file> [--dry-run] [--vkeyboard] [--report-size=N] "
+                             "[--capture=FILE] [--latency-dump=FILE] [--gyro] [--gyro-sens=N] [--trackpad] [--mouse-hz=N] "
+                             "[--mouse-curve=C] [--mouse-deadzone=D] [--profile=FILE] [--dictionary=FILE] [--layout=FILE] [--shm[=NAME]] "
+                             "[--metrics[=PORT]]\n", argv[0]);
+        return 2;
+    }
+    return run(opts);
+}
@@ -1,9 +1,10 @@
+#include <winsock2.h> // before windows.h, which would pull in the old winsock.h
 #include <windows.h>
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <vector>
 #include <array>
-#include <mutex>
 #include <optional>
 #include <thread>
 #include <chrono>
@@ -13,164 +14,280 @@
 #include <sstream>
 #include <stdexcept>
 #include <cmath>
-#include <map>
 #include <algorithm>
 #include <cctype>
+#include <cstdlib>
 #include <atomic>
+#include <memory>
+
+#include "console_frame.h"
+#include "controller_shards.h"
+#include "controller_state.h"
+#include "latency_histogram.h"
+#include "mapper_metrics.h"
+#include "metrics_server.h"
+#include "output_sink.h"
+#include "profile_watcher.h"
+#include "ps4_mapper.h"
+#include "raw_input_decode.h"
+#include "report_capture.h"
+#include "shared_state.h"
+#include "spsc_ring.h"
+#include "triple_buffer.h"
+#include "visualizer_view.h"
 
 #ifndef MOUSEEVENTF_MOVE_NOCOALESCE
 #define MOUSEEVENTF_MOVE_NOCOALESCE 0x2000
 #endif
 
-#pragma pack(push, 1)
-struct PS4ControllerReport {
-    uint8_t reportId;
-    uint8_t leftStickX;
-    uint8_t leftStickY;
-    uint8_t rightStickX;
-    uint8_t rightStickY;
-    uint8_t buttons1;      // D-pad (lower nibble) and face buttons (upper nibble)
-    uint8_t buttons2;      // Shoulder buttons and stick clicks
-    uint8_t buttons3;      // PS, touchpad, share, options (approx.)
-    uint8_t leftTrigger;
-    uint8_t rightTrigger;
-    uint8_t unknown1[2];
-    uint8_t gyroX[2];
-    uint8_t gyroY[2];
-    uint8_t gyroZ[2];
-    uint8_t accelX[2];
-    uint8_t accelY[2];
-    uint8_t accelZ[2];
-    uint8_t unknown2[5];
-    uint8_t battery;
-    uint8_t unknown3[4];
-    uint8_t touchpad[3];
-    uint8_t unknown4[21];
+// ---------- Console helper ----------
+// Win32 backend for ConsoleFrame: one WriteConsoleOutputA per changed run, so cells between
+// runs (other rows, or far apart on one row) are never rewritten.
+class Win32ConsoleBackend : public ConsoleBackend {
+public:
+    Win32ConsoleBackend(HANDLE out, WORD attributes) : hOut(out), attr(attributes) {}
+
+    void present(const FrameBuffer &frame, const DirtyRun *runs, size_t count) override {
+        for (size_t i = 0; i < count; ++i) {
+            const DirtyRun &r = runs[i];
+            if (cells.size() < static_cast<size_t>(r.len)) cells.resize(static_cast<size_t>(frame.width())); // once, then reused
+            const char *src = frame.row(r.y) + r.x;
+            for (int x = 0; x < r.len; ++x) {
+                cells[x].Char.AsciiChar = src[x];
+                cells[x].Attributes = attr;
+            }
+            SMALL_RECT region { static_cast<SHORT>(r.x), static_cast<SHORT>(r.y),
+                                static_cast<SHORT>(r.x + r.len - 1), static_cast<SHORT>(r.y) };
+            WriteConsoleOutputA(hOut, cells.data(), COORD{ static_cast<SHORT>(r.len), 1 }, COORD{ 0, 0 }, &region);
+        }
+    }
+
+private:
+    HANDLE hOut;
+    WORD attr;
+    std::vector<CHAR_INFO> cells;
 };
-#pragma pack(pop)
 
-// ---------- Console helper ----------
+// Drawing goes into an off-screen frame; present() writes only what changed since last frame.
 class Console {
 public:
+    static constexpr int FRAME_WIDTH = 160;
+    static constexpr int FRAME_HEIGHT = 40;
+
     Console() : hOut(GetStdHandle(STD_OUTPUT_HANDLE)) {
         if (hOut == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to get console output handle");
         CONSOLE_CURSOR_INFO info {};
         if (GetConsoleCursorInfo(hOut, &info)) savedCursorInfo = info;
         hideCursor();
+
+        int width = FRAME_WIDTH, height = FRAME_HEIGHT;
+        WORD attributes = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        if (GetConsoleScreenBufferInfo(hOut, &csbi)) {
+            width = (std::min)(width, static_cast<int>(csbi.dwSize.X));
+            height = (std::min)(height, static_cast<int>(csbi.dwSize.Y));
+            attributes = csbi.wAttributes;
+        }
+        frame = std::make_unique<ConsoleFrame>(width, height);
+        backend = std::make_unique<Win32ConsoleBackend>(hOut, attributes);
     }
     ~Console() {
         if (hOut != INVALID_HANDLE_VALUE) SetConsoleCursorInfo(hOut, &savedCursorInfo);
     }
-    void clear() {
-        COORD topLeft {0, 0};
-        CONSOLE_SCREEN_BUFFER_INFO csbi;
-        if (!GetConsoleScreenBufferInfo(hOut, &csbi)) return;
-        DWORD len = static_cast<DWORD>(csbi.dwSize.X) * csbi.dwSize.Y;
-        DWORD written = 0;
-        FillConsoleOutputCharacterA(hOut, ' ', len, topLeft, &written);
-        FillConsoleOutputAttribute(hOut, csbi.wAttributes, len, topLeft, &written);
-        SetConsoleCursorPosition(hOut, topLeft);
+    // Back buffer to draw into; nothing reaches the screen until present().
+    FrameBuffer &buffer() {
+        return frame->buffer();
     }
     void setCursor(int x, int y) {
         COORD coord { static_cast<SHORT>(x), static_cast<SHORT>(y) };
         SetConsoleCursorPosition(hOut, coord);
     }
+    int height() const { return frame->buffer().height(); }
     void hideCursor() {
         CONSOLE_CURSOR_INFO info {};
         info.bVisible = FALSE;
         info.dwSize = 1;
         SetConsoleCursorInfo(hOut, &info);
     }
-    void writeAt(int x, int y, const std::string& s) {
-        setCursor(x, y);
-        std::cout << s;
-    }
-    static std::string bytesToHex(const uint8_t* data, size_t len) {
-        std::ostringstream ss;
-        ss << std::hex << std::setfill('0');
-        for (size_t i = 0; i < len; ++i) {
-            ss << std::setw(2) << static_cast<int>(data[i]) << ' ';
-        }
-        ss << std::dec;
-        return ss.str();
+    void present() {
+        frame->present(*backend);
     }
 private:
     HANDLE hOut;
     CONSOLE_CURSOR_INFO savedCursorInfo {};
+    std::unique_ptr<ConsoleFrame> frame;
+    std::unique_ptr<Win32ConsoleBackend> backend;
 };
 
-// ---------- Input emulation helpers (mouse + keyboard) ----------
+// ---------- Input emulation backend (mouse + keyboard) ----------
 namespace Emu {
-    // send keyboard key down/up using SendInput
-    void sendKey(WORD vk, bool down) {
+    INPUT toInput(const OutputEvent &e) {
         INPUT in{};
-        in.type = INPUT_KEYBOARD;
-        in.ki.wVk = vk;
-        in.ki.dwFlags = down ? 0 : KEYEVENTF_KEYUP;
-        SendInput(1, &in, sizeof(in));
-    }
+        switch (e.type) {
+            case OutputEvent::Key:
+                in.type = INPUT_KEYBOARD;
+                in.ki.wVk = e.vk;
+                in.ki.dwFlags = e.down ? 0 : KEYEVENTF_KEYUP;
+                break;
+            case OutputEvent::MouseMove:
+                in.type = INPUT_MOUSE;
+                in.mi.dx = e.dx;
+                in.mi.dy = e.dy;
+                // Use NOCOALESCE to improve responsiveness (don't let OS coalesce successive relative moves)
+                in.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_MOVE_NOCOALESCE;
+                break;
+            case OutputEvent::MouseButton:
+                in.type = INPUT_MOUSE;
+                in.mi.dwFlags = e.left ? (e.down ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP)
+                                       : (e.down ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP);
+                break;
+            case OutputEvent::MouseWheel:
+                // one axis per INPUT; SendInputSink splits events that scroll both ways
+                in.type = INPUT_MOUSE;
+                in.mi.dwFlags = e.dy != 0 ? MOUSEEVENTF_WHEEL : MOUSEEVENTF_HWHEEL;
+                in.mi.mouseData = static_cast<DWORD>(e.dy != 0 ? e.dy : e.dx);
+                break;
+        }
+        return in;
+    }
+
+    // Converts a batch to INPUT records and injects it with a single SendInput call.
+    class SendInputSink : public OutputSink {
+    public:
+        SendInputSink() { inputs.reserve(64); }
+        void submit(const OutputEvent *events, size_t count) override {
+            inputs.clear();
+            for (size_t i = 0; i < count; ++i) {
+                const OutputEvent &e = events[i];
+                if (e.type == OutputEvent::MouseWheel && e.dx != 0 && e.dy != 0) {
+                    inputs.push_back(toInput(OutputEvent::mouseWheel(0, e.dy)));
+                    inputs.push_back(toInput(OutputEvent::mouseWheel(e.dx, 0)));
+                } else {
+                    inputs.push_back(toInput(e));
+                }
+            }
+            SendInput(static_cast<UINT>(inputs.size()), inputs.data(), sizeof(INPUT));
+        }
+    private:
+        std::vector<INPUT> inputs;
+    };
+}
 
-    // send mouse relative movement
-    void sendMouseMoveRelative(int dx, int dy) {
-        INPUT in{};
-        in.type = INPUT_MOUSE;
-        in.mi.dx = dx;
-        in.mi.dy = dy;
-        // Use NOCOALESCE to improve responsiveness (don't let OS coalesce successive relative moves)
-        in.mi.dwFlags = MOUSEEVENTF_MOVE | MOUSEEVENTF_MOVE_NOCOALESCE;
-        SendInput(1, &in, sizeof(in));
-    }
+struct MapperOptions {
+    bool visualizer = true; // false: no render thread, console stays untouched
+    int maxFps = 60;        // render cap
+    std::string capturePath; // non-empty: record every report here (see report_capture.h)
+    std::string latencyDumpPath; // non-empty: write the per-stage histograms here as CSV on exit
+    bool gyroAim = false;   // add controller rotation to mouse motion
+    bool trackpad = false;  // touchpad moves the pointer, scrolls and taps to click
+    float gyroSensitivity = 8.0f; // mouse counts per degree
+    int mouseHz = 1000;     // cursor motion output tick
+    StickConfig mouseStick = PS4Mapper::MOUSE_STICK_CONFIG; // right stick curve and deadzone
+    std::string profilePath; // non-empty: bindings from this file, reloaded when it changes
+    // --device-profile=MATCH=FILE: the controllers MATCH picks (DeviceMatch) run FILE instead
+    std::vector<std::pair<std::string, std::string>> deviceProfiles;
+    std::string dictionaryPath; // non-empty: word completion on the virtual keyboard (word_dictionary.h)
+    std::string layoutPath; // non-empty: virtual keyboard pages from this file (keyboard_layout.h)
+    std::string sharedStateName; // non-empty: publish controller state in shared memory (ds4_shared_state.h)
+    bool headless = false;  // console hidden and never drawn; implies no visualizer
+    int metricsPort = 0;    // non-zero: serve Prometheus metrics on 127.0.0.1:port (mapper_metrics.h)
+};
 
-    void sendMouseButton(bool left, bool down) {
-        INPUT in{};
-        in.type = INPUT_MOUSE;
-        in.mi.dwFlags = left ? (down ? MOUSEEVENTF_LEFTDOWN : MOUSEEVENTF_LEFTUP)
-                             : (down ? MOUSEEVENTF_RIGHTDOWN : MOUSEEVENTF_RIGHTUP);
-        SendInput(1, &in, sizeof(in));
-    }
+// ---------- Owned kernel handles ----------
+struct HandleCloser {
+    void operator()(HANDLE h) const { if (h && h != INVALID_HANDLE_VALUE) CloseHandle(h); }
+};
+using UniqueHandle = std::unique_ptr<void, HandleCloser>;
+
+// Waitable timer, high resolution where available (Windows 10 1803+); null on failure.
+static HANDLE createWaitableTimer() {
+    HANDLE t = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    return t ? t : CreateWaitableTimerW(nullptr, FALSE, nullptr);
 }
 
 // ---------- PS4 Visualizer + Mapper + Virtual Keyboard ----------
 class PS4VisualizerMapper {
 public:
-    PS4VisualizerMapper()
+    explicit PS4VisualizerMapper(const MapperOptions &opts = MapperOptions())
+        : options(opts)
     {
-        // start the message thread which creates the message-only window and registers raw input
-        msgThread = std::thread(&PS4VisualizerMapper::messageThreadProc, this);
-
-        // wait a short time for message thread to create window / register raw input
-        auto start = std::chrono::steady_clock::now();
-        while (msgThreadId.load() == 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
-            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(2)) break;
+        // the frame and the hidden cursor only matter while something is drawn
+        if (options.visualizer && !options.headless) console = std::make_unique<Console>();
+        // Handles are owned from creation, so a throw below closes whatever was made so far.
+        // auto-reset event the message thread signals for every report; the main loop blocks on it
+        reportEvent.reset(CreateEventW(nullptr, FALSE, FALSE, nullptr));
+        if (!reportEvent) throw std::runtime_error("Failed to create report event");
+        hIn = GetStdHandle(STD_INPUT_HANDLE);
+        // periodic timer for cursor motion
+        mouseTimer.reset(createWaitableTimer());
+        if (!mouseTimer) throw std::runtime_error("Failed to create mouse timer");
+        // one-shot timer for the earliest deadline of any mapper timer
+        deadlineTimer.reset(createWaitableTimer());
+        if (!deadlineTimer) throw std::runtime_error("Failed to create deadline timer");
+        // manual-reset; set once run() has released everything (see consoleCtrlHandler)
+        stoppedEvent.reset(CreateEventW(nullptr, TRUE, FALSE, nullptr));
+        if (!stoppedEvent) throw std::runtime_error("Failed to create stop event");
+
+        if (!options.capturePath.empty() && !capture.open(options.capturePath)) {
+            throw std::runtime_error("Failed to open capture file: " + options.capturePath);
+        }
+        if (!options.sharedStateName.empty() && !sharedState.open(options.sharedStateName)) {
+            throw std::runtime_error("Failed to create shared state: " + sharedState.lastError());
+        }
+        if (options.metricsPort != 0 &&
+            !metricsServer.start(static_cast<uint16_t>(options.metricsPort), [this] { return metrics.render(); })) {
+            throw std::runtime_error("Failed to start metrics endpoint: " + metricsServer.lastError());
+        }
+
+        std::string layoutError;
+        if (!options.layoutPath.empty() && !KeyboardLayout::load(options.layoutPath, keyboardLayout, layoutError)) {
+            throw std::runtime_error("Failed to load keyboard layout: " + layoutError);
+        }
+        if (!options.dictionaryPath.empty() && !dictionary.open(options.dictionaryPath)) {
+            throw std::runtime_error("Failed to load dictionary " + options.dictionaryPath + ": " + dictionary.lastError());
+        }
+
+        // every device profile exists before any watcher thread publishes to one
+        std::vector<int> deviceProfileIds;
+        for (const auto &dp : options.deviceProfiles) deviceProfileIds.push_back(controllers.addDeviceProfile(DeviceMatch::parse(dp.first)));
+        if (!options.deviceProfiles.empty()) controllers.setIdentify(identifyRawInputDevice);
+
+        // compiled on the watcher thread, adopted by each controller's mapper between reports
+        for (size_t i = 0; i < options.deviceProfiles.size(); ++i) {
+            const int id = deviceProfileIds[i];
+            deviceProfileWatchers.push_back(std::make_unique<ProfileWatcher>());
+            ProfileWatcher &w = *deviceProfileWatchers.back();
+            if (!w.start(options.deviceProfiles[i].second, [this, id](const ActionTable &t) { controllers.publishProfile(t, id); })) {
+                throw std::runtime_error("Failed to load device profile: " + w.lastError());
+            }
         }
-
-        console.clear();
-        initFaceButtonMap();
-        initVirtualKeyboard();
-        printHeader();
-
-        // Ensure console is topmost on startup (Keep console always on top)
-        setConsoleAlwaysOnTop();
-    }
-
-    ~PS4VisualizerMapper() {
-        // request message thread to quit
-        if (msgThreadId.load() != 0) {
-            // post WM_QUIT to the message thread so it exits its GetMessage loop
-            PostThreadMessage(msgThreadId.load(), WM_QUIT, 0, 0);
+        if (!options.profilePath.empty() &&
+            !profileWatcher.start(options.profilePath, [this](const ActionTable &t) { controllers.publishProfile(t); })) {
+            throw std::runtime_error("Failed to load profile: " + profileWatcher.lastError());
         }
 
-        if (msgThread.joinable()) msgThread.join();
-
-        // ensure any held inputs are released
-        releaseAllInputs();
+        // start the message thread which creates the message-only window and registers raw input;
+        // from here on a throw must stop the threads before the members they use go away
+        msgThread = std::thread(&PS4VisualizerMapper::messageThreadProc, this);
+        try {
+            finishStartup();
+        } catch (...) {
+            shutdown();
+            throw;
+        }
     }
 
+    ~PS4VisualizerMapper() { shutdown(); }
+
     void run() {
         bool done = false;
         while (!done) {
-            if (_kbhit()) {
+            // Block until a report arrives, a console key is pressed, the mouse timer fires or
+            // the next mapper timer is due.
+            const bool mouseTick = waitForWork();
+            if (stopRequested.load()) done = true;
+
+            while (!done && _kbhit()) {
                 int ch = _getch();
                 // Check for special key prefix
                 if (ch == 0 || ch == 0xE0) {
@@ -184,33 +301,46 @@ public:
                         toggleMode();
                     } else if (ch == 'v' || ch == 'V') {
                         // explicit visualizer request
-                        setMode(MODE_VISUALIZER);
+                        setMode(PS4Mapper::MODE_VISUALIZER);
                     } else if (ch == 'k' || ch == 'K') {
                         // explicit keyboard request
-                        setMode(MODE_VKEYBOARD);
+                        setMode(PS4Mapper::MODE_VKEYBOARD);
                     }
                 }
             }
 
-            // If the message thread has produced a report, process it on the main thread.
-            if (newReportAvailable.exchange(false)) {
-                std::optional<PS4ControllerReport> snapshot;
-                {
-                    std::lock_guard<std::mutex> lk(stateMutex);
-                    snapshot = lastReport;
-                }
-                if (snapshot.has_value()) {
-                    // now process mapping & update display on main thread (keeps console writes single-threaded)
-                    processMapping(snapshot.value());
-                    updateDisplay();
+            // Drain every queued report, each controller's in arrival order so short taps keep
+            // both edges, interleaved across controllers so none waits behind another's backlog.
+            // A report that changes nothing the mapping reads is neither flushed nor redrawn.
+            // Nothing here waits on the console.
+            bool changed = false;
+            controllers.drain([&](ControllerShard &c, const TimedReport &item) {
+                const auto dequeued = std::chrono::steady_clock::now();
+                const bool mappedReport = c.mapper->processReport(item.report);
+                const auto mapped = std::chrono::steady_clock::now();
+                if (mappedReport) {
+                    c.output->flush(); // one SendInput per processed report
+                    changed = true;
+                    focused = c.index;
                 }
+                latency.record(item.received, dequeued, mapped, std::chrono::steady_clock::now());
+                if ((c.mapper->takeHostRequests() & PS4Mapper::HOST_TOGGLE_CONSOLE) && !options.headless) toggleConsoleWindow();
+                // recorded after SendInput so capturing never delays the injected input
+                if (capture.isOpen()) capture.write(item.received, item.report);
+                if (sharedState.isOpen()) sharedState.publish(c.index, item.received, item.report, c.mapper->currentMode());
+            });
+
+            // cursor motion accumulated since the last tick, then every due mapper timer;
+            // then one snapshot for the render thread if anything it shows moved
+            if (mouseTick) {
+                controllers.tickMouse();
+                changed = true;
             }
-
-            // handle repeats for WASD and arrow keys
-            handleKeyRepeats();
-
-            // ---- Faster update rate (was 16ms) ----
-            std::this_thread::sleep_for(std::chrono::milliseconds(8));
+            if (controllers.runTimers(&latency.timerLateness()) > 0) changed = true;
+            if (changed && isDrawing()) publishSnapshot();
+            updateMouseTimer();
+            // copies of this thread's own counters for the scraper; nothing shared is written
+            if (metricsServer.isRunning()) metrics.update(controllers);
         }
 
         // on exit, ensure message thread exits
@@ -219,15 +349,198 @@ public:
         }
         if (msgThread.joinable()) msgThread.join();
 
+        stopRenderThread();
+        // WriteConsoleOutput never moves the cursor; put it below the frame for the summary
+        if (console) console->setCursor(0, console->height());
+
         // on exit, release any held keys/buttons
-        releaseAllInputs();
+        controllers.releaseAllInputs();
+        if (metricsServer.isRunning()) {
+            metricsServer.stop();
+            std::cout << "Served " << metricsServer.scrapeCount() << " metrics scrapes on 127.0.0.1:" << options.metricsPort << std::endl;
+        }
+
+        std::cout << "Report latency by stage, visualizer " << (options.visualizer ? "on" : "off") << ":\n";
+        latency.printSummary(std::cout);
+        if (!options.latencyDumpPath.empty()) {
+            std::ofstream dump(options.latencyDumpPath);
+            latency.dumpCsv(dump);
+            std::cout << "Latency histograms written to " << options.latencyDumpPath << std::endl;
+        }
+        if (capture.isOpen()) {
+            capture.close();
+            std::cout << "Captured " << capture.recordCount() << " reports to " << options.capturePath << std::endl;
+        }
+        if (sharedState.isOpen()) {
+            std::cout << "Published " << sharedState.published() << " reports to shared memory " << options.sharedStateName << std::endl;
+        }
+        if (!options.profilePath.empty()) {
+            profileWatcher.stop();
+            std::cout << "Profile reloaded " << profileWatcher.reloadCount() << " times";
+            if (profileWatcher.rejectedCount()) std::cout << ", last rejected: " << profileWatcher.lastError();
+            std::cout << std::endl;
+        }
+        for (const auto &w : deviceProfileWatchers) {
+            w->stop();
+            std::cout << "Device profile " << w->profilePath() << " reloaded " << w->reloadCount() << " times";
+            if (w->rejectedCount()) std::cout << ", last rejected: " << w->lastError();
+            std::cout << std::endl;
+        }
+        if (stoppedEvent) SetEvent(stoppedEvent.get());
     }
 
 private:
+    // The rest of the constructor, run after the message thread has started.
+    void finishStartup() {
+        // wait a short time for message thread to create window / register raw input
+        auto start = std::chrono::steady_clock::now();
+        while (msgThreadId.load() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(2)) break;
+        }
+
+        // Ctrl+C, Ctrl+Break and closing the console end run() like ESC, so held keys are released
+        // (a hidden console takes no keys at all)
+        activeInstance.store(this);
+        SetConsoleCtrlHandler(consoleCtrlHandler, TRUE);
+
+        if (options.headless) {
+            // nothing is drawn, so nothing needs to be seen; the summary on exit still goes to stdout
+            options.visualizer = false;
+            if (HWND hConsole = GetConsoleWindow()) ShowWindow(hConsole, SW_HIDE);
+            consoleVisible.store(false);
+            return;
+        }
+
+        publishSnapshot();
+
+        // console output is owned by the render thread from here on
+        if (options.visualizer) {
+            renderRunning.store(true);
+            renderThread = std::thread(&PS4VisualizerMapper::renderThreadProc, this);
+        }
+
+        // Ensure console is topmost on startup (Keep console always on top)
+        setConsoleAlwaysOnTop();
+    }
+
+    // Stops every thread that uses this object and releases held inputs: the destructor, and the
+    // constructor once the message thread exists. The handles close afterwards, as members.
+    void shutdown() {
+        SetConsoleCtrlHandler(consoleCtrlHandler, FALSE);
+        activeInstance.store(nullptr);
+        // A handler that loaded `this` before the store above may still be using reportEvent
+        // and stoppedEvent; wake it and wait for it to leave before the handles are closed.
+        if (stoppedEvent) SetEvent(stoppedEvent.get());
+        while (handlersRunning.load() != 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // request message thread to quit
+        if (msgThreadId.load() != 0) {
+            // post WM_QUIT to the message thread so it exits its GetMessage loop
+            PostThreadMessage(msgThreadId.load(), WM_QUIT, 0, 0);
+        }
+
+        if (msgThread.joinable()) msgThread.join();
+        stopRenderThread();
+        metricsServer.stop();
+
+        // ensure any held inputs are released
+        controllers.releaseAllInputs();
+    }
+
+    // ---------- Console control events ----------
+    static inline std::atomic<PS4VisualizerMapper *> activeInstance{nullptr};
+    // handlers between their load of activeInstance and their return; the destructor waits for 0
+    static inline std::atomic<int> handlersRunning{0};
+    std::atomic<bool> stopRequested{false};
+    UniqueHandle stoppedEvent; // set once run() has released everything
+
+    // Runs on a thread the system creates. Closing the console, logoff and shutdown end the
+    // process as soon as this returns, so those wait (briefly) for run() to finish.
+    // Counted in handlersRunning before activeInstance is read (both sequentially consistent),
+    // so the destructor either sees the count or the handler sees nullptr.
+    static BOOL WINAPI consoleCtrlHandler(DWORD type) {
+        handlersRunning.fetch_add(1);
+        PS4VisualizerMapper *self = activeInstance.load();
+        if (!self) {
+            handlersRunning.fetch_sub(1);
+            return FALSE;
+        }
+        self->stopRequested.store(true);
+        SetEvent(self->reportEvent.get());
+        if (type == CTRL_CLOSE_EVENT || type == CTRL_LOGOFF_EVENT || type == CTRL_SHUTDOWN_EVENT) {
+            WaitForSingleObject(self->stoppedEvent.get(), 4000);
+        }
+        handlersRunning.fetch_sub(1);
+        return TRUE;
+    }
+
     // ---------- Message thread and raw input ----------
     std::thread msgThread;
     std::atomic<DWORD> msgThreadId{0};
-    std::atomic<bool> newReportAvailable{false};
+    UniqueHandle reportEvent;
+    HANDLE hIn = INVALID_HANDLE_VALUE;
+    UniqueHandle mouseTimer;
+    bool mouseTimerArmed = false;
+    UniqueHandle deadlineTimer;
+    std::chrono::steady_clock::time_point deadlineArmed = std::chrono::steady_clock::time_point::max(); // max: disarmed
+
+    // The mouse timer only runs while the cursor is moving, so an idle mapper doesn't wake
+    // mouseHz times a second. Its period is whole milliseconds; tickMouse() integrates real
+    // elapsed time, so rounding the period changes smoothness, not speed.
+    void updateMouseTimer() {
+        const bool active = controllers.isMouseMotionActive();
+        if (active == mouseTimerArmed) return;
+        if (active) {
+            PS4Mapper::Clock::duration interval{};
+            controllers.forEach([&](const ControllerShard &c) { interval = c.mapper->mouseTickInterval(); }); // same for every controller
+            LARGE_INTEGER due;
+            due.QuadPart = -static_cast<LONGLONG>(std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count() / 100);
+            const auto periodMs = (std::max)(std::chrono::milliseconds(1), std::chrono::duration_cast<std::chrono::milliseconds>(interval));
+            SetWaitableTimer(mouseTimer.get(), &due, static_cast<LONG>(periodMs.count()), nullptr, nullptr, FALSE);
+        } else {
+            CancelWaitableTimer(mouseTimer.get());
+        }
+        mouseTimerArmed = active;
+    }
+
+    // Point the deadline timer at the earliest mapper deadline. A WaitForMultipleObjects
+    // timeout is whole milliseconds on the system tick (up to 15.6 ms late); a high-resolution
+    // waitable timer fires within a fraction of a millisecond, in 100 ns units.
+    void armDeadlineTimer() {
+        const auto deadline = controllers.nextTimerDeadline().value_or(std::chrono::steady_clock::time_point::max());
+        if (deadline == deadlineArmed) return;
+        deadlineArmed = deadline;
+        if (deadline == std::chrono::steady_clock::time_point::max()) {
+            CancelWaitableTimer(deadlineTimer.get());
+            return;
+        }
+        const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+        LARGE_INTEGER due;
+        due.QuadPart = -(std::max)(static_cast<LONGLONG>(wait.count() / 100), static_cast<LONGLONG>(1)); // relative
+        SetWaitableTimer(deadlineTimer.get(), &due, 0, nullptr, nullptr, FALSE);
+    }
+
+    // Wait on the report event, the mouse timer, the deadline timer and the console input
+    // handle. Returns true if the mouse timer fired. Spurious wakeups are harmless: run()
+    // re-checks every source.
+    bool waitForWork() {
+        armDeadlineTimer();
+        HANDLE handles[4] = { reportEvent.get(), mouseTimer.get(), deadlineTimer.get(), hIn };
+        DWORD count = (hIn != nullptr && hIn != INVALID_HANDLE_VALUE) ? 4 : 3;
+        DWORD rc = WaitForMultipleObjects(count, handles, FALSE, INFINITE);
+        if (rc == WAIT_OBJECT_0 + 2) {
+            deadlineArmed = std::chrono::steady_clock::time_point::max(); // fired; re-arm for whatever is next
+        } else if (rc == WAIT_OBJECT_0 + 3 && !_kbhit()) {
+            // console input is signaled by mouse/focus/key-up records too; _kbhit() leaves those
+            // queued, which would keep the handle signaled and turn this wait into a busy loop
+            FlushConsoleInputBuffer(hIn);
+        } else if (rc == WAIT_FAILED) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        // WaitForMultipleObjects reports the lowest signaled index; a report and a tick can be
+        // due together, so ask the (auto-reset) timer directly
+        return rc == WAIT_OBJECT_0 + 1 || (mouseTimerArmed && WaitForSingleObject(mouseTimer.get(), 0) == WAIT_OBJECT_0);
+    }
 
     void messageThreadProc() {
         // Save thread id for cross-thread signaling
@@ -258,14 +571,16 @@ private:
             return;
         }
 
+        if (isWow64Process()) bufferLayout = RawInputLayout::x64();
+
         // store hwnd (safe; main thread will only read msgThreadId/hwnd when joined or posting quit)
         hwnd = localHwnd;
 
-        // register raw input for gamepad
+        // register raw input for gamepad; DEVNOTIFY adds WM_INPUT_DEVICE_CHANGE on arrival and removal
         RAWINPUTDEVICE rid{};
         rid.usUsagePage = 0x01; // Generic Desktop
         rid.usUsage = 0x05;     // Game Pad
-        rid.dwFlags = RIDEV_INPUTSINK;
+        rid.dwFlags = RIDEV_INPUTSINK | RIDEV_DEVNOTIFY;
         rid.hwndTarget = hwnd;
 
         if (!RegisterRawInputDevices(&rid, 1, sizeof(rid))) {
@@ -316,599 +631,213 @@ private:
             case WM_INPUT:
                 handleRawInputMessageThread(reinterpret_cast<HRAWINPUT>(lParam));
                 return 0;
+            case WM_INPUT_DEVICE_CHANGE:
+                // A controller that was unplugged or lost its Bluetooth link: the mapping thread
+                // releases whatever it held and frees its shard. Arrival needs nothing; the
+                // device registers with its first report.
+                if (wParam == GIDC_REMOVAL && controllers.remove(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(reinterpret_cast<HANDLE>(lParam))))) {
+                    SetEvent(reportEvent.get());
+                }
+                return 0;
             default:
                 return DefWindowProc(hwnd, msg, wParam, lParam);
         }
     }
 
-    // This function runs on the message thread: store the latest report and notify main thread.
-    void handleRawInputMessageThread(HRAWINPUT hRaw) {
-        UINT size = 0;
-        if (GetRawInputData(hRaw, RID_INPUT, nullptr, &size, sizeof(RAWINPUTHEADER)) == (UINT)-1) return;
-        if (size == 0) return;
-
-        std::vector<BYTE> buffer(size);
-        if (GetRawInputData(hRaw, RID_INPUT, buffer.data(), &size, sizeof(RAWINPUTHEADER)) != size) return;
-
-        RAWINPUT* raw = reinterpret_cast<RAWINPUT*>(buffer.data());
-        if (raw->header.dwType != RIM_TYPEHID) return;
-
-        if (raw->data.hid.dwSizeHid >= sizeof(PS4ControllerReport) && raw->data.hid.dwCount >= 1) {
-            PS4ControllerReport report{};
-            std::memcpy(&report, raw->data.hid.bRawData, sizeof(report));
-
-            {
-                std::lock_guard<std::mutex> lk(stateMutex);
-                lastReport = report;
-                controllerConnected = true;
+    // ---------- Render thread ----------
+    MapperOptions options;
+    TripleBuffer<DisplaySnapshot> displayState;
+    std::thread renderThread;
+    DisplaySnapshot frame;     // render thread's copy, completed with live latency percentiles
+    std::atomic<bool> renderRunning{false};
+    PipelineLatency latency;   // written by the mapping thread, read by the render thread
+    ReportCaptureWriter capture;
+    SharedStatePublisher sharedState; // written by the mapping thread, read by other processes
+    MapperMetrics metrics{latency};   // written by the mapping thread, read by the metrics server
+    MetricsServer metricsServer;
+
+    // Mapping thread: snapshots are only worth copying while the render thread draws them.
+    bool isDrawing() const { return options.visualizer && consoleVisible.load(std::memory_order_relaxed); }
+
+    // Mapping thread: copy what the renderer needs and publish it. Never blocks.
+    void publishSnapshot() {
+        // The slot was last written two publishes ago: start from nothing, so fields filled only
+        // for a focused controller with a report never show another controller's old data.
+        DisplaySnapshot &s = displayState.writeBuffer();
+        s = DisplaySnapshot{};
+        s.controllerCount = controllers.count();
+        s.focused = focused;
+        controllers.forEach([&](const ControllerShard &c) { s.controllers[c.index] = summarizeController(c); });
+        s.hasReport = controllers.shard(focused).mapper && controllers.shard(focused).lastReport.has_value();
+        if (s.hasReport) {
+            const ControllerShard &c = controllers.shard(focused);
+            const PS4Mapper &m = *c.mapper;
+            s.report = *c.lastReport;
+            s.mode = m.currentMode();
+            s.lastMouseMoveX = m.lastMouseMoveX();
+            s.lastMouseMoveY = m.lastMouseMoveY();
+            s.mouseLeftDown = m.isMouseLeftDown();
+            s.mouseRightDown = m.isMouseRightDown();
+            s.keyboardPage = m.keyboardPage();
+            s.selRow = m.selectedRow();
+            s.selCol = m.selectedCol();
+            s.shiftSticky = m.isShiftSticky();
+            s.gyroAim = m.isGyroAimEnabled();
+            s.trackpad = m.isTrackpadEnabled();
+            s.gyroRate[0] = m.motionState().pitchRate();
+            s.gyroRate[1] = m.motionState().worldYawRate();
+            s.gyroRate[2] = m.motionState().rollRate();
+            s.motionStill = m.motionState().isStill();
+            s.lastReportEvents = c.output->lastFlushEventCount();
+            s.dictionary = m.hasDictionary();
+            s.typedWord.set(m.currentWord());
+            s.suggestionCount = m.suggestionCount();
+            s.selectedSuggestion = m.selectedSuggestion();
+            for (int i = 0; i < s.suggestionCount; ++i) s.suggestions[i].set(m.suggestion(i));
+        }
+        s.droppedReports = controllers.droppedReports();
+        s.rejectedReports = controllers.rejectedReports();
+        s.outputEvents = controllers.outputEvents();
+        s.outputSubmissions = controllers.outputSubmissions();
+        s.profileFile = !options.profilePath.empty() || !options.deviceProfiles.empty();
+        s.profileReloads = profileWatcher.reloadCount();
+        s.profileRejected = profileWatcher.rejectedCount();
+        for (const auto &w : deviceProfileWatchers) {
+            s.profileReloads += w->reloadCount();
+            s.profileRejected += w->rejectedCount();
+        }
+        displayState.publish();
+    }
+
+    // Render thread: draw the newest snapshot at most maxFps times per second, and only
+    // when the mapper published something since the last frame.
+    // While the console is hidden nothing is drawn; showing it publishes a fresh snapshot.
+    void renderThreadProc() {
+        const auto frameInterval = std::chrono::microseconds(1000000 / (std::max)(1, options.maxFps));
+        auto nextFrame = std::chrono::steady_clock::now();
+        while (renderRunning.load()) {
+            if (consoleVisible.load(std::memory_order_relaxed) && displayState.fetch()) {
+                frame = displayState.readBuffer();
+                frame.latency = latency.summarize();
+                updateDisplay(frame);
             }
-            // *do not* call processMapping() or updateDisplay() here.
-            // Just mark we have a new report for the main thread to pick up.
-            newReportAvailable.store(true);
+            nextFrame += frameInterval;
+            auto now = std::chrono::steady_clock::now();
+            if (nextFrame < now) nextFrame = now; // don't try to catch up after a stall
+            std::this_thread::sleep_until(nextFrame);
         }
     }
 
-    // ---------- Mapping logic (unchanged except mapping is executed on main thread) ----------
-    static float normalizeAxis(uint8_t v) {
-        return (static_cast<int>(v) - 128) / 127.0f;
-    }
-
-    static constexpr WORD VK_KEY_W = 0x57; // 'W'
-    static constexpr WORD VK_KEY_A = 0x41; // 'A'
-    static constexpr WORD VK_KEY_S = 0x53; // 'S'
-    static constexpr WORD VK_KEY_D = 0x44; // 'D'
-
-    enum Mode {
-        MODE_VISUALIZER = 0,
-        MODE_VKEYBOARD  = 1
-    };
-
-    void initFaceButtonMap() {
-        faceButtonMap = {
-            {"SQUARE", 'E'},     // Example: Square -> 'E'
-            {"CROSS", VK_SPACE}, // Cross -> Space
-            {"CIRCLE", VK_LCONTROL}, // Circle -> Left Ctrl
-            {"TRIANGLE", VK_LSHIFT}  // Triangle -> Left Shift
-        };
-        faceButtonState.clear();
-        controllerPrev.clear();
-        faceButtonState["SQUARE"] = false;
-        faceButtonState["CROSS"] = false;
-        faceButtonState["CIRCLE"] = false;
-        faceButtonState["TRIANGLE"] = false;
-        controllerPrev["SQUARE"] = false;
-        controllerPrev["CROSS"] = false;
-        controllerPrev["CIRCLE"] = false;
-        controllerPrev["TRIANGLE"] = false;
-        prevOptions = false;
-    }
-
-    void initVirtualKeyboard() {
-        vkLayout = {
-            {"Q","W","E","R","T","Y","U","I","O","P"},
-            {"A","S","D","F","G","H","J","K","L","ENTER"},
-            {"Z","X","C","V","B","N","M",",",".","/"},
-            {"SPACE","BACKSPACE"}
-        };
-        vkRows = static_cast<int>(vkLayout.size());
-        selRow = 0;
-        selCol = 0;
-        vkMoveDelayMs = 150;
-        lastVKMove = std::chrono::steady_clock::now();
-        shiftSticky = false;
-        shiftHeldByEmulator = false;
-        mode = MODE_VISUALIZER;
+    void stopRenderThread() {
+        renderRunning.store(false);
+        if (renderThread.joinable()) renderThread.join();
     }
 
-    void handleFaceButton(const std::string& name, bool pressed) {
-        WORD vk = faceButtonMap[name];
-        bool currentlyDown = faceButtonState[name];
-
-        if (pressed && !currentlyDown) {
-            Emu::sendKey(vk, true);
-            faceButtonState[name] = true;
-        } else if (!pressed && currentlyDown) {
-            Emu::sendKey(vk, false);
-            faceButtonState[name] = false;
-        }
-    }
-
-    void processMapping(const PS4ControllerReport& r) {
-        bool optionsPressed = (r.buttons2 & 0x20) != 0;
-        if (optionsPressed && !prevOptions) {
-            toggleMode();
-        }
-        prevOptions = optionsPressed;
-
-        bool r1Pressed = (r.buttons2 & 0x02) != 0;
-        if (r1Pressed && !prevR1) {
-            toggleConsoleWindow();
-        }
-        prevR1 = r1Pressed;
-
-        if (mode == MODE_VKEYBOARD) {
-            processVirtualKeyboard(r);
-        } else {
-            processVisualizerMapping(r);
-        }
-
-        processDPadMapping(r);
-        processTriggerMapping(r);
-        processRightStickMouse(r);
-    }
-
-    void processVisualizerMapping(const PS4ControllerReport& r) {
-        const float deadzone = 0.25f;
-        float lx = normalizeAxis(r.leftStickX);
-        float ly = normalizeAxis(r.leftStickY);
-        ly = -ly;
-
-        bool wantW = (ly > deadzone);
-        bool wantS = (ly < -deadzone);
-        bool wantA = (lx < -deadzone);
-        bool wantD = (lx > deadzone);
-
-        setKeyState(VK_KEY_W, wantW);
-        setKeyState(VK_KEY_S, wantS);
-        setKeyState(VK_KEY_A, wantA);
-        setKeyState(VK_KEY_D, wantD);
-
-        handleFaceButton("SQUARE",   (r.buttons1 & 0x10) != 0);
-        handleFaceButton("CROSS",    (r.buttons1 & 0x20) != 0);
-        handleFaceButton("CIRCLE",   (r.buttons1 & 0x40) != 0);
-        handleFaceButton("TRIANGLE", (r.buttons1 & 0x80) != 0);
-    }
-
-    void processDPadMapping(const PS4ControllerReport& r) {
-        // Keep D-Pad -> Arrow key mapping active while in Virtual Keyboard mode
-        uint8_t dpad = r.buttons1 & 0x0F;
-        bool up = false, down = false, left = false, right = false;
-        switch (dpad) {
-            case 0: up = true; break;
-            case 1: up = true; right = true; break;
-            case 2: right = true; break;
-            case 3: right = true; down = true; break;
-            case 4: down = true; break;
-            case 5: down = true; left = true; break;
-            case 6: left = true; break;
-            case 7: left = true; up = true; break;
-            default: break;
-        }
-        setKeyState(VK_UP, up);
-        setKeyState(VK_DOWN, down);
-        setKeyState(VK_LEFT, left);
-        setKeyState(VK_RIGHT, right);
-    }
-
-    void processTriggerMapping(const PS4ControllerReport& r) {
-        const uint8_t pressThreshold = 50;
-        bool wantLeftClick = r.rightTrigger > pressThreshold;
-        bool wantRightClick = r.leftTrigger > pressThreshold;
-        setMouseButtonState(true, wantLeftClick);
-        setMouseButtonState(false, wantRightClick);
-    }
-
-    void processRightStickMouse(const PS4ControllerReport& r) {
-        float rx = normalizeAxis(r.rightStickX);
-        float ry = normalizeAxis(r.rightStickY);
-        // ---- reduced deadzone for more responsive small movements ----
-        const float stickDead = 0.08f;
-        int moveX = 0, moveY = 0;
-        if (std::fabs(rx) > stickDead || std::fabs(ry) > stickDead) {
-            auto scale = [](float v)->float {
-                float s = std::copysign(v * v * v, v);
-                return s;
-            };
-            float sx = scale(rx);
-            float sy = scale(ry);
-            // ---- increased sensitivity to speed up cursor movement ----
-            const float sensitivity = 36.0f;
-            moveX = static_cast<int>(std::round(sx * sensitivity));
-            moveY = static_cast<int>(std::round(sy * sensitivity));
-            if (moveX == 0 && std::fabs(rx) > stickDead) moveX = (rx > 0) ? 1 : -1;
-            if (moveY == 0 && std::fabs(ry) > stickDead) moveY = (ry > 0) ? 1 : -1;
-        }
-
-        if (moveX != 0 || moveY != 0) {
-            Emu::sendMouseMoveRelative(moveX, moveY);
-            lastMouseMoveX = moveX;
-            lastMouseMoveY = moveY;
-        } else {
-            lastMouseMoveX = lastMouseMoveY = 0;
-        }
-    }
-
-    void processVirtualKeyboard(const PS4ControllerReport& r) {
-        bool square = (r.buttons1 & 0x10) != 0;
-        bool cross  = (r.buttons1 & 0x20) != 0;
-        bool circle = (r.buttons1 & 0x40) != 0;
-        bool tri    = (r.buttons1 & 0x80) != 0;
-        bool l3     = (r.buttons2 & 0x40) != 0;
-
-        float lx = normalizeAxis(r.leftStickX);
-        float ly = normalizeAxis(r.leftStickY);
-        ly = -ly;
-
-        const float vkDead = 0.35f;
-        auto now = std::chrono::steady_clock::now();
-        auto msSince = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastVKMove).count();
-        if (msSince >= vkMoveDelayMs) {
-            if (std::fabs(lx) > std::fabs(ly)) {
-                if (lx > vkDead) { moveVKSelection(1, 0); lastVKMove = now; }
-                else if (lx < -vkDead) { moveVKSelection(-1, 0); lastVKMove = now; }
-            } else {
-                if (ly > vkDead) { moveVKSelection(0, -1); lastVKMove = now; }
-                else if (ly < -vkDead) { moveVKSelection(0, 1); lastVKMove = now; }
-            }
-        }
-
-        if (cross && !controllerPrev["CROSS"]) {
-            pressSelectedVirtualKey();
-        }
-        if (square && !controllerPrev["SQUARE"]) {
-            toggleShiftSticky();
-        }
-        if (circle && !controllerPrev["CIRCLE"]) {
-            pressVirtualKeyByLabel("BACKSPACE");
-        }
-        if (tri && !controllerPrev["TRIANGLE"]) {
-            pressVirtualKeyByLabel("SPACE");
-        }
-        if (l3 && !prevL3) {
-            toggleImeMode();
-        }
-
-        controllerPrev["CROSS"] = cross;
-        controllerPrev["SQUARE"] = square;
-        controllerPrev["CIRCLE"] = circle;
-        controllerPrev["TRIANGLE"] = tri;
-        prevL3 = l3;
-    }
+    // Raw input is read into this buffer, allocated once and reused for every WM_INPUT.
+    // 16 KiB holds ~200 DS4 USB records per GetRawInputBuffer call.
+    static constexpr size_t RAW_BUFFER_BYTES = 16 * 1024;
+    alignas(16) std::array<BYTE, RAW_BUFFER_BYTES> rawBuffer{};
+    // GetRawInputBuffer hands a 32-bit process on 64-bit Windows 64-bit headers
+    RawInputLayout bufferLayout = RawInputLayout::native();
 
-    void moveVKSelection(int dx, int dy) {
-        int newRow = selRow + dy;
-        if (newRow < 0) newRow = 0;
-        if (newRow >= vkRows) newRow = vkRows - 1;
-        int maxCols = static_cast<int>(vkLayout[newRow].size());
-        int newCol = selCol + dx;
-        if (newCol < 0) newCol = 0;
-        if (newCol >= maxCols) newCol = maxCols - 1;
-        selRow = newRow;
-        selCol = newCol;
+    static bool isWow64Process() {
+        BOOL wow64 = FALSE;
+        return sizeof(void*) == 4 && IsWow64Process(GetCurrentProcess(), &wow64) && wow64;
     }
 
-    void pressSelectedVirtualKey() {
-        if (selRow < 0 || selRow >= vkRows) return;
-        if (selCol < 0 || selCol >= static_cast<int>(vkLayout[selRow].size())) return;
-        const std::string &label = vkLayout[selRow][selCol];
-        pressVirtualKeyByLabel(label);
-    }
+    // This function runs on the message thread: queue the reports and notify main thread.
+    // The WM_INPUT that woke us is read with one GetRawInputData call, then everything else
+    // already queued is drained in bulk with GetRawInputBuffer. No heap allocation per message.
+    void handleRawInputMessageThread(HRAWINPUT hRaw) {
+        const auto received = std::chrono::steady_clock::now();
+        bool queued = false;
+        auto onReport = [&](uint64_t device, const uint8_t *data, uint32_t len) {
+            // The device's parser turns USB and Bluetooth reports alike into the USB layout.
+            // Each controller has its own ring. A full ring drops the report and bumps the
+            // overflow counter shown in the visualizer.
+            queued |= controllers.push(device, received, data, len);
+        };
 
-    WORD getVkForLabel(const std::string &label) {
-        if (label.empty()) return 0;
-        if (label.size() == 1) {
-            char c = label[0];
-            if (std::isalpha(static_cast<unsigned char>(c))) {
-                return static_cast<WORD>(std::toupper(static_cast<unsigned char>(c)));
-            }
-            if (std::isdigit(static_cast<unsigned char>(c))) {
-                return static_cast<WORD>(c);
-            }
-        }
-        if (label == "SPACE") return VK_SPACE;
-        if (label == "ENTER") return VK_RETURN;
-        if (label == "BACKSPACE") return VK_BACK;
-        if (label == "TAB") return VK_TAB;
-        if (label == "CAPS") return VK_CAPITAL;
-        if (label == "LSHFT" || label == "RSHIFT") return VK_LSHIFT;
-        if (label == "LCTRL" || label == "RCTRL") return VK_LCONTROL;
-        if (label == "LALT" || label == "RALT") return VK_MENU;
-        if (label == ",") return 0xBC;
-        if (label == ".") return 0xBE;
-        if (label == "/") return 0xBF;
-        if (label == ";") return 0xBA;
-        if (label == "'") return 0xDE;
-        if (label == "[") return 0xDB;
-        if (label == "]") return 0xDD;
-        if (label == "\\") return 0xDC;
-        if (label == "-") return 0xBD;
-        if (label == "=") return 0xBB;
-        return 0;
-    }
-
-    void pressVirtualKeyByLabel(const std::string &label) {
-        WORD vk = getVkForLabel(label);
-        if (vk == 0) return;
-
-        if (shiftSticky) {
-            setShiftState(true);
-            Emu::sendKey(vk, true);
-            Emu::sendKey(vk, false);
-        } else {
-            Emu::sendKey(vk, true);
-            Emu::sendKey(vk, false);
+        UINT size = static_cast<UINT>(rawBuffer.size());
+        UINT copied = GetRawInputData(hRaw, RID_INPUT, rawBuffer.data(), &size, sizeof(RAWINPUTHEADER));
+        if (copied != (UINT)-1 && copied > 0) {
+            RawInputDecode::decodeBlocks(rawBuffer.data(), copied, 1, RawInputLayout::native(), onReport);
         }
-    }
-
-    void toggleShiftSticky() {
-        shiftSticky = !shiftSticky;
-        setShiftState(shiftSticky);
-    }
 
-    void setShiftState(bool on) {
-        if (on && !shiftHeldByEmulator) {
-            Emu::sendKey(VK_LSHIFT, true);
-            shiftHeldByEmulator = true;
-        } else if (!on && shiftHeldByEmulator) {
-            Emu::sendKey(VK_LSHIFT, false);
-            shiftHeldByEmulator = false;
+        for (;;) {
+            UINT cb = static_cast<UINT>(rawBuffer.size());
+            UINT blocks = GetRawInputBuffer(reinterpret_cast<PRAWINPUT>(rawBuffer.data()), &cb, sizeof(RAWINPUTHEADER));
+            if (blocks == 0 || blocks == (UINT)-1) break;
+            RawInputDecode::decodeBlocks(rawBuffer.data(), rawBuffer.size(), blocks, bufferLayout, onReport);
         }
-    }
 
-    void setKeyState(WORD vk, bool wantDown) {
-        auto it = keyState.find(vk);
-        bool currentlyDown = (it != keyState.end()) ? it->second : false;
-        if (wantDown && !currentlyDown) {
-            Emu::sendKey(vk, true);
-            keyState[vk] = true;
-            if (std::find(repeatKeys.begin(), repeatKeys.end(), vk) != repeatKeys.end()) {
-                repeatNextTime[vk] = std::chrono::steady_clock::now() + std::chrono::milliseconds(repeatInitialDelayMs);
-            }
-        } else if (!wantDown && currentlyDown) {
-            Emu::sendKey(vk, false);
-            keyState[vk] = false;
-            repeatNextTime.erase(vk);
-        }
+        // *do not* call processMapping() or updateDisplay() here.
+        // Just wake the main thread once for everything queued in this pass.
+        if (queued) SetEvent(reportEvent.get());
     }
 
-    void setMouseButtonState(bool left, bool wantDown) {
-        bool &stateRef = left ? mouseLeftDown : mouseRightDown;
-        if (wantDown && !stateRef) {
-            Emu::sendMouseButton(left, true);
-            stateRef = true;
-        } else if (!wantDown && stateRef) {
-            Emu::sendMouseButton(left, false);
-            stateRef = false;
-        }
+    // ---------- UI / rendering ----------
+    // Render thread only. Reads nothing but the snapshot and the mapper's immutable layout.
+    void updateDisplay(const DisplaySnapshot &snap) {
+        view.draw(snap, console->buffer());
+        // only the cells that differ from the previous frame reach the console
+        console->present();
     }
 
-    void releaseAllInputs() {
-        for (auto &kv : keyState) {
-            if (kv.second) {
-                Emu::sendKey(kv.first, false);
-                kv.second = false;
-            }
-        }
-        keyState.clear();
-        repeatNextTime.clear();
-
-        if (mouseLeftDown) {
-            Emu::sendMouseButton(true, false);
-            mouseLeftDown = false;
-        }
-        if (mouseRightDown) {
-            Emu::sendMouseButton(false, false);
-            mouseRightDown = false;
-        }
-
-        for (auto &kv : faceButtonState) {
-            if (kv.second) {
-                WORD vk = faceButtonMap[kv.first];
-                Emu::sendKey(vk, false);
-                kv.second = false;
-            }
-        }
-
-        if (shiftHeldByEmulator) {
-            Emu::sendKey(VK_LSHIFT, false);
-            shiftHeldByEmulator = false;
-        }
+    // Console keys switch every controller.
+    void toggleMode() {
+        controllers.forEach([](ControllerShard &c) { c.mapper->toggleMode(); c.output->flush(); });
+        if (isDrawing()) publishSnapshot();
     }
 
-    void handleKeyRepeats() {
-        auto now = std::chrono::steady_clock::now();
-        for (WORD vk : repeatKeys) {
-            auto itState = keyState.find(vk);
-            if (itState == keyState.end() || !itState->second) {
-                continue;
-            }
-            auto itNext = repeatNextTime.find(vk);
-            if (itNext == repeatNextTime.end()) {
-                repeatNextTime[vk] = now + std::chrono::milliseconds(repeatInitialDelayMs);
-                continue;
-            }
-            if (now >= itNext->second) {
-                Emu::sendKey(vk, false);
-                Emu::sendKey(vk, true);
-                itNext->second = now + std::chrono::milliseconds(repeatIntervalMs);
-            }
-        }
+    void setMode(PS4Mapper::Mode m) {
+        controllers.forEach([&](ControllerShard &c) { c.mapper->setMode(m); c.output->flush(); });
+        if (isDrawing()) publishSnapshot();
     }
 
-    // ---------- UI / rendering ----------
-    void printHeader() {
-        console.setCursor(0, 0);
-        std::cout << "=== PS4 Controller -> Mouse/Keyboard Mapper ===\n";
-        std::cout << "Mappings (Visualizer mode):\n";
-        std::cout << "  Left stick -> WASD (analog -> digital)\n";
-        std::cout << "  D-Pad -> Arrow keys\n";
-        std::cout << "  Right stick -> Mouse movement (relative)\n";
-        std::cout << "  R2 -> Left mouse button, L2 -> Right mouse button\n";
-        std::cout << "Controls:\n";
-        std::cout << "  ESC to exit | TAB to toggle Visualizer/Virtual Keyboard | OPTIONS button toggles too\n";
-        std::cout << "  In Virtual Keyboard: Left stick to move, Cross(X) to press, Square toggles Shift, Circle Backspace, Triangle Space, L3 JA/EN toggle\n\n";
-        std::cout.flush();
-    }
-
-    void updateDisplay() {
-        console.clear();
-        printHeader();
-        std::optional<PS4ControllerReport> snapshot;
-        {
-            std::lock_guard<std::mutex> lk(stateMutex);
-            snapshot = lastReport;
-        }
-
-        console.writeAt(0, 7, std::string("Mode: ") + (mode == MODE_VISUALIZER ? "Visualizer" : "Virtual Keyboard"));
-
-        if (!snapshot.has_value()) {
-            console.writeAt(0, 9, "Waiting for controller data...");
-            return;
+    // Message thread, once per new controller with --device-profile: what picks its profile.
+    static DeviceInfo identifyRawInputDevice(uint64_t device) {
+        DeviceInfo info;
+        const HANDLE h = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(device));
+        RID_DEVICE_INFO rdi{};
+        rdi.cbSize = sizeof(rdi);
+        UINT size = sizeof(rdi);
+        if (GetRawInputDeviceInfoW(h, RIDI_DEVICEINFO, &rdi, &size) != (UINT)-1 && rdi.dwType == RIM_TYPEHID) {
+            info.vendorId = static_cast<uint16_t>(rdi.hid.dwVendorId);
+            info.productId = static_cast<uint16_t>(rdi.hid.dwProductId);
         }
-        const PS4ControllerReport &r = snapshot.value();
-
-        if (mode == MODE_VISUALIZER) {
-            drawStick(0, 10, r.leftStickX, r.leftStickY, "Left");
-            drawStick(30, 10, r.rightStickX, r.rightStickY, "Right");
-            drawTrigger(60, 10, r.leftTrigger, "L2");
-            drawTrigger(60, 11, r.rightTrigger, "R2");
-            console.writeAt(60, 13, "Battery: " + padNumber((int)r.battery, 3));
-            drawButtons(0, 18, r);
-            console.writeAt(0, 26, "Last mouse move: X=" + std::to_string(lastMouseMoveX) + " Y=" + std::to_string(lastMouseMoveY));
-            console.writeAt(0, 27, "Mouse L down: " + std::string(mouseLeftDown ? "YES" : "NO") + "  Mouse R down: " + std::string(mouseRightDown ? "YES" : "NO"));
-            constexpr size_t HEX_DUMP_BYTES = 24;
-            console.writeAt(0, 29, "Raw Data: " + Console::bytesToHex(reinterpret_cast<const uint8_t*>(&r), (std::min)(sizeof(r), HEX_DUMP_BYTES)));
-        } else {
-            drawVirtualKeyboard(0, 10);
-            console.writeAt(0, 18 + vkRows + 1, "Shift (Square): " + std::string(shiftSticky ? "ON" : "OFF"));
-            console.writeAt(0, 20 + vkRows + 1, "Press Cross to send selected key. Circle = Backspace, Triangle = Space, L3 = JA/EN toggle. TAB/OPTIONS toggles mode.");
-            console.writeAt(0, 22 + vkRows + 1, "Last mouse move: X=" + std::to_string(lastMouseMoveX) + " Y=" + std::to_string(lastMouseMoveY));
-            constexpr size_t HEX_DUMP_BYTES = 24;
-            console.writeAt(0, 24 + vkRows + 1, "Raw Data: " + Console::bytesToHex(reinterpret_cast<const uint8_t*>(&r), (std::min)(sizeof(r), HEX_DUMP_BYTES)));
+        wchar_t name[512];
+        UINT chars = 512;
+        const UINT copied = GetRawInputDeviceInfoW(h, RIDI_DEVICENAME, name, &chars);
+        if (copied != (UINT)-1) {
+            // \\?\HID#VID_054C&PID_09CC#...: ASCII, so a narrowing copy is exact
+            for (UINT i = 0; i < copied && name[i]; ++i) info.path += name[i] < 0x80 ? static_cast<char>(name[i]) : '?';
         }
+        return info;
     }
 
-    void drawStick(int x, int y, uint8_t rawX, uint8_t rawY, const std::string& name) {
-        constexpr int GRID_W = 11;
-        constexpr int GRID_H = 5;
-        constexpr int HALF_W = 5;
-        constexpr int HALF_H = 2;
-
-        console.writeAt(x, y, name + " Stick:");
-
-        auto norm = [](uint8_t v) -> float {
-            return (static_cast<int>(v) - 128) / 127.0f;
-        };
-        float nx = norm(rawX);
-        float ny = norm(rawY);
-        int posX = static_cast<int>(std::round(nx * HALF_W));
-        int posY = static_cast<int>(std::round(ny * HALF_H));
-
-        for (int row = -HALF_H; row <= HALF_H; ++row) {
-            std::string line;
-            line.reserve(GRID_W);
-            for (int col = -HALF_W; col <= HALF_W; ++col) {
-                if (col == posX && row == posY) line += "@";
-                else if (col == 0 && row == 0) line += "+";
-                else line += ".";
-            }
-            console.writeAt(x, y + 1 + (row + HALF_H), line);
-        }
-        console.writeAt(x, y + 1 + GRID_H, "X: " + padNumber((int)rawX, 3) + " Y: " + padNumber((int)rawY, 3));
-    }
-
-    void drawTrigger(int x, int y, uint8_t value, const std::string& name) {
-        int bars = (value * 10) / 255;
-        std::ostringstream ss;
-        ss << name << ": [";
-        for (int i = 0; i < 10; ++i) ss << (i < bars ? "#" : ".");
-        ss << "] " << std::setw(3) << (int)value;
-        console.writeAt(x, y, ss.str());
-    }
-
-    void drawButtons(int x, int y, const PS4ControllerReport& r) {
-        std::ostringstream ss1;
-        ss1 << "Buttons: ";
-        ss1 << (r.buttons1 & 0x10 ? "[SQR] " : " SQR  ");
-        ss1 << (r.buttons1 & 0x20 ? "[CRO] " : " CRO  ");
-        ss1 << (r.buttons1 & 0x40 ? "[CIR] " : " CIR  ");
-        ss1 << (r.buttons1 & 0x80 ? "[TRI] " : " TRI  ");
-        console.writeAt(x, y, ss1.str());
-
-        uint8_t dpad = r.buttons1 & 0x0F;
-        std::string dpadStr = dpadToLabel(dpad);
-        console.writeAt(x, y + 1, "D-Pad: " + dpadStr);
-
-        std::ostringstream ss2;
-        ss2 << (r.buttons2 & 0x01 ? "[L1] " : " L1  ");
-        ss2 << (r.buttons2 & 0x02 ? "[R1] " : " R1  ");
-        ss2 << (r.buttons2 & 0x40 ? "[L3] " : " L3  ");
-        ss2 << (r.buttons2 & 0x80 ? "[R3] " : " R3  ");
-        ss2 << " | ";
-        ss2 << (r.buttons3 & 0x01 ? "[PS] " : " PS  ");
-        ss2 << (r.buttons3 & 0x02 ? "[PAD] " : " PAD  ");
-        ss2 << (r.buttons2 & 0x10 ? "[SHARE] " : " SHARE  ");
-        ss2 << (r.buttons2 & 0x20 ? "[OPTIONS] " : " OPTIONS  ");
-
-        console.writeAt(x, y + 2, ss2.str());
-    }
-
-    void drawVirtualKeyboard(int x, int y) {
-        for (int r = 0; r < vkRows; ++r) {
-            int colX = x;
-            for (size_t c = 0; c < vkLayout[r].size(); ++c) {
-                std::string label = vkLayout[r][c];
-                std::string disp;
-                const int minKeyWidth = 7;
-                if (r == selRow && static_cast<int>(c) == selCol) {
-                    std::ostringstream ss;
-                    ss << '[' << label << ']';
-                    disp = ss.str();
-                } else {
-                    disp = " " + label + " ";
-                }
-                if ((int)disp.size() < minKeyWidth) disp += std::string(minKeyWidth - (int)disp.size(), ' ');
-                console.writeAt(colX, y + r, disp);
-                colX += disp.size() + 1;
-            }
-        }
-    }
-
-    static std::string dpadToLabel(uint8_t d) {
-        switch (d) {
-            case 0: return "Up";
-            case 1: return "Up-Right";
-            case 2: return "Right";
-            case 3: return "Down-Right";
-            case 4: return "Down";
-            case 5: return "Down-Left";
-            case 6: return "Left";
-            case 7: return "Up-Left";
-            default: return "Neutral";
-        }
-    }
-
-    static std::string padNumber(int v, int w) {
-        std::ostringstream ss;
-        ss << std::setw(w) << v;
-        return ss.str();
-    }
-
-    void toggleMode() {
-        if (mode == MODE_VISUALIZER) setMode(MODE_VKEYBOARD);
-        else setMode(MODE_VISUALIZER);
-    }
-
-    void setMode(Mode m) {
-        if (mode == m) return;
-        releaseAllInputs();
-        mode = m;
-        if (mode == MODE_VKEYBOARD) {
-            if (selRow < 0) selRow = 0;
-            if (selRow >= vkRows) selRow = vkRows - 1;
-            if (selCol < 0) selCol = 0;
-            if (selCol >= static_cast<int>(vkLayout[selRow].size())) selCol = static_cast<int>(vkLayout[selRow].size()) - 1;
-        }
-        updateDisplay();
+    // Mapping thread: a newly seen controller gets the command-line options; its profile
+    // comes from ControllerShards.
+    void configureController(ControllerShard &c) {
+        PS4Mapper &m = *c.mapper;
+        m.setGyroAim(options.gyroAim);
+        m.setTrackpad(options.trackpad);
+        m.setMouseTickRate(options.mouseHz);
+        m.setGyroSensitivity(options.gyroSensitivity);
+        m.setMouseStick(options.mouseStick);
+        m.setDictionary(&dictionary);
+        m.setKeyboardLayout(&keyboardLayout);
     }
 
     void toggleConsoleWindow() {
         HWND hConsole = GetConsoleWindow();
         if (!hConsole) return;
-        consoleVisible = !consoleVisible;
-        ShowWindow(hConsole, consoleVisible ? SW_SHOW : SW_HIDE);
-        if (consoleVisible) {
+        const bool visible = !consoleVisible.load(std::memory_order_relaxed);
+        consoleVisible.store(visible, std::memory_order_relaxed);
+        ShowWindow(hConsole, visible ? SW_SHOW : SW_HIDE);
+        if (visible) {
             setConsoleAlwaysOnTop();
+            publishSnapshot(); // whatever changed while hidden
         }
     }
 
@@ -922,61 +851,70 @@ private:
     HWND hwnd = nullptr;
     const std::wstring windowClassName = L"PS4RawInputClassRefactored";
 
-    std::mutex stateMutex;
-    std::optional<PS4ControllerReport> lastReport;
-    bool controllerConnected = false;
+    // main-thread only: the controller shown in full, the one that reported last
+    int focused = 0;
 
-    Console console;
+    // null in --headless and --no-visualizer: nothing is drawn
+    std::unique_ptr<Console> console;
 
-    std::map<WORD, bool> keyState;
-    bool mouseLeftDown = false;
-    bool mouseRightDown = false;
-    int lastMouseMoveX = 0;
-    int lastMouseMoveY = 0;
+    // every synthesized event goes through a controller's OutputBatch, flushed once per
+    // processed report, then through the shared key/button merge into SendInput
+    Emu::SendInputSink sendInputSink;
 
-    std::map<std::string, WORD> faceButtonMap;
-    std::map<std::string, bool> faceButtonState;
+    // loaded once, shared read-only by every controller's mapper, so declared before them
+    WordDictionary dictionary;
+    KeyboardLayout keyboardLayout = KeyboardLayout::builtIn();
 
-    std::map<std::string, bool> controllerPrev;
-    bool prevOptions = false;
+    // per-controller queues and mappers; mapping runs on the main thread only
+    ControllerShards controllers{sendInputSink, [this](ControllerShard &c) { configureController(c); }};
+    // declared after `controllers`, which they publish to, so they stop first
+    ProfileWatcher profileWatcher;
+    std::vector<std::unique_ptr<ProfileWatcher>> deviceProfileWatchers;
+    VisualizerView view{keyboardLayout};
 
-    bool prevR1 = false;
-    bool consoleVisible = true;
-
-    Mode mode = MODE_VISUALIZER;
-
-    std::vector<std::vector<std::string>> vkLayout;
-    int vkRows = 0;
-    int selRow = 0, selCol = 0;
-    int vkMoveDelayMs = 150;
-    std::chrono::steady_clock::time_point lastVKMove;
-
-    bool shiftSticky = false;
-    bool shiftHeldByEmulator = false;
-    bool prevL3 = false;
-
-    std::vector<WORD> repeatKeys = { VK_KEY_W, VK_KEY_A, VK_KEY_S, VK_KEY_D, VK_UP, VK_DOWN, VK_LEFT, VK_RIGHT };
-    std::map<WORD, std::chrono::steady_clock::time_point> repeatNextTime;
-    int repeatInitialDelayMs = 300;
-    int repeatIntervalMs = 70;
-    
-    void toggleImeMode() {
-        Emu::sendKey(VK_KANJI, true);
-        Emu::sendKey(VK_KANJI, false);
-    }
+    // written by the mapping thread; the render thread stops drawing while it is false
+    std::atomic<bool> consoleVisible{true};
 };
 
-// helper: virtual key constants for arrows (already in WinAPI)
-#ifndef VK_KEY_W
-#define VK_KEY_W 0x57
-#define VK_KEY_A 0x41
-#define VK_KEY_S 0x53
-#define VK_KEY_D 0x44
-#endif
-
-int main() {
+int main(int argc, char** argv) {
     try {
-        PS4VisualizerMapper viz;
+        MapperOptions opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--no-visualizer") opts.visualizer = false;
+            else if (arg.rfind("--fps=", 0) == 0) opts.maxFps = (std::max)(1, std::atoi(arg.c_str() + 6));
+            else if (arg.rfind("--capture=", 0) == 0) opts.capturePath = arg.substr(10);
+            else if (arg.rfind("--latency-dump=", 0) == 0) opts.latencyDumpPath = arg.substr(15);
+            else if (arg == "--gyro") opts.gyroAim = true;
+            else if (arg == "--trackpad") opts.trackpad = true;
+            else if (arg.rfind("--mouse-hz=", 0) == 0) opts.mouseHz = (std::max)(1, std::atoi(arg.c_str() + 11));
+            else if (arg.rfind("--gyro-sens=", 0) == 0) opts.gyroSensitivity = static_cast<float>(std::atof(arg.c_str() + 12));
+            else if (arg.rfind("--mouse-curve=", 0) == 0) {
+                AxisCurve curve;
+                if (!parseAxisCurve(arg.substr(14), curve)) throw std::runtime_error("Invalid curve: " + arg);
+                opts.mouseStick.curveX = opts.mouseStick.curveY = curve;
+            }
+            else if (arg.rfind("--mouse-deadzone=", 0) == 0) {
+                if (!parseDeadzone(arg.substr(17), opts.mouseStick)) throw std::runtime_error("Invalid deadzone: " + arg);
+            }
+            else if (arg.rfind("--profile=", 0) == 0) opts.profilePath = arg.substr(10);
+            else if (arg.rfind("--device-profile=", 0) == 0) {
+                const size_t eq = arg.find('=', 17);
+                if (eq == std::string::npos || eq == 17 || eq + 1 == arg.size()) throw std::runtime_error("Invalid device profile (MATCH=FILE): " + arg);
+                opts.deviceProfiles.emplace_back(arg.substr(17, eq - 17), arg.substr(eq + 1));
+            }
+            else if (arg.rfind("--dictionary=", 0) == 0) opts.dictionaryPath = arg.substr(13);
+            else if (arg.rfind("--layout=", 0) == 0) opts.layoutPath = arg.substr(9);
+            else if (arg == "--shm") opts.sharedStateName = DS4_SHM_NAME;
+            else if (arg.rfind("--shm=", 0) == 0) opts.sharedStateName = arg.substr(6);
+            else if (arg == "--headless") opts.headless = true;
+            else if (arg == "--metrics") opts.metricsPort = MetricsServer::DEFAULT_PORT;
+            else if (arg.rfind("--metrics=", 0) == 0) {
+                opts.metricsPort = std::atoi(arg.c_str() + 10);
+                if (opts.metricsPort < 1 || opts.metricsPort > 65535) throw std::runtime_error("Invalid metrics port: " + arg);
+            }
+        }
+        PS4VisualizerMapper viz(opts);
         viz.run();
     } catch (const std::exception& ex) {
         std::cerr << "Fatal error: " << ex.what() << std::endl;
@@ -0,0 +1,248 @@
+#pragma once
+// Runtime counters and latency histograms in the Prometheus text format, for a metrics
+// endpoint (metrics_server.h) on a mapper that runs without a console.
+//
+// Every value has exactly one writer thread, so collecting costs the mapping thread nothing it
+// could wait on. The mapping thread copies its own plain counters (reports, skips, output
+// events and SendInput calls from each controller's PS4Mapper and OutputBatch) into a block of
+// relaxed atomics once per loop iteration: a few stores, no lock, no read-modify-write. Dropped
+// and rejected reports are counted by the producer thread (report ring, ReportParser) and only
+// copied here. Latency and timer lateness are PipelineLatency's histograms, which are
+// single-writer already. The scraping thread only loads, at scrape rate.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "clock_source.h"
+#include "controller_shards.h"
+#include "latency_histogram.h"
+
+// One controller's counters as the mapping thread sees them; all totals since it connected.
+struct ControllerCounters {
+    uint64_t device = 0;            // RAWINPUT hDevice, or the hidraw descriptor
+    uint64_t reports = 0;           // received, mapped or skipped
+    uint64_t skipped = 0;           // unchanged, so not mapped (PS4Mapper::processReport())
+    uint64_t dropped = 0;           // lost to a full report ring
+    uint64_t rejected = 0;          // not a DS4 input report, or a bad Bluetooth checksum (ReportParser)
+    uint64_t outputEvents = 0;
+    uint64_t outputSubmissions = 0; // SendInput calls, or uinput writes
+    uint64_t stuckKeyResets = 0;    // PS4Mapper::stuckKeyResets()
+};
+
+class MapperMetrics {
+public:
+    static constexpr int MAX_CONTROLLERS = ControllerShards::MAX_CONTROLLERS;
+    // Histogram bucket bounds in nanoseconds, 1 us to 100 ms; +Inf is implied.
+    static constexpr std::array<uint64_t, 16> LATENCY_BOUNDS_NS = {
+        1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000 };
+
+    explicit MapperMetrics(const PipelineLatency &pipeline, const ClockSource &clockSource = SteadyClockSource::instance())
+        : latency(pipeline), clock(clockSource), rateSince(clockSource.now()) {}
+    MapperMetrics(const MapperMetrics &) = delete;
+    MapperMetrics &operator=(const MapperMetrics &) = delete;
+
+    // ---------- mapping thread ----------
+    void update(int index, const ControllerCounters &c) {
+        if (index < 0 || index >= MAX_CONTROLLERS) return;
+        Block &b = blocks[index];
+        store(b.device, c.device);
+        store(b.reports, c.reports);
+        store(b.skipped, c.skipped);
+        store(b.dropped, c.dropped);
+        store(b.rejected, c.rejected);
+        store(b.outputEvents, c.outputEvents);
+        store(b.outputSubmissions, c.outputSubmissions);
+        store(b.stuckKeyResets, c.stuckKeyResets);
+        if (index >= active.load(std::memory_order_relaxed)) active.store(index + 1, std::memory_order_release);
+    }
+
+    // Every controller that has a mapper, plus the reports no shard could take.
+    void update(const ControllerShards &controllers) {
+        controllers.forEach([&](const ControllerShard &s) {
+            ControllerCounters c;
+            c.device = s.device;
+            c.reports = s.reports;
+            c.skipped = s.mapper->reportsSkipped();
+            c.dropped = s.ring.overflowCount();
+            c.rejected = s.parser.rejected();
+            c.outputEvents = s.output->eventCount();
+            c.outputSubmissions = s.output->submissionCount();
+            c.stuckKeyResets = s.mapper->stuckKeyResets();
+            update(s.index, c);
+        });
+        store(unassigned, controllers.unassignedReports());
+        store(unrecognized, controllers.unrecognizedReports());
+    }
+
+    // ---------- scraping thread ----------
+    // The whole exposition. ds4_report_rate_hz is taken over the time since the previous
+    // sample at least a second old, so scrape from one thread (or use rate() on
+    // ds4_reports_total for anything finer).
+    std::string render() {
+        std::string out;
+        out.reserve(16 * 1024);
+        const int n = active.load(std::memory_order_acquire);
+        updateRates(n);
+
+        gauge(out, "ds4_controllers", "Controllers that have sent a report.");
+        line(out, "ds4_controllers", "", static_cast<uint64_t>(n));
+
+        counter(out, "ds4_reports_total", "Reports received per controller, mapped or skipped.");
+        perController(out, "ds4_reports_total", n, &Block::reports);
+        gauge(out, "ds4_report_rate_hz", "Reports per second per controller.");
+        for (int i = 0; i < n; ++i) {
+            char value[32];
+            std::snprintf(value, sizeof(value), "%.1f", rates[i]);
+            out += "ds4_report_rate_hz";
+            labels(out, i);
+            out += ' ';
+            out += value;
+            out += '\n';
+        }
+        counter(out, "ds4_reports_skipped_total", "Reports that changed nothing the mapping reads, so were not mapped.");
+        perController(out, "ds4_reports_skipped_total", n, &Block::skipped);
+        counter(out, "ds4_reports_dropped_total", "Reports dropped because the controller's report ring was full.");
+        perController(out, "ds4_reports_dropped_total", n, &Block::dropped);
+        counter(out, "ds4_reports_unassigned_total", "Reports dropped because every controller slot was held by a connected controller.");
+        line(out, "ds4_reports_unassigned_total", "", load(unassigned));
+        counter(out, "ds4_reports_rejected_total", "Reports in no DS4 input format, or with a bad Bluetooth checksum.");
+        perController(out, "ds4_reports_rejected_total", n, &Block::rejected);
+        counter(out, "ds4_reports_unrecognized_total", "Reports from devices that have not sent a DS4 input report.");
+        line(out, "ds4_reports_unrecognized_total", "", load(unrecognized));
+        counter(out, "ds4_output_events_total", "Key, mouse button, motion and wheel events sent.");
+        perController(out, "ds4_output_events_total", n, &Block::outputEvents);
+        counter(out, "ds4_output_submissions_total", "Output batches sent: one SendInput call or uinput write each.");
+        perController(out, "ds4_output_submissions_total", n, &Block::outputSubmissions);
+        counter(out, "ds4_stuck_key_resets_total", "Held keys and mouse buttons released by a reset rather than by their input.");
+        perController(out, "ds4_stuck_key_resets_total", n, &Block::stuckKeyResets);
+
+        out += "# HELP ds4_report_latency_seconds Report pipeline latency by stage: queue, map, submit, total.\n"
+               "# TYPE ds4_report_latency_seconds histogram\n";
+        const PipelineLatency::Stage stages[] = { PipelineLatency::QUEUE, PipelineLatency::MAP, PipelineLatency::SUBMIT, PipelineLatency::TOTAL };
+        for (PipelineLatency::Stage s : stages) {
+            const std::string stage = std::string("stage=\"") + PipelineLatency::stageName(s) + '"';
+            histogram(out, "ds4_report_latency_seconds", stage, latency.stage(s));
+        }
+        out += "# HELP ds4_timer_lateness_seconds How long after their deadline mapper timers (key repeats, keyboard moves, combo holds, macro steps) fired.\n"
+               "# TYPE ds4_timer_lateness_seconds histogram\n";
+        histogram(out, "ds4_timer_lateness_seconds", "", latency.stage(PipelineLatency::TIMER));
+        return out;
+    }
+
+private:
+    struct Block {
+        std::atomic<uint64_t> device{0};
+        std::atomic<uint64_t> reports{0};
+        std::atomic<uint64_t> skipped{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> rejected{0};
+        std::atomic<uint64_t> outputEvents{0};
+        std::atomic<uint64_t> outputSubmissions{0};
+        std::atomic<uint64_t> stuckKeyResets{0};
+    };
+
+    // Single writer: a plain relaxed store of the writer's own total.
+    static void store(std::atomic<uint64_t> &a, uint64_t v) { a.store(v, std::memory_order_relaxed); }
+    static uint64_t load(const std::atomic<uint64_t> &a) { return a.load(std::memory_order_relaxed); }
+
+    void updateRates(int n) {
+        const auto now = clock.now();
+        const double seconds = std::chrono::duration<double>(now - rateSince).count();
+        if (seconds < 1.0) return;
+        for (int i = 0; i < n; ++i) {
+            const uint64_t reports = load(blocks[i].reports);
+            // fewer than last time: another controller took the slot and counts from zero
+            rates[i] = static_cast<double>(reports - (reports < rateReports[i] ? 0 : rateReports[i])) / seconds;
+            rateReports[i] = reports;
+        }
+        rateSince = now;
+    }
+
+    static void counter(std::string &out, const char *name, const char *help) { header(out, name, help, "counter"); }
+    static void gauge(std::string &out, const char *name, const char *help) { header(out, name, help, "gauge"); }
+    static void header(std::string &out, const char *name, const char *help, const char *type) {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    void labels(std::string &out, int index) const {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "{controller=\"%d\",device=\"0x%llx\"}", index,
+                      static_cast<unsigned long long>(load(blocks[index].device)));
+        out += buf;
+    }
+
+    static void line(std::string &out, const char *name, const std::string &labelSet, uint64_t value) {
+        out += name;
+        if (!labelSet.empty()) {
+            out += '{';
+            out += labelSet;
+            out += '}';
+        }
+        out += ' ';
+        out += std::to_string(value);
+        out += '\n';
+    }
+
+    void perController(std::string &out, const char *name, int n, std::atomic<uint64_t> Block::*field) const {
+        for (int i = 0; i < n; ++i) {
+            out += name;
+            labels(out, i);
+            out += ' ';
+            out += std::to_string(load(blocks[i].*field));
+            out += '\n';
+        }
+    }
+
+    // Cumulative buckets from one pass over the HDR buckets, so they never decrease and +Inf
+    // equals _count. A value is counted under the first bound at or above its HDR bucket's
+    // upper edge: never under a bound below it, at most ~3% late.
+    static void histogram(std::string &out, const char *name, const std::string &labelSet, const LatencyHistogram &h) {
+        const std::string bucketName = std::string(name) + "_bucket";
+        const std::string prefix = labelSet.empty() ? std::string() : labelSet + ',';
+        uint64_t seen = 0;
+        size_t i = 0;
+        for (uint64_t bound : LATENCY_BOUNDS_NS) {
+            for (; i < LatencyHistogram::BUCKET_COUNT && LatencyHistogram::bucketHigh(i) <= bound; ++i) seen += h.bucketCount(i);
+            char le[40];
+            std::snprintf(le, sizeof(le), "le=\"%g\"", static_cast<double>(bound) / 1e9);
+            line(out, bucketName.c_str(), prefix + le, seen);
+        }
+        for (; i < LatencyHistogram::BUCKET_COUNT; ++i) seen += h.bucketCount(i);
+        line(out, bucketName.c_str(), prefix + "le=\"+Inf\"", seen);
+
+        char sum[48];
+        std::snprintf(sum, sizeof(sum), " %.9f\n", static_cast<double>(h.sumNanoseconds()) / 1e9);
+        out += name;
+        out += "_sum";
+        if (!labelSet.empty()) out += '{' + labelSet + '}';
+        out += sum;
+        line(out, (std::string(name) + "_count").c_str(), labelSet, seen);
+    }
+
+    const PipelineLatency &latency;
+    const ClockSource &clock;
+
+    // mapping thread writes, scraping thread reads
+    std::array<Block, MAX_CONTROLLERS> blocks;
+    std::atomic<int> active{0};
+    std::atomic<uint64_t> unassigned{0};
+    std::atomic<uint64_t> unrecognized{0};
+
+    // scraping thread only
+    ClockSource::time_point rateSince;
+    std::array<uint64_t, MAX_CONTROLLERS> rateReports{};
+    std::array<double, MAX_CONTROLLERS> rates{};
+};
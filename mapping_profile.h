@@ -0,0 +1,652 @@
+#pragma once
+// Mapping profiles: which key or mouse button each controller input produces.
+//
+// A profile is a small TOML-style text file (see profiles/default.profile):
+//
+//   [bind]                      # input = action
+//   cross = "SPACE"
+//   r2 = "mouse_left"
+//   options = "toggle_mode"
+//   lstick_up = "W"
+//   [repeat]
+//   keys = ["W", "A", "S", "D"]
+//   delay_ms = 300
+//   interval_ms = 70
+//   [triggers]
+//   threshold = 50
+//   [macros]                    # name = "steps"
+//   melee = "V down, 30ms, V up"
+//   [combos]                    # trigger = macro or action
+//   l1+r1 = "melee"
+//   hold:triangle = "toggle_console"
+//
+// It is compiled once, at load time, into an ActionTable. Every bindable input is one bit of
+// a 32-bit input mask: the Button bits of ControllerState::buttons as they are, followed by
+// the thresholded triggers and the four left-stick directions. The table stores, for each
+// distinct key it drives, the mask of inputs that hold it down, so per report the mapper does
+// one AND per bound key and never walks the text form. Combos and macros compile into a
+// ComboSet of fixed arrays.
+//
+// Tables move from the loader to the mapping thread through a ProfileExchange: two atomic
+// exchanges per reload and nothing that locks, allocates or frees on the mapping side.
+
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "controller_state.h"
+#include "vk_codes.h"
+
+// Input ids after the Button bits: analog inputs turned into digital ones.
+enum AnalogInput : uint8_t {
+    IN_L2 = BTN_COUNT,   // left trigger past the profile's threshold
+    IN_R2,
+    IN_LSTICK_UP,        // left stick outside its deadzone, per direction
+    IN_LSTICK_DOWN,
+    IN_LSTICK_LEFT,
+    IN_LSTICK_RIGHT,
+    INPUT_COUNT
+};
+static_assert(INPUT_COUNT <= 32, "inputs must fit one mask");
+
+constexpr uint32_t inputBit(int id) { return 1u << id; }
+
+constexpr uint32_t LSTICK_INPUTS = inputBit(IN_LSTICK_UP) | inputBit(IN_LSTICK_DOWN) |
+                                   inputBit(IN_LSTICK_LEFT) | inputBit(IN_LSTICK_RIGHT);
+
+struct InputName {
+    const char *name;
+    uint8_t id;
+};
+
+// Profile spelling of every input id.
+constexpr InputName INPUT_NAMES[] = {
+    { "square", BTN_SQUARE }, { "cross", BTN_CROSS }, { "circle", BTN_CIRCLE }, { "triangle", BTN_TRIANGLE },
+    { "l1", BTN_L1 }, { "r1", BTN_R1 }, { "l2_button", BTN_L2 }, { "r2_button", BTN_R2 },
+    { "share", BTN_SHARE }, { "options", BTN_OPTIONS }, { "l3", BTN_L3 }, { "r3", BTN_R3 },
+    { "ps", BTN_PS }, { "touchpad", BTN_PAD },
+    { "dpad_up", BTN_DPAD_UP }, { "dpad_right", BTN_DPAD_RIGHT }, { "dpad_down", BTN_DPAD_DOWN }, { "dpad_left", BTN_DPAD_LEFT },
+    { "l2", IN_L2 }, { "r2", IN_R2 },
+    { "lstick_up", IN_LSTICK_UP }, { "lstick_down", IN_LSTICK_DOWN },
+    { "lstick_left", IN_LSTICK_LEFT }, { "lstick_right", IN_LSTICK_RIGHT },
+};
+static_assert(sizeof(INPUT_NAMES) / sizeof(INPUT_NAMES[0]) == INPUT_COUNT, "every input has a name");
+
+struct Action {
+    enum Kind : uint8_t {
+        None,
+        Key,            // held while the input is
+        MouseLeft,
+        MouseRight,
+        ToggleMode,     // on press: Visualizer <-> Virtual Keyboard
+        ToggleConsole   // on press: PS4Mapper::HOST_TOGGLE_CONSOLE
+    };
+    Kind kind = None;
+    uint16_t vk = 0;
+};
+
+// Combos and macros of a profile ([combos], [macros]); matched and played by combo_engine.h.
+// Combo ids are bits of a 32-bit mask too: byInput[] holds, per input, the combos it takes
+// part in, so an input edge only looks at the combos that read that input.
+struct ComboSet {
+    static constexpr int MAX_COMBOS = 32;        // one bit each
+    static constexpr int MAX_MACROS = 32;
+    static constexpr int MAX_STEPS = 512;        // all macros together
+    static constexpr int MAX_SEQUENCE = 8;
+    static constexpr uint32_t MAX_WAIT_US = 10000000;
+
+    struct Step {
+        enum Kind : uint8_t { Wait, KeyDown, KeyUp, MouseDown, MouseUp, Wheel };
+        Kind kind = Wait;
+        bool left = false;    // MouseDown / MouseUp
+        uint16_t vk = 0;      // KeyDown / KeyUp
+        int32_t wheel = 0;    // Wheel: 1/120 notch, positive = away from the user
+        uint32_t waitUs = 0;  // pause after this step
+    };
+
+    struct Macro {
+        uint16_t first = 0;   // into steps
+        uint16_t count = 0;
+    };
+
+    struct Combo {
+        enum Kind : uint8_t {
+            Chord,      // every input pressed within chordMs of the first
+            Tap,        // pressed and released within holdMs
+            Hold,       // held for holdMs
+            Sequence    // pressed one after another, each within sequenceMs of the last
+        };
+        enum Target : uint8_t { PlayMacro, ToggleMode, ToggleConsole };
+        Kind kind = Chord;
+        Target target = PlayMacro;
+        uint8_t macro = 0;
+        uint8_t length = 0;                             // Sequence: steps
+        uint32_t inputs = 0;                            // every input the combo reads
+        std::array<uint8_t, MAX_SEQUENCE> sequence{};   // Sequence: input ids in order
+        std::array<uint8_t, MAX_SEQUENCE> fallback{};   // Sequence: KMP failure function
+    };
+
+    // ---------- as written in the profile ----------
+    int chordMs = 50;
+    int holdMs = 300;
+    int sequenceMs = 300;
+    std::array<Combo, MAX_COMBOS> combos{};
+    int comboCount = 0;
+    std::array<Macro, MAX_MACROS> macros{};
+    int macroCount = 0;
+    std::array<Step, MAX_STEPS> steps{};
+    int stepCount = 0;
+
+    // ---------- compiled by compile() ----------
+    std::array<uint32_t, INPUT_COUNT> byInput{};  // combo mask per input id
+    uint32_t inputs = 0;                          // read by any combo
+    uint32_t holdInputs = 0;                      // have a Hold combo: need a hold timer
+    uint32_t chordCombos = 0, tapCombos = 0, holdCombos = 0, sequenceCombos = 0;
+
+    void compile() {
+        byInput.fill(0);
+        inputs = holdInputs = 0;
+        chordCombos = tapCombos = holdCombos = sequenceCombos = 0;
+        for (int c = 0; c < comboCount; ++c) {
+            Combo &k = combos[c];
+            const uint32_t bit = 1u << c;
+            inputs |= k.inputs;
+            for (uint32_t m = k.inputs; m; m &= m - 1) byInput[lowestBitIndex(m)] |= bit;
+            switch (k.kind) {
+                case Combo::Chord: chordCombos |= bit; break;
+                case Combo::Tap: tapCombos |= bit; break;
+                case Combo::Hold: holdCombos |= bit; holdInputs |= k.inputs; break;
+                case Combo::Sequence: sequenceCombos |= bit; break;
+            }
+            // fallback[i]: length of the longest proper prefix of sequence[0..i] that is also
+            // its suffix, so a wrong press resumes from a partial match instead of from zero
+            k.fallback = {};
+            for (int i = 1, len = 0; i < k.length; ++i) {
+                while (len > 0 && k.sequence[i] != k.sequence[len]) len = k.fallback[len - 1];
+                if (k.sequence[i] == k.sequence[len]) ++len;
+                k.fallback[i] = static_cast<uint8_t>(len);
+            }
+        }
+    }
+};
+
+struct ActionTable {
+    // ---------- as written in the profile ----------
+    std::array<Action, INPUT_COUNT> bindings{};   // indexed by input id
+    std::array<bool, Vk::COUNT> repeat{};         // keys that auto-repeat while held
+    uint8_t triggerThreshold = 50;
+    int repeatDelayMs = 300;
+    int repeatIntervalMs = 70;
+    ComboSet combos;
+    std::string source;                           // file it was loaded from, empty = built in
+
+    // ---------- compiled by compile() ----------
+    struct KeyBinding {
+        uint32_t inputs;   // any of these held -> key down
+        uint16_t vk;
+        bool repeat;
+    };
+    std::array<KeyBinding, INPUT_COUNT> keys{};   // one per distinct key, in input order
+    int keyCount = 0;
+    std::array<bool, Vk::COUNT> bound{};          // vk appears in keys
+    uint32_t mouseLeftInputs = 0;
+    uint32_t mouseRightInputs = 0;
+    uint32_t toggleModeInputs = 0;
+    uint32_t toggleConsoleInputs = 0;
+
+    ActionTable *retiredNext = nullptr;           // ProfileExchange's retire list
+
+    void bind(int input, Action::Kind kind, uint16_t vk = 0) {
+        bindings[input].kind = kind;
+        bindings[input].vk = kind == Action::Key ? vk : 0;
+    }
+
+    void compile() {
+        keys = {};
+        keyCount = 0;
+        bound.fill(false);
+        mouseLeftInputs = mouseRightInputs = toggleModeInputs = toggleConsoleInputs = 0;
+        for (int i = 0; i < INPUT_COUNT; ++i) {
+            const Action &a = bindings[i];
+            switch (a.kind) {
+                case Action::None: break;
+                case Action::Key: {
+                    if (!bound[a.vk]) {
+                        keys[keyCount++] = { 0, a.vk, repeat[a.vk] };
+                        bound[a.vk] = true;
+                    }
+                    for (int k = 0; k < keyCount; ++k) {
+                        if (keys[k].vk == a.vk) keys[k].inputs |= inputBit(i);
+                    }
+                    break;
+                }
+                case Action::MouseLeft: mouseLeftInputs |= inputBit(i); break;
+                case Action::MouseRight: mouseRightInputs |= inputBit(i); break;
+                case Action::ToggleMode: toggleModeInputs |= inputBit(i); break;
+                case Action::ToggleConsole: toggleConsoleInputs |= inputBit(i); break;
+            }
+        }
+        combos.compile();
+    }
+
+    // The built-in mapping, identical to profiles/default.profile.
+    static ActionTable defaults() {
+        ActionTable t;
+        t.bind(BTN_SQUARE, Action::Key, Vk::E);
+        t.bind(BTN_CROSS, Action::Key, Vk::SPACE);
+        t.bind(BTN_CIRCLE, Action::Key, Vk::LCONTROL);
+        t.bind(BTN_TRIANGLE, Action::Key, Vk::LSHIFT);
+        t.bind(BTN_R1, Action::ToggleConsole);
+        t.bind(BTN_OPTIONS, Action::ToggleMode);
+        t.bind(BTN_DPAD_UP, Action::Key, Vk::UP);
+        t.bind(BTN_DPAD_RIGHT, Action::Key, Vk::RIGHT);
+        t.bind(BTN_DPAD_DOWN, Action::Key, Vk::DOWN);
+        t.bind(BTN_DPAD_LEFT, Action::Key, Vk::LEFT);
+        t.bind(IN_L2, Action::MouseRight);
+        t.bind(IN_R2, Action::MouseLeft);
+        t.bind(IN_LSTICK_UP, Action::Key, Vk::W);
+        t.bind(IN_LSTICK_DOWN, Action::Key, Vk::S);
+        t.bind(IN_LSTICK_LEFT, Action::Key, Vk::A);
+        t.bind(IN_LSTICK_RIGHT, Action::Key, Vk::D);
+        for (uint16_t vk : { Vk::W, Vk::A, Vk::S, Vk::D, Vk::UP, Vk::DOWN, Vk::LEFT, Vk::RIGHT }) t.repeat[vk] = true;
+        t.compile();
+        return t;
+    }
+};
+
+// ---------- profile text -> ActionTable ----------
+
+// Key names: letters, digits, SPACE, ENTER, punctuation, navigation and JIS keys, NUM0-NUM9
+// and NUM+ style keypad keys, or any virtual-key code in hex (0xBA). Profiles and keyboard
+// layouts (keyboard_layout.h) share these.
+inline uint16_t vkForKeyName(const std::string &name) {
+    if (name.size() == 1) {
+        const unsigned char c = static_cast<unsigned char>(name[0]);
+        if (std::isalpha(c)) return static_cast<uint16_t>(std::toupper(c));
+        if (std::isdigit(c)) return static_cast<uint16_t>(c);
+    }
+    static const struct { const char *name; uint16_t vk; } names[] = {
+        { "SPACE", Vk::SPACE }, { "ENTER", Vk::RETURN }, { "BACKSPACE", Vk::BACK }, { "TAB", Vk::TAB },
+        { "CAPS", Vk::CAPITAL }, { "LSHIFT", Vk::LSHIFT }, { "LCTRL", Vk::LCONTROL }, { "LALT", Vk::MENU },
+        { "UP", Vk::UP }, { "DOWN", Vk::DOWN }, { "LEFT", Vk::LEFT }, { "RIGHT", Vk::RIGHT },
+        { ",", Vk::OEM_COMMA }, { ".", Vk::OEM_PERIOD }, { "/", Vk::OEM_2 }, { ";", Vk::OEM_1 },
+        { "'", Vk::OEM_7 }, { "[", Vk::OEM_4 }, { "]", Vk::OEM_6 }, { "\\", Vk::OEM_5 },
+        { "-", Vk::OEM_MINUS }, { "=", Vk::OEM_PLUS }, { "`", Vk::OEM_3 }, { "OEM_102", Vk::OEM_102 },
+        { "ESC", Vk::ESCAPE }, { "DELETE", Vk::DELETE }, { "KANA", Vk::KANA }, { "KANJI", Vk::KANJI },
+        { "HENKAN", Vk::CONVERT }, { "MUHENKAN", Vk::NONCONVERT },
+        { "NUM*", Vk::MULTIPLY }, { "NUM+", Vk::ADD }, { "NUM-", Vk::SUBTRACT }, { "NUM.", Vk::DECIMAL },
+        { "NUM/", Vk::DIVIDE },
+    };
+    for (const auto &n : names) {
+        if (name == n.name) return n.vk;
+    }
+    if (name.size() == 4 && name.compare(0, 3, "NUM") == 0 && std::isdigit(static_cast<unsigned char>(name[3]))) {
+        return static_cast<uint16_t>(Vk::NUMPAD0 + (name[3] - '0'));
+    }
+    // any other virtual-key code as hex, e.g. 0xBA
+    if (name.size() > 2 && name.size() <= 4 && name[0] == '0' && (name[1] == 'x' || name[1] == 'X')) {
+        char *end = nullptr;
+        const unsigned long vk = std::strtoul(name.c_str() + 2, &end, 16);
+        if (*end == '\0' && vk > 0 && vk < Vk::COUNT) return static_cast<uint16_t>(vk);
+    }
+    return 0;
+}
+
+inline int inputForName(const std::string &name) {
+    for (const InputName &n : INPUT_NAMES) {
+        if (name == n.name) return n.id;
+    }
+    return -1;
+}
+
+// Macro text -> steps appended to `set`. Steps are comma-separated: KEY (a tap), KEY down,
+// KEY up, mouse_left / mouse_right (a click, or with down / up), wheel_up, wheel_down, and
+// pauses such as 20ms, 1.5ms or 250us. Returns the new macro's index, or -1 with `error` set.
+inline int addMacro(const std::string &text, ComboSet &set, std::string &error) {
+    using Step = ComboSet::Step;
+    auto trim = [](const std::string &s) {
+        const size_t b = s.find_first_not_of(" \t");
+        if (b == std::string::npos) return std::string();
+        return s.substr(b, s.find_last_not_of(" \t") - b + 1);
+    };
+    if (set.macroCount == ComboSet::MAX_MACROS) {
+        error = "more than " + std::to_string(ComboSet::MAX_MACROS) + " macros";
+        return -1;
+    }
+    const int first = set.stepCount;
+    auto push = [&](Step::Kind kind, uint16_t vk = 0, bool left = false, int32_t wheel = 0) {
+        if (set.stepCount == ComboSet::MAX_STEPS) return false;
+        Step &s = set.steps[set.stepCount++];
+        s = Step{};
+        s.kind = kind;
+        s.vk = vk;
+        s.left = left;
+        s.wheel = wheel;
+        return true;
+    };
+    auto fail = [&](const std::string &what) {
+        set.stepCount = first;
+        error = what;
+        return -1;
+    };
+
+    std::istringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        item = trim(item);
+        if (item.empty()) return fail("empty step in macro \"" + text + "\"");
+        const bool isWait = std::isdigit(static_cast<unsigned char>(item[0])) && item.size() > 2 &&
+                            (item.compare(item.size() - 2, 2, "ms") == 0 || item.compare(item.size() - 2, 2, "us") == 0);
+        if (isWait) {
+            char *end = nullptr;
+            const double n = std::strtod(item.c_str(), &end);
+            const double us = item.back() == 's' && item[item.size() - 2] == 'm' ? n * 1000.0 : n;
+            if (end != item.c_str() + item.size() - 2 || !(us >= 1.0 && us <= ComboSet::MAX_WAIT_US)) {
+                return fail("pause '" + item + "' must be 1us..10000ms");
+            }
+            // a pause belongs to the step before it; only a leading one needs a step of its own
+            if (set.stepCount == first && !push(Step::Wait)) return fail("macros have more than " + std::to_string(ComboSet::MAX_STEPS) + " steps");
+            uint32_t &wait = set.steps[set.stepCount - 1].waitUs;
+            wait = static_cast<uint32_t>((std::min)(wait + us + 0.5, static_cast<double>(ComboSet::MAX_WAIT_US)));
+            continue;
+        }
+        const size_t space = item.find(' ');
+        const std::string name = item.substr(0, space);
+        const std::string edge = space == std::string::npos ? std::string() : trim(item.substr(space));
+        const bool wheel = name == "wheel_up" || name == "wheel_down";
+        const bool mouse = name == "mouse_left" || name == "mouse_right";
+        const uint16_t vk = wheel || mouse ? 0 : vkForKeyName(name);
+        if (!wheel && !mouse && !vk) return fail("unknown macro step '" + item + "'");
+        if (!edge.empty() && (wheel || (edge != "down" && edge != "up"))) {
+            return fail(wheel ? "'" + name + "' takes no down or up" : "expected down or up after '" + name + "'");
+        }
+        const bool press = edge != "up", release = edge != "down";
+        bool ok = true;
+        if (wheel) {
+            ok = push(Step::Wheel, 0, false, name == "wheel_up" ? 120 : -120);
+        } else if (mouse) {
+            if (press) ok = push(Step::MouseDown, 0, name == "mouse_left");
+            if (release) ok = ok && push(Step::MouseUp, 0, name == "mouse_left");
+        } else {
+            if (press) ok = push(Step::KeyDown, vk);
+            if (release) ok = ok && push(Step::KeyUp, vk);
+        }
+        if (!ok) return fail("macros have more than " + std::to_string(ComboSet::MAX_STEPS) + " steps");
+    }
+    if (set.stepCount == first) return fail("empty macro");
+    ComboSet::Macro &m = set.macros[set.macroCount];
+    m.first = static_cast<uint16_t>(first);
+    m.count = static_cast<uint16_t>(set.stepCount - first);
+    return set.macroCount++;
+}
+
+// Combo trigger -> `c` without its target: l1+r1 (a chord), tap:INPUT, hold:INPUT, or
+// dpad_down>dpad_right>square (a sequence).
+inline bool parseComboTrigger(const std::string &text, ComboSet::Combo &c, std::string &error) {
+    using Combo = ComboSet::Combo;
+    c = Combo{};
+    auto input = [&](const std::string &name, int &id) {
+        id = inputForName(name);
+        if (id < 0) error = "unknown input '" + name + "' in combo '" + text + "'";
+        return id >= 0;
+    };
+    int id = 0;
+    if (text.rfind("tap:", 0) == 0 || text.rfind("hold:", 0) == 0) {
+        const bool tap = text[0] == 't';
+        if (!input(text.substr(tap ? 4 : 5), id)) return false;
+        c.kind = tap ? Combo::Tap : Combo::Hold;
+        c.inputs = inputBit(id);
+        return true;
+    }
+    const char separator = text.find('>') != std::string::npos ? '>' : '+';
+    c.kind = separator == '>' ? Combo::Sequence : Combo::Chord;
+    std::istringstream parts(text);
+    std::string part;
+    int count = 0;
+    while (std::getline(parts, part, separator)) {
+        if (!input(part, id)) return false;
+        if (c.kind == Combo::Chord && (c.inputs & inputBit(id))) {
+            error = "input '" + part + "' twice in chord '" + text + "'";
+            return false;
+        }
+        if (count == ComboSet::MAX_SEQUENCE) {
+            error = "combo '" + text + "' has more than " + std::to_string(ComboSet::MAX_SEQUENCE) + " inputs";
+            return false;
+        }
+        c.sequence[count++] = static_cast<uint8_t>(id);
+        c.inputs |= inputBit(id);
+    }
+    if (count < 2) {
+        error = "combo '" + text + "' needs two or more inputs (a+b, a>b), or tap: / hold:";
+        return false;
+    }
+    c.length = c.kind == Combo::Sequence ? static_cast<uint8_t>(count) : 0;
+    return true;
+}
+
+// Parse profile text into `table` (compiled). On failure returns false, leaves `table`
+// untouched and describes the first problem, with its line number, in `error`. Bindings start
+// empty: what the file lists is all there is.
+inline bool parseProfile(const std::string &text, ActionTable &table, std::string &error) {
+    ActionTable t;
+    std::istringstream in(text);
+    std::string line, section;
+    int lineNo = 0;
+    struct PendingMacro { int combo, line; std::string text; };
+    std::vector<std::string> macroNames;     // [macros] names by index
+    std::vector<PendingMacro> comboMacros;
+    auto fail = [&](const std::string &what) {
+        error = "line " + std::to_string(lineNo) + ": " + what;
+        return false;
+    };
+    auto trim = [](std::string s) {
+        const size_t b = s.find_first_not_of(" \t\r");
+        if (b == std::string::npos) return std::string();
+        return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+    };
+    // "quoted" or bare word
+    auto unquote = [](const std::string &v, std::string &out) {
+        if (v.size() >= 2 && v.front() == '"' && v.back() == '"') { out = v.substr(1, v.size() - 2); return true; }
+        if (v.empty() || v.find('"') != std::string::npos) return false;
+        out = v;
+        return true;
+    };
+    auto integer = [](const std::string &v, int lo, int hi, int &out) {
+        char *end = nullptr;
+        const long n = std::strtol(v.c_str(), &end, 10);
+        if (v.empty() || *end != '\0' || n < lo || n > hi) return false;
+        out = static_cast<int>(n);
+        return true;
+    };
+
+    while (std::getline(in, line)) {
+        ++lineNo;
+        bool quoted = false;
+        for (size_t i = 0; i < line.size(); ++i) {   // strip comments outside strings
+            if (line[i] == '"') quoted = !quoted;
+            else if (line[i] == '#' && !quoted) { line.resize(i); break; }
+        }
+        line = trim(line);
+        if (line.empty()) continue;
+        if (line.front() == '[') {
+            if (line.back() != ']') return fail("unterminated section header");
+            section = trim(line.substr(1, line.size() - 2));
+            if (section != "bind" && section != "repeat" && section != "triggers" && section != "combos" && section != "macros") {
+                return fail("unknown section [" + section + "]");
+            }
+            continue;
+        }
+        const size_t eq = line.find('=');
+        if (eq == std::string::npos) return fail("expected key = value");
+        const std::string key = trim(line.substr(0, eq));
+        const std::string value = trim(line.substr(eq + 1));
+
+        if (section == "bind") {
+            const int input = inputForName(key);
+            if (input < 0) return fail("unknown input '" + key + "'");
+            std::string action;
+            if (!unquote(value, action)) return fail("expected a quoted action for '" + key + "'");
+            if (action == "none") t.bind(input, Action::None);
+            else if (action == "mouse_left") t.bind(input, Action::MouseLeft);
+            else if (action == "mouse_right") t.bind(input, Action::MouseRight);
+            else if (action == "toggle_mode") t.bind(input, Action::ToggleMode);
+            else if (action == "toggle_console") t.bind(input, Action::ToggleConsole);
+            else if (uint16_t vk = vkForKeyName(action)) t.bind(input, Action::Key, vk);
+            else return fail("unknown action '" + action + "'");
+        } else if (section == "repeat") {
+            if (key == "keys") {
+                if (value.size() < 2 || value.front() != '[' || value.back() != ']') return fail("expected [\"KEY\", ...]");
+                std::istringstream items(value.substr(1, value.size() - 2));
+                std::string item;
+                while (std::getline(items, item, ',')) {
+                    std::string name;
+                    item = trim(item);
+                    if (item.empty()) continue;
+                    if (!unquote(item, name)) return fail("expected a quoted key name in keys");
+                    const uint16_t vk = vkForKeyName(name);
+                    if (!vk) return fail("unknown key '" + name + "'");
+                    t.repeat[vk] = true;
+                }
+            } else if (key == "delay_ms") {
+                if (!integer(value, 1, 10000, t.repeatDelayMs)) return fail("delay_ms must be 1..10000");
+            } else if (key == "interval_ms") {
+                if (!integer(value, 1, 10000, t.repeatIntervalMs)) return fail("interval_ms must be 1..10000");
+            } else {
+                return fail("unknown key '" + key + "' in [repeat]");
+            }
+        } else if (section == "triggers") {
+            int threshold = 0;
+            if (key != "threshold") return fail("unknown key '" + key + "' in [triggers]");
+            if (!integer(value, 0, 254, threshold)) return fail("threshold must be 0..254");
+            t.triggerThreshold = static_cast<uint8_t>(threshold);
+        } else if (section == "macros") {
+            std::string steps, why;
+            if (key.empty() || key.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789_") != std::string::npos) {
+                return fail("macro names are lower-case letters, digits and _");
+            }
+            for (const std::string &n : macroNames) {
+                if (n == key) return fail("macro '" + key + "' defined twice");
+            }
+            if (!unquote(value, steps)) return fail("expected a quoted list of steps for macro '" + key + "'");
+            if (addMacro(steps, t.combos, why) < 0) return fail(why);
+            macroNames.push_back(key);
+        } else if (section == "combos") {
+            ComboSet &c = t.combos;
+            if (key == "chord_ms") {
+                if (!integer(value, 1, 10000, c.chordMs)) return fail("chord_ms must be 1..10000");
+            } else if (key == "hold_ms") {
+                if (!integer(value, 1, 10000, c.holdMs)) return fail("hold_ms must be 1..10000");
+            } else if (key == "sequence_ms") {
+                if (!integer(value, 1, 10000, c.sequenceMs)) return fail("sequence_ms must be 1..10000");
+            } else {
+                std::string trigger, target, why;
+                if (!unquote(key, trigger)) return fail("bad combo '" + key + "'");
+                if (c.comboCount == ComboSet::MAX_COMBOS) return fail("more than " + std::to_string(ComboSet::MAX_COMBOS) + " combos");
+                ComboSet::Combo &combo = c.combos[c.comboCount];
+                if (!parseComboTrigger(trigger, combo, why)) return fail(why);
+                if (!unquote(value, target)) return fail("expected a quoted macro or action for combo '" + trigger + "'");
+                if (target == "toggle_mode") combo.target = ComboSet::Combo::ToggleMode;
+                else if (target == "toggle_console") combo.target = ComboSet::Combo::ToggleConsole;
+                else comboMacros.push_back({ c.comboCount, lineNo, target });   // after every [macros] line is read
+                ++c.comboCount;
+            }
+        } else {
+            return fail("'" + key + "' outside of a section");
+        }
+    }
+    // a combo's macro is a name from [macros], or steps written in place
+    for (const PendingMacro &p : comboMacros) {
+        lineNo = p.line;
+        int index = -1;
+        for (size_t i = 0; i < macroNames.size(); ++i) {
+            if (macroNames[i] == p.text) index = static_cast<int>(i);
+        }
+        std::string why;
+        if (index < 0 && (index = addMacro(p.text, t.combos, why)) < 0) return fail(why);
+        t.combos.combos[p.combo].macro = static_cast<uint8_t>(index);
+    }
+    t.compile();
+    table = std::move(t);
+    return true;
+}
+
+inline bool loadProfile(const std::string &path, ActionTable &table, std::string &error) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::ostringstream text;
+    text << f.rdbuf();
+    if (!parseProfile(text.str(), table, error)) {
+        error = path + ": " + error;
+        return false;
+    }
+    table.source = path;
+    return true;
+}
+
+// ---------- loader thread -> mapping thread ----------
+// RCU-style handoff of compiled tables to one mapping thread. The loader publishes with an
+// atomic exchange; a table it replaces before the mapping thread took it is freed right there.
+// The mapping thread takes the newest table between reports with one exchange and gives the
+// table it replaced back through a lock-free list, which the loader frees on its next
+// publish(), so nothing is freed while the mapping thread might still read it.
+class ProfileExchange {
+public:
+    ProfileExchange() = default;
+    ProfileExchange(const ProfileExchange &) = delete;
+    ProfileExchange &operator=(const ProfileExchange &) = delete;
+    ~ProfileExchange() {
+        delete pending.exchange(nullptr);
+        collect();
+    }
+
+    // ---------- loader thread ----------
+    void publish(std::unique_ptr<ActionTable> table) {
+        collect();
+        table->retiredNext = nullptr;
+        delete pending.exchange(table.release(), std::memory_order_acq_rel);
+        published.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Free every table the mapping thread has retired.
+    void collect() {
+        ActionTable *t = retired.exchange(nullptr, std::memory_order_acquire);
+        while (t) {
+            ActionTable *next = t->retiredNext;
+            delete t;
+            t = next;
+        }
+    }
+
+    uint64_t publishCount() const { return published.load(std::memory_order_relaxed); }
+
+    // ---------- mapping thread ----------
+    // The newest published table, or null if nothing new. One relaxed load when idle.
+    std::unique_ptr<ActionTable> take() {
+        if (!pending.load(std::memory_order_relaxed)) return nullptr;
+        return std::unique_ptr<ActionTable>(pending.exchange(nullptr, std::memory_order_acq_rel));
+    }
+
+    // Hand a table the mapping thread no longer uses back to the loader.
+    void retire(std::unique_ptr<ActionTable> table) {
+        if (!table) return;
+        ActionTable *t = table.release();
+        t->retiredNext = retired.load(std::memory_order_relaxed);
+        while (!retired.compare_exchange_weak(t->retiredNext, t, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+private:
+    std::atomic<ActionTable *> pending{nullptr};
+    std::atomic<ActionTable *> retired{nullptr};
+    std::atomic<uint64_t> published{0};
+};
@@ -0,0 +1,185 @@
+#pragma once
+// Loopback HTTP endpoint for a Prometheus scraper: GET /metrics on 127.0.0.1:PORT answers with
+// whatever the render callback returns (MapperMetrics::render()).
+//
+// The server has its own thread and handles one connection at a time, which is all a scraper
+// needs. It binds to the loopback address only, so nothing outside the machine can reach it.
+// Nothing here touches the mapping thread: a slow or stuck client delays the next scrape, not
+// a report. The accept loop wakes every STOP_POLL_MS to notice stop().
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+class MetricsServer {
+public:
+    using Render = std::function<std::string()>;
+    static constexpr uint16_t DEFAULT_PORT = 9470;
+    static constexpr int STOP_POLL_MS = 100;
+    static constexpr int CLIENT_TIMEOUT_MS = 2000;  // for the request to arrive, and per send
+
+    MetricsServer() = default;
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+    ~MetricsServer() { stop(); }
+
+    // Listen on 127.0.0.1:`port` (0: any free port, see port()). Returns false with
+    // lastError() set.
+    bool start(uint16_t port, Render renderMetrics) {
+        stop();
+        render = std::move(renderMetrics);
+#if defined(_WIN32)
+        WSADATA wsa;
+        if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return fail("WSAStartup failed");
+        wsaStarted = true;
+#endif
+        listener = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener == INVALID) return fail("cannot create socket");
+#if !defined(_WIN32)
+        // restart without waiting out TIME_WAIT; on Windows this would let others share the port
+        const int one = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+#endif
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (::bind(listener, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) != 0) {
+            return fail("cannot bind 127.0.0.1:" + std::to_string(port));
+        }
+        if (::listen(listener, 8) != 0) return fail("cannot listen on 127.0.0.1:" + std::to_string(port));
+        socklen_t len = sizeof(addr);
+        getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &len);
+        boundPort = ntohs(addr.sin_port);
+
+        running.store(true);
+        thread = std::thread(&MetricsServer::serve, this);
+        return true;
+    }
+
+    void stop() {
+        running.store(false);
+        if (thread.joinable()) thread.join();
+        if (listener != INVALID) closeSocket(listener);
+        listener = INVALID;
+#if defined(_WIN32)
+        if (wsaStarted) WSACleanup();
+        wsaStarted = false;
+#endif
+    }
+
+    bool isRunning() const { return running.load(); }
+    uint16_t port() const { return boundPort; }
+    uint64_t scrapeCount() const { return scrapes.load(std::memory_order_relaxed); }
+    const std::string &lastError() const { return error; }
+
+private:
+#if defined(_WIN32)
+    using Socket = SOCKET;
+    static constexpr Socket INVALID = INVALID_SOCKET;
+    static void closeSocket(Socket s) { closesocket(s); }
+    static int pollOne(Socket s, short events, int timeoutMs) {
+        WSAPOLLFD p{};
+        p.fd = s;
+        p.events = events;
+        return WSAPoll(&p, 1, timeoutMs);
+    }
+    static int sendSome(Socket s, const char *data, size_t len) { return ::send(s, data, static_cast<int>(len), 0); }
+#else
+    using Socket = int;
+    static constexpr Socket INVALID = -1;
+    static void closeSocket(Socket s) { ::close(s); }
+    static int pollOne(Socket s, short events, int timeoutMs) {
+        pollfd p{};
+        p.fd = s;
+        p.events = events;
+        return ::poll(&p, 1, timeoutMs);
+    }
+    // a scraper that hangs up early must not raise SIGPIPE
+    static int sendSome(Socket s, const char *data, size_t len) { return static_cast<int>(::send(s, data, len, MSG_NOSIGNAL)); }
+#endif
+
+    bool fail(const std::string &what) {
+        error = what;
+        stop();
+        return false;
+    }
+
+    void serve() {
+        while (running.load()) {
+            if (pollOne(listener, POLLIN, STOP_POLL_MS) <= 0) continue;
+            Socket client = ::accept(listener, nullptr, nullptr);
+            if (client == INVALID) continue;
+            handle(client);
+            closeSocket(client);
+        }
+    }
+
+    // Reads the request head, answers, closes. Only the request line matters.
+    void handle(Socket client) {
+        char request[2048];
+        size_t got = 0;
+        while (got < sizeof(request) - 1) {
+            if (pollOne(client, POLLIN, CLIENT_TIMEOUT_MS) <= 0) return;
+            const int n = static_cast<int>(::recv(client, request + got, static_cast<int>(sizeof(request) - 1 - got), 0));
+            if (n <= 0) return;
+            got += static_cast<size_t>(n);
+            request[got] = '\0';
+            if (std::strstr(request, "\r\n\r\n") || std::strstr(request, "\n\n")) break;
+        }
+        request[got] = '\0';
+
+        const bool isGet = std::strncmp(request, "GET ", 4) == 0;
+        const bool isMetrics = isGet && (std::strncmp(request + 4, "/metrics ", 9) == 0 || std::strncmp(request + 4, "/metrics?", 9) == 0);
+        std::string body, status, type = "text/plain; charset=utf-8";
+        if (isMetrics) {
+            body = render();
+            status = "200 OK";
+            type = "text/plain; version=0.0.4; charset=utf-8";
+            scrapes.fetch_add(1, std::memory_order_relaxed);
+        } else if (isGet) {
+            status = "404 Not Found";
+            body = "metrics are at /metrics\n";
+        } else {
+            status = "405 Method Not Allowed";
+            body = "GET only\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+                               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        response += body;
+        for (size_t sent = 0; sent < response.size();) {
+            if (pollOne(client, POLLOUT, CLIENT_TIMEOUT_MS) <= 0) return;
+            const int n = sendSome(client, response.data() + sent, response.size() - sent);
+            if (n <= 0) return;
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    Render render;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> scrapes{0};
+    Socket listener = INVALID;
+    uint16_t boundPort = 0;
+    std::string error;
+#if defined(_WIN32)
+    bool wsaStarted = false;
+#endif
+};
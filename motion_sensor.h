@@ -0,0 +1,154 @@
+#pragma once
+// Gyro/accelerometer pipeline: calibration, bias removal, gravity estimate and gyro aiming.
+//
+// Runs once per report on the mapping thread with fixed-size state only (no allocation), so it
+// keeps up with 1000 Hz Bluetooth/USB report rates. Per report:
+//   1. raw int16 gyro/accel -> deg/s and g (MotionCalibration scales)
+//   2. gyro bias: while the controller is held still, the bias estimate drifts toward the raw
+//      reading, so slow sensor drift doesn't turn into a creeping cursor
+//   3. gravity: a complementary filter integrates the gyro and leans on the accelerometer
+//   4. aiming rates: yaw is taken around the gravity axis, so turning a tilted controller still
+//      moves the cursor horizontally; pitch is the controller's own pitch axis
+// GyroMouse converts the rates into mouse counts with a sub-pixel remainder carried between
+// reports, so slow, steady motion adds up instead of rounding to zero every report.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "controller_state.h"
+
+struct MotionCalibration {
+    float gyroDpsPerLsb = 1.0f / 16.0f;     // DS4: +-2000 deg/s full scale
+    float accelGPerLsb = 1.0f / 8192.0f;    // DS4: +-4 g full scale
+    float gyroBias[3] = { 0.0f, 0.0f, 0.0f }; // raw LSB, starting estimate
+    bool autoBias = true;                    // refine the bias while the controller is still
+};
+
+class MotionProcessor {
+public:
+    static constexpr float STILL_GYRO_DPS = 3.0f;     // deviation from the running mean
+    static constexpr float STILL_RATE_DPS = 1.5f;     // bias-corrected rate, once calibrated
+    static constexpr float UNCALIBRATED_RATE_DPS = 10.0f;
+    static constexpr float CALIBRATED_SECONDS = 2.0f; // total still time before the tight limit
+    static constexpr float STILL_ACCEL_G = 0.05f;     // |accel| this close to 1 g
+    static constexpr float STILL_SECONDS = 0.5f;      // held this long before bias updates
+    static constexpr float BIAS_TIME_CONSTANT = 1.0f; // seconds
+    static constexpr float GRAVITY_TIME_CONSTANT = 0.5f;
+
+    explicit MotionProcessor(const MotionCalibration &c = MotionCalibration()) : cal(c) {
+        for (int i = 0; i < 3; ++i) bias[i] = cal.gyroBias[i];
+    }
+
+    void update(const ControllerState &s, float dt) {
+        float raw[3], accelG[3];
+        for (int i = 0; i < 3; ++i) {
+            raw[i] = static_cast<float>(s.gyro[i]);
+            accelG[i] = s.accel[i] * cal.accelGPerLsb;
+        }
+        const float accelMag = std::sqrt(dot(accelG, accelG));
+
+        // stillness: gyro close to its own recent mean and the accelerometer reading ~1 g
+        const float meanAlpha = blend(dt, 0.1f);
+        float deviation = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            gyroMean[i] += (raw[i] - gyroMean[i]) * meanAlpha;
+            deviation = (std::max)(deviation, std::fabs(raw[i] - gyroMean[i]) * cal.gyroDpsPerLsb);
+        }
+        // a steady slow turn also looks "still" to the deviation test; once the bias is known,
+        // only rates close to zero count, so slow aiming isn't absorbed into the bias
+        float corrected = 0.0f;
+        for (int i = 0; i < 3; ++i) corrected = (std::max)(corrected, std::fabs(raw[i] - bias[i]) * cal.gyroDpsPerLsb);
+        const float rateLimit = calibratedTime >= CALIBRATED_SECONDS ? STILL_RATE_DPS : UNCALIBRATED_RATE_DPS;
+        const bool stillNow = deviation < STILL_GYRO_DPS && corrected < rateLimit &&
+                              std::fabs(accelMag - 1.0f) < STILL_ACCEL_G;
+        stillTime = stillNow ? stillTime + dt : 0.0f;
+        still = stillTime >= STILL_SECONDS;
+        if (cal.autoBias && still) {
+            const float a = blend(dt, BIAS_TIME_CONSTANT);
+            for (int i = 0; i < 3; ++i) bias[i] += (gyroMean[i] - bias[i]) * a;
+            calibratedTime += dt;
+        }
+
+        for (int i = 0; i < 3; ++i) rate[i] = (raw[i] - bias[i]) * cal.gyroDpsPerLsb;
+
+        // gravity in controller space: rotate the last estimate by the gyro, then pull it
+        // toward the accelerometer when that reads about 1 g (no strong linear acceleration)
+        constexpr float DEG_TO_RAD = 3.14159265f / 180.0f;
+        const float w[3] = { rate[0] * DEG_TO_RAD * dt, rate[1] * DEG_TO_RAD * dt, rate[2] * DEG_TO_RAD * dt };
+        const float g0 = gravity[0], g1 = gravity[1], g2 = gravity[2];
+        gravity[0] = g0 - (w[1] * g2 - w[2] * g1);
+        gravity[1] = g1 - (w[2] * g0 - w[0] * g2);
+        gravity[2] = g2 - (w[0] * g1 - w[1] * g0);
+        if (accelMag > 0.5f && accelMag < 1.5f) {
+            const float a = haveGravity ? blend(dt, GRAVITY_TIME_CONSTANT) : 1.0f;
+            for (int i = 0; i < 3; ++i) gravity[i] += (accelG[i] / accelMag - gravity[i]) * a;
+            haveGravity = true;
+        }
+        const float gMag = std::sqrt(dot(gravity, gravity));
+        if (gMag > 1e-6f) for (float &g : gravity) g /= gMag;
+    }
+
+    // Bias-corrected angular velocity, deg/s: pitch (X), yaw (Y), roll (Z) in controller space.
+    float pitchRate() const { return rate[0]; }
+    float yawRate() const { return rate[1]; }
+    float rollRate() const { return rate[2]; }
+    // Rotation about the gravity axis, deg/s; equals yawRate() when the controller lies flat.
+    float worldYawRate() const { return dot(rate, gravity); }
+
+    const float *gravityDirection() const { return gravity; }
+    const float *gyroBias() const { return bias; }
+    bool isStill() const { return still; }
+
+private:
+    static float dot(const float *a, const float *b) { return a[0] * b[0] + a[1] * b[1] + a[2] * b[2]; }
+    // first-order low-pass weight for a step of dt seconds
+    static float blend(float dt, float timeConstant) { return dt / (timeConstant + dt); }
+
+    MotionCalibration cal;
+    float bias[3] = { 0.0f, 0.0f, 0.0f };
+    float gyroMean[3] = { 0.0f, 0.0f, 0.0f };
+    float rate[3] = { 0.0f, 0.0f, 0.0f };
+    float gravity[3] = { 0.0f, 1.0f, 0.0f };   // flat on a table: +Y is up
+    bool haveGravity = false;
+    float stillTime = 0.0f;
+    float calibratedTime = 0.0f;
+    bool still = false;
+};
+
+// Turns fractional per-report motion into whole mouse counts without losing the fraction.
+class SubPixelAccumulator {
+public:
+    int take(float delta) {
+        remainder += delta;
+        const int whole = static_cast<int>(remainder); // toward zero, remainder stays in (-1, 1)
+        remainder -= static_cast<float>(whole);
+        return whole;
+    }
+    void reset() { remainder = 0.0f; }
+    float pending() const { return remainder; }
+
+private:
+    float remainder = 0.0f;
+};
+
+// Gyro aiming: mouse counts per degree of controller rotation.
+class GyroMouse {
+public:
+    float countsPerDegree = 8.0f;
+    float deadzoneDps = 0.75f;   // below this the rate is treated as noise
+
+    void apply(const MotionProcessor &m, float dt, int &dx, int &dy) {
+        const float yaw = filter(m.worldYawRate());
+        const float pitch = filter(m.pitchRate());
+        // turning left (positive yaw) moves the cursor left; tilting up moves it up
+        dx += accX.take(-yaw * countsPerDegree * dt);
+        dy += accY.take(-pitch * countsPerDegree * dt);
+    }
+    void reset() { accX.reset(); accY.reset(); }
+
+private:
+    float filter(float dps) const { return std::fabs(dps) < deadzoneDps ? 0.0f : dps; }
+
+    SubPixelAccumulator accX, accY;
+};
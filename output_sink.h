@@ -0,0 +1,94 @@
+#pragma once
+// Output sink abstraction for synthesized keyboard/mouse input.
+//
+// The mapper never talks to SendInput directly. It appends events to an OutputBatch while it
+// processes a report and flushes once at the end, so everything one report produces reaches
+// the backend as a single ordered submission. Backends: Win32 SendInput (main.cpp) and
+// RecordingOutputSink below, which needs no OS and is what the Linux benchmarks use.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct OutputEvent {
+    enum Type : uint8_t {
+        Key,
+        MouseMove,
+        MouseButton,
+        MouseWheel
+    };
+    Type type = Key;
+    bool down = false;   // Key / MouseButton
+    bool left = false;   // MouseButton: true = left, false = right
+    uint16_t vk = 0;     // Key: Windows virtual-key code
+    int32_t dx = 0;      // MouseMove; MouseWheel: horizontal, 1/120 notch, positive = right
+    int32_t dy = 0;      // MouseWheel: vertical, 1/120 notch, positive = away from the user
+
+    static OutputEvent key(uint16_t vk, bool down) {
+        OutputEvent e; e.type = Key; e.vk = vk; e.down = down; return e;
+    }
+    static OutputEvent mouseMove(int32_t dx, int32_t dy) {
+        OutputEvent e; e.type = MouseMove; e.dx = dx; e.dy = dy; return e;
+    }
+    static OutputEvent mouseButton(bool left, bool down) {
+        OutputEvent e; e.type = MouseButton; e.left = left; e.down = down; return e;
+    }
+    static OutputEvent mouseWheel(int32_t dx, int32_t dy) {
+        OutputEvent e; e.type = MouseWheel; e.dx = dx; e.dy = dy; return e;
+    }
+};
+
+class OutputSink {
+public:
+    virtual ~OutputSink() = default;
+    // Deliver events in order as one submission. count is never zero.
+    virtual void submit(const OutputEvent *events, size_t count) = 0;
+};
+
+// Collects the events of one processing pass and hands them to the sink in one call.
+class OutputBatch {
+public:
+    explicit OutputBatch(OutputSink &target) : sink(&target) { pending.reserve(64); }
+
+    void key(uint16_t vk, bool down) { pending.push_back(OutputEvent::key(vk, down)); }
+    void mouseMove(int32_t dx, int32_t dy) { pending.push_back(OutputEvent::mouseMove(dx, dy)); }
+    void mouseButton(bool left, bool down) { pending.push_back(OutputEvent::mouseButton(left, down)); }
+    void mouseWheel(int32_t dx, int32_t dy) { pending.push_back(OutputEvent::mouseWheel(dx, dy)); }
+
+    // Submit everything queued since the last flush. Returns the number of events submitted.
+    size_t flush() {
+        size_t n = pending.size();
+        lastFlushEvents = n;
+        if (n == 0) return 0;
+        sink->submit(pending.data(), n);
+        totalEvents += n;
+        ++totalSubmissions;
+        pending.clear();
+        return n;
+    }
+
+    void setSink(OutputSink &s) { sink = &s; }
+
+    size_t pendingCount() const { return pending.size(); }
+    uint64_t eventCount() const { return totalEvents; }
+    uint64_t submissionCount() const { return totalSubmissions; }
+    size_t lastFlushEventCount() const { return lastFlushEvents; }
+
+private:
+    OutputSink *sink;
+    std::vector<OutputEvent> pending;
+    uint64_t totalEvents = 0;
+    uint64_t totalSubmissions = 0;
+    size_t lastFlushEvents = 0;
+};
+
+// Records every submission; used to run the mapper without an OS input backend.
+class RecordingOutputSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        batches.emplace_back(events, events + count);
+    }
+    void clear() { batches.clear(); }
+
+    std::vector<std::vector<OutputEvent>> batches;
+};
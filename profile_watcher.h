@@ -0,0 +1,213 @@
+#pragma once
+// Reloads a mapping profile whenever its file changes, on a background thread.
+//
+// start() loads the profile once, synchronously, so a broken file fails at startup. After
+// that the watcher thread sleeps until the file's directory reports a change (inotify on
+// Linux, a change notification handle on Windows; editors usually save by writing a temporary
+// file and renaming it over the original, so the directory is watched rather than the file).
+// A short settle delay lets the save finish, then the file is read and, if its text actually
+// changed, parsed and compiled. A table that compiles goes to onLoad; a file that does not
+// parse goes to onError and the previous table stays in use.
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "mapping_profile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+class ProfileWatcher {
+public:
+    // Both run on the watcher thread (and once in start() on the caller's thread).
+    using OnLoad = std::function<void(const ActionTable &)>;
+    using OnError = std::function<void(const std::string &)>;
+
+    ProfileWatcher() = default;
+    ProfileWatcher(const ProfileWatcher &) = delete;
+    ProfileWatcher &operator=(const ProfileWatcher &) = delete;
+    ~ProfileWatcher() { stop(); }
+
+    bool start(const std::string &profilePath, OnLoad onLoad, OnError onError = OnError()) {
+        stop();
+        path = profilePath;
+        loaded = std::move(onLoad);
+        failed = std::move(onError);
+        if (!reload(true)) return false;
+        if (!openWatch()) return false;
+        worker = std::thread(&ProfileWatcher::watchLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!worker.joinable()) return;
+#if defined(_WIN32)
+        SetEvent(stopEvent);
+#else
+        const uint64_t one = 1;
+        (void)!write(stopFd, &one, sizeof(one));
+#endif
+        worker.join();
+        closeWatch();
+    }
+
+    const std::string &profilePath() const { return path; }
+    uint64_t reloadCount() const { return reloads.load(std::memory_order_relaxed); }
+    uint64_t rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+    std::string lastError() const {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        return error;
+    }
+
+private:
+    static constexpr auto SETTLE_TIME = std::chrono::milliseconds(50);
+
+    // Re-read the file; publish it if its text changed and compiles.
+    bool reload(bool initial) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) return fail("cannot open " + path);
+        std::ostringstream text;
+        text << f.rdbuf();
+        if (!initial && text.str() == lastText) return true;   // touched, or another file in the directory
+        lastText = text.str();
+
+        auto table = std::make_unique<ActionTable>();
+        std::string why;
+        if (!parseProfile(lastText, *table, why)) return fail(path + ": " + why);
+        table->source = path;
+        if (!initial) reloads.fetch_add(1, std::memory_order_relaxed);
+        loaded(*table);
+        return true;
+    }
+
+    bool fail(const std::string &why) {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            error = why;
+        }
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        if (failed) failed(why);
+        return false;
+    }
+
+    std::string directory() const {
+        const size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? std::string(".") : path.substr(0, slash == 0 ? 1 : slash);
+    }
+    std::string fileName() const {
+        const size_t slash = path.find_last_of("/\\");
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+#if defined(_WIN32)
+    bool openWatch() {
+        stopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        changeHandle = FindFirstChangeNotificationA(directory().c_str(), FALSE,
+                                                    FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+        if (!stopEvent || changeHandle == INVALID_HANDLE_VALUE) {
+            closeWatch();
+            return fail("cannot watch " + directory());
+        }
+        return true;
+    }
+
+    void closeWatch() {
+        if (changeHandle != INVALID_HANDLE_VALUE) FindCloseChangeNotification(changeHandle);
+        if (stopEvent) CloseHandle(stopEvent);
+        changeHandle = INVALID_HANDLE_VALUE;
+        stopEvent = nullptr;
+    }
+
+    void watchLoop() {
+        const HANDLE handles[2] = { stopEvent, changeHandle };
+        for (;;) {
+            const DWORD r = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+            if (r != WAIT_OBJECT_0 + 1) return;
+            // let the save finish; changes meanwhile are covered by the reload that follows
+            if (WaitForSingleObject(stopEvent, static_cast<DWORD>(SETTLE_TIME.count())) == WAIT_OBJECT_0) return;
+            FindNextChangeNotification(changeHandle);
+            reload(false);
+        }
+    }
+
+    HANDLE stopEvent = nullptr;
+    HANDLE changeHandle = INVALID_HANDLE_VALUE;
+#else
+    bool openWatch() {
+        stopFd = eventfd(0, EFD_CLOEXEC);
+        inotifyFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (stopFd < 0 || inotifyFd < 0 ||
+            inotify_add_watch(inotifyFd, directory().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            closeWatch();
+            return fail("cannot watch " + directory());
+        }
+        return true;
+    }
+
+    void closeWatch() {
+        if (inotifyFd >= 0) close(inotifyFd);
+        if (stopFd >= 0) close(stopFd);
+        inotifyFd = stopFd = -1;
+    }
+
+    // True if any queued event names the profile file.
+    bool drainEvents() {
+        alignas(inotify_event) char buf[4096];
+        bool ours = false;
+        for (;;) {
+            const ssize_t n = read(inotifyFd, buf, sizeof(buf));
+            if (n <= 0) return ours;
+            for (ssize_t off = 0; off < n;) {
+                const inotify_event *e = reinterpret_cast<const inotify_event *>(buf + off);
+                if (e->len && fileName() == e->name) ours = true;
+                off += static_cast<ssize_t>(sizeof(inotify_event) + e->len);
+            }
+        }
+    }
+
+    void watchLoop() {
+        pollfd fds[2] = { { stopFd, POLLIN, 0 }, { inotifyFd, POLLIN, 0 } };
+        bool dirty = false;
+        for (;;) {
+            // while a change is pending, wait only the settle time for more events
+            const int timeout = dirty ? static_cast<int>(SETTLE_TIME.count()) : -1;
+            const int ready = poll(fds, 2, timeout);
+            if (ready < 0) continue;
+            if (fds[0].revents) return;
+            if (ready == 0) {
+                dirty = false;
+                reload(false);
+                continue;
+            }
+            if (fds[1].revents && drainEvents()) dirty = true;
+        }
+    }
+
+    int stopFd = -1;
+    int inotifyFd = -1;
+#endif
+
+    std::string path;
+    OnLoad loaded;
+    OnError failed;
+    std::string lastText;          // watcher thread only
+    std::thread worker;
+
+    std::atomic<uint64_t> reloads{0};
+    std::atomic<uint64_t> rejected{0};
+    mutable std::mutex errorMutex;
+    std::string error;
+};
@@ -0,0 +1,56 @@
+# The built-in mapping (ActionTable::defaults() in mapping_profile.h), as a profile.
+# Copy it, edit it, and run with --profile=FILE; saving the file reloads it while running.
+#
+# [bind]: input = action. Actions are a key name ("W", "SPACE", "LSHIFT", "UP", ...),
+# "mouse_left", "mouse_right", "toggle_mode", "toggle_console" or "none". Inputs not listed
+# do nothing. In Virtual Keyboard mode the face buttons, L3 and the left stick drive the
+# keyboard and their bindings are ignored.
+#
+# Inputs: square cross circle triangle l1 r1 l2_button r2_button share options l3 r3 ps
+#         touchpad dpad_up dpad_right dpad_down dpad_left
+#         l2 r2 (trigger pulled past [triggers] threshold)
+#         lstick_up lstick_down lstick_left lstick_right (left stick outside its deadzone)
+#
+# [macros]: name = "steps", comma-separated: KEY (a tap), KEY down, KEY up, mouse_left or
+# mouse_right (a click, or with down / up), wheel_up, wheel_down, and pauses such as 20ms,
+# 1.5ms or 250us. Steps without a pause between them go out together.
+#
+# [combos]: trigger = macro name, steps written in place, "toggle_mode" or "toggle_console".
+#   l1+r1 = ...                   chord: all pressed within chord_ms (default 50)
+#   tap:triangle = ...            released within hold_ms (default 300)
+#   hold:triangle = ...           held for hold_ms; the release is then no tap
+#   dpad_down>dpad_right>square   sequence: each press within sequence_ms (default 300)
+# Combo inputs keep their [bind] actions, so leave them unbound if the combo should be all
+# they do, and don't let a macro press a key that [bind] holds. The built-in mapping has none:
+#
+#   [macros]
+#   melee = "V down, 30ms, V up"
+#   [combos]
+#   l1+r1 = "melee"
+#   hold:share = "toggle_console"
+
+[bind]
+square = "E"
+cross = "SPACE"
+circle = "LCTRL"
+triangle = "LSHIFT"
+r1 = "toggle_console"
+options = "toggle_mode"
+dpad_up = "UP"
+dpad_right = "RIGHT"
+dpad_down = "DOWN"
+dpad_left = "LEFT"
+l2 = "mouse_right"
+r2 = "mouse_left"
+lstick_up = "W"
+lstick_down = "S"
+lstick_left = "A"
+lstick_right = "D"
+
+[repeat]
+keys = ["W", "A", "S", "D", "UP", "DOWN", "LEFT", "RIGHT"]
+delay_ms = 300
+interval_ms = 70
+
+[triggers]
+threshold = 50
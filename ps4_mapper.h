@@ -0,0 +1,809 @@
+#pragma once
+// Controller -> keyboard/mouse mapping core.
+//
+// PS4Mapper turns decoded controller state into OutputEvents. It has no platform
+// dependencies: the Win32 front end in main.cpp owns the threads, raw input and console, and
+// feeds reports in. The same class runs on Linux with RecordingOutputSink for benchmarks.
+//
+// Hot-path bookkeeping is all fixed arrays and bitmasks: button edges come from one XOR
+// against the previous ControllerState, key state is indexed by VK code, and stick axes go
+// through precomputed curve/deadzone tables (axis_curve.h). Bindings come from a compiled
+// ActionTable (mapping_profile.h) that can be swapped between reports. Everything that happens
+// at a time rather than on a report (key repeat, virtual keyboard auto-move) is a deadline in
+// one TimerQueue (timer_queue.h); the host sleeps until nextTimerDeadline() and calls
+// runTimers(). The profile's combos are matched on input edges and their macros play as
+// timers too (combo_engine.h). With a WordDictionary (word_dictionary.h) the virtual keyboard also offers
+// completions for the word being typed. processReport() skips reports that repeat the last
+// mapped one in everything the current mode and profile read (report_filter.h).
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "axis_curve.h"
+#include "clock_source.h"
+#include "combo_engine.h"
+#include "controller_state.h"
+#include "keyboard_layout.h"
+#include "latency_histogram.h"
+#include "mapping_profile.h"
+#include "motion_sensor.h"
+#include "output_sink.h"
+#include "report_filter.h"
+#include "timer_queue.h"
+#include "touchpad.h"
+#include "vk_codes.h"
+#include "word_dictionary.h"
+
+class PS4Mapper {
+public:
+    using Clock = ClockSource::Clock;
+
+    enum Mode {
+        MODE_VISUALIZER = 0,
+        MODE_VKEYBOARD  = 1
+    };
+
+    // Things the mapper wants the host to do that are outside of input injection.
+    enum HostRequest : uint32_t {
+        HOST_TOGGLE_CONSOLE = 1u << 0
+    };
+
+    // Default stick profiles; their tables are built at compile time.
+    static constexpr StickConfig MOVE_STICK_CONFIG = {          // left stick -> WASD
+        AxisCurve::linear(), AxisCurve::linear(), DeadzoneShape::Axial, 0.25f
+    };
+    static constexpr StickConfig MOUSE_STICK_CONFIG = {         // right stick -> cursor velocity
+        AxisCurve::cubic(), AxisCurve::cubic(), DeadzoneShape::Square, 0.08f
+    };
+    static constexpr StickConfig KEYBOARD_STICK_CONFIG = {      // left stick -> on-screen keyboard
+        AxisCurve::linear(), AxisCurve::linear(), DeadzoneShape::Axial, 0.35f
+    };
+    static constexpr StickMapping DEFAULT_MOVE_STICK{ MOVE_STICK_CONFIG };
+    static constexpr StickMapping DEFAULT_MOUSE_STICK{ MOUSE_STICK_CONFIG };
+    static constexpr StickMapping DEFAULT_KEYBOARD_STICK{ KEYBOARD_STICK_CONFIG };
+
+    static constexpr int SUGGESTION_COUNT = 4;   // completions offered for the current word
+
+    // All timing goes through the clock source; pass a ManualClockSource for deterministic replay.
+    explicit PS4Mapper(OutputBatch &out, const ClockSource &clockSource = SteadyClockSource::instance())
+        : output(out), clock(clockSource), actions(std::make_unique<ActionTable>(ActionTable::defaults())) {
+        initVirtualKeyboard();
+        updateReportMask();
+    }
+
+    void processMapping(const PS4ControllerReport &r) {
+        const ControllerState cur = decodeReport(r);
+        const ButtonEdges edges = diffButtons(prev, cur);
+        const float dt = reportInterval(cur);
+        motion.update(cur, dt);
+
+        // Bound inputs this report. In Virtual Keyboard mode the face buttons, L3 and the left
+        // stick drive the keyboard, so their bindings are masked off there.
+        const uint32_t inputs = activeInputs(cur);
+        const uint32_t pressed = inputs & ~prevInputs & modeInputMask();
+        const uint32_t released = prevInputs & ~inputs & modeInputMask();
+        prevInputs = inputs;
+
+        if (pressed & actions->toggleModeInputs) {
+            toggleMode();
+        }
+        if (pressed & actions->toggleConsoleInputs) {
+            hostRequests |= HOST_TOGGLE_CONSOLE;
+        }
+        if ((pressed | released) & actions->combos.inputs) {
+            // masked again: a toggle above may have switched mode
+            processCombos(pressed & modeInputMask(), released & modeInputMask());
+        }
+
+        if (mode == MODE_VKEYBOARD) {
+            processVirtualKeyboard(cur, edges);
+        }
+
+        applyBindings(inputs & modeInputMask());
+        processRightStickMouse(cur, dt);
+
+        prev = cur;
+        lastMapped = r;
+        haveMapped = true;
+    }
+
+    // ---------- idle reports ----------
+    // The controller keeps streaming while nothing moves. processReport() maps `r` only if it
+    // differs from the last mapped report in something the current mode and profile read:
+    // bound buttons and triggers, a stick beyond what its deadzone and curve swallow, and the
+    // motion sensors or touchpad only while gyro aiming or trackpad mode use them. Otherwise
+    // it returns false and the host can skip the flush and the redraw too. Mapping the same
+    // input again would change nothing: key state is level-mapped, repeats and keyboard moves
+    // are timers, and cursor motion is integrated on the mouse tick.
+    bool processReport(const PS4ControllerReport &r) {
+        if (haveMapped && isSameInput(r)) {
+            ++skippedReports;
+            skippedSinceMapped = true;
+            return false;
+        }
+        // touch frames skipped meanwhile were all empty, but enough of them wrap the frame counter
+        if (skippedSinceMapped) trackpad.resync();
+        skippedSinceMapped = false;
+        processMapping(r);
+        ++mappedReports;
+        return true;
+    }
+
+    uint64_t reportsSkipped() const { return skippedReports; }
+    uint64_t reportsMapped() const { return mappedReports; }
+    // Keys and mouse buttons released by a reset (releaseAllInputs(), a mode switch, a profile
+    // that unbinds them) while their input was still held, rather than by letting go.
+    uint64_t stuckKeyResets() const { return forcedReleases; }
+    uint64_t combosMatched() const { return matchedCombos; }
+    uint64_t macrosStarted() const { return macros.startCount(); }
+    // Macro triggers ignored because every MacroPlayer slot was busy.
+    uint64_t macrosDropped() const { return macros.dropped(); }
+    int macrosPlaying() const { return macros.playing(); }
+    const ReportMask &reportMask() const { return relevantBits; }
+
+    // Swap in a compiled profile and return the table it replaces (hand that to
+    // ProfileExchange::retire() rather than freeing it here). Held keys are reconciled on the
+    // spot against the inputs of the last report: keys and mouse buttons the new table leaves
+    // unbound are released, keys it still binds stay down without a release/press glitch, and
+    // keys newly bound to an input that is held go down. Playing macros stop and release what
+    // they hold, and partial combos start over.
+    std::unique_ptr<ActionTable> setActionTable(std::unique_ptr<ActionTable> next) {
+        stopCombos();
+        std::swap(actions, next);
+        for (int vk = 0; vk < Vk::COUNT; ++vk) {
+            if (!keyDown[vk]) continue;
+            if (!actions->bound[vk]) {
+                output.key(static_cast<uint16_t>(vk), false);
+                keyDown[vk] = false;
+                ++forcedReleases;
+                timers.cancel(TIMER_KEY_REPEAT + vk);
+            } else if (!actions->repeat[vk]) {
+                timers.cancel(TIMER_KEY_REPEAT + vk);
+            } else if (!timers.isScheduled(TIMER_KEY_REPEAT + vk)) {
+                timers.schedule(TIMER_KEY_REPEAT + vk, clock.now() + std::chrono::milliseconds(actions->repeatDelayMs));
+            }
+        }
+        applyBindings(prevInputs & modeInputMask());
+        updateReportMask();
+        return next;
+    }
+
+    // Take the newest table from `exchange`, if there is one, and retire the old one to it.
+    // Lock-free and allocation-free; call it between reports.
+    bool adoptActionTable(ProfileExchange &exchange) {
+        std::unique_ptr<ActionTable> next = exchange.take();
+        if (!next) return false;
+        exchange.retire(setActionTable(std::move(next)));
+        return true;
+    }
+
+    const ActionTable &actionTable() const { return *actions; }
+
+    // ---------- timed actions ----------
+    // Fire every timer that is due, earliest first. A repeating timer is re-armed from its own
+    // deadline, not from when it happened to run, so a late wakeup delays one repeat without
+    // shifting the ones after it. With `lateness`, records how long after its deadline each
+    // timer fired. Returns how many fired.
+    int runTimers(LatencyHistogram *lateness = nullptr) {
+        const auto now = clock.now();
+        int fired = 0;
+        for (int id; (id = timers.popDue(now)) >= 0; ++fired) {
+            const auto due = timers.deadlineOf(id);
+            if (lateness) lateness->record(now - due);
+            if (id >= TIMER_MACRO) {
+                continueMacro(id - TIMER_MACRO, due);
+            } else if (id >= TIMER_COMBO_HOLD) {
+                fireCombos(combos.holdElapsed(actions->combos, id - TIMER_COMBO_HOLD), due);
+            } else if (id == TIMER_VK_MOVE) {
+                if (mode == MODE_VKEYBOARD && (vkMoveDx != 0 || vkMoveDy != 0)) {
+                    moveVKSelection(vkMoveDx, vkMoveDy);
+                    timers.schedule(TIMER_VK_MOVE, nextPeriod(due, now, std::chrono::milliseconds(vkMoveDelayMs)));
+                }
+            } else {
+                const uint16_t vk = static_cast<uint16_t>(id - TIMER_KEY_REPEAT);
+                if (!keyDown[vk]) continue;
+                output.key(vk, false);
+                output.key(vk, true);
+                timers.schedule(id, nextPeriod(due, now, std::chrono::milliseconds(actions->repeatIntervalMs)));
+            }
+        }
+        return fired;
+    }
+
+    // Earliest pending timer (key repeat, virtual keyboard move, combo hold, macro step), if any.
+    std::optional<Clock::time_point> nextTimerDeadline() const { return timers.nextDeadline(); }
+
+    void releaseAllInputs() {
+        stopCombos();
+        for (int vk = 0; vk < Vk::COUNT; ++vk) {
+            if (keyDown[vk]) {
+                output.key(static_cast<uint16_t>(vk), false);
+                keyDown[vk] = false;
+                ++forcedReleases;
+            }
+        }
+        timers.clear();
+        vkMoveDx = vkMoveDy = 0;
+
+        if (mouseLeftDown) {
+            output.mouseButton(true, false);
+            mouseLeftDown = false;
+            ++forcedReleases;
+        }
+        if (mouseRightDown) {
+            output.mouseButton(false, false);
+            mouseRightDown = false;
+            ++forcedReleases;
+        }
+
+        if (shiftHeldByEmulator) {
+            output.key(Vk::LSHIFT, false);
+            shiftHeldByEmulator = false;
+            ++forcedReleases;
+        }
+
+        mouseVelX = mouseVelY = 0.0f;
+        pendingMoveX = pendingMoveY = 0;
+        trackpad.reset();
+        mouseAccX.reset();
+        mouseAccY.reset();
+    }
+
+    void toggleMode() {
+        if (mode == MODE_VISUALIZER) setMode(MODE_VKEYBOARD);
+        else setMode(MODE_VISUALIZER);
+    }
+
+    void setMode(Mode m) {
+        if (mode == m) return;
+        releaseAllInputs();
+        resetWord();
+        mode = m;
+        if (mode == MODE_VKEYBOARD) clampSelection();
+        updateReportMask();
+    }
+
+    // Returns and clears the pending HostRequest bits.
+    uint32_t takeHostRequests() {
+        uint32_t r = hostRequests;
+        hostRequests = 0;
+        return r;
+    }
+
+    // ---------- mouse motion engine ----------
+    // Cursor motion leaves on its own fixed-rate tick rather than once per report. While
+    // isMouseMotionActive(), the host calls tickMouse() every mouseTickInterval(); each tick
+    // emits the whole counts accumulated since the previous one (stick velocity x elapsed time,
+    // plus gyro motion), and the fractional remainder carries over.
+    void tickMouse() {
+        const auto now = clock.now();
+        advanceMouse(now);
+        lastMouseTick = now;
+        lastMoveX = pendingMoveX;
+        lastMoveY = pendingMoveY;
+        if (pendingMoveX != 0 || pendingMoveY != 0) output.mouseMove(pendingMoveX, pendingMoveY);
+        pendingMoveX = pendingMoveY = 0;
+    }
+
+    bool isMouseMotionActive() const {
+        return mouseVelX != 0.0f || mouseVelY != 0.0f || pendingMoveX != 0 || pendingMoveY != 0;
+    }
+
+    std::optional<Clock::time_point> nextMouseTick() const {
+        if (!isMouseMotionActive()) return std::nullopt;
+        return lastMouseTick + mouseTickPeriod;
+    }
+
+    void setMouseTickRate(int hz) {
+        mouseTickPeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / (std::max)(hz, 1)));
+    }
+    Clock::duration mouseTickInterval() const { return mouseTickPeriod; }
+
+    // Full-deflection cursor speed, counts per second (before the response curve).
+    void setMouseSpeed(float countsPerSecond) { mouseSpeed = countsPerSecond; }
+
+    // Replace a stick profile; the tables are rebuilt here, once, not per report.
+    void setMoveStick(const StickConfig &c) { moveStick = StickMapping(c); haveMapped = false; }
+    void setMouseStick(const StickConfig &c) { mouseStick = StickMapping(c); haveMapped = false; }
+    void setKeyboardStick(const StickConfig &c) { keyboardStick = StickMapping(c); haveMapped = false; }
+
+    // Gyro aiming adds controller rotation to the right-stick mouse motion (Visualizer mode).
+    void setGyroAim(bool on) {
+        gyroAim = on;
+        gyroMouse.reset();
+        updateReportMask();
+    }
+    void setGyroSensitivity(float countsPerDegree) { gyroMouse.countsPerDegree = countsPerDegree; }
+    bool isGyroAimEnabled() const { return gyroAim; }
+
+    // Trackpad mode: the touchpad moves the pointer, scrolls and clicks (Visualizer mode).
+    void setTrackpad(bool on) {
+        trackpadMode = on;
+        trackpad.reset();
+        updateReportMask();
+    }
+    bool isTrackpadEnabled() const { return trackpadMode; }
+    Trackpad &trackpadSettings() { return trackpad; }
+    const MotionProcessor &motionState() const { return motion; }
+
+    // ---------- word completion ----------
+    // With a dictionary, the virtual keyboard follows the word being typed and offers its most
+    // frequent completions: L1 highlights the next one, R1 types the rest of the highlighted
+    // word plus a space. While a dictionary is set, L1 and R1 belong to the keyboard in its
+    // mode and their bindings are masked there. The dictionary is read-only and may be shared
+    // by several mappers; it must outlive them. nullptr turns completion off.
+    void setDictionary(const WordDictionary *d) {
+        dictionary = d && d->isOpen() ? d : nullptr;
+        resetWord();
+        updateReportMask();
+    }
+    bool hasDictionary() const { return dictionary != nullptr; }
+    std::string_view currentWord() const {
+        return std::string_view(typed.data(), static_cast<size_t>((std::min)(typedLen, WORD_CAPACITY)));
+    }
+    int suggestionCount() const { return suggestionTotal; }
+    std::string_view suggestion(int i) const { return dictionary->word(suggestions[i]); }
+    int selectedSuggestion() const { return suggestionSel; }
+
+    static float normalizeAxis(uint8_t v) {
+        return (static_cast<int>(v) - 128) / 127.0f;
+    }
+
+    // ---------- state for rendering ----------
+    Mode currentMode() const { return mode; }
+    int lastMouseMoveX() const { return lastMoveX; }
+    int lastMouseMoveY() const { return lastMoveY; }
+    bool isMouseLeftDown() const { return mouseLeftDown; }
+    bool isMouseRightDown() const { return mouseRightDown; }
+    bool isShiftSticky() const { return shiftSticky; }
+    int selectedRow() const { return selRow; }
+    int selectedCol() const { return selCol; }
+    const KeyboardLayout &keyboardLayout() const { return *layout; }
+    int keyboardPage() const { return page; }
+
+    // Replace the on-screen keyboard's layout (shared and immutable; it must outlive the
+    // mapper). Starts on its first page.
+    void setKeyboardLayout(const KeyboardLayout *l) {
+        layout = l;
+        page = 0;
+        clampSelection();
+        resetWord();
+    }
+
+private:
+    // TimerQueue ids: a repeat timer per VK code, the virtual keyboard's auto-move, a hold
+    // timer per input for hold: combos, then one per MacroPlayer slot for its next step.
+    enum TimerId : int {
+        TIMER_KEY_REPEAT = 0,
+        TIMER_VK_MOVE = TIMER_KEY_REPEAT + Vk::COUNT,
+        TIMER_COMBO_HOLD,
+        TIMER_MACRO = TIMER_COMBO_HOLD + INPUT_COUNT,
+        TIMER_COUNT = TIMER_MACRO + MacroPlayer::MAX_PLAYING
+    };
+
+    // Next deadline of a periodic timer that was due at `due`; if it is already a whole
+    // period behind (a stalled loop), resume from now instead of firing a burst.
+    static Clock::time_point nextPeriod(Clock::time_point due, Clock::time_point now, Clock::duration period) {
+        const auto next = due + period;
+        return next > now ? next : now + period;
+    }
+
+    // Inputs the virtual keyboard takes over in its mode.
+    static constexpr uint32_t VKEYBOARD_INPUTS = FACE_BUTTONS | buttonBit(BTN_L3) | LSTICK_INPUTS;
+
+    void initVirtualKeyboard() {
+        layout = &KeyboardLayout::builtIn();
+        page = 0;
+        selRow = 0;
+        selCol = 0;
+        vkMoveDelayMs = 150;
+        shiftSticky = false;
+        shiftHeldByEmulator = false;
+        mode = MODE_VISUALIZER;
+    }
+
+    // L1/R1, taken over for completions when there is a dictionary.
+    static constexpr uint32_t SUGGESTION_INPUTS = buttonBit(BTN_L1) | buttonBit(BTN_R1);
+
+    uint32_t modeInputMask() const {
+        if (mode != MODE_VKEYBOARD) return ~0u;
+        return ~(VKEYBOARD_INPUTS | (dictionary ? SUGGESTION_INPUTS : 0u));
+    }
+
+    // The Button bits as they are, plus triggers past the threshold and left-stick directions
+    // outside the move stick's deadzone. Not masked by mode, so a mode switch mid-report sees
+    // the inputs of the new mode.
+    uint32_t activeInputs(const ControllerState &s) const {
+        uint32_t in = s.buttons;
+        if (s.leftTrigger > actions->triggerThreshold) in |= inputBit(IN_L2);
+        if (s.rightTrigger > actions->triggerThreshold) in |= inputBit(IN_R2);
+        return in | moveStickInputs(s.leftX, s.leftY);
+    }
+
+    uint32_t moveStickInputs(uint8_t x, uint8_t y) const {
+        float lx, ly;
+        moveStick.apply(x, y, lx, ly); // zero inside the deadzone
+        uint32_t in = 0;
+        if (ly < 0.0f) in |= inputBit(IN_LSTICK_UP);
+        if (ly > 0.0f) in |= inputBit(IN_LSTICK_DOWN);
+        if (lx < 0.0f) in |= inputBit(IN_LSTICK_LEFT);
+        if (lx > 0.0f) in |= inputBit(IN_LSTICK_RIGHT);
+        return in;
+    }
+
+    // The bits processMapping() reads in the current mode, from the bindings in effect, and
+    // the inputs among them; the sticks are compared in isSameInput(). Called whenever one of
+    // those changes, and the next report is then mapped whatever it holds.
+    void updateReportMask() {
+        const ActionTable &t = *actions;
+        uint32_t inputs = t.mouseLeftInputs | t.mouseRightInputs | t.toggleModeInputs | t.toggleConsoleInputs | t.combos.inputs;
+        for (int i = 0; i < t.keyCount; ++i) inputs |= t.keys[i].inputs;
+        inputs &= modeInputMask();
+        if (mode == MODE_VKEYBOARD) inputs |= VKEYBOARD_INPUTS | (dictionary ? SUGGESTION_INPUTS : 0u);
+        relevantInputs = inputs;
+        relevantBits.clear();
+        relevantBits.addInputs(inputs);
+        if (gyroAim && mode == MODE_VISUALIZER) relevantBits.addMotion();
+        haveMapped = false;
+    }
+
+    // `r` against the last mapped report: the masked bits, then each stick through the tables
+    // that read it, so jitter inside a deadzone is no change. In trackpad mode, reports with
+    // a finger on the pad are always mapped.
+    bool isSameInput(const PS4ControllerReport &r) const {
+        const PS4ControllerReport &p = lastMapped;
+        if (!sameUnderMask(r, p, relevantBits)) return false;
+        if (trackpadMode && mode == MODE_VISUALIZER && (anyFingerDown(r) || anyFingerDown(p))) return false;
+        if (r.rightStickX != p.rightStickX || r.rightStickY != p.rightStickY) {
+            float ax, ay, bx, by;
+            mouseStick.apply(r.rightStickX, r.rightStickY, ax, ay);
+            mouseStick.apply(p.rightStickX, p.rightStickY, bx, by);
+            if (ax != bx || ay != by) return false;
+        }
+        if (r.leftStickX != p.leftStickX || r.leftStickY != p.leftStickY) {
+            if (mode == MODE_VKEYBOARD) {
+                int adx, ady, bdx, bdy;
+                keyboardStickDirection(r.leftStickX, r.leftStickY, adx, ady);
+                keyboardStickDirection(p.leftStickX, p.leftStickY, bdx, bdy);
+                if (adx != bdx || ady != bdy) return false;
+            } else if (relevantInputs & LSTICK_INPUTS) {
+                const uint32_t changed = moveStickInputs(r.leftStickX, r.leftStickY) ^ moveStickInputs(p.leftStickX, p.leftStickY);
+                if (changed & relevantInputs) return false;
+            }
+        }
+        return true;
+    }
+
+    // Press and release edges of combo inputs. Hold timers run from the press; a release before
+    // the timer fires cancels it.
+    void processCombos(uint32_t pressed, uint32_t released) {
+        const ComboSet &s = actions->combos;
+        const auto now = clock.now();
+        for (uint32_t m = released & s.holdInputs; m; m &= m - 1) timers.cancel(TIMER_COMBO_HOLD + lowestBitIndex(m));
+        for (uint32_t m = pressed & s.holdInputs; m; m &= m - 1) {
+            timers.schedule(TIMER_COMBO_HOLD + lowestBitIndex(m), now + std::chrono::milliseconds(s.holdMs));
+        }
+        fireCombos(combos.update(s, pressed, released, now), now);
+    }
+
+    // Macros start at `at`, the report or the hold deadline that completed their combo.
+    void fireCombos(uint32_t fired, Clock::time_point at) {
+        for (; fired; fired &= fired - 1) {
+            const ComboSet::Combo &c = actions->combos.combos[lowestBitIndex(fired)];
+            ++matchedCombos;
+            switch (c.target) {
+                case ComboSet::Combo::PlayMacro: {
+                    const int slot = macros.start(c.macro);
+                    if (slot >= 0) continueMacro(slot, at);
+                    break;
+                }
+                case ComboSet::Combo::ToggleMode: toggleMode(); break;
+                case ComboSet::Combo::ToggleConsole: hostRequests |= HOST_TOGGLE_CONSOLE; break;
+            }
+        }
+    }
+
+    // Play macro slot `slot`, which was due at `due`, up to its next pause.
+    void continueMacro(int slot, Clock::time_point due) {
+        const auto pause = macros.play(slot, actions->combos, output);
+        if (pause.count() > 0) timers.schedule(TIMER_MACRO + slot, due + pause);
+    }
+
+    // Stop macros (releasing what they hold) and forget partial combos and their timers.
+    void stopCombos() {
+        forcedReleases += static_cast<uint64_t>(macros.stopAll(output));
+        for (int id = TIMER_COMBO_HOLD; id < TIMER_COUNT; ++id) timers.cancel(id);
+        combos.reset();
+    }
+
+    // Bindings are level-mapped: a key is down while any input bound to it is held, so after a
+    // mode switch released everything, a button that is still held goes down again.
+    void applyBindings(uint32_t inputs) {
+        const ActionTable &t = *actions;
+        for (int i = 0; i < t.keyCount; ++i) {
+            setKeyState(t.keys[i].vk, (inputs & t.keys[i].inputs) != 0, t.keys[i].repeat);
+        }
+        setMouseButtonState(true, (inputs & t.mouseLeftInputs) != 0);
+        setMouseButtonState(false, (inputs & t.mouseRightInputs) != 0);
+    }
+
+    // Seconds since the previous report, from the controller's own sensor timestamp when it
+    // advances (so gyro integration ignores delivery jitter), otherwise from the clock.
+    float reportInterval(const ControllerState &s) {
+        constexpr float TIMESTAMP_SECONDS = 16.0f / 3.0f / 1e6f;
+        constexpr float MAX_INTERVAL = 0.05f; // after a gap, don't integrate the whole pause
+        const auto now = clock.now();
+        float dt;
+        const uint16_t ticks = static_cast<uint16_t>(s.timestamp - prev.timestamp);
+        if (ticks != 0) dt = ticks * TIMESTAMP_SECONDS;
+        else dt = std::chrono::duration<float>(now - lastReportTime).count();
+        lastReportTime = now;
+        return (std::min)((std::max)(dt, 0.0f), MAX_INTERVAL);
+    }
+
+    // The right stick sets a cursor velocity; tickMouse() integrates it over elapsed time.
+    // Report rate only decides how often the velocity is sampled, not how far the cursor goes.
+    void processRightStickMouse(const ControllerState &s, float dt) {
+        const auto now = clock.now();
+        advanceMouse(now); // the old velocity applies up to this report
+
+        float rx, ry;
+        mouseStick.apply(s.rightX, s.rightY, rx, ry);
+        const bool wasActive = isMouseMotionActive();
+        mouseVelX = rx * mouseSpeed;
+        mouseVelY = ry * mouseSpeed;
+        if (gyroAim && mode == MODE_VISUALIZER) gyroMouse.apply(motion, dt, pendingMoveX, pendingMoveY);
+        if (trackpadMode && mode == MODE_VISUALIZER) processTrackpad(s, now);
+        // first tick one interval after motion starts, not at whenever the last one was
+        if (!wasActive) lastMouseTick = now;
+    }
+
+    // Every touch frame in the report; pointer motion joins the stick's pending counts and
+    // leaves on the next mouse tick, scroll and taps go out with this report.
+    void processTrackpad(const ControllerState &s, Clock::time_point now) {
+        TrackpadOutput t;
+        trackpad.process(s, now, t);
+        pendingMoveX += t.moveX;
+        pendingMoveY += t.moveY;
+        if (t.wheelX != 0 || t.wheelY != 0) output.mouseWheel(t.wheelX, t.wheelY);
+        for (int i = 0; i < t.leftClicks; ++i) clickMouse(true);
+        for (int i = 0; i < t.rightClicks; ++i) clickMouse(false);
+    }
+
+    // A tap while the trigger holds the same button would release it early; skip it.
+    void clickMouse(bool left) {
+        if (left ? mouseLeftDown : mouseRightDown) return;
+        output.mouseButton(left, true);
+        output.mouseButton(left, false);
+    }
+
+    void advanceMouse(Clock::time_point now) {
+        // a stalled loop (debugger, suspend) shouldn't fling the cursor when it resumes
+        constexpr float MAX_STEP_SECONDS = 0.1f;
+        const float elapsed = (std::min)(std::chrono::duration<float>(now - mouseAdvancedAt).count(), MAX_STEP_SECONDS);
+        mouseAdvancedAt = now;
+        if (elapsed <= 0.0f || (mouseVelX == 0.0f && mouseVelY == 0.0f)) return;
+        pendingMoveX += mouseAccX.take(mouseVelX * elapsed);
+        pendingMoveY += mouseAccY.take(mouseVelY * elapsed);
+    }
+
+    void processVirtualKeyboard(const ControllerState &s, const ButtonEdges &edges) {
+        keyboardStickDirection(s.leftX, s.leftY, vkMoveDx, vkMoveDy);
+        // A deflection moves at once, then again every vkMoveDelayMs while it is held (the
+        // move timer). While the timer is pending a new deflection waits for it.
+        if ((vkMoveDx != 0 || vkMoveDy != 0) && !timers.isScheduled(TIMER_VK_MOVE)) {
+            moveVKSelection(vkMoveDx, vkMoveDy);
+            timers.schedule(TIMER_VK_MOVE, clock.now() + std::chrono::milliseconds(vkMoveDelayMs));
+        }
+
+        if (edges.wasPressed(BTN_CROSS)) pressSelectedVirtualKey();
+        if (edges.wasPressed(BTN_SQUARE)) toggleShiftSticky();
+        if (edges.wasPressed(BTN_CIRCLE)) pressVirtualKey(Vk::BACK);
+        if (edges.wasPressed(BTN_TRIANGLE)) pressVirtualKey(Vk::SPACE);
+        if (edges.wasPressed(BTN_L3)) toggleImeMode();
+        if (dictionary && edges.wasPressed(BTN_L1) && suggestionTotal > 0) {
+            suggestionSel = (suggestionSel + 1) % suggestionTotal;
+        }
+        if (dictionary && edges.wasPressed(BTN_R1)) acceptSuggestion();
+    }
+
+    // The dominant axis picks the direction; a zeroed axis is inside the deadzone.
+    void keyboardStickDirection(uint8_t x, uint8_t y, int &dx, int &dy) const {
+        float lx, ly;
+        keyboardStick.apply(x, y, lx, ly);
+        dx = dy = 0;
+        if (std::fabs(lx) > std::fabs(ly)) dx = lx > 0.0f ? 1 : lx < 0.0f ? -1 : 0;
+        else dy = ly > 0.0f ? 1 : ly < 0.0f ? -1 : 0;
+    }
+
+    // Type the rest of the highlighted completion and a space; pressVirtualKey() keeps the
+    // word tracking up to date, so the space also clears the word.
+    void acceptSuggestion() {
+        if (suggestionSel >= suggestionTotal) return;
+        const std::string_view word = suggestion(suggestionSel);
+        for (size_t i = static_cast<size_t>(typedLen); i < word.size(); ++i) {
+            pressVirtualKey(static_cast<uint16_t>(std::toupper(static_cast<unsigned char>(word[i]))));
+        }
+        pressVirtualKey(Vk::SPACE);
+    }
+
+    // Letters extend the current word, Backspace shortens it, anything else ends it. A word
+    // longer than the dictionary allows gets no completions until it ends.
+    void trackTyped(uint16_t vk) {
+        if (!dictionary) return;
+        if (vk >= 'A' && vk <= 'Z') {
+            if (typedLen < WORD_CAPACITY) typed[typedLen] = static_cast<char>(vk - 'A' + 'a');
+            ++typedLen;
+        } else if (vk == Vk::BACK) {
+            if (typedLen > 0) --typedLen;
+        } else {
+            typedLen = 0;
+        }
+        suggestionSel = 0;
+        suggestionTotal = typedLen > 0 && typedLen <= WORD_CAPACITY
+            ? dictionary->complete(currentWord(), suggestions.data(), SUGGESTION_COUNT) : 0;
+    }
+
+    void resetWord() {
+        typedLen = 0;
+        suggestionTotal = 0;
+        suggestionSel = 0;
+    }
+
+    void moveVKSelection(int dx, int dy) {
+        selRow += dy;
+        selCol += dx;
+        clampSelection();
+    }
+
+    // Keep the selection on a key of the current page (rows differ in length, pages in rows).
+    void clampSelection() {
+        const LayoutPage &p = layout->page(page);
+        selRow = (std::min)((std::max)(selRow, 0), p.rows - 1);
+        selCol = (std::min)((std::max)(selCol, 0), p.rowLength[selRow] - 1);
+    }
+
+    void pressSelectedVirtualKey() {
+        const LayoutKey &k = layout->page(page).key(selRow, selCol);
+        if (k.kind == LayoutKey::Page) {
+            page = k.page;
+            clampSelection();
+        } else {
+            pressVirtualKey(k.vk, (k.modifiers & LayoutKey::MOD_SHIFT) != 0);
+        }
+    }
+
+    // `shifted`: Shift is held for this key alone (a layout's shifted symbols), unless sticky
+    // Shift already holds it.
+    void pressVirtualKey(uint16_t vk, bool shifted = false) {
+        if (vk == 0) return;
+        if (shiftSticky) setShiftState(true);
+        const bool shiftForKey = shifted && !shiftHeldByEmulator;
+        if (shiftForKey) output.key(Vk::LSHIFT, true);
+        output.key(vk, true);
+        output.key(vk, false);
+        if (shiftForKey) output.key(Vk::LSHIFT, false);
+        trackTyped(vk);
+    }
+
+    void toggleShiftSticky() {
+        shiftSticky = !shiftSticky;
+        setShiftState(shiftSticky);
+    }
+
+    void setShiftState(bool on) {
+        if (on && !shiftHeldByEmulator) {
+            output.key(Vk::LSHIFT, true);
+            shiftHeldByEmulator = true;
+        } else if (!on && shiftHeldByEmulator) {
+            output.key(Vk::LSHIFT, false);
+            shiftHeldByEmulator = false;
+        }
+    }
+
+    void setKeyState(uint16_t vk, bool wantDown, bool repeat) {
+        if (wantDown == keyDown[vk]) return;
+        output.key(vk, wantDown);
+        keyDown[vk] = wantDown;
+        if (wantDown && repeat) timers.schedule(TIMER_KEY_REPEAT + vk, clock.now() + std::chrono::milliseconds(actions->repeatDelayMs));
+        else timers.cancel(TIMER_KEY_REPEAT + vk);
+    }
+
+    void setMouseButtonState(bool left, bool wantDown) {
+        bool &stateRef = left ? mouseLeftDown : mouseRightDown;
+        if (wantDown && !stateRef) {
+            output.mouseButton(left, true);
+            stateRef = true;
+        } else if (!wantDown && stateRef) {
+            output.mouseButton(left, false);
+            stateRef = false;
+        }
+    }
+
+    void toggleImeMode() {
+        output.key(Vk::KANJI, true);
+        output.key(Vk::KANJI, false);
+    }
+
+    OutputBatch &output;
+    const ClockSource &clock;
+    uint32_t hostRequests = 0;
+
+    ControllerState prev;
+    uint32_t prevInputs = 0;     // activeInputs() of the previous report
+    Clock::time_point lastReportTime;
+
+    // idle report filter; see processReport()
+    PS4ControllerReport lastMapped{};
+    bool haveMapped = false;
+    bool skippedSinceMapped = false;
+    ReportMask relevantBits;
+    uint32_t relevantInputs = 0;
+    uint64_t skippedReports = 0;
+    uint64_t mappedReports = 0;
+    uint64_t forcedReleases = 0;  // see stuckKeyResets()
+
+    // mapping thread only; replaced by setActionTable()
+    std::unique_ptr<ActionTable> actions;
+
+    MotionProcessor motion;
+    GyroMouse gyroMouse;
+    bool gyroAim = false;
+    Trackpad trackpad;
+    bool trackpadMode = false;
+
+    // indexed by VK code
+    std::array<bool, Vk::COUNT> keyDown{};
+    TimerQueue<TIMER_COUNT> timers;
+
+    ComboMatcher combos;
+    MacroPlayer macros;
+    uint64_t matchedCombos = 0;
+
+    bool mouseLeftDown = false;
+    bool mouseRightDown = false;
+    int lastMoveX = 0;          // counts emitted by the last mouse tick
+    int lastMoveY = 0;
+
+    StickMapping moveStick = DEFAULT_MOVE_STICK;
+    StickMapping mouseStick = DEFAULT_MOUSE_STICK;
+    StickMapping keyboardStick = DEFAULT_KEYBOARD_STICK;
+
+    // 36 counts per report at the DS4's 250 Hz USB rate, the speed of the per-report mapping
+    float mouseSpeed = 9000.0f;
+    float mouseVelX = 0.0f, mouseVelY = 0.0f;   // counts per second
+    SubPixelAccumulator mouseAccX, mouseAccY;
+    int pendingMoveX = 0, pendingMoveY = 0;     // whole counts waiting for the next tick
+    Clock::time_point mouseAdvancedAt;
+    Clock::time_point lastMouseTick;
+    Clock::duration mouseTickPeriod = std::chrono::milliseconds(1);
+
+    Mode mode = MODE_VISUALIZER;
+
+    const KeyboardLayout *layout = nullptr;
+    int page = 0;                     // current page of `layout`
+    int selRow = 0, selCol = 0;
+    int vkMoveDelayMs = 150;
+    int vkMoveDx = 0, vkMoveDy = 0;   // held direction, for the move timer
+
+    bool shiftSticky = false;
+    bool shiftHeldByEmulator = false;
+
+    // word completion; the word is kept lower-case, as the dictionary stores it
+    static constexpr int WORD_CAPACITY = static_cast<int>(WordDictionary::MAX_WORD_LENGTH);
+    const WordDictionary *dictionary = nullptr;
+    std::array<char, WORD_CAPACITY> typed{};
+    int typedLen = 0;                 // may exceed WORD_CAPACITY; then there are no completions
+    std::array<uint32_t, SUGGESTION_COUNT> suggestions{};
+    int suggestionTotal = 0;
+    int suggestionSel = 0;
+};
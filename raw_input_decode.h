@@ -0,0 +1,85 @@
+#pragma once
+// Portable decoder for Win32 RAWINPUT blocks.
+//
+// GetRawInputData() / GetRawInputBuffer() fill a caller-owned buffer with RAWINPUT records.
+// Walking that buffer and slicing out the HID reports does not need any Win32 call, so it lives
+// here with plain integer types. That lets it be benchmarked on Linux against captured blobs.
+// Nothing here allocates; reports are handed to the callback as pointers into the buffer.
+//
+// Block layout (see winuser.h):
+//   RAWINPUTHEADER { DWORD dwType; DWORD dwSize; HANDLE hDevice; WPARAM wParam; }
+//   RAWHID         { DWORD dwSizeHid; DWORD dwCount; BYTE bRawData[dwSizeHid * dwCount]; }
+// Blocks returned by GetRawInputBuffer are padded to the pointer size (NEXTRAWINPUTBLOCK).
+// A 32-bit process on 64-bit Windows gets 64-bit headers from GetRawInputBuffer, hence the layout
+// parameter instead of sizeof(RAWINPUTHEADER).
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+struct RawInputLayout {
+    size_t headerSize;   // sizeof(RAWINPUTHEADER)
+    size_t blockAlign;   // NEXTRAWINPUTBLOCK alignment
+
+    static constexpr RawInputLayout native() { return { 8 + 2 * sizeof(void*), sizeof(void*) }; }
+    static constexpr RawInputLayout x64() { return { 24, 8 }; }
+    static constexpr RawInputLayout x86() { return { 16, 4 }; }
+};
+
+struct RawInputDecodeStats {
+    size_t blocks = 0;       // RAWINPUT records walked
+    size_t hidReports = 0;   // HID reports handed to the callback
+    size_t skipped = 0;      // non-HID records
+    size_t malformed = 0;    // records whose sizes don't fit the buffer (walk stops there)
+};
+
+namespace RawInputDecode {
+    constexpr uint32_t TYPE_HID = 2; // RIM_TYPEHID
+
+    inline uint32_t readU32(const uint8_t *p) { uint32_t v; std::memcpy(&v, p, sizeof(v)); return v; }
+
+    inline uint64_t readPtr(const uint8_t *p, size_t width) {
+        if (width == 8) { uint64_t v; std::memcpy(&v, p, 8); return v; }
+        return readU32(p);
+    }
+
+    // Walk up to maxBlocks RAWINPUT records in buf[0, bytes) and call
+    //   onReport(uint64_t device, const uint8_t *report, uint32_t reportSize)
+    // for every HID report of every record (dwCount may be > 1).
+    template <typename OnReport>
+    RawInputDecodeStats decodeBlocks(const uint8_t *buf, size_t bytes, size_t maxBlocks,
+                                     RawInputLayout layout, OnReport &&onReport) {
+        RawInputDecodeStats st;
+        const size_t ptrWidth = (layout.headerSize - 8) / 2;
+        size_t off = 0;
+        while (st.blocks < maxBlocks && off + layout.headerSize <= bytes) {
+            const uint8_t *block = buf + off;
+            uint32_t type = readU32(block);
+            uint32_t size = readU32(block + 4);
+            if (size < layout.headerSize || size > bytes - off) { ++st.malformed; break; }
+            ++st.blocks;
+
+            if (type == TYPE_HID && size >= layout.headerSize + 8) {
+                uint64_t device = readPtr(block + 8, ptrWidth);
+                uint32_t sizeHid = readU32(block + layout.headerSize);
+                uint32_t count = readU32(block + layout.headerSize + 4);
+                const uint8_t *data = block + layout.headerSize + 8;
+                uint64_t payload = static_cast<uint64_t>(sizeHid) * count;
+                if (sizeHid == 0 || payload > size - layout.headerSize - 8) {
+                    ++st.malformed;
+                } else {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        onReport(device, data + static_cast<size_t>(i) * sizeHid, sizeHid);
+                        ++st.hidReports;
+                    }
+                }
+            } else {
+                ++st.skipped;
+            }
+
+            size_t next = off + size;
+            off = (next + layout.blockAlign - 1) & ~(layout.blockAlign - 1);
+        }
+        return st;
+    }
+}
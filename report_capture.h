@@ -0,0 +1,267 @@
+#pragma once
+// Binary capture and offline replay of controller report streams.
+//
+// File layout (little endian):
+//   CaptureFileHeader                  16 bytes
+//   CaptureRecord[n]                   72 bytes each: ns since capture start + raw report
+//
+// Version 1 files stored only the first 58 report bytes (no touch packets past the first);
+// they still load, with the missing bytes read as zero.
+//
+// ReportCaptureWriter appends records with buffered stdio. ReportCaptureFile maps a capture
+// read-only (mmap / file mapping) so replay reads records in place without copying the file.
+// replayCapture() feeds the records through a PS4Mapper driven by a ManualClockSource, so
+// the output of a replay depends only on the file, whether it is paced in real time or not.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "clock_source.h"
+#include "controller_state.h"
+#include "output_sink.h"
+#include "ps4_mapper.h"
+
+#pragma pack(push, 1)
+struct CaptureFileHeader {
+    char magic[8];          // "DS4CAPT\0"
+    uint32_t version;
+    uint32_t recordSize;    // sizeof(CaptureRecord)
+};
+
+struct CaptureRecord {
+    uint64_t timestampNs;   // since the first captured report
+    PS4ControllerReport report;
+};
+#pragma pack(pop)
+
+namespace Capture {
+    constexpr char MAGIC[8] = { 'D', 'S', '4', 'C', 'A', 'P', 'T', '\0' };
+    constexpr uint32_t VERSION = 2;
+    constexpr uint32_t V1_RECORD_SIZE = 8 + 58;
+}
+
+class ReportCaptureWriter {
+public:
+    ReportCaptureWriter() = default;
+    ReportCaptureWriter(const ReportCaptureWriter &) = delete;
+    ReportCaptureWriter &operator=(const ReportCaptureWriter &) = delete;
+    ~ReportCaptureWriter() { close(); }
+
+    bool open(const std::string &path) {
+        close();
+        file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+        // large stdio buffer: the mapping thread should almost never reach the kernel
+        std::setvbuf(file, nullptr, _IOFBF, 1 << 16);
+        CaptureFileHeader hdr{};
+        std::memcpy(hdr.magic, Capture::MAGIC, sizeof(hdr.magic));
+        hdr.version = Capture::VERSION;
+        hdr.recordSize = sizeof(CaptureRecord);
+        std::fwrite(&hdr, sizeof(hdr), 1, file);
+        started = false;
+        return true;
+    }
+
+    void write(ClockSource::time_point received, const PS4ControllerReport &report) {
+        if (!file) return;
+        if (!started) { start = received; started = true; }
+        CaptureRecord rec;
+        rec.timestampNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(received - start).count());
+        rec.report = report;
+        std::fwrite(&rec, sizeof(rec), 1, file);
+        ++records;
+    }
+
+    void close() {
+        if (file) std::fclose(file);
+        file = nullptr;
+    }
+
+    bool isOpen() const { return file != nullptr; }
+    uint64_t recordCount() const { return records; }
+
+private:
+    std::FILE *file = nullptr;
+    ClockSource::time_point start;
+    bool started = false;
+    uint64_t records = 0;
+};
+
+// Read-only memory-mapped view of a capture file.
+class ReportCaptureFile {
+public:
+    ReportCaptureFile() = default;
+    ReportCaptureFile(const ReportCaptureFile &) = delete;
+    ReportCaptureFile &operator=(const ReportCaptureFile &) = delete;
+    ~ReportCaptureFile() { close(); }
+
+    // Returns false with `error` set if the file can't be mapped or isn't a capture.
+    bool open(const std::string &path) {
+        close();
+        if (!mapFile(path)) return false;
+        if (size < sizeof(CaptureFileHeader)) return fail("file too small for a capture header");
+        CaptureFileHeader hdr;
+        std::memcpy(&hdr, data, sizeof(hdr));
+        if (std::memcmp(hdr.magic, Capture::MAGIC, sizeof(hdr.magic)) != 0) return fail("not a DS4 capture file");
+        if (hdr.version == Capture::VERSION) {
+            if (hdr.recordSize != sizeof(CaptureRecord)) return fail("unexpected record size");
+        } else if (hdr.version == 1) {
+            if (hdr.recordSize != Capture::V1_RECORD_SIZE) return fail("unexpected record size");
+        } else {
+            return fail("unsupported capture version");
+        }
+        recordBytes = hdr.recordSize;
+        count = (size - sizeof(CaptureFileHeader)) / recordBytes;
+        return true;
+    }
+
+    size_t recordCount() const { return count; }
+
+    // Records are packed and unaligned in the mapping; copy out through memcpy.
+    CaptureRecord record(size_t i) const {
+        CaptureRecord rec{};
+        std::memcpy(&rec, data + sizeof(CaptureFileHeader) + i * recordBytes, recordBytes);
+        return rec;
+    }
+
+    const std::string &lastError() const { return error; }
+
+    void close() {
+#if defined(_WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mapping = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+        count = 0;
+    }
+
+private:
+    bool fail(const char *why) {
+        error = why;
+        close();
+        return false;
+    }
+
+#if defined(_WIN32)
+    bool mapFile(const std::string &path) {
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return fail("cannot open file");
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(fileHandle, &sz) || sz.QuadPart == 0) return fail("cannot size file");
+        mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return fail("cannot create file mapping");
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) return fail("cannot map file");
+        size = static_cast<size_t>(sz.QuadPart);
+        return true;
+    }
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    bool mapFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return fail("cannot open file");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return fail("cannot size file"); }
+        void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return fail("cannot map file");
+        madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        data = static_cast<const uint8_t*>(p);
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+#endif
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t count = 0;
+    size_t recordBytes = sizeof(CaptureRecord);
+    std::string error;
+};
+
+struct ReplayStats {
+    size_t reports = 0;
+    size_t skipped = 0;                        // unchanged, not mapped (skipUnchanged)
+    uint64_t outputEvents = 0;
+    uint64_t submissions = 0;
+    std::chrono::nanoseconds captureSpan{0};   // timestamp of the last record
+    std::chrono::nanoseconds wallTime{0};      // how long the replay took
+};
+
+// Fire every mapper timer and mouse-tick deadline up to and including `until`, in time order,
+// with the clock set to each deadline. This is what the live loops' timers do in real time.
+inline void runTimersUntil(ClockSource::time_point until, PS4Mapper &mapper, OutputBatch &output,
+                           ManualClockSource &clock) {
+    for (;;) {
+        const auto timer = mapper.nextTimerDeadline();
+        const auto tick = mapper.nextMouseTick();
+        const bool timerDue = timer && *timer <= until;
+        const bool tickDue = tick && *tick <= until;
+        if (!timerDue && !tickDue) return;
+        if (tickDue && (!timerDue || *tick <= *timer)) {
+            clock.set(*tick);
+            mapper.tickMouse();
+        } else {
+            clock.set(*timer);
+            mapper.runTimers();
+        }
+        output.flush();
+    }
+}
+
+// Feed every record of `file` through `mapper`, flushing `output` once per report like the live
+// loop does. `clock` must be the clock the mapper was built with; it is set to each record's
+// capture time, and timer and mouse-tick deadlines between two records fire at their deadline.
+// With realTime the replay is paced to the original timestamps, otherwise it runs flat out.
+// With skipUnchanged reports go through processReport() as in the live loops, so reports
+// that change nothing are not mapped; the output must be the same either way.
+inline ReplayStats replayCapture(const ReportCaptureFile &file, PS4Mapper &mapper, OutputBatch &output,
+                                 ManualClockSource &clock, bool realTime, bool skipUnchanged = false) {
+    ReplayStats st;
+    const uint64_t eventsBefore = output.eventCount();
+    const uint64_t submissionsBefore = output.submissionCount();
+    const ClockSource::time_point base = clock.now();
+    const auto wallStart = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < file.recordCount(); ++i) {
+        const CaptureRecord rec = file.record(i);
+        const auto at = base + std::chrono::nanoseconds(rec.timestampNs);
+
+        // timers due before this report (mapper timers and mouse ticks) fire first, at their own time
+        runTimersUntil(at, mapper, output, clock);
+
+        if (realTime) std::this_thread::sleep_until(wallStart + std::chrono::nanoseconds(rec.timestampNs));
+        clock.set(at);
+        if (!skipUnchanged) mapper.processMapping(rec.report);
+        else if (!mapper.processReport(rec.report)) ++st.skipped;
+        output.flush();
+        ++st.reports;
+        st.captureSpan = std::chrono::nanoseconds(rec.timestampNs);
+    }
+
+    st.outputEvents = output.eventCount() - eventsBefore;
+    st.submissions = output.submissionCount() - submissionsBefore;
+    st.wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wallStart);
+    return st;
+}
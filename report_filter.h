@@ -0,0 +1,87 @@
+#pragma once
+// Change detection for controller reports.
+//
+// A DS4 sends a full report 250-1000 times a second whether or not anything moved, and most
+// of its bytes change every time regardless: the report counter in the top bits of buttons3,
+// the sensor timestamp, gyro and accelerometer noise, temperature and battery. A ReportMask
+// selects the bits a mapping actually reads; two reports equal under the mask are the same
+// input. The compare is XOR, AND and an OR-reduce over the 64 bytes: four 16-byte SSE2
+// vectors, or eight 64-bit words where SSE2 isn't available.
+//
+// Sticks and the touchpad are left to the caller. At rest a stick jitters by a count or two
+// inside its deadzone, so whether it moved is decided through its curve tables, not its raw
+// bytes; the touch packets carry frame counters, so what matters is whether a finger is down.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DS4_REPORT_COMPARE_SSE2 1
+#endif
+
+#include "controller_state.h"
+#include "mapping_profile.h"
+
+struct ReportMask {
+    static constexpr size_t SIZE = sizeof(PS4ControllerReport);
+    alignas(16) uint8_t bytes[SIZE] = {};
+
+    void clear() { std::memset(bytes, 0, SIZE); }
+    void addBits(size_t offset, uint8_t bits) { bytes[offset] |= bits; }
+    void addBytes(size_t offset, size_t count) { std::memset(bytes + offset, 0xFF, count); }
+
+    // The report bits behind a mask of input ids (mapping_profile.h). The left-stick
+    // directions add nothing; see above.
+    void addInputs(uint32_t inputs) {
+        forEachButton(inputs & ((1u << BTN_COUNT) - 1), [&](Button b) {
+            if (b <= BTN_TRIANGLE) addBits(offsetof(PS4ControllerReport, buttons1), static_cast<uint8_t>(0x10 << b));
+            else if (b <= BTN_R3) addBits(offsetof(PS4ControllerReport, buttons2), static_cast<uint8_t>(1 << (b - BTN_L1)));
+            else if (b <= BTN_PAD) addBits(offsetof(PS4ControllerReport, buttons3), static_cast<uint8_t>(1 << (b - BTN_PS)));
+            else addBits(offsetof(PS4ControllerReport, buttons1), 0x0F);   // the D-pad is one hat value
+        });
+        if (inputs & inputBit(IN_L2)) addBytes(offsetof(PS4ControllerReport, leftTrigger), 1);
+        if (inputs & inputBit(IN_R2)) addBytes(offsetof(PS4ControllerReport, rightTrigger), 1);
+    }
+
+    // Timestamp, gyro and accelerometer, for gyro aiming.
+    void addMotion() {
+        addBytes(offsetof(PS4ControllerReport, timestamp), offsetof(PS4ControllerReport, unknown2) - offsetof(PS4ControllerReport, timestamp));
+        bytes[offsetof(PS4ControllerReport, temperature)] = 0;
+    }
+};
+
+// True if any touch packet of `r` has a finger down.
+inline bool anyFingerDown(const PS4ControllerReport &r) {
+    const int n = r.touchPacketCount < MAX_TOUCH_FRAMES ? r.touchPacketCount : MAX_TOUCH_FRAMES;
+    for (int i = 0; i < n; ++i) {
+        if (!(r.touchPackets[i][1] & 0x80) || !(r.touchPackets[i][5] & 0x80)) return true;
+    }
+    return false;
+}
+
+// True if `a` and `b` agree on every bit set in `mask`.
+inline bool sameUnderMask(const PS4ControllerReport &a, const PS4ControllerReport &b, const ReportMask &mask) {
+    const uint8_t *pa = reinterpret_cast<const uint8_t *>(&a);
+    const uint8_t *pb = reinterpret_cast<const uint8_t *>(&b);
+#if defined(DS4_REPORT_COMPARE_SSE2)
+    __m128i diff = _mm_setzero_si128();
+    for (size_t i = 0; i < ReportMask::SIZE; i += 16) {
+        const __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pa + i)),
+                                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(pb + i)));
+        diff = _mm_or_si128(diff, _mm_and_si128(x, _mm_load_si128(reinterpret_cast<const __m128i *>(mask.bytes + i))));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) == 0xFFFF;
+#else
+    uint64_t diff = 0;
+    for (size_t i = 0; i < ReportMask::SIZE; i += 8) {
+        uint64_t x, y, m;
+        std::memcpy(&x, pa + i, 8);
+        std::memcpy(&y, pb + i, 8);
+        std::memcpy(&m, mask.bytes + i, 8);
+        diff |= (x ^ y) & m;
+    }
+    return diff == 0;
+#endif
+}
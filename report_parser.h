@@ -0,0 +1,206 @@
+#pragma once
+// DS4 input report formats, and a parser picked once per device.
+//
+// A DS4 sends one of three input reports:
+//   USB         id 0x01, 64 bytes: the layout of PS4ControllerReport
+//   Bluetooth   id 0x11, 78 bytes: the same fields two bytes further in, then a CRC-32 of
+//               0xA1 (the HID input header) and the report's first 74 bytes
+//   BT basic    id 0x01, 10 bytes: sticks, buttons and triggers only, sent over Bluetooth until
+//               the host reads feature report 0x02
+// Each format is a ReportLayout, and parseReport<Layout>() is its parser: a fixed-size copy
+// into a PS4ControllerReport plus, for Bluetooth, the checksum. Everything downstream (report
+// rings, captures, the idle filter, shared state, decodeReport()) reads the USB layout only.
+//
+// ReportParser picks the layout from a device's first report (id and length) and keeps calling
+// it while the id and length stay the same; only a report that differs picks again, which is
+// how a paired controller moves from the basic report to 0x11. Reports it can't place, and
+// Bluetooth reports with a bad checksum, are rejected and counted.
+//
+// The CRC is slicing-by-8 over tables built at compile time: one step per 8 bytes, nine for a
+// Bluetooth report. (SSE4.2's crc32 instruction computes CRC-32C, a different polynomial.)
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "controller_state.h"
+
+enum class ReportFormat : uint8_t {
+    Unknown,
+    Usb,
+    Bluetooth,
+    BluetoothBasic
+};
+
+inline const char *reportFormatName(ReportFormat f) {
+    switch (f) {
+        case ReportFormat::Usb: return "USB";
+        case ReportFormat::Bluetooth: return "BT";
+        case ReportFormat::BluetoothBasic: return "BT basic";
+        default: return "?";
+    }
+}
+
+// ---------- CRC-32 (IEEE 802.3, reflected), slicing-by-8 ----------
+namespace Ds4Crc {
+    struct Tables {
+        uint32_t t[8][256];
+    };
+
+    constexpr Tables makeTables() {
+        Tables x{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? (c >> 1) ^ 0xEDB88320u : c >> 1;
+            x.t[0][i] = c;
+        }
+        for (int s = 1; s < 8; ++s) {
+            for (uint32_t i = 0; i < 256; ++i) x.t[s][i] = (x.t[s - 1][i] >> 8) ^ x.t[0][x.t[s - 1][i] & 0xFF];
+        }
+        return x;
+    }
+    inline constexpr Tables TABLES = makeTables();
+
+    // Advance a running (not yet inverted) CRC over `len` bytes.
+    inline uint32_t update(uint32_t crc, const uint8_t *p, size_t len) {
+        const auto &t = TABLES.t;
+        for (; len >= 8; p += 8, len -= 8) {
+            const uint32_t lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24));
+            const uint32_t hi = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<uint32_t>(p[7]) << 24);
+            crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+                  t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+        }
+        for (; len > 0; ++p, --len) crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF];
+        return crc;
+    }
+
+    inline uint32_t crc32(const uint8_t *p, size_t len) { return ~update(0xFFFFFFFFu, p, len); }
+
+    // The running CRC after the 0xA1 header byte every Bluetooth input report is checked with.
+    constexpr uint32_t AFTER_INPUT_HEADER = (0xFFFFFFFFu >> 8) ^ TABLES.t[0][(0xFFFFFFFFu ^ 0xA1u) & 0xFF];
+
+    inline uint32_t bluetoothInput(const uint8_t *p, size_t len) { return ~update(AFTER_INPUT_HEADER, p, len); }
+}
+
+// ---------- layouts ----------
+// Where a format keeps the USB report's bytes 1..63: from PAYLOAD on, COPY of them. SIZE is the
+// shortest report of the format; longer ones (Windows pads Bluetooth reports) are fine.
+template <ReportFormat Format, uint8_t Id, uint32_t Size, uint32_t Payload, bool Crc>
+struct ReportLayout {
+    static constexpr ReportFormat FORMAT = Format;
+    static constexpr uint8_t ID = Id;
+    static constexpr uint32_t SIZE = Size;
+    static constexpr uint32_t PAYLOAD = Payload;
+    static constexpr bool HAS_CRC = Crc;
+    static constexpr uint32_t CRC_OFFSET = Size - 4;
+    static constexpr uint32_t AVAILABLE = Size - Payload - (Crc ? 4 : 0);
+    static constexpr uint32_t COPY = AVAILABLE < sizeof(PS4ControllerReport) - 1 ? AVAILABLE : sizeof(PS4ControllerReport) - 1;
+};
+
+using UsbReportLayout = ReportLayout<ReportFormat::Usb, 0x01, 64, 1, false>;
+using BluetoothReportLayout = ReportLayout<ReportFormat::Bluetooth, 0x11, 78, 3, true>;
+using BluetoothBasicReportLayout = ReportLayout<ReportFormat::BluetoothBasic, 0x01, 10, 1, false>;
+
+static_assert(offsetof(PS4ControllerReport, leftStickX) == 1 && offsetof(PS4ControllerReport, touchPacketCount) == 33,
+              "PS4ControllerReport is the USB layout");
+static_assert(UsbReportLayout::COPY == 63 && BluetoothReportLayout::COPY == 63, "full reports fill every field");
+
+// `data` holds at least Layout::SIZE bytes of a report with id Layout::ID. Straight-line apart
+// from the checksum compare: no per-field branches.
+template <typename Layout>
+inline bool parseReport(const uint8_t *data, PS4ControllerReport &out) {
+    if constexpr (Layout::HAS_CRC) {
+        const uint8_t *c = data + Layout::CRC_OFFSET;
+        const uint32_t stored = c[0] | (c[1] << 8) | (c[2] << 16) | (static_cast<uint32_t>(c[3]) << 24);
+        if (Ds4Crc::bluetoothInput(data, Layout::CRC_OFFSET) != stored) return false;
+    }
+    uint8_t *dst = reinterpret_cast<uint8_t *>(&out);
+    if constexpr (Layout::COPY < sizeof(PS4ControllerReport) - 1) {
+        // no sensors or touch: neutral zeros, as a USB report with nothing on the touchpad
+        std::memset(dst + 1 + Layout::COPY, 0, sizeof(PS4ControllerReport) - 1 - Layout::COPY);
+    }
+    dst[0] = UsbReportLayout::ID;
+    std::memcpy(dst + 1, data + Layout::PAYLOAD, Layout::COPY);
+    // Bluetooth has room for a fourth touch packet (the oldest); the USB layout keeps three
+    const uint8_t n = out.touchPacketCount;
+    out.touchPacketCount = n < MAX_TOUCH_FRAMES ? n : static_cast<uint8_t>(MAX_TOUCH_FRAMES);
+    return true;
+}
+
+// ---------- per device ----------
+// One per device, on the thread that reads its reports. Counters may be read from any thread.
+class ReportParser {
+public:
+    ReportParser() = default;
+    ReportParser(const ReportParser &) = delete;
+    ReportParser &operator=(const ReportParser &) = delete;
+
+    // The format a report of `len` bytes starting with `data` is in, from its id and length.
+    static ReportFormat formatOf(const uint8_t *data, uint32_t len) {
+        if (len == 0) return ReportFormat::Unknown;
+        if (data[0] == BluetoothReportLayout::ID && len >= BluetoothReportLayout::SIZE) return ReportFormat::Bluetooth;
+        if (data[0] == UsbReportLayout::ID && len >= UsbReportLayout::SIZE) return ReportFormat::Usb;
+        if (data[0] == BluetoothBasicReportLayout::ID && len >= BluetoothBasicReportLayout::SIZE) return ReportFormat::BluetoothBasic;
+        return ReportFormat::Unknown;
+    }
+
+    // Parse one report into the USB layout. False if it is in no known format or fails its
+    // checksum; `out` is then unspecified.
+    bool parse(const uint8_t *data, uint32_t len, PS4ControllerReport &out) {
+        // the common case: same id and length as the last report
+        if (len != length || len == 0 || data[0] != id) select(formatOf(data, len), len);
+        if (!parser || !parser(data, out)) {
+            store(rejectedReports, load(rejectedReports) + 1);
+            return false;
+        }
+        return true;
+    }
+
+    // Forget the format, for a new device reading through this parser. The counters go on.
+    void reset() {
+        parser = nullptr;
+        id = 0;
+        length = 0;
+        currentFormat.store(static_cast<uint8_t>(ReportFormat::Unknown), std::memory_order_relaxed);
+    }
+
+    ReportFormat format() const { return static_cast<ReportFormat>(currentFormat.load(std::memory_order_relaxed)); }
+    // Reports in no known format or with a bad Bluetooth checksum.
+    uint64_t rejected() const { return load(rejectedReports); }
+    // Times the format changed after the first report (basic -> full Bluetooth, say).
+    uint64_t formatChanges() const { return load(changes); }
+
+private:
+    using ParseFn = bool (*)(const uint8_t *, PS4ControllerReport &);
+
+    template <typename Layout>
+    void use(uint32_t len) {
+        parser = &parseReport<Layout>;
+        id = Layout::ID;
+        length = len;
+    }
+
+    void select(ReportFormat f, uint32_t len) {
+        switch (f) {
+            case ReportFormat::Usb: use<UsbReportLayout>(len); break;
+            case ReportFormat::Bluetooth: use<BluetoothReportLayout>(len); break;
+            case ReportFormat::BluetoothBasic: use<BluetoothBasicReportLayout>(len); break;
+            case ReportFormat::Unknown: parser = nullptr; length = 0; return;  // keep the last known format for display
+        }
+        const ReportFormat before = format();
+        if (before != f && before != ReportFormat::Unknown) store(changes, load(changes) + 1);
+        currentFormat.store(static_cast<uint8_t>(f), std::memory_order_relaxed);
+    }
+
+    // single writer: a plain relaxed store, as in MapperMetrics
+    static void store(std::atomic<uint64_t> &a, uint64_t v) { a.store(v, std::memory_order_relaxed); }
+    static uint64_t load(const std::atomic<uint64_t> &a) { return a.load(std::memory_order_relaxed); }
+
+    ParseFn parser = nullptr;
+    uint8_t id = 0;
+    uint32_t length = 0;      // of the report `parser` was picked for; 0 never matches
+    std::atomic<uint8_t> currentFormat{ static_cast<uint8_t>(ReportFormat::Unknown) };
+    std::atomic<uint64_t> rejectedReports{0};
+    std::atomic<uint64_t> changes{0};
+};
@@ -0,0 +1,210 @@
+#pragma once
+// Writer side of ds4_shared_state.h: publishes every controller's decoded state and its raw
+// reports into a named shared-memory region that other processes map read-only.
+//
+// publish() runs on the mapping thread after a report's output is flushed, so a reader can
+// never delay injected input. Per report it decodes the report into the controller's slot and
+// appends the raw bytes to the ring, each under its seqlock: a handful of stores and two
+// fences, no system call, no lock, nothing that waits on a reader. One writer only.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "controller_state.h"
+#include "ds4_shared_state.h"
+
+static_assert(sizeof(ds4_shm_header) == 64, "layout shared with C readers");
+static_assert(sizeof(ds4_shm_controller) == 128, "layout shared with C readers");
+static_assert(sizeof(ds4_shm_report) == 96, "layout shared with C readers");
+static_assert(offsetof(ds4_shm_region, controllers) == 64, "layout shared with C readers");
+static_assert(sizeof(PS4ControllerReport) == sizeof(ds4_shm_report::data), "raw report in the ring");
+static_assert(DS4_BTN_DPAD_LEFT == buttonBit(BTN_DPAD_LEFT) && DS4_BTN_PAD == buttonBit(BTN_PAD), "button bits");
+static_assert((DS4_SHM_RING_SIZE & (DS4_SHM_RING_SIZE - 1)) == 0, "ring size is a power of two");
+
+class SharedStatePublisher {
+public:
+    SharedStatePublisher() = default;
+    SharedStatePublisher(const SharedStatePublisher &) = delete;
+    SharedStatePublisher &operator=(const SharedStatePublisher &) = delete;
+    ~SharedStatePublisher() { close(); }
+
+    // Create (or take over) the region called `name`. Returns false with lastError() set.
+    bool open(const std::string &name = DS4_SHM_NAME) {
+        close();
+        if (!mapRegion(name)) return false;
+        initialize();
+        return true;
+    }
+
+    // Publish into caller-owned memory instead, e.g. to benchmark without a named region;
+    // `memory` must be suitably aligned and outlive this.
+    void attach(ds4_shm_region *memory) {
+        close();
+        shm = memory;
+        initialize();
+    }
+
+    bool isOpen() const { return shm != nullptr; }
+    const ds4_shm_region *region() const { return shm; }
+    const std::string &lastError() const { return error; }
+    uint64_t published() const { return publishedCount; }
+
+    // Latest state of controller `index` (ControllerShard::index) plus the raw report.
+    void publish(int index, std::chrono::steady_clock::time_point received, const PS4ControllerReport &r, int mode) {
+        if (!shm || index < 0 || index >= DS4_SHM_MAX_CONTROLLERS) return;
+        const uint64_t receivedNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(received.time_since_epoch()).count());
+        const ControllerState s = decodeReport(r);
+
+        ds4_shm_controller &c = shm->controllers[index];
+        beginWrite(&c.seq);
+        ds4_shm_state &out = c.state;
+        out.received_ns = receivedNs;
+        out.reports = ++reports[index];
+        out.buttons = s.buttons;
+        out.dpad = s.dpad;
+        out.left_x = s.leftX;
+        out.left_y = s.leftY;
+        out.right_x = s.rightX;
+        out.right_y = s.rightY;
+        out.left_trigger = s.leftTrigger;
+        out.right_trigger = s.rightTrigger;
+        out.battery = s.battery;
+        out.timestamp = s.timestamp;
+        for (int i = 0; i < 3; ++i) {
+            out.gyro[i] = s.gyro[i];
+            out.accel[i] = s.accel[i];
+        }
+        out.mode = static_cast<uint8_t>(mode);
+        out.touch_frames = s.touchFrames;
+        for (int f = 0; f < MAX_TOUCH_FRAMES; ++f) {
+            const TouchFrame &t = s.touch[f];
+            ds4_shm_touch &o = out.touch[f];
+            o.counter = t.counter;
+            o.down = static_cast<uint8_t>((t.finger[0].active ? 1 : 0) | (t.finger[1].active ? 2 : 0));
+            for (int i = 0; i < 2; ++i) {
+                o.id[i] = t.finger[i].id;
+                o.x[i] = t.finger[i].x;
+                o.y[i] = t.finger[i].y;
+            }
+        }
+        endWrite(&c.seq);
+
+        const uint32_t n = static_cast<uint32_t>(publishedCount);
+        ds4_shm_report &e = shm->ring[n & (DS4_SHM_RING_SIZE - 1)];
+        ds4_shm_store_relaxed(&e.seq, 2u * n + 1u);
+        ds4_shm_fence_release();
+        e.controller = static_cast<uint8_t>(index);
+        e.received_ns = receivedNs;
+        std::memcpy(e.data, &r, sizeof(r));
+        ds4_shm_store_release(&e.seq, 2u * n + 2u);
+        ++publishedCount;
+        ds4_shm_store_release(&shm->header.ring_head, n + 1);
+    }
+
+    // Readers see the writer gone (writer_pid 0) but keep their mappings; a named region is
+    // removed, so the next open() starts a fresh one.
+    void close() {
+        if (shm) ds4_shm_store_release(&shm->header.writer_pid, 0);
+#if defined(_WIN32)
+        if (mapping) {
+            if (shm) UnmapViewOfFile(shm);
+            CloseHandle(mapping);
+            mapping = nullptr;
+        }
+#else
+        if (mapped) {
+            munmap(shm, sizeof(ds4_shm_region));
+            shm_unlink(shmName.c_str());
+            mapped = false;
+        }
+#endif
+        shm = nullptr;
+    }
+
+private:
+    static void beginWrite(uint32_t *seq) {
+        ds4_shm_store_relaxed(seq, ds4_shm_load_relaxed(seq) + 1);   // odd: readers retry
+        ds4_shm_fence_release();
+    }
+    static void endWrite(uint32_t *seq) {
+        ds4_shm_store_release(seq, ds4_shm_load_relaxed(seq) + 1);
+    }
+
+    // A leftover region from a writer that crashed is reset; readers of it see the magic
+    // vanish and come back.
+    void initialize() {
+        ds4_shm_store_release(&shm->header.magic, 0);
+        std::memset(reinterpret_cast<uint8_t *>(shm) + sizeof(uint32_t), 0, sizeof(ds4_shm_region) - sizeof(uint32_t));
+        shm->header.version = DS4_SHM_VERSION;
+        shm->header.size = sizeof(ds4_shm_region);
+        shm->header.max_controllers = DS4_SHM_MAX_CONTROLLERS;
+        shm->header.ring_size = DS4_SHM_RING_SIZE;
+#if defined(_WIN32)
+        shm->header.writer_pid = GetCurrentProcessId();
+#else
+        shm->header.writer_pid = static_cast<uint32_t>(getpid());
+#endif
+        std::memset(reports, 0, sizeof(reports));
+        publishedCount = 0;
+        ds4_shm_store_release(&shm->header.magic, DS4_SHM_MAGIC);
+    }
+
+    bool fail(const std::string &what) {
+        error = what;
+        close();
+        return false;
+    }
+
+#if defined(_WIN32)
+    bool mapRegion(const std::string &name) {
+        const std::string full = "Local\\" + name;
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(ds4_shm_region), full.c_str());
+        if (!mapping) return fail("cannot create file mapping " + full);
+        shm = static_cast<ds4_shm_region *>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ds4_shm_region)));
+        if (!shm) return fail("cannot map " + full);
+        return true;
+    }
+    HANDLE mapping = nullptr;
+#else
+    bool mapRegion(const std::string &name) {
+        shmName = "/" + name;
+        // readable by other users: the mapper often runs as root for uinput, overlays don't
+        const int fd = shm_open(shmName.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+        if (fd < 0) return fail("cannot create shared memory " + shmName);
+        if (ftruncate(fd, sizeof(ds4_shm_region)) != 0) {
+            ::close(fd);
+            shm_unlink(shmName.c_str());
+            return fail("cannot size shared memory " + shmName);
+        }
+        void *p = mmap(nullptr, sizeof(ds4_shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            shm_unlink(shmName.c_str());
+            return fail("cannot map shared memory " + shmName);
+        }
+        shm = static_cast<ds4_shm_region *>(p);
+        mapped = true;
+        return true;
+    }
+    std::string shmName;
+    bool mapped = false;
+#endif
+
+    ds4_shm_region *shm = nullptr;
+    std::string error;
+    uint64_t reports[DS4_SHM_MAX_CONTROLLERS] = {};
+    uint64_t publishedCount = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+// Lock-free single-producer / single-consumer ring buffer.
+//
+// The producer (raw input message thread) calls tryPush(), the consumer (main thread) calls
+// tryPop(). Neither side ever blocks; when the ring is full the new element is dropped and
+// counted in overflowCount() so the consumer can surface it.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+public:
+    // producer side
+    bool tryPush(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - cachedTail >= Capacity) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h - cachedTail >= Capacity) {
+                overflows.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots[h & (Capacity - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    bool tryPop(T &out) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == cachedHead) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t == cachedHead) return false;
+        }
+        out = slots[t & (Capacity - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    uint64_t overflowCount() const { return overflows.load(std::memory_order_relaxed); }
+
+    static constexpr size_t capacity() { return Capacity; }
+
+private:
+    // head/tail live on separate cache lines so producer and consumer don't false-share
+    alignas(64) std::atomic<size_t> head{0};
+    size_t cachedTail = 0;                 // producer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t cachedHead = 0;                 // consumer's view of head
+    alignas(64) std::atomic<uint64_t> overflows{0};
+    std::array<T, Capacity> slots{};
+};
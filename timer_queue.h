@@ -0,0 +1,111 @@
+#pragma once
+// Deadline scheduler for the mapper's timed actions (key repeat, virtual keyboard auto-move,
+// combo hold, macro step).
+//
+// TimerQueue is a binary min-heap over a fixed set of timer ids, with each id's heap position
+// kept alongside, so schedule, reschedule and cancel are O(log n) and the earliest deadline is
+// O(1). Everything is fixed-size arrays: no allocation, and an id can only be pending once, so
+// re-arming a timer moves it instead of queueing a duplicate. The host sleeps until
+// nextDeadline() and then pops everything that is due, in deadline order.
+
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include "clock_source.h"
+
+template <int Capacity>
+class TimerQueue {
+public:
+    using time_point = ClockSource::time_point;
+    static_assert(Capacity > 0 && Capacity < 0xFFFF, "ids are 16 bits");
+
+    TimerQueue() { position.fill(NONE); }
+
+    // Arm `id` for `when`, replacing any deadline it already had.
+    void schedule(int id, time_point when) {
+        deadline[id] = when;
+        if (position[id] == NONE) {
+            position[id] = static_cast<uint16_t>(size);
+            heap[size++] = static_cast<uint16_t>(id);
+            siftUp(position[id]);
+        } else {
+            siftUp(position[id]);
+            siftDown(position[id]);
+        }
+    }
+
+    void cancel(int id) {
+        const int at = position[id];
+        if (at == NONE) return;
+        position[id] = NONE;
+        if (--size == at) return;
+        const uint16_t moved = heap[size];
+        heap[at] = moved;
+        position[moved] = static_cast<uint16_t>(at);
+        siftUp(at);
+        siftDown(position[moved]);
+    }
+
+    void clear() {
+        for (int i = 0; i < size; ++i) position[heap[i]] = NONE;
+        size = 0;
+    }
+
+    bool isScheduled(int id) const { return position[id] != NONE; }
+    time_point deadlineOf(int id) const { return deadline[id]; }
+    bool empty() const { return size == 0; }
+    int pending() const { return size; }
+
+    std::optional<time_point> nextDeadline() const {
+        if (size == 0) return std::nullopt;
+        return deadline[heap[0]];
+    }
+
+    // Remove the earliest timer if it is due at `now`; returns its id, or -1.
+    int popDue(time_point now) {
+        if (size == 0 || deadline[heap[0]] > now) return -1;
+        const int id = heap[0];
+        cancel(id);
+        return id;
+    }
+
+private:
+    static constexpr uint16_t NONE = 0xFFFF;
+
+    bool earlier(int a, int b) const { return deadline[heap[a]] < deadline[heap[b]]; }
+
+    void swapAt(int a, int b) {
+        const uint16_t t = heap[a];
+        heap[a] = heap[b];
+        heap[b] = t;
+        position[heap[a]] = static_cast<uint16_t>(a);
+        position[heap[b]] = static_cast<uint16_t>(b);
+    }
+
+    void siftUp(int at) {
+        while (at > 0) {
+            const int parent = (at - 1) / 2;
+            if (!earlier(at, parent)) return;
+            swapAt(at, parent);
+            at = parent;
+        }
+    }
+
+    void siftDown(int at) {
+        for (;;) {
+            const int left = 2 * at + 1, right = left + 1;
+            int least = at;
+            if (left < size && earlier(left, least)) least = left;
+            if (right < size && earlier(right, least)) least = right;
+            if (least == at) return;
+            swapAt(at, least);
+            at = least;
+        }
+    }
+
+    std::array<uint16_t, Capacity> heap{};        // ids, heap-ordered by deadline
+    std::array<uint16_t, Capacity> position{};    // id -> index in heap, NONE if not pending
+    std::array<time_point, Capacity> deadline{};  // by id
+    int size = 0;
+};
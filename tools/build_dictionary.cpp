@@ -0,0 +1,60 @@
+// Builds the virtual keyboard's word-completion dictionary from a word list (portable).
+//
+//   g++ -std=c++17 -O2 -I. tools/build_dictionary.cpp -o build_dictionary
+//   ./build_dictionary words.txt words.ds4dict
+//
+// One word per line, optionally followed by whitespace and a count (a frequency list such as
+// "the 23135851162"). A word without a count counts 1, so in a plain word list every word ties
+// and they rank alphabetically. Lines starting with '#' are skipped. Words are lower-cased;
+// words with anything but letters are left out. Load the result with --dictionary=FILE.
+
+#include "word_dictionary.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <word list> <output.ds4dict>\n", argv[0]);
+        return 2;
+    }
+    std::ifstream in(argv[1]);
+    if (!in) {
+        std::fprintf(stderr, "%s: cannot open file\n", argv[1]);
+        return 1;
+    }
+    std::vector<std::pair<std::string, uint32_t>> list;
+    std::string line;
+    size_t lines = 0;
+    while (std::getline(in, line)) {
+        ++lines;
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string word;
+        unsigned long long count = 1;
+        if (!(fields >> word)) continue;
+        if (!(fields >> count)) count = 1;
+        list.emplace_back(word, static_cast<uint32_t>((std::min)(count, 0xFFFFFFFFull)));
+    }
+
+    const std::vector<uint8_t> image = WordDictionary::build(std::move(list));
+    WordDictionary check;
+    if (!check.openImage(image.data(), image.size())) {
+        std::fprintf(stderr, "internal error: %s\n", check.lastError().c_str());
+        return 1;
+    }
+    std::FILE *out = std::fopen(argv[2], "wb");
+    bool written = out && std::fwrite(image.data(), 1, image.size(), out) == image.size();
+    if (out) written = std::fclose(out) == 0 && written;
+    if (!written) {
+        std::fprintf(stderr, "%s: cannot write file\n", argv[2]);
+        return 1;
+    }
+    std::printf("%zu lines -> %u words, %u trie nodes, %zu bytes\n", lines, check.wordCount(), check.nodeCount(), image.size());
+    return 0;
+}
@@ -0,0 +1,129 @@
+// Offline replay of a DS4 capture through the mapping core (portable, runs on Linux).
+//
+// Record a capture on Windows with `main.exe --capture=session.ds4cap`, then:
+//
+//   g++ -std=c++17 -O2 -I. tools/replay.cpp -o replay
+//   ./replay session.ds4cap [--realtime] [--vkeyboard] [--gyro] [--trackpad] [--profile=FILE] [--dictionary=FILE] [--layout=FILE] [--map-all]
+//
+// Prints what the mapper produced plus a digest of the exact output event sequence. The
+// mapper runs on an injected clock, so the digest is stable across runs and machines and can
+// be used as a regression check after changing mapping code. --gyro turns on gyro aiming and
+// also prints the sensor pipeline's final bias and gravity estimate. --profile replays with the
+// bindings of a profile file instead of the built-in ones, --dictionary with word completion on
+// the virtual keyboard, --layout with the virtual keyboard pages of a layout file. A profile
+// with combos also prints how many matched and how many macros they started. Reports that
+// change nothing the mapping reads are skipped as in the live loops; --map-all maps every
+// report, which must give the same digest.
+
+#include "report_capture.h"
+
+#include <cstdio>
+#include <string>
+
+// FNV-1a over every event field, in submission order.
+class DigestSink : public OutputSink {
+public:
+    void submit(const OutputEvent *events, size_t count) override {
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = events[i];
+            mix(e.type); mix(e.down); mix(e.left); mix(e.vk);
+            mix(static_cast<uint32_t>(e.dx)); mix(static_cast<uint32_t>(e.dy));
+        }
+        ++batches;
+    }
+    uint64_t digest = 14695981039346656037ull;
+    uint64_t batches = 0;
+
+private:
+    void mix(uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            digest ^= (v >> (8 * i)) & 0xFF;
+            digest *= 1099511628211ull;
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <capture> [--realtime] [--vkeyboard] [--gyro] [--trackpad] [--profile=FILE] [--dictionary=FILE] [--layout=FILE] [--map-all]\n", argv[0]);
+        return 2;
+    }
+    bool realTime = false, vkeyboard = false, gyro = false, trackpad = false, mapAll = false;
+    std::string profilePath, dictionaryPath, layoutPath;
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--realtime") realTime = true;
+        else if (arg == "--vkeyboard") vkeyboard = true;
+        else if (arg == "--gyro") gyro = true;
+        else if (arg == "--trackpad") trackpad = true;
+        else if (arg == "--map-all") mapAll = true;
+        else if (arg.rfind("--profile=", 0) == 0) profilePath = arg.substr(10);
+        else if (arg.rfind("--dictionary=", 0) == 0) dictionaryPath = arg.substr(13);
+        else if (arg.rfind("--layout=", 0) == 0) layoutPath = arg.substr(9);
+    }
+
+    ReportCaptureFile file;
+    if (!file.open(argv[1])) {
+        std::fprintf(stderr, "%s: %s\n", argv[1], file.lastError().c_str());
+        return 1;
+    }
+
+    DigestSink sink;
+    OutputBatch output(sink);
+    ManualClockSource clock;
+    PS4Mapper mapper(output, clock);
+    if (vkeyboard) mapper.setMode(PS4Mapper::MODE_VKEYBOARD);
+    mapper.setGyroAim(gyro);
+    mapper.setTrackpad(trackpad);
+    if (!profilePath.empty()) {
+        auto table = std::make_unique<ActionTable>();
+        std::string error;
+        if (!loadProfile(profilePath, *table, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        mapper.setActionTable(std::move(table));
+    }
+    WordDictionary dictionary;
+    if (!dictionaryPath.empty()) {
+        if (!dictionary.open(dictionaryPath)) {
+            std::fprintf(stderr, "%s: %s\n", dictionaryPath.c_str(), dictionary.lastError().c_str());
+            return 1;
+        }
+        mapper.setDictionary(&dictionary);
+    }
+    KeyboardLayout keyboardLayout;
+    if (!layoutPath.empty()) {
+        std::string error;
+        if (!KeyboardLayout::load(layoutPath, keyboardLayout, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        mapper.setKeyboardLayout(&keyboardLayout);
+    }
+    output.flush();
+
+    ReplayStats st = replayCapture(file, mapper, output, clock, realTime, !mapAll);
+
+    double spanMs = st.captureSpan.count() / 1e6;
+    double wallMs = st.wallTime.count() / 1e6;
+    std::printf("reports     %zu (%.1f ms of capture), %zu unchanged and not mapped\n", st.reports, spanMs, st.skipped);
+    std::printf("output      %llu events in %llu submissions\n",
+                static_cast<unsigned long long>(st.outputEvents), static_cast<unsigned long long>(st.submissions));
+    if (mapper.actionTable().combos.comboCount > 0) {
+        std::printf("combos      %llu matched, %llu macros started, %llu dropped (all slots busy)\n",
+                    static_cast<unsigned long long>(mapper.combosMatched()), static_cast<unsigned long long>(mapper.macrosStarted()),
+                    static_cast<unsigned long long>(mapper.macrosDropped()));
+    }
+    std::printf("wall time   %.3f ms (%.1f ns/report, %.0fx real time)\n", wallMs,
+                st.reports ? st.wallTime.count() / static_cast<double>(st.reports) : 0.0,
+                wallMs > 0 ? spanMs / wallMs : 0.0);
+    if (gyro) {
+        const MotionProcessor &m = mapper.motionState();
+        const float *bias = m.gyroBias(), *g = m.gravityDirection();
+        std::printf("gyro bias   %.1f %.1f %.1f LSB%s\n", bias[0], bias[1], bias[2], m.isStill() ? " (still at end)" : "");
+        std::printf("gravity     %.3f %.3f %.3f\n", g[0], g[1], g[2]);
+    }
+    std::printf("digest      %016llx\n", static_cast<unsigned long long>(sink.digest));
+    return 0;
+}
@@ -0,0 +1,155 @@
+// Example reader of the mapper's shared-memory state (ds4_shared_state.h), in plain C.
+//
+// Start the mapper with --shm (or --shm=NAME), then:
+//
+//   gcc -std=c99 -O2 -I. tools/shm_reader.c -o shm_reader     (add -lrt on glibc before 2.34)
+//   ./shm_reader [NAME] [--reports] [--hz=N]
+//
+// Maps the region read-only and prints every controller's sticks, triggers, buttons and mode
+// N times a second (default 20) when something changed. --reports follows the report ring
+// instead and prints each raw report as the mapper received it, with the reports missed if
+// this reader fell a ring behind. Exits when the mapper does. Reading is a few loads and
+// copies out of the mapping: no system calls and nothing the mapper ever waits for.
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "ds4_shared_state.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static const ds4_shm_region *openRegion(const char *name) {
+    char full[128];
+#if defined(_WIN32)
+    HANDLE mapping;
+    const void *view;
+    snprintf(full, sizeof(full), "Local\\%s", name);
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, full);
+    if (!mapping) return NULL;
+    view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(ds4_shm_region));
+    CloseHandle(mapping);   // the view keeps the mapping alive
+    return (const ds4_shm_region *)view;
+#else
+    int fd;
+    void *view;
+    struct stat st;
+    snprintf(full, sizeof(full), "/%s", name);
+    fd = shm_open(full, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    // not sized yet if the mapper is starting right now; reading past the end would fault
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ds4_shm_region)) {
+        close(fd);
+        return NULL;
+    }
+    view = mmap(NULL, sizeof(ds4_shm_region), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return view == MAP_FAILED ? NULL : (const ds4_shm_region *)view;
+#endif
+}
+
+static void sleepMs(int ms) {
+#if defined(_WIN32)
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+#endif
+}
+
+static void printState(int index, const ds4_shm_state *s) {
+    static const char *names[] = { "Sq", "X", "O", "Tri", "L1", "R1", "L2", "R2", "Share", "Opt",
+                                   "L3", "R3", "PS", "Pad", "Up", "Right", "Down", "Left" };
+    char held[96] = "";
+    int b;
+    for (b = 0; b < 18; ++b) {
+        if (!(s->buttons & (1u << b))) continue;
+        strncat(held, " ", sizeof(held) - strlen(held) - 1);
+        strncat(held, names[b], sizeof(held) - strlen(held) - 1);
+    }
+    printf("#%d %-10s L %3d,%3d R %3d,%3d  L2 %3d R2 %3d  gyro %6d %6d %6d  touch %s  %10llu reports %s\n", index,
+           s->mode == DS4_MODE_VKEYBOARD ? "keyboard" : "visualizer", s->left_x, s->left_y, s->right_x, s->right_y,
+           s->left_trigger, s->right_trigger, s->gyro[0], s->gyro[1], s->gyro[2],
+           s->touch_frames && (s->touch[s->touch_frames - 1].down & 1) ? "down" : "up  ",
+           (unsigned long long)s->reports, held);
+}
+
+static void followStates(const ds4_shm_region *shm, int hz) {
+    unsigned long long seen[DS4_SHM_MAX_CONTROLLERS] = { 0 };
+    while (ds4_shm_writer_alive(shm)) {
+        unsigned i;
+        for (i = 0; i < DS4_SHM_MAX_CONTROLLERS; ++i) {
+            ds4_shm_state s;
+            if (ds4_shm_read_state(shm, i, &s) != 1 || s.reports == seen[i]) continue;
+            seen[i] = s.reports;
+            printState((int)i, &s);
+        }
+        fflush(stdout);
+        sleepMs(1000 / hz);
+    }
+}
+
+static void followReports(const ds4_shm_region *shm) {
+    uint32_t cursor = ds4_shm_ring_head(shm);
+    uint64_t lost = 0, printedLost = 0;
+    while (ds4_shm_writer_alive(shm)) {
+        ds4_shm_report r;
+        int any = 0;
+        while (ds4_shm_next_report(shm, &cursor, &r, &lost)) {
+            int i;
+            any = 1;
+            if (lost != printedLost) {
+                printf("... %llu reports missed\n", (unsigned long long)(lost - printedLost));
+                printedLost = lost;
+            }
+            printf("%14.6f #%u", (double)r.received_ns / 1e9, (unsigned)r.controller);
+            for (i = 0; i < 12; ++i) printf(" %02x", r.data[i]);
+            printf(" ...\n");
+        }
+        if (any) fflush(stdout);
+        sleepMs(1);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *name = DS4_SHM_NAME;
+    const ds4_shm_region *shm;
+    int reports = 0, hz = 20, i;
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--reports") == 0) reports = 1;
+        else if (strncmp(argv[i], "--hz=", 5) == 0) hz = atoi(argv[i] + 5);
+        else if (argv[i][0] != '-') name = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [NAME] [--reports] [--hz=N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (hz < 1 || hz > 1000) hz = 20;
+    shm = openRegion(name);
+    if (!shm) {
+        fprintf(stderr, "%s: no shared state; is the mapper running with --shm?\n", name);
+        return 1;
+    }
+    if (!ds4_shm_valid(shm, sizeof(ds4_shm_region))) {
+        fprintf(stderr, "%s: not a version %u region\n", name, DS4_SHM_VERSION);
+        return 1;
+    }
+    if (reports) followReports(shm);
+    else followStates(shm, hz);
+    printf("mapper exited\n");
+    return 0;
+}
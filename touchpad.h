@@ -0,0 +1,119 @@
+#pragma once
+// Touchpad as a trackpad: relative pointer motion, two-finger scroll and tap-to-click.
+//
+// Trackpad::process() takes every touch frame of a report, oldest first, and skips frames it
+// has already seen (packets can repeat across reports). Working per frame rather than per
+// report keeps the full touchpad sample rate, so a fast swipe is not cut down to the report
+// rate.
+//   one finger   moves the pointer by the finger's travel since the previous frame
+//   two fingers  scroll by the travel of their midpoint, vertically and horizontally
+//   tap          touch and release within tapTime without travelling more than tapSlop:
+//                one finger = left click, two fingers = right click
+// Motion and scroll keep their fractional remainder between frames (SubPixelAccumulator).
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+#include "clock_source.h"
+#include "controller_state.h"
+#include "motion_sensor.h"
+
+struct TrackpadOutput {
+    int moveX = 0, moveY = 0;     // mouse counts
+    int wheelX = 0, wheelY = 0;   // 1/120 notch, as OutputEvent::MouseWheel
+    int leftClicks = 0;
+    int rightClicks = 0;
+};
+
+class Trackpad {
+public:
+    float pointerGain = 0.6f;     // mouse counts per touchpad unit (the pad is 1920 across)
+    float scrollGain = 1.0f;      // wheel units per touchpad unit: one notch per 120
+    bool naturalScroll = false;   // true: content follows the fingers
+    ClockSource::Clock::duration tapTime = std::chrono::milliseconds(180);
+    int tapSlop = 40;             // touchpad units a tap may travel
+
+    void process(const ControllerState &s, ClockSource::time_point now, TrackpadOutput &out) {
+        for (int i = 0; i < s.touchFrames; ++i) {
+            const TouchFrame &f = s.touch[i];
+            if (haveFrame && static_cast<int8_t>(f.counter - lastCounter) <= 0) continue;
+            haveFrame = true;
+            lastCounter = f.counter;
+            processFrame(f, now, out);
+        }
+    }
+
+    // Take the next frame as new whatever its counter; for after a gap in the frames seen.
+    void resync() { haveFrame = false; }
+
+    void reset() {
+        fingers = 0;
+        moveAccX.reset(); moveAccY.reset();
+        wheelAccX.reset(); wheelAccY.reset();
+    }
+
+    int fingerCount() const { return fingers; }
+
+private:
+    void processFrame(const TouchFrame &f, ClockSource::time_point now, TrackpadOutput &out) {
+        const TouchPoint &a = f.finger[0], &b = f.finger[1];
+        const int count = a.active + b.active;
+
+        if (count > 0 && fingers == 0) {
+            gestureStart = now;
+            maxFingers = 0;
+            travel = 0;
+        }
+        maxFingers = (std::max)(maxFingers, count);
+
+        // position being tracked: the single finger, or the midpoint of two
+        int x = 0, y = 0, ids = -1;
+        if (count == 1) {
+            const TouchPoint &p = a.active ? a : b;
+            x = p.x; y = p.y; ids = p.id;
+        } else if (count == 2) {
+            x = (a.x + b.x) / 2; y = (a.y + b.y) / 2; ids = a.id << 7 | b.id;
+        }
+        // deltas only while the same fingers stay down, so lifting or adding one never jumps
+        if (count > 0 && count == fingers && ids == trackedIds) {
+            const int dx = x - lastX, dy = y - lastY;
+            travel += std::abs(dx) + std::abs(dy);
+            if (count == 1) {
+                out.moveX += moveAccX.take(dx * pointerGain);
+                out.moveY += moveAccY.take(dy * pointerGain);
+            } else {
+                // fingers moving up scroll up (positive wheel) unless scrolling is natural
+                const float sign = naturalScroll ? 1.0f : -1.0f;
+                out.wheelY += wheelAccY.take(sign * dy * scrollGain);
+                out.wheelX += wheelAccX.take(-sign * dx * scrollGain);
+            }
+        }
+
+        if (count == 0 && fingers > 0) {
+            if (now - gestureStart <= tapTime && travel <= tapSlop) {
+                if (maxFingers >= 2) ++out.rightClicks;
+                else ++out.leftClicks;
+            }
+            reset();
+        }
+        fingers = count;
+        trackedIds = ids;
+        lastX = x;
+        lastY = y;
+    }
+
+    bool haveFrame = false;
+    uint8_t lastCounter = 0;
+
+    int fingers = 0;              // fingers down in the previous frame
+    int trackedIds = -1;
+    int lastX = 0, lastY = 0;
+
+    ClockSource::time_point gestureStart;
+    int maxFingers = 0;
+    int travel = 0;
+
+    SubPixelAccumulator moveAccX, moveAccY;
+    SubPixelAccumulator wheelAccX, wheelAccY;
+};
@@ -0,0 +1,38 @@
+#pragma once
+// Wait-free single-writer / single-reader triple buffer.
+//
+// The writer fills writeBuffer() and calls publish(); the reader calls fetch() and, if it
+// returns true, reads readBuffer(). Neither side ever blocks or waits for the other, and the
+// reader always gets the newest complete value. Intermediate values may be skipped, which is
+// what a frame-capped renderer wants.
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class TripleBuffer {
+public:
+    // writer side
+    T &writeBuffer() { return slots[writeIdx]; }
+    void publish() {
+        writeIdx = static_cast<uint8_t>(middle.exchange(static_cast<uint8_t>(writeIdx | DIRTY), std::memory_order_acq_rel) & INDEX_MASK);
+    }
+
+    // reader side: true if a value newer than the current readBuffer() was published
+    bool fetch() {
+        if ((middle.load(std::memory_order_relaxed) & DIRTY) == 0) return false;
+        readIdx = static_cast<uint8_t>(middle.exchange(readIdx, std::memory_order_acq_rel) & INDEX_MASK);
+        return true;
+    }
+    const T &readBuffer() const { return slots[readIdx]; }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t DIRTY = 0x04;
+
+    std::array<T, 3> slots{};
+    uint8_t writeIdx = 0;
+    alignas(64) uint8_t readIdx = 1;
+    alignas(64) std::atomic<uint8_t> middle{2};
+};
@@ -0,0 +1,207 @@
+#pragma once
+// Linux OutputSink: injects keyboard and mouse events through a uinput virtual device.
+//
+// The Linux counterpart of Emu::SendInputSink. Each submission is translated into evdev
+// events in a reused buffer and written with a single write(), the same one-call-per-report
+// batching SendInput gets. Every key or button change is followed by its own SYN_REPORT so a
+// press and release of the same key within one batch still reads as a tap to clients.
+// Needs write access to /dev/uinput (root, or a udev rule for the `uinput` group).
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "output_sink.h"
+#include "vk_codes.h"
+
+namespace Evdev {
+    // Windows virtual-key code -> evdev KEY_* code, 0 where there is no equivalent.
+    inline constexpr std::array<uint16_t, Vk::COUNT> makeKeyTable() {
+        std::array<uint16_t, Vk::COUNT> t{};
+        constexpr uint16_t letters[26] = {
+            KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J, KEY_K, KEY_L, KEY_M,
+            KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T, KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z
+        };
+        for (int i = 0; i < 26; ++i) t['A' + i] = letters[i];
+        t['0'] = KEY_0;
+        for (int i = 1; i <= 9; ++i) t['0' + i] = static_cast<uint16_t>(KEY_1 + i - 1);
+        t[Vk::BACK] = KEY_BACKSPACE;
+        t[Vk::TAB] = KEY_TAB;
+        t[Vk::RETURN] = KEY_ENTER;
+        t[Vk::MENU] = KEY_LEFTALT;
+        t[Vk::CAPITAL] = KEY_CAPSLOCK;
+        t[Vk::KANA] = KEY_KATAKANAHIRAGANA;
+        t[Vk::KANJI] = KEY_ZENKAKUHANKAKU;
+        t[Vk::ESCAPE] = KEY_ESC;
+        t[Vk::CONVERT] = KEY_HENKAN;
+        t[Vk::NONCONVERT] = KEY_MUHENKAN;
+        t[Vk::DELETE] = KEY_DELETE;
+        t[Vk::SPACE] = KEY_SPACE;
+        t[Vk::LEFT] = KEY_LEFT;
+        t[Vk::UP] = KEY_UP;
+        t[Vk::RIGHT] = KEY_RIGHT;
+        t[Vk::DOWN] = KEY_DOWN;
+        constexpr uint16_t keypad[10] = {
+            KEY_KP0, KEY_KP1, KEY_KP2, KEY_KP3, KEY_KP4, KEY_KP5, KEY_KP6, KEY_KP7, KEY_KP8, KEY_KP9
+        };
+        for (int i = 0; i < 10; ++i) t[Vk::NUMPAD0 + i] = keypad[i];
+        t[Vk::MULTIPLY] = KEY_KPASTERISK;
+        t[Vk::ADD] = KEY_KPPLUS;
+        t[Vk::SUBTRACT] = KEY_KPMINUS;
+        t[Vk::DECIMAL] = KEY_KPDOT;
+        t[Vk::DIVIDE] = KEY_KPSLASH;
+        t[Vk::LSHIFT] = KEY_LEFTSHIFT;
+        t[Vk::LCONTROL] = KEY_LEFTCTRL;
+        t[Vk::OEM_1] = KEY_SEMICOLON;
+        t[Vk::OEM_PLUS] = KEY_EQUAL;
+        t[Vk::OEM_COMMA] = KEY_COMMA;
+        t[Vk::OEM_MINUS] = KEY_MINUS;
+        t[Vk::OEM_PERIOD] = KEY_DOT;
+        t[Vk::OEM_2] = KEY_SLASH;
+        t[Vk::OEM_3] = KEY_GRAVE;
+        t[Vk::OEM_4] = KEY_LEFTBRACE;
+        t[Vk::OEM_5] = KEY_BACKSLASH;
+        t[Vk::OEM_6] = KEY_RIGHTBRACE;
+        t[Vk::OEM_7] = KEY_APOSTROPHE;
+        t[Vk::OEM_102] = KEY_102ND;
+        return t;
+    }
+
+    inline constexpr std::array<uint16_t, Vk::COUNT> KEY_FOR_VK = makeKeyTable();
+}
+
+class UinputSink : public OutputSink {
+public:
+    UinputSink() { events.reserve(128); }
+    UinputSink(const UinputSink &) = delete;
+    UinputSink &operator=(const UinputSink &) = delete;
+    ~UinputSink() { close(); }
+
+    // Create the virtual device. Returns false with lastError() set on failure.
+    bool open(const char *deviceName = "DS4 mapper", const char *path = "/dev/uinput") {
+        close();
+        fd = ::open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) return fail(std::string("cannot open ") + path + ": " + std::strerror(errno));
+
+        bool ok = ioctl(fd, UI_SET_EVBIT, EV_KEY) == 0 && ioctl(fd, UI_SET_EVBIT, EV_REL) == 0 &&
+                  ioctl(fd, UI_SET_EVBIT, EV_SYN) == 0;
+        for (uint16_t code : Evdev::KEY_FOR_VK) {
+            if (code) ok = ok && ioctl(fd, UI_SET_KEYBIT, code) == 0;
+        }
+        ok = ok && ioctl(fd, UI_SET_KEYBIT, BTN_LEFT) == 0 && ioctl(fd, UI_SET_KEYBIT, BTN_RIGHT) == 0 &&
+             ioctl(fd, UI_SET_RELBIT, REL_X) == 0 && ioctl(fd, UI_SET_RELBIT, REL_Y) == 0 &&
+             ioctl(fd, UI_SET_RELBIT, REL_WHEEL) == 0 && ioctl(fd, UI_SET_RELBIT, REL_HWHEEL) == 0;
+#if defined(REL_WHEEL_HI_RES)
+        ok = ok && ioctl(fd, UI_SET_RELBIT, REL_WHEEL_HI_RES) == 0 && ioctl(fd, UI_SET_RELBIT, REL_HWHEEL_HI_RES) == 0;
+#endif
+        if (!ok) return fail(std::string("uinput setup: ") + std::strerror(errno));
+
+        uinput_setup setup{};
+        setup.id.bustype = BUS_VIRTUAL;
+        setup.id.vendor = 0x054C;   // Sony, so the device is easy to spot in evtest
+        setup.id.product = 0x05C4;
+        std::strncpy(setup.name, deviceName, UINPUT_MAX_NAME_SIZE - 1);
+        if (ioctl(fd, UI_DEV_SETUP, &setup) != 0 || ioctl(fd, UI_DEV_CREATE) != 0) {
+            return fail(std::string("uinput create: ") + std::strerror(errno));
+        }
+        return true;
+    }
+
+    void submit(const OutputEvent *batch, size_t count) override {
+        if (fd < 0) return;
+        events.clear();
+        for (size_t i = 0; i < count; ++i) {
+            const OutputEvent &e = batch[i];
+            switch (e.type) {
+                case OutputEvent::Key:
+                    if (uint16_t code = Evdev::KEY_FOR_VK[e.vk & 0xFF]) {
+                        push(EV_KEY, code, e.down ? 1 : 0);
+                        push(EV_SYN, SYN_REPORT, 0);
+                    } else {
+                        ++unmapped;
+                    }
+                    break;
+                case OutputEvent::MouseMove:
+                    if (e.dx) push(EV_REL, REL_X, e.dx);
+                    if (e.dy) push(EV_REL, REL_Y, e.dy);
+                    if (e.dx || e.dy) push(EV_SYN, SYN_REPORT, 0);
+                    break;
+                case OutputEvent::MouseButton:
+                    push(EV_KEY, e.left ? BTN_LEFT : BTN_RIGHT, e.down ? 1 : 0);
+                    push(EV_SYN, SYN_REPORT, 0);
+                    break;
+                case OutputEvent::MouseWheel:
+                    // hi-res units are 1/120 notch like OutputEvent; whole notches go out as
+                    // REL_WHEEL for clients that only read those
+                    wheel(REL_WHEEL, WHEEL_HI_RES, e.dy, wheelRemainder[0]);
+                    wheel(REL_HWHEEL, HWHEEL_HI_RES, e.dx, wheelRemainder[1]);
+                    if (e.dx || e.dy) push(EV_SYN, SYN_REPORT, 0);
+                    break;
+            }
+        }
+        if (events.empty()) return;
+        ssize_t bytes = static_cast<ssize_t>(events.size() * sizeof(input_event));
+        if (::write(fd, events.data(), static_cast<size_t>(bytes)) != bytes) ++failedWrites;
+        ++writes;
+    }
+
+    void close() {
+        if (fd >= 0) {
+            ioctl(fd, UI_DEV_DESTROY);
+            ::close(fd);
+        }
+        fd = -1;
+    }
+
+    uint64_t writeCount() const { return writes; }
+    uint64_t failedWriteCount() const { return failedWrites; }
+    uint64_t unmappedKeyCount() const { return unmapped; }
+    const std::string &lastError() const { return error; }
+
+private:
+    void push(uint16_t type, uint16_t code, int32_t value) {
+        input_event ev{};
+        ev.type = type;
+        ev.code = code;
+        ev.value = value;
+        events.push_back(ev);
+    }
+
+#if defined(REL_WHEEL_HI_RES)
+    static constexpr int WHEEL_HI_RES = REL_WHEEL_HI_RES;
+    static constexpr int HWHEEL_HI_RES = REL_HWHEEL_HI_RES;
+#else
+    static constexpr int WHEEL_HI_RES = -1;   // kernel headers before 5.0
+    static constexpr int HWHEEL_HI_RES = -1;
+#endif
+
+    void wheel(uint16_t notchCode, int hiResCode, int32_t units, int32_t &remainder) {
+        if (units == 0) return;
+        if (hiResCode >= 0) push(EV_REL, static_cast<uint16_t>(hiResCode), units);
+        remainder += units;
+        const int32_t notches = remainder / 120;
+        remainder -= notches * 120;
+        if (notches) push(EV_REL, notchCode, notches);
+    }
+
+    bool fail(const std::string &why) {
+        error = why;
+        close();
+        return false;
+    }
+
+    int fd = -1;
+    std::vector<input_event> events;
+    uint64_t writes = 0;
+    uint64_t failedWrites = 0;
+    uint64_t unmapped = 0;
+    int32_t wheelRemainder[2] = { 0, 0 };   // vertical, horizontal; partial notches
+    std::string error;
+};
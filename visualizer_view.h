@@ -0,0 +1,354 @@
+#pragma once
+// Visualizer drawing, independent of the console backend.
+//
+// The render thread takes a published DisplaySnapshot and VisualizerView::draw() lays it out
+// into a FrameBuffer; Console (Win32) or AnsiConsoleBackend then presents only what changed.
+// Nothing here touches the OS, so frames can be drawn and benchmarked on Linux.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "console_frame.h"
+#include "controller_shards.h"
+#include "controller_state.h"
+#include "latency_histogram.h"
+#include "ps4_mapper.h"
+#include "report_parser.h"
+
+// One line of the controller list.
+struct ControllerSummary {
+    bool connected = false; // false: a free shard, nothing to list
+    uint64_t device = 0;
+    int mode = 0;
+    bool hasReport = false;
+    PS4ControllerReport report{};
+    uint64_t reports = 0;
+    uint64_t skipped = 0;   // of those, unchanged input and not mapped
+    uint64_t dropped = 0;   // this controller's ring was full
+    ReportFormat format = ReportFormat::Unknown;
+    uint64_t rejected = 0;  // not a DS4 input report, or a bad Bluetooth checksum
+};
+
+// Mapping thread only.
+inline ControllerSummary summarizeController(const ControllerShard &c) {
+    ControllerSummary d;
+    d.connected = true;
+    d.device = c.device;
+    d.mode = c.mapper->currentMode();
+    d.hasReport = c.lastReport.has_value();
+    if (d.hasReport) d.report = *c.lastReport;
+    d.reports = c.reports;
+    d.skipped = c.mapper->reportsSkipped();
+    d.dropped = c.ring.overflowCount();
+    d.format = c.parser.format();
+    d.rejected = c.parser.rejected();
+    return d;
+}
+
+// A short string copied into the snapshot without allocating; longer text is cut off.
+struct SnapshotText {
+    char chars[24] = {};
+    void set(std::string_view text) {
+        const size_t n = (std::min)(text.size(), sizeof(chars) - 1);
+        std::memcpy(chars, text.data(), n);
+        chars[n] = '\0';
+    }
+    const char *c_str() const { return chars; }
+};
+
+// Everything the renderer needs, copied out of the mappers after each batch of reports.
+// The render thread only ever reads a published copy, never live mapper state. The full view
+// is of the `focused` controller; every controller gets a line in the list.
+struct DisplaySnapshot {
+    int controllerCount = 0;         // connected; `controllers` is indexed by shard, with gaps
+    int focused = 0;
+    std::array<ControllerSummary, ControllerShards::MAX_CONTROLLERS> controllers{};
+    int mode = 0;
+    bool hasReport = false;
+    PS4ControllerReport report{};
+    int lastMouseMoveX = 0;
+    int lastMouseMoveY = 0;
+    bool mouseLeftDown = false;
+    bool mouseRightDown = false;
+    int keyboardPage = 0;
+    int selRow = 0;
+    int selCol = 0;
+    bool shiftSticky = false;
+    bool gyroAim = false;
+    bool trackpad = false;
+    float gyroRate[3] = { 0.0f, 0.0f, 0.0f }; // pitch, world yaw, roll in deg/s
+    bool motionStill = false;
+    uint64_t droppedReports = 0;
+    uint64_t rejectedReports = 0;
+    uint64_t outputEvents = 0;
+    uint64_t outputSubmissions = 0;
+    size_t lastReportEvents = 0;
+    bool profileFile = false;        // running a --profile file rather than the built-in mapping
+    uint64_t profileReloads = 0;
+    uint64_t profileRejected = 0;    // reloads that did not parse; the previous profile stayed
+    bool dictionary = false;         // word completion is on (--dictionary)
+    SnapshotText typedWord;
+    std::array<SnapshotText, PS4Mapper::SUGGESTION_COUNT> suggestions{};
+    int suggestionCount = 0;
+    int selectedSuggestion = 0;
+    // Filled by the render thread from the live histograms just before drawing.
+    PipelineLatency::Table latency{};
+};
+
+class VisualizerView {
+public:
+    // `keyboard` is the mappers' virtual keyboard layout; it must outlive the view.
+    explicit VisualizerView(const KeyboardLayout &keyboard) : layout(keyboard) {}
+
+    void drawHeader(FrameBuffer &out) const {
+        out.put(0, 0, "=== PS4 Controller -> Mouse/Keyboard Mapper ===");
+        out.put(0, 1, "Mappings (Visualizer mode):");
+        out.put(0, 2, "  Left stick -> WASD (analog -> digital)");
+        out.put(0, 3, "  D-Pad -> Arrow keys");
+        out.put(0, 4, "  Right stick -> Mouse movement (relative)");
+        out.put(0, 5, "  R2 -> Left mouse button, L2 -> Right mouse button");
+        out.put(0, 6, "Controls:");
+        out.put(0, 7, "  ESC to exit | TAB to toggle Visualizer/Virtual Keyboard | OPTIONS button toggles too");
+        out.put(0, 8, "  In Virtual Keyboard: Left stick to move, Cross(X) to press, Square toggles Shift, Circle Backspace, Triangle Space, L3 JA/EN toggle");
+    }
+
+    // Draw a complete frame for `snap` into `out`.
+    void draw(const DisplaySnapshot &snap, FrameBuffer &out) const {
+        out.fill(' ');
+        drawHeader(out);
+
+        out.put(0, 7, std::string("Mode: ") + (snap.mode == PS4Mapper::MODE_VISUALIZER ? "Visualizer" : "Virtual Keyboard"));
+
+        if (!snap.hasReport) {
+            out.put(0, 9, "Waiting for controller data...");
+            return;
+        }
+        const PS4ControllerReport &r = snap.report;
+        const int vkRows = layout.maxRows();
+
+        if (snap.mode == PS4Mapper::MODE_VISUALIZER) {
+            drawStick(out, 0, 10, r.leftStickX, r.leftStickY, "Left");
+            drawStick(out, 30, 10, r.rightStickX, r.rightStickY, "Right");
+            drawTrigger(out, 60, 10, r.leftTrigger, "L2");
+            drawTrigger(out, 60, 11, r.rightTrigger, "R2");
+            out.put(60, 13, "Battery: " + padNumber((int)r.battery, 3));
+            drawLatency(out, 60, 15, snap.latency);
+            drawMotion(out, 60, 21, snap);
+            drawTouch(out, 60, 23, r, snap.trackpad);
+            drawButtons(out, 0, 18, r);
+            drawControllers(out, 0, 31, snap);
+            out.put(0, 26, "Last mouse move: X=" + std::to_string(snap.lastMouseMoveX) + " Y=" + std::to_string(snap.lastMouseMoveY));
+            out.put(0, 27, "Mouse L down: " + std::string(snap.mouseLeftDown ? "YES" : "NO") + "  Mouse R down: " + std::string(snap.mouseRightDown ? "YES" : "NO"));
+            out.put(0, 28, "Dropped reports (ring full): " + std::to_string(snap.droppedReports) +
+                           "  Rejected: " + std::to_string(snap.rejectedReports) +
+                           "  Output: " + std::to_string(snap.outputEvents) + " events / " +
+                           std::to_string(snap.outputSubmissions) + " SendInput calls, last report " +
+                           std::to_string(snap.lastReportEvents) + " events");
+            constexpr size_t HEX_DUMP_BYTES = 24;
+            out.put(0, 29, "Raw Data: " + bytesToHex(reinterpret_cast<const uint8_t*>(&r), (std::min)(sizeof(r), HEX_DUMP_BYTES)));
+        } else {
+            drawVirtualKeyboard(out, 0, 10, snap.keyboardPage, snap.selRow, snap.selCol);
+            if (snap.dictionary) drawSuggestions(out, 0, 10 + vkRows + 1, snap);
+            out.put(0, 18 + vkRows + 1, "Shift (Square): " + std::string(snap.shiftSticky ? "ON" : "OFF") +
+                                        "   Page: " + layout.page(snap.keyboardPage).name);
+            out.put(0, 20 + vkRows + 1, "Press Cross to send selected key. Circle = Backspace, Triangle = Space, L3 = JA/EN toggle. TAB/OPTIONS toggles mode.");
+            out.put(0, 22 + vkRows + 1, "Last mouse move: X=" + std::to_string(snap.lastMouseMoveX) + " Y=" + std::to_string(snap.lastMouseMoveY));
+            constexpr size_t HEX_DUMP_BYTES = 24;
+            out.put(0, 24 + vkRows + 1, "Raw Data: " + bytesToHex(reinterpret_cast<const uint8_t*>(&r), (std::min)(sizeof(r), HEX_DUMP_BYTES)));
+            drawLatency(out, 0, 26 + vkRows + 1, snap.latency);
+            drawControllers(out, 60, 26 + vkRows + 1, snap);
+        }
+    }
+
+    // One line per connected controller; `*` marks the one shown above.
+    void drawControllers(FrameBuffer &out, int x, int y, const DisplaySnapshot &snap) const {
+        std::string header = "Controllers: " + std::to_string(snap.controllerCount) + "   Profile: ";
+        if (snap.profileFile) {
+            header += "file, " + std::to_string(snap.profileReloads) + " reloads, " +
+                      std::to_string(snap.profileRejected) + " rejected";
+        } else {
+            header += "built-in";
+        }
+        out.put(x, y, header);
+        int row = 0;
+        for (int i = 0; i < ControllerShards::MAX_CONTROLLERS; ++i) {
+            const ControllerSummary &c = snap.controllers[i];
+            if (!c.connected) continue;
+            char line[128];
+            std::snprintf(line, sizeof(line), "%c%d %08llx %-8s %-3s L %3d,%3d R %3d,%3d  %10llu reports %10llu idle %6llu dropped %6llu rejected",
+                          i == snap.focused ? '*' : ' ', i + 1, static_cast<unsigned long long>(c.device),
+                          reportFormatName(c.format), c.mode == PS4Mapper::MODE_VISUALIZER ? "VIS" : "KBD",
+                          c.report.leftStickX, c.report.leftStickY, c.report.rightStickX, c.report.rightStickY,
+                          static_cast<unsigned long long>(c.reports), static_cast<unsigned long long>(c.skipped),
+                          static_cast<unsigned long long>(c.dropped), static_cast<unsigned long long>(c.rejected));
+            out.put(x, y + 1 + row++, line);
+        }
+    }
+
+    void drawMotion(FrameBuffer &out, int x, int y, const DisplaySnapshot &snap) const {
+        char line[96];
+        std::snprintf(line, sizeof(line), "Gyro aim: %s  pitch %7.1f  yaw %7.1f  roll %7.1f deg/s%s",
+                      snap.gyroAim ? "ON " : "OFF", snap.gyroRate[0], snap.gyroRate[1], snap.gyroRate[2],
+                      snap.motionStill ? "  (still)" : "");
+        out.put(x, y, line);
+    }
+
+    // Newest touch frame of the report, and how many frames it carried.
+    void drawTouch(FrameBuffer &out, int x, int y, const PS4ControllerReport &r, bool trackpad) const {
+        ControllerState s;
+        decodeTouch(r, s);
+        std::string line = std::string("Touchpad: ") + (trackpad ? "trackpad " : "") +
+                           std::to_string(s.touchFrames) + " frame" + (s.touchFrames == 1 ? "" : "s");
+        if (s.touchFrames > 0) {
+            const TouchFrame &f = s.touch[s.touchFrames - 1];
+            for (int i = 0; i < 2; ++i) {
+                if (!f.finger[i].active) continue;
+                char buf[48];
+                std::snprintf(buf, sizeof(buf), "  #%u %4u,%3u", f.finger[i].id, f.finger[i].x, f.finger[i].y);
+                line += buf;
+            }
+        }
+        out.put(x, y, line);
+    }
+
+    // Per-stage percentiles, one line per stage under a heading.
+    void drawLatency(FrameBuffer &out, int x, int y, const PipelineLatency::Table &latency) const {
+        out.put(x, y, "Latency (us)    p50     p99   p99.9     max");
+        for (int s = 0; s < PipelineLatency::STAGE_COUNT; ++s) {
+            const LatencySummary &l = latency[s];
+            char line[64];
+            std::snprintf(line, sizeof(line), "  %-8s %7.1f %7.1f %7.1f %7.1f",
+                          PipelineLatency::stageName(static_cast<PipelineLatency::Stage>(s)),
+                          l.p50Ns / 1000.0, l.p99Ns / 1000.0, l.p999Ns / 1000.0, l.maxNs / 1000.0);
+            out.put(x, y + 1 + s, line);
+        }
+    }
+
+    void drawStick(FrameBuffer &out, int x, int y, uint8_t rawX, uint8_t rawY, const std::string& name) const {
+        constexpr int GRID_W = 11;
+        constexpr int GRID_H = 5;
+        constexpr int HALF_W = 5;
+        constexpr int HALF_H = 2;
+
+        out.put(x, y, name + " Stick:");
+
+        auto norm = [](uint8_t v) -> float {
+            return (static_cast<int>(v) - 128) / 127.0f;
+        };
+        float nx = norm(rawX);
+        float ny = norm(rawY);
+        int posX = static_cast<int>(std::round(nx * HALF_W));
+        int posY = static_cast<int>(std::round(ny * HALF_H));
+
+        for (int row = -HALF_H; row <= HALF_H; ++row) {
+            std::string line;
+            line.reserve(GRID_W);
+            for (int col = -HALF_W; col <= HALF_W; ++col) {
+                if (col == posX && row == posY) line += "@";
+                else if (col == 0 && row == 0) line += "+";
+                else line += ".";
+            }
+            out.put(x, y + 1 + (row + HALF_H), line);
+        }
+        out.put(x, y + 1 + GRID_H, "X: " + padNumber((int)rawX, 3) + " Y: " + padNumber((int)rawY, 3));
+    }
+
+    void drawTrigger(FrameBuffer &out, int x, int y, uint8_t value, const std::string& name) const {
+        int bars = (value * 10) / 255;
+        std::ostringstream ss;
+        ss << name << ": [";
+        for (int i = 0; i < 10; ++i) ss << (i < bars ? "#" : ".");
+        ss << "] " << std::setw(3) << (int)value;
+        out.put(x, y, ss.str());
+    }
+
+    void drawButtons(FrameBuffer &out, int x, int y, const PS4ControllerReport& r) const {
+        std::ostringstream ss1;
+        ss1 << "Buttons: ";
+        ss1 << (r.buttons1 & 0x10 ? "[SQR] " : " SQR  ");
+        ss1 << (r.buttons1 & 0x20 ? "[CRO] " : " CRO  ");
+        ss1 << (r.buttons1 & 0x40 ? "[CIR] " : " CIR  ");
+        ss1 << (r.buttons1 & 0x80 ? "[TRI] " : " TRI  ");
+        out.put(x, y, ss1.str());
+
+        uint8_t dpad = r.buttons1 & 0x0F;
+        std::string dpadStr = dpadToLabel(dpad);
+        out.put(x, y + 1, "D-Pad: " + dpadStr);
+
+        std::ostringstream ss2;
+        ss2 << (r.buttons2 & 0x01 ? "[L1] " : " L1  ");
+        ss2 << (r.buttons2 & 0x02 ? "[R1] " : " R1  ");
+        ss2 << (r.buttons2 & 0x40 ? "[L3] " : " L3  ");
+        ss2 << (r.buttons2 & 0x80 ? "[R3] " : " R3  ");
+        ss2 << " | ";
+        ss2 << (r.buttons3 & 0x01 ? "[PS] " : " PS  ");
+        ss2 << (r.buttons3 & 0x02 ? "[PAD] " : " PAD  ");
+        ss2 << (r.buttons2 & 0x10 ? "[SHARE] " : " SHARE  ");
+        ss2 << (r.buttons2 & 0x20 ? "[OPTIONS] " : " OPTIONS  ");
+
+        out.put(x, y + 2, ss2.str());
+    }
+
+    // The word being typed and its completions, the highlighted one in brackets.
+    void drawSuggestions(FrameBuffer &out, int x, int y, const DisplaySnapshot &snap) const {
+        std::string line = "Word: " + std::string(snap.typedWord.c_str()) + "_   L1 next, R1 accept:";
+        for (int i = 0; i < snap.suggestionCount; ++i) {
+            const std::string word = snap.suggestions[i].c_str();
+            line += i == snap.selectedSuggestion ? " [" + word + "]" : "  " + word + " ";
+        }
+        out.put(x, y, line);
+    }
+
+    // The rows are prerendered unselected; only the selected cell's brackets are drawn here.
+    void drawVirtualKeyboard(FrameBuffer &out, int x, int y, int pageIndex, int selectedRow, int selectedCol) const {
+        const LayoutPage &p = layout.page(pageIndex);
+        for (int r = 0; r < p.rows; ++r) out.put(x, y + r, p.rowText[r], p.rowTextLen[r]);
+        if (selectedRow < 0 || selectedRow >= p.rows || selectedCol < 0 || selectedCol >= p.rowLength[selectedRow]) return;
+        const LayoutKey &k = p.key(selectedRow, selectedCol);
+        out.put(x + k.x, y + selectedRow, "[", 1);
+        out.put(x + k.x + k.labelLen + 1, y + selectedRow, "]", 1);
+    }
+
+    static std::string dpadToLabel(uint8_t d) {
+        switch (d) {
+            case 0: return "Up";
+            case 1: return "Up-Right";
+            case 2: return "Right";
+            case 3: return "Down-Right";
+            case 4: return "Down";
+            case 5: return "Down-Left";
+            case 6: return "Left";
+            case 7: return "Up-Left";
+            default: return "Neutral";
+        }
+    }
+
+    static std::string padNumber(int v, int w) {
+        std::ostringstream ss;
+        ss << std::setw(w) << v;
+        return ss.str();
+    }
+
+    static std::string bytesToHex(const uint8_t* data, size_t len) {
+        std::ostringstream ss;
+        ss << std::hex << std::setfill('0');
+        for (size_t i = 0; i < len; ++i) {
+            ss << std::setw(2) << static_cast<int>(data[i]) << ' ';
+        }
+        ss << std::dec;
+        return ss.str();
+    }
+
+private:
+    const KeyboardLayout &layout;
+};
@@ -0,0 +1,52 @@
+#pragma once
+// Windows virtual-key codes used by the mapper, spelled out so the mapping core compiles
+// without <windows.h>. Values match winuser.h.
+
+#include <cstdint>
+
+namespace Vk {
+    constexpr uint16_t BACK     = 0x08;
+    constexpr uint16_t TAB      = 0x09;
+    constexpr uint16_t RETURN   = 0x0D;
+    constexpr uint16_t MENU     = 0x12;
+    constexpr uint16_t CAPITAL  = 0x14;
+    constexpr uint16_t KANA     = 0x15;
+    constexpr uint16_t KANJI    = 0x19;
+    constexpr uint16_t ESCAPE   = 0x1B;
+    constexpr uint16_t CONVERT  = 0x1C; // JIS henkan
+    constexpr uint16_t NONCONVERT = 0x1D; // JIS muhenkan
+    constexpr uint16_t SPACE    = 0x20;
+    constexpr uint16_t LEFT     = 0x25;
+    constexpr uint16_t UP       = 0x26;
+    constexpr uint16_t RIGHT    = 0x27;
+    constexpr uint16_t DOWN     = 0x28;
+    constexpr uint16_t DELETE   = 0x2E;
+    // letters and digits are their ASCII code; not named KEY_x, which <linux/input.h> defines as macros
+    constexpr uint16_t A        = 0x41;
+    constexpr uint16_t D        = 0x44;
+    constexpr uint16_t E        = 0x45;
+    constexpr uint16_t S        = 0x53;
+    constexpr uint16_t W        = 0x57;
+    constexpr uint16_t NUMPAD0  = 0x60; // NUMPAD1..9 follow
+    constexpr uint16_t MULTIPLY = 0x6A;
+    constexpr uint16_t ADD      = 0x6B;
+    constexpr uint16_t SUBTRACT = 0x6D;
+    constexpr uint16_t DECIMAL  = 0x6E;
+    constexpr uint16_t DIVIDE   = 0x6F;
+    constexpr uint16_t LSHIFT   = 0xA0;
+    constexpr uint16_t LCONTROL = 0xA2;
+    constexpr uint16_t OEM_1      = 0xBA; // ;
+    constexpr uint16_t OEM_PLUS   = 0xBB; // =
+    constexpr uint16_t OEM_COMMA  = 0xBC; // ,
+    constexpr uint16_t OEM_MINUS  = 0xBD; // -
+    constexpr uint16_t OEM_PERIOD = 0xBE; // .
+    constexpr uint16_t OEM_2      = 0xBF; // /
+    constexpr uint16_t OEM_3      = 0xC0; // ` (@ on JIS)
+    constexpr uint16_t OEM_4      = 0xDB; // [
+    constexpr uint16_t OEM_5      = 0xDC; // backslash
+    constexpr uint16_t OEM_6      = 0xDD; // ]
+    constexpr uint16_t OEM_7      = 0xDE; // '
+    constexpr uint16_t OEM_102    = 0xE2; // ISO <> key, JIS ro
+
+    constexpr int COUNT = 256;
+}
@@ -0,0 +1,353 @@
+#pragma once
+// Word completion for the virtual keyboard: a frequency-ranked trie, built offline and
+// memory-mapped read-only at startup.
+//
+// File layout (little endian, every section 4-byte aligned):
+//   WordDictionaryHeader                24 bytes
+//   WordTrieNode[nodeCount]             16 bytes each; node 0 is the root, the children of a
+//                                       node are contiguous and sorted by letter
+//   uint32_t wordOffsets[wordCount + 1] into the text section
+//   uint32_t frequencies[wordCount]
+//   char text[textBytes]                the words back to back, lower-case a-z, no terminators
+//
+// Word ids are frequency ranks (0 is the most frequent word), and every node stores the
+// smallest id in its subtree. Completing a prefix walks down to the prefix's node and then
+// expands subtrees best-first by that id; since each pending subtree is known to hold a word
+// of exactly its key, only the best k of them can matter, so the frontier is a sorted array
+// of at most k entries. A lookup touches a few dozen nodes whatever the dictionary size and
+// never allocates. open() maps the file and checks the header and section sizes, and that the
+// text is only a-z: accepting a completion types its letters as virtual keys, so a stray byte
+// would otherwise send arrows, Enter or Escape. Node and word indices are bounds-checked as
+// they are followed (and children must come after their parent), so a corrupt file gives
+// wrong completions, never a bad read or a loop.
+//
+// WordDictionary::build() turns a word list into the file image (tools/build_dictionary.cpp).
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct WordDictionaryHeader {
+    char magic[8];          // "DS4WORDS"
+    uint32_t version;
+    uint32_t wordCount;
+    uint32_t nodeCount;
+    uint32_t textBytes;
+};
+
+struct WordTrieNode {
+    uint32_t firstChild;    // index of the first child; children are contiguous
+    uint32_t best;          // smallest word id (highest frequency) in this subtree
+    uint32_t word;          // id of the word ending here, or NO_WORD
+    uint8_t letter;         // 'a'..'z' on the edge into this node; 0 for the root
+    uint8_t childCount;
+    uint16_t reserved;
+};
+
+static_assert(sizeof(WordDictionaryHeader) == 24, "file layout");
+static_assert(sizeof(WordTrieNode) == 16, "file layout");
+
+class WordDictionary {
+public:
+    static constexpr char MAGIC[8] = { 'D', 'S', '4', 'W', 'O', 'R', 'D', 'S' };
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t NO_WORD = 0xFFFFFFFFu;
+    static constexpr int MAX_COMPLETIONS = 16;
+    static constexpr size_t MAX_WORD_LENGTH = 64;
+
+    WordDictionary() = default;
+    WordDictionary(const WordDictionary &) = delete;
+    WordDictionary &operator=(const WordDictionary &) = delete;
+    ~WordDictionary() { close(); }
+
+    // Returns false with lastError() set if the file can't be mapped or isn't a dictionary.
+    bool open(const std::string &path) {
+        close();
+        if (!mapFile(path)) return false;
+        return attach();
+    }
+
+    // Use an in-memory image (from build()) instead of a file; `image` must outlive this.
+    bool openImage(const uint8_t *image, size_t bytes) {
+        close();
+        data = image;
+        size = bytes;
+        return attach();
+    }
+
+    bool isOpen() const { return nodes != nullptr; }
+    uint32_t wordCount() const { return words; }
+    uint32_t nodeCount() const { return nodeTotal; }
+    size_t imageBytes() const { return size; }
+    const std::string &lastError() const { return error; }
+
+    std::string_view word(uint32_t id) const {
+        if (id >= words) return {};
+        const uint32_t begin = offsets[id], end = offsets[id + 1];
+        if (begin > end || end > textBytes) return {};
+        return std::string_view(text + begin, end - begin);
+    }
+    uint32_t frequency(uint32_t id) const { return id < words ? frequencies[id] : 0; }
+
+    // Up to `k` word ids starting with `prefix` (lower-case a-z), most frequent first; a word
+    // equal to the prefix counts. Returns how many were written to `out`.
+    int complete(std::string_view prefix, uint32_t *out, int k) const {
+        if (!nodes) return 0;
+        k = (std::min)(k, MAX_COMPLETIONS);
+        uint32_t at = 0;
+        for (char c : prefix) {
+            at = child(at, static_cast<uint8_t>(c));
+            if (at == NO_WORD) return 0;
+        }
+
+        // frontier: pending words and subtrees ordered by key, at most k - found entries
+        struct Entry { uint32_t key; uint32_t node; bool subtree; };
+        Entry frontier[MAX_COMPLETIONS];
+        int pending = 0, found = 0;
+        auto push = [&](uint32_t key, uint32_t node, bool subtree) {
+            const int limit = k - found;
+            int i = pending;
+            if (i == limit) {
+                if (key >= frontier[i - 1].key) return;
+                --i; // drop the worst
+            } else {
+                ++pending;
+            }
+            for (; i > 0 && frontier[i - 1].key > key; --i) frontier[i] = frontier[i - 1];
+            frontier[i] = { key, node, subtree };
+        };
+
+        if (k > 0 && nodes[at].best < words) push(nodes[at].best, at, true);
+        while (pending > 0 && found < k) {
+            const Entry e = frontier[0];
+            std::memmove(frontier, frontier + 1, sizeof(Entry) * --pending);
+            if (!e.subtree) {
+                out[found++] = e.key;
+                pending = (std::min)(pending, k - found);
+                continue;
+            }
+            const WordTrieNode &n = nodes[e.node];
+            if (n.word < words) push(n.word, e.node, false);
+            const uint32_t end = n.firstChild + n.childCount;
+            if (n.firstChild <= e.node || end > nodeTotal) continue; // children come after their parent
+            for (uint32_t c = n.firstChild; c < end; ++c) {
+                if (nodes[c].best < words) push(nodes[c].best, c, true);
+            }
+        }
+        return found;
+    }
+
+    void close() {
+        if (owned) {
+#if defined(_WIN32)
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+            mapping = nullptr;
+            fileHandle = INVALID_HANDLE_VALUE;
+#else
+            if (data) munmap(const_cast<uint8_t*>(data), size);
+#endif
+        }
+        owned = false;
+        data = nullptr;
+        size = 0;
+        nodes = nullptr;
+        words = nodeTotal = textBytes = 0;
+    }
+
+    // ---------- offline build ----------
+    // File image for `list` (word, count). Words are lower-cased; words with anything but
+    // letters, or longer than MAX_WORD_LENGTH, are skipped, and duplicates add their counts.
+    static std::vector<uint8_t> build(std::vector<std::pair<std::string, uint32_t>> list) {
+        for (auto &entry : list) {
+            for (char &c : entry.first) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        list.erase(std::remove_if(list.begin(), list.end(), [](const std::pair<std::string, uint32_t> &e) {
+            if (e.first.empty() || e.first.size() > MAX_WORD_LENGTH) return true;
+            for (char c : e.first) if (c < 'a' || c > 'z') return true;
+            return false;
+        }), list.end());
+        std::sort(list.begin(), list.end());
+        size_t unique = 0;
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (unique > 0 && list[unique - 1].first == list[i].first) {
+                const uint64_t sum = static_cast<uint64_t>(list[unique - 1].second) + list[i].second;
+                list[unique - 1].second = static_cast<uint32_t>((std::min)(sum, static_cast<uint64_t>(0xFFFFFFFFu)));
+            } else {
+                if (unique != i) list[unique] = std::move(list[i]);
+                ++unique;
+            }
+        }
+        list.resize(unique);
+        // ids are frequency ranks; ties go alphabetically
+        std::stable_sort(list.begin(), list.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+
+        // pointer trie first, then laid out breadth-first so siblings are contiguous
+        struct BuildNode { uint32_t child[26]; uint32_t word = NO_WORD; uint32_t best = NO_WORD; };
+        std::vector<BuildNode> tree(1);
+        std::fill(std::begin(tree[0].child), std::end(tree[0].child), NO_WORD);
+        for (uint32_t id = 0; id < list.size(); ++id) {
+            uint32_t at = 0;
+            for (char c : list[id].first) {
+                const int l = c - 'a';
+                if (tree[at].child[l] == NO_WORD) {
+                    tree[at].child[l] = static_cast<uint32_t>(tree.size());
+                    tree.emplace_back();
+                    std::fill(std::begin(tree.back().child), std::end(tree.back().child), NO_WORD);
+                }
+                at = tree[at].child[l];
+                // ids arrive in rank order, so the first word through a node is its best
+                if (tree[at].best == NO_WORD) tree[at].best = id;
+            }
+            tree[at].word = id;
+        }
+        if (!list.empty()) tree[0].best = 0;
+
+        std::vector<WordTrieNode> laid;
+        laid.reserve(tree.size());
+        std::vector<uint32_t> order{ 0 };               // laid index -> tree index
+        laid.push_back({ 0, tree[0].best, tree[0].word, 0, 0, 0 });
+        for (size_t i = 0; i < order.size(); ++i) {
+            const BuildNode &b = tree[order[i]];
+            laid[i].firstChild = static_cast<uint32_t>(order.size());
+            for (int l = 0; l < 26; ++l) {
+                if (b.child[l] == NO_WORD) continue;
+                const BuildNode &c = tree[b.child[l]];
+                order.push_back(b.child[l]);
+                laid.push_back({ 0, c.best, c.word, static_cast<uint8_t>('a' + l), 0, 0 });
+                ++laid[i].childCount;
+            }
+        }
+
+        std::vector<uint32_t> wordOffsets{ 0 }, counts;
+        std::string textBlob;
+        for (const auto &entry : list) {
+            textBlob += entry.first;
+            wordOffsets.push_back(static_cast<uint32_t>(textBlob.size()));
+            counts.push_back(entry.second);
+        }
+
+        WordDictionaryHeader hdr{};
+        std::memcpy(hdr.magic, MAGIC, sizeof(hdr.magic));
+        hdr.version = VERSION;
+        hdr.wordCount = static_cast<uint32_t>(list.size());
+        hdr.nodeCount = static_cast<uint32_t>(laid.size());
+        hdr.textBytes = static_cast<uint32_t>(textBlob.size());
+        std::vector<uint8_t> image;
+        auto append = [&](const void *p, size_t n) {
+            image.insert(image.end(), static_cast<const uint8_t*>(p), static_cast<const uint8_t*>(p) + n);
+        };
+        append(&hdr, sizeof(hdr));
+        append(laid.data(), laid.size() * sizeof(WordTrieNode));
+        append(wordOffsets.data(), wordOffsets.size() * sizeof(uint32_t));
+        append(counts.data(), counts.size() * sizeof(uint32_t));
+        append(textBlob.data(), textBlob.size());
+        return image;
+    }
+
+private:
+    // Child of `node` along `letter`, or NO_WORD.
+    uint32_t child(uint32_t node, uint8_t letter) const {
+        const WordTrieNode &n = nodes[node];
+        const uint32_t end = n.firstChild + n.childCount;
+        if (end > nodeTotal) return NO_WORD;
+        for (uint32_t c = n.firstChild; c < end; ++c) {
+            if (nodes[c].letter == letter) return c;
+        }
+        return NO_WORD;
+    }
+
+    bool fail(const char *why) {
+        error = why;
+        close();
+        return false;
+    }
+
+    bool attach() {
+        if (size < sizeof(WordDictionaryHeader)) return fail("file too small for a dictionary header");
+        WordDictionaryHeader hdr;
+        std::memcpy(&hdr, data, sizeof(hdr));
+        if (std::memcmp(hdr.magic, MAGIC, sizeof(hdr.magic)) != 0) return fail("not a word dictionary");
+        if (hdr.version != VERSION) return fail("unsupported dictionary version");
+        if (hdr.nodeCount == 0) return fail("dictionary has no root node");
+        const uint64_t expected = sizeof(WordDictionaryHeader) + uint64_t(hdr.nodeCount) * sizeof(WordTrieNode) +
+                                  (uint64_t(hdr.wordCount) * 2 + 1) * sizeof(uint32_t) + hdr.textBytes;
+        if (expected != size) return fail("dictionary size does not match its header");
+        const uint8_t *p = data + sizeof(WordDictionaryHeader);
+        nodes = reinterpret_cast<const WordTrieNode*>(p);
+        p += size_t(hdr.nodeCount) * sizeof(WordTrieNode);
+        offsets = reinterpret_cast<const uint32_t*>(p);
+        p += (size_t(hdr.wordCount) + 1) * sizeof(uint32_t);
+        frequencies = reinterpret_cast<const uint32_t*>(p);
+        p += size_t(hdr.wordCount) * sizeof(uint32_t);
+        text = reinterpret_cast<const char*>(p);
+        // one pass the compiler vectorizes; any byte outside a-z sets `bad`
+        uint8_t bad = 0;
+        for (uint32_t i = 0; i < hdr.textBytes; ++i) bad |= static_cast<uint8_t>(static_cast<uint8_t>(p[i] - 'a') > 25);
+        if (bad) return fail("dictionary text is not lower-case a-z");
+        words = hdr.wordCount;
+        nodeTotal = hdr.nodeCount;
+        textBytes = hdr.textBytes;
+        return true;
+    }
+
+#if defined(_WIN32)
+    bool mapFile(const std::string &path) {
+        fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return fail("cannot open file");
+        owned = true;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(fileHandle, &sz) || sz.QuadPart == 0) return fail("cannot size file");
+        mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) return fail("cannot create file mapping");
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!data) return fail("cannot map file");
+        size = static_cast<size_t>(sz.QuadPart);
+        return true;
+    }
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    bool mapFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return fail("cannot open file");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return fail("cannot size file"); }
+        void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return fail("cannot map file");
+        madvise(p, static_cast<size_t>(st.st_size), MADV_RANDOM); // lookups touch a few pages each
+        data = static_cast<const uint8_t*>(p);
+        size = static_cast<size_t>(st.st_size);
+        owned = true;
+        return true;
+    }
+#endif
+
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool owned = false;     // data is our mapping (open), not a caller's image (openImage)
+
+    const WordTrieNode *nodes = nullptr;
+    const uint32_t *offsets = nullptr;
+    const uint32_t *frequencies = nullptr;
+    const char *text = nullptr;
+    uint32_t words = 0, nodeTotal = 0, textBytes = 0;
+    std::string error;
+};